@@ -0,0 +1,14 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <time.h>
+
+// monotonic wall clock in seconds, usable without an engine or GL context
+static double bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif  // __BENCH_H__
@@ -0,0 +1,194 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "anim.h"
+#include "bench.h"
+#include "jobs.h"
+
+// gives each of 1k to 100k objects a looping track on every channel, with
+// keys at uneven times, and plays them for a second of 60 Hz frames. each
+// track is first sampled one at a time from keys stored per track (a binary
+// search, then vec3_lerp, vec4_lerp or quat_slerp), then all of them by
+// anim_sample; writing the samples into the objects is timed on its own.
+// reports tracks per millisecond, and how far the two ways disagree.
+// needs no GL context.
+
+#define FRAMES 60
+#define KEYS 8
+
+typedef struct
+{
+    float times[KEYS];
+    float values[KEYS][4];
+    unsigned int count;
+    float time;
+    float out[4];
+} __track_t;
+
+static const unsigned int __components[anim_channel_count] = { 3, 4, 3, 4 };
+
+static float __randf(float lo, float hi)
+{
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+static void __sample_one(__track_t * track, anim_channel_e channel, float delta)
+{
+    float start = track->times[0], length = track->times[track->count - 1] - start, t = 0.0f;
+    unsigned int lo = 0, hi = track->count - 1;
+
+    track->time = start + fmodf(track->time - start + delta, length);
+    while (hi - lo > 1)
+    {
+        unsigned int middle = (lo + hi) / 2;
+
+        if (track->times[middle] <= track->time) lo = middle;
+        else hi = middle;
+    }
+    t = (track->time - track->times[lo]) / (track->times[lo + 1] - track->times[lo]);
+
+    if (channel == anim_rotation)
+    {
+        const float * a = track->values[lo], * b = track->values[lo + 1];
+        quat_t q = quat_slerp((quat_t) { a[0], a[1], a[2], a[3] }, (quat_t) { b[0], b[1], b[2], b[3] }, t);
+
+        track->out[0] = q.x;
+        track->out[1] = q.y;
+        track->out[2] = q.z;
+        track->out[3] = q.w;
+    }
+    else if (channel == anim_color)
+    {
+        const float * a = track->values[lo], * b = track->values[lo + 1];
+        vec4_t v = vec4_lerp(vec4_make(a[0], a[1], a[2], a[3]), vec4_make(b[0], b[1], b[2], b[3]), t);
+
+        track->out[0] = v.x;
+        track->out[1] = v.y;
+        track->out[2] = v.z;
+        track->out[3] = v.w;
+    }
+    else
+    {
+        const float * a = track->values[lo], * b = track->values[lo + 1];
+        vec3_t v = vec3_lerp(vec3_make(a[0], a[1], a[2]), vec3_make(b[0], b[1], b[2]), t);
+
+        track->out[0] = v.x;
+        track->out[1] = v.y;
+        track->out[2] = v.z;
+    }
+}
+
+static void __run(unsigned int num_objects)
+{
+    unsigned int num_tracks = num_objects * anim_channel_count;
+    __track_t * tracks = malloc(num_tracks * sizeof(__track_t));
+    render_handle_t * objects = malloc(num_objects * sizeof(render_handle_t));
+    double start = 0.0, single_time = 0.0, sample_time = 0.0, apply_time = 0.0, max_error = 0.0;
+    anim_t anim;
+
+    if (!tracks || !objects || anim_init(&anim) != status_success)
+    {
+        fprintf(stderr, "failed to allocate memory for %u objects\n", num_objects);
+        exit(1);
+    }
+
+    srand(num_objects);
+    for (unsigned int idx = 0; idx < num_tracks; ++idx)
+    {
+        __track_t * track = &tracks[idx];
+        anim_channel_e channel = idx % anim_channel_count;
+        float packed[KEYS * 4], time = 0.0f;
+
+        if (channel == 0) objects[idx / anim_channel_count] = render_create_object(render_object_cube, 0);
+
+        track->count = channel == anim_scale || channel == anim_color ? KEYS / 2 : KEYS;
+        for (unsigned int key = 0; key < track->count; ++key)
+        {
+            float len = 0.0f;
+
+            track->times[key] = time;
+            time += __randf(0.1f, 0.5f);
+            for (unsigned int c = 0; c < 4; ++c)
+            {
+                float value = __randf(-1.0f, 1.0f);
+
+                track->values[key][c] = value;
+                len += value * value;
+            }
+            // both ways start from the same unit keys
+            for (unsigned int c = 0; c < 4 && channel == anim_rotation; ++c) track->values[key][c] /= sqrtf(len);
+            for (unsigned int c = 0; c < __components[channel]; ++c) packed[key * __components[channel] + c] = track->values[key][c];
+        }
+        track->time = 0.0f;
+
+        if (anim_add_track(&anim, objects[idx / anim_channel_count], channel, track->times, packed, track->count, 1) != status_success)
+        {
+            exit(1);
+        }
+    }
+
+    for (int frame = 0; frame < FRAMES; ++frame)
+    {
+        start = bench_now();
+        for (unsigned int idx = 0; idx < num_tracks; ++idx) __sample_one(&tracks[idx], idx % anim_channel_count, 1.0f / 60.0f);
+        single_time += bench_now() - start;
+
+        start = bench_now();
+        anim_sample(&anim, 1.0f / 60.0f);
+        sample_time += bench_now() - start;
+
+        start = bench_now();
+        anim_apply(&anim);
+        apply_time += bench_now() - start;
+    }
+
+    // tracks went into each channel in object order, so a channel's track n is object n's
+    for (unsigned int idx = 0; idx < num_tracks; ++idx)
+    {
+        anim_channel_e channel = idx % anim_channel_count;
+        const float * sample = anim.channels[channel].samples + (idx / anim_channel_count) * __components[channel];
+
+        if (channel == anim_rotation)
+        {
+            double d = fabs(sample[0] * tracks[idx].out[0] + sample[1] * tracks[idx].out[1] + sample[2] * tracks[idx].out[2]
+                    + sample[3] * tracks[idx].out[3]);
+            double degrees = 2.0 * acos(d > 1.0 ? 1.0 : d) * 180.0 / M_PI;
+
+            max_error = degrees > max_error ? degrees : max_error;
+            continue;
+        }
+
+        for (unsigned int c = 0; c < __components[channel]; ++c)
+        {
+            double error = fabs(sample[c] - tracks[idx].out[c]);
+            max_error = error > max_error ? error : max_error;
+        }
+    }
+
+    printf("%6u objects, %u tracks: largest difference %.4f (degrees for rotations)\n", num_objects, num_tracks, max_error);
+    printf("  one at a time: %10.0f tracks/ms\n", num_tracks * FRAMES / (single_time * 1000.0));
+    printf("  anim_sample:   %10.0f tracks/ms (%.2fx)\n", num_tracks * FRAMES / (sample_time * 1000.0), single_time / sample_time);
+    printf("  anim_apply:    %10.0f tracks/ms\n", num_tracks * FRAMES / (apply_time * 1000.0));
+
+    anim_destroy(&anim);
+    for (unsigned int idx = 0; idx < num_objects; ++idx) render_destroy_object(objects[idx]);
+    free(tracks);
+    free(objects);
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned int max_objects = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000, workers = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+
+    if (jobs_init(workers) != status_success || render_init() != status_success)
+    {
+        fprintf(stderr, "failed to initialize\n");
+        return 1;
+    }
+
+    printf("%s, on %u threads\n", math3d_simd_name(), jobs_num_threads());
+    for (unsigned int count = 1000; count <= max_objects; count *= 10) __run(count);
+
+    return 0;
+}
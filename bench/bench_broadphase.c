@@ -0,0 +1,136 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "broadphase.h"
+
+// boxes drifting through a volume that grows with their number, so each one
+// has about as many neighbors whatever the count. for each count, both
+// methods are built and then updated over a run of frames; the pairwise test
+// of every box against every other is timed once where it is bearable, and
+// checks the pair counts. a second run makes a tenth of the boxes jump
+// across the volume every frame, which sweep and prune is worst at. reports
+// how many of its updates sorted the endpoints back in, and how many gave up
+// and sorted anew.
+
+#define FRAMES 30
+#define SPACING 4.0f                // world size per cube root of a box
+#define CELL_SIZE 4.0f
+#define BRUTE_FORCE_MAX 10000
+
+static float __randf(float lo, float hi)
+{
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+static unsigned int __brute_force(const vec3_t * min, const vec3_t * max, unsigned int count)
+{
+    unsigned int pairs = 0;
+
+    for (unsigned int a = 0; a < count; ++a)
+    {
+        for (unsigned int b = a + 1; b < count; ++b)
+        {
+            pairs += min[a].x <= max[b].x && max[a].x >= min[b].x && min[a].y <= max[b].y && max[a].y >= min[b].y
+                && min[a].z <= max[b].z && max[a].z >= min[b].z;
+        }
+    }
+
+    return pairs;
+}
+
+static void __run(unsigned int count, int jumps)
+{
+    const char * names[2] = { "sweep and prune", "grid           " };
+    float size = SPACING * cbrtf((float)count);
+    vec3_t * min = malloc(count * sizeof(vec3_t)), * max = malloc(count * sizeof(vec3_t)), * velocity = malloc(count * sizeof(vec3_t));
+    int * proxies[2] = { malloc(count * sizeof(int)), malloc(count * sizeof(int)) };
+    unsigned int pairs[2] = { 0 }, brute = 0, rebuilds = 0;
+    double build_time[2] = { 0.0 }, update_time[2] = { 0.0 }, brute_time = 0.0, start = 0.0;
+    unsigned long swaps = 0;
+    broadphase_t bp[2];
+
+    if (!min || !max || !velocity || !proxies[0] || !proxies[1])
+    {
+        fprintf(stderr, "failed to allocate memory for %u boxes\n", count);
+        exit(1);
+    }
+
+    srand(count);
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        vec3_t center = vec3_make(__randf(0.0f, size), __randf(0.0f, size), __randf(0.0f, size));
+        vec3_t half = vec3_make(__randf(0.5f, 1.5f), __randf(0.5f, 1.5f), __randf(0.5f, 1.5f));
+
+        min[idx] = vec3_sub(center, half);
+        max[idx] = vec3_add(center, half);
+        velocity[idx] = vec3_make(__randf(-0.1f, 0.1f), __randf(-0.1f, 0.1f), __randf(-0.1f, 0.1f));
+    }
+
+    for (int method = 0; method < 2; ++method)
+    {
+        broadphase_init(&bp[method], method == 0 ? broadphase_sap : broadphase_grid, CELL_SIZE);
+
+        start = bench_now();
+        for (unsigned int idx = 0; idx < count; ++idx) proxies[method][idx] = broadphase_add(&bp[method], min[idx], max[idx], NULL);
+        broadphase_update(&bp[method]);
+        build_time[method] = bench_now() - start;
+    }
+
+    for (int frame = 0; frame < FRAMES; ++frame)
+    {
+        for (unsigned int idx = 0; idx < count; ++idx)
+        {
+            vec3_t step = velocity[idx];
+
+            if (jumps && idx % 10 == (unsigned int)frame % 10) step.x += (rand() & 1 ? 0.5f : -0.5f) * size;
+            min[idx] = vec3_add(min[idx], step);
+            max[idx] = vec3_add(max[idx], step);
+        }
+
+        for (int method = 0; method < 2; ++method)
+        {
+            start = bench_now();
+            for (unsigned int idx = 0; idx < count; ++idx) broadphase_move(&bp[method], proxies[method][idx], min[idx], max[idx]);
+            pairs[method] = broadphase_update(&bp[method]);
+            update_time[method] += bench_now() - start;
+        }
+        swaps += bp[0].swaps;
+        rebuilds += bp[0].rebuilt;
+    }
+
+    printf("%6u boxes%s: %u pairs\n", count, jumps ? ", a tenth jumping" : "", pairs[0]);
+    for (int method = 0; method < 2; ++method)
+    {
+        printf("  %s: built in %8.3f ms, %8.3f ms per update%s\n", names[method], build_time[method] * 1000.0,
+                update_time[method] * 1000.0 / FRAMES, pairs[method] == pairs[0] ? "" : " (pair counts differ!)");
+        broadphase_destroy(&bp[method]);
+    }
+    printf("  %u of %u updates sorted in, %.0f endpoint swaps per update; %u sorted anew\n", FRAMES - rebuilds, FRAMES,
+            swaps / (double)FRAMES, rebuilds);
+
+    if (count <= BRUTE_FORCE_MAX)
+    {
+        start = bench_now();
+        brute = __brute_force(min, max, count);
+        brute_time = bench_now() - start;
+        printf("  every pair     : %8.3f ms%s\n", brute_time * 1000.0, brute == pairs[0] ? "" : " (pair counts differ!)");
+    }
+
+    free(min);
+    free(max);
+    free(velocity);
+    free(proxies[0]);
+    free(proxies[1]);
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned int max_count = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+
+    for (unsigned int count = 1000; count <= max_count; count *= 10) __run(count, 0);
+    for (unsigned int count = 1000; count <= max_count; count *= 10) __run(count, 1);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "bvh.h"
+#include "cull.h"
+#include "math3d.h"
+
+// a large mostly static scene: builds the tree, then each frame moves the
+// dynamic objects, updates their leaves and culls against a rotating camera.
+// the flat per-object frustum test is timed alongside for comparison.
+
+#define FRAMES 100
+#define WORLD_SIZE 2000.0f
+
+static float __randf(float lo, float hi)
+{
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+static int __count_hit(void * data, int inside, void * user)
+{
+    ++*(unsigned long *)user;
+    return 1;
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned int num_static = 1000000, num_moving = 10000, count = 0, idx = 0, frame = 0;
+    bvh_aabb_t * boxes = NULL;
+    vec3_t * velocity = NULL;
+    int * proxies = NULL;
+    bvh_t tree;
+    mat4_t projection, view, view_projection;
+    cull_frustum_t frustum;
+    unsigned long tree_hits = 0, flat_hits = 0, region_hits = 0, visited = 0, reinserted = 0, rebuilds = 0;
+    double start = 0.0, insert_time = 0.0, rebuild_time = 0.0, update_time = 0.0, query_time = 0.0, flat_time = 0.0;
+    double region_time = 0.0, nearest_time = 0.0;
+    float cost_inserted = 0.0f;
+
+    if (argc > 1) num_static = strtoul(argv[1], NULL, 10);
+    if (argc > 2) num_moving = strtoul(argv[2], NULL, 10);
+    count = num_static + num_moving;
+
+    boxes = malloc(count * sizeof(bvh_aabb_t));
+    velocity = malloc(num_moving * sizeof(vec3_t));
+    proxies = malloc(count * sizeof(int));
+    if (!boxes || !velocity || !proxies)
+    {
+        fprintf(stderr, "failed to allocate memory for %u objects\n", count);
+        return 1;
+    }
+
+    bvh_init(&tree, 0.25f);
+
+    for (idx = 0; idx < count; ++idx)
+    {
+        vec3_t center = vec3_make(__randf(-WORLD_SIZE, WORLD_SIZE), __randf(-50.0f, 50.0f), __randf(-WORLD_SIZE, WORLD_SIZE));
+        vec3_t half = vec3_make(__randf(0.5f, 2.0f), __randf(0.5f, 2.0f), __randf(0.5f, 2.0f));
+
+        boxes[idx].min = vec3_sub(center, half);
+        boxes[idx].max = vec3_add(center, half);
+    }
+
+    for (idx = 0; idx < num_moving; ++idx)
+    {
+        velocity[idx] = vec3_make(__randf(-1.0f, 1.0f), 0.0f, __randf(-1.0f, 1.0f));
+    }
+
+    start = bench_now();
+    for (idx = 0; idx < count; ++idx)
+    {
+        proxies[idx] = bvh_insert(&tree, &boxes[idx], &boxes[idx]);
+    }
+    insert_time = bench_now() - start;
+    cost_inserted = bvh_cost(&tree);
+
+    start = bench_now();
+    bvh_rebuild(&tree);
+    rebuild_time = bench_now() - start;
+
+    mat4_perspective(&projection, 60.0f, 16.0f / 9.0f, 0.1f, 500.0f);
+
+    for (frame = 0; frame < FRAMES; ++frame)
+    {
+        float angle = frame * 3.6f;
+        bvh_aabb_t region;
+        float distance = 0.0f;
+
+        start = bench_now();
+        for (idx = num_static; idx < count; ++idx)
+        {
+            vec3_t v = velocity[idx - num_static];
+
+            boxes[idx].min = vec3_add(boxes[idx].min, v);
+            boxes[idx].max = vec3_add(boxes[idx].max, v);
+            reinserted += bvh_update(&tree, proxies[idx], &boxes[idx]);
+        }
+        rebuilds += bvh_optimize(&tree, 1.5f);
+        update_time += bench_now() - start;
+
+        mat4_rotation(&view, angle, vec3_make(0.0f, 1.0f, 0.0f));
+        mat4_mul(&view_projection, &projection, &view);
+        cull_frustum_extract(&frustum, &view_projection);
+
+        start = bench_now();
+        tree_hits += bvh_query_frustum(&tree, &frustum, __count_hit, &visited);
+        query_time += bench_now() - start;
+
+        start = bench_now();
+        for (idx = 0; idx < count; ++idx)
+        {
+            flat_hits += cull_aabb(&frustum, boxes[idx].min, boxes[idx].max) != cull_outside;
+        }
+        flat_time += bench_now() - start;
+
+        region.min = vec3_make(-100.0f, -100.0f, -100.0f);
+        region.max = vec3_make(100.0f, 100.0f, 100.0f);
+        start = bench_now();
+        region_hits += bvh_query_aabb(&tree, &region, __count_hit, &visited);
+        region_time += bench_now() - start;
+
+        start = bench_now();
+        bvh_nearest(&tree, vec3_make(__randf(-WORLD_SIZE, WORLD_SIZE), 0.0f, __randf(-WORLD_SIZE, WORLD_SIZE)),
+                WORLD_SIZE, NULL, NULL, &distance);
+        nearest_time += bench_now() - start;
+    }
+
+    printf("%u static + %u moving objects, %d frames\n", num_static, num_moving, FRAMES);
+    printf("  incremental insert: %8.3f ms (cost %.3g)\n", insert_time * 1000.0, cost_inserted);
+    printf("  SAH rebuild:        %8.3f ms (cost %.3g)\n", rebuild_time * 1000.0, tree.rebuild_cost);
+    printf("  moving updates:     %8.3f ms/frame (%lu reinserted, %lu rebuilds)\n", update_time * 1000.0 / FRAMES,
+            reinserted, rebuilds);
+    printf("  frustum via tree:   %8.3f ms/frame (%lu candidates)\n", query_time * 1000.0 / FRAMES, tree_hits / FRAMES);
+    printf("  frustum flat:       %8.3f ms/frame (%lu visible, %.1fx)\n", flat_time * 1000.0 / FRAMES, flat_hits / FRAMES,
+            flat_time / query_time);
+    printf("  region query:       %8.3f ms/frame (%lu hits)\n", region_time * 1000.0 / FRAMES, region_hits / FRAMES);
+    printf("  nearest query:      %8.3f ms/frame\n", nearest_time * 1000.0 / FRAMES);
+
+    bvh_destroy(&tree);
+    free(boxes);
+    free(velocity);
+    free(proxies);
+
+    return 0;
+}
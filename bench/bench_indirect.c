@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "logging.h"
+#include "render.h"
+
+// renders a grid of boxes spread over many differently shaped defs in a core
+// profile context, first with every run packed into multi-draw-indirect calls
+// and then with one instanced draw per run, and reports draws per second
+
+#define WARMUP_FRAMES 20
+#define MEASURED_FRAMES 200
+
+static void prerun_callback(void);
+static void render_callback();
+static void postrender_callback();
+static render_def_t * __make_box(unsigned long id, GLfloat x, GLfloat y, GLfloat z);
+static unsigned int __num_objects = 50000;
+static unsigned int __num_defs = 2000;
+static unsigned int __side = 1;
+static unsigned int __frame = 0;
+static double __frame_start = 0.0;
+static double __frame_time[2] = { 0.0 };
+static unsigned long __draws[2] = { 0 };
+static unsigned long __draw_calls[2] = { 0 };
+static engine_ctx_t __engine_ctx;
+
+int main(int argc, char ** argv)
+{
+    int status = 0;
+
+    if (argc > 1) __num_objects = strtoul(argv[1], NULL, 10);
+    if (argc > 2) __num_defs = strtoul(argv[2], NULL, 10);
+    if (__num_defs == 0) __num_defs = 1;
+
+    memset(&__engine_ctx, 0, sizeof(__engine_ctx));
+    __engine_ctx.window_width = 1280;
+    __engine_ctx.window_height = 720;
+    __engine_ctx.core_profile = 1;
+    strncpy(__engine_ctx.window_title, "bench_indirect", sizeof(__engine_ctx.window_title));
+    if ((status = engine_init(&__engine_ctx)) != status_success) return status;
+
+    engine_register_prerun_callback(prerun_callback);
+    engine_register_render_callback(render_callback);
+    engine_register_postrender_callback(postrender_callback);
+
+    if ((status = engine_run()) != status_success) return status;
+
+    printf("%u objects over %u defs, %d frames per mode\n", __num_objects, __num_defs, MEASURED_FRAMES);
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        double seconds = __frame_time[mode] / MEASURED_FRAMES;
+
+        printf("  %s %8lu draws in %6lu calls, %8.3f ms/frame, %12.0f draws/s\n", mode == 0 ? "indirect:" : "per run: ",
+                __draws[mode], __draw_calls[mode], seconds * 1000.0, seconds > 0.0 ? __draws[mode] / seconds : 0.0);
+    }
+
+    return 0;
+}
+
+static void prerun_callback(void)
+{
+    glfwSwapInterval(0);
+
+    if (render_get_backend() != render_backend_core)
+    {
+        LOG_ERROR("no core profile context, indirect drawing is not available\n");
+        engine_stop();
+        return;
+    }
+
+    // every object is submitted so both modes draw the same set
+    render_set_culling(0);
+
+    for (unsigned int idx = 0; idx < __num_defs; ++idx)
+    {
+        render_def_t * def = __make_box(idx + 1, 0.4f + (idx % 7) * 0.05f, 0.4f + (idx % 11) * 0.03f, 0.4f + (idx % 13) * 0.02f);
+        if (!def || render_add_def(def) != status_success) return;
+    }
+
+    while (__side * __side < __num_objects) ++__side;
+
+    for (unsigned int idx = 0; idx < __num_objects; ++idx)
+    {
+        render_handle_t object = render_create_object(render_object_count, idx % __num_defs + 1);
+
+        if (object == RENDER_NULL_HANDLE) return;
+        render_object_set_position(object, (idx % __side) * 1.5f - __side * 0.75f, (idx / __side) * 1.5f - __side * 0.75f,
+                -(GLfloat)__side * 1.5f);
+        render_object_set_rotation(object, (GLfloat)(idx % 360), 0.0f, 1.0f, 0.0f);
+        render_object_set_color(object, (idx % 7) / 7.0f, (idx % 5) / 5.0f, (idx % 3) / 3.0f, 1.0f);
+    }
+}
+
+static void render_callback()
+{
+    int mode = (__frame < WARMUP_FRAMES + MEASURED_FRAMES ? 0 : 1);
+    mat4_t view, projection;
+
+    render_set_indirect(mode == 0);
+
+    mat4_identity(&view);
+    mat4_perspective(&projection, 45.0f, __engine_ctx.window_width / (float)__engine_ctx.window_height, 0.01f, 1000.0f);
+    render_set_camera(&view, &projection);
+
+    __frame_start = glfwGetTime();
+}
+
+static void postrender_callback()
+{
+    int mode = (__frame < WARMUP_FRAMES + MEASURED_FRAMES ? 0 : 1);
+    unsigned int frame_in_mode = __frame - mode * (WARMUP_FRAMES + MEASURED_FRAMES);
+    render_stats_t stats;
+
+    glFinish();
+
+    if (frame_in_mode >= WARMUP_FRAMES)
+    {
+        render_get_stats(&stats);
+        __frame_time[mode] += glfwGetTime() - __frame_start;
+        __draws[mode] = mode == 0 ? stats.indirect_draws : stats.draw_calls;
+        __draw_calls[mode] = stats.draw_calls;
+    }
+
+    if (++__frame == 2 * (WARMUP_FRAMES + MEASURED_FRAMES)) engine_stop();
+}
+
+// a box of the given half extents, one quad per face so each face gets its own normal
+static render_def_t * __make_box(unsigned long id, GLfloat x, GLfloat y, GLfloat z)
+{
+    static const GLfloat corners[6][4][3] = {
+        { { 1, 1, 1 }, { 1, -1, 1 }, { 1, -1, -1 }, { 1, 1, -1 } },
+        { { -1, 1, -1 }, { -1, -1, -1 }, { -1, -1, 1 }, { -1, 1, 1 } },
+        { { -1, 1, -1 }, { -1, 1, 1 }, { 1, 1, 1 }, { 1, 1, -1 } },
+        { { -1, -1, 1 }, { -1, -1, -1 }, { 1, -1, -1 }, { 1, -1, 1 } },
+        { { -1, 1, 1 }, { -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 } },
+        { { 1, 1, -1 }, { 1, -1, -1 }, { -1, -1, -1 }, { -1, 1, -1 } },
+    };
+    static const GLfloat normals[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    render_def_t * def = calloc(1, sizeof(render_def_t));
+    GLfloat * vertices = malloc(24 * 3 * sizeof(GLfloat)), * vertex_normals = malloc(24 * 3 * sizeof(GLfloat));
+    GLushort * indices = malloc(36 * sizeof(GLushort));
+
+    if (!def || !vertices || !vertex_normals || !indices)
+    {
+        LOG_ERROR("failed to allocate memory for def %lu\n", id);
+        free(def);
+        free(vertices);
+        free(vertex_normals);
+        free(indices);
+        return NULL;
+    }
+
+    for (unsigned int face = 0; face < 6; ++face)
+    {
+        GLushort base = face * 4;
+        GLushort quad[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+
+        for (unsigned int corner = 0; corner < 4; ++corner)
+        {
+            vertices[(base + corner) * 3] = corners[face][corner][0] * x;
+            vertices[(base + corner) * 3 + 1] = corners[face][corner][1] * y;
+            vertices[(base + corner) * 3 + 2] = corners[face][corner][2] * z;
+            memcpy(vertex_normals + (base + corner) * 3, normals[face], 3 * sizeof(GLfloat));
+        }
+        memcpy(indices + face * 6, quad, sizeof(quad));
+    }
+
+    def->id = id;
+    def->vertices = vertices;
+    def->normals = vertex_normals;
+    def->num_vertices = 24;
+    def->vertex_mode = GL_TRIANGLES;
+    def->indices = indices;
+    def->num_indices = 36;
+    def->index_type = GL_UNSIGNED_SHORT;
+
+    return def;
+}
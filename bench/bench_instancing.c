@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "engine.h"
+#include "logging.h"
+#include "render.h"
+
+// renders a grid of identical cubes, first batched into instanced draws and
+// then with one draw per object, and reports draw calls and frame times
+
+#define WARMUP_FRAMES 20
+#define MEASURED_FRAMES 200
+
+static void prerun_callback(void);
+static void render_callback();
+static void postrender_callback();
+static unsigned int __num_cubes = 50000;
+static unsigned int __frame = 0;
+static double __frame_start = 0.0;
+static double __frame_time[2] = { 0.0 };
+static unsigned long __draw_calls[2] = { 0 };
+static engine_ctx_t __engine_ctx;
+
+int main(int argc, char ** argv)
+{
+    int status = 0;
+
+    if (argc > 1) __num_cubes = strtoul(argv[1], NULL, 10);
+
+    memset(&__engine_ctx, 0, sizeof(__engine_ctx));
+    __engine_ctx.window_width = 1280;
+    __engine_ctx.window_height = 720;
+    strncpy(__engine_ctx.window_title, "bench_instancing", sizeof(__engine_ctx.window_title));
+    if ((status = engine_init(&__engine_ctx)) != status_success) return status;
+
+    engine_register_prerun_callback(prerun_callback);
+    engine_register_render_callback(render_callback);
+    engine_register_postrender_callback(postrender_callback);
+
+    if ((status = engine_run()) != status_success) return status;
+
+    printf("%u cubes, %d frames per mode\n", __num_cubes, MEASURED_FRAMES);
+    printf("  instanced:     %8lu draw calls, %8.3f ms/frame\n", __draw_calls[0], __frame_time[0] * 1000.0 / MEASURED_FRAMES);
+    printf("  per object:    %8lu draw calls, %8.3f ms/frame\n", __draw_calls[1], __frame_time[1] * 1000.0 / MEASURED_FRAMES);
+
+    return 0;
+}
+
+static void prerun_callback(void)
+{
+    unsigned int side = 1;
+    GLfloat light0_position[] = { 1.0, 1.0, 1.0, 0.0 };
+
+    glfwSwapInterval(0);
+    // every cube is submitted so both modes draw the same set
+    render_set_culling(0);
+    glLightfv(GL_LIGHT0, GL_POSITION, light0_position);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_LIGHT0);
+
+    while (side * side < __num_cubes) ++side;
+
+    for (unsigned int idx = 0; idx < __num_cubes; ++idx)
+    {
+        render_ctx_t * ctx = calloc(1, sizeof(render_ctx_t));
+        ctx->pos[0] = (idx % side) * 1.5f - side * 0.75f;
+        ctx->pos[1] = (idx / side) * 1.5f - side * 0.75f;
+        ctx->pos[2] = -side * 1.5f;
+        ctx->color[0] = (idx % 7) / 7.0f;
+        ctx->color[1] = (idx % 5) / 5.0f;
+        ctx->color[2] = (idx % 3) / 3.0f;
+        ctx->color[3] = 1.0f;
+        ctx->scale[0] = ctx->scale[1] = ctx->scale[2] = 1.0f;
+        ctx->rotation_angle = (GLfloat)(idx % 360);
+        ctx->rotation_vector[1] = 1.0f;
+        ctx->object_type = render_object_cube;
+        ctx->polygon_mode = (idx % 2 == 0 ? GL_LINE : GL_FILL);
+        if (render_add_object(ctx) != status_success) return;
+    }
+}
+
+static void render_callback()
+{
+    int mode = (__frame < WARMUP_FRAMES + MEASURED_FRAMES ? 0 : 1);
+
+    render_set_instancing(mode == 0);
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(45, __engine_ctx.window_width / (double)__engine_ctx.window_height, 0.01, 1000);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    __frame_start = glfwGetTime();
+}
+
+static void postrender_callback()
+{
+    int mode = (__frame < WARMUP_FRAMES + MEASURED_FRAMES ? 0 : 1);
+    unsigned int frame_in_mode = __frame - mode * (WARMUP_FRAMES + MEASURED_FRAMES);
+    render_stats_t stats;
+
+    glFinish();
+
+    if (frame_in_mode >= WARMUP_FRAMES)
+    {
+        render_get_stats(&stats);
+        __frame_time[mode] += glfwGetTime() - __frame_start;
+        __draw_calls[mode] = stats.draw_calls;
+    }
+
+    if (++__frame == 2 * (WARMUP_FRAMES + MEASURED_FRAMES)) engine_stop();
+}
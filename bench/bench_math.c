@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "math3d.h"
+
+// compares the SIMD model-matrix batch against the scalar path and times mat4_mul
+
+#define ITERATIONS 1000
+
+int main(int argc, char ** argv)
+{
+    unsigned int count = 16384, idx = 0, iter = 0;
+    vec3_t * pos = NULL, * scale = NULL;
+    quat_t * rotation = NULL;
+    mat4_t * out = NULL, product;
+    float sink = 0.0f;
+    double start = 0.0, scalar_time = 0.0, batch_time = 0.0, mul_time = 0.0;
+
+    if (argc > 1) count = strtoul(argv[1], NULL, 10);
+
+    pos = malloc(count * sizeof(vec3_t));
+    scale = malloc(count * sizeof(vec3_t));
+    rotation = malloc(count * sizeof(quat_t));
+    out = malloc(count * sizeof(mat4_t));
+    if (!pos || !scale || !rotation || !out)
+    {
+        fprintf(stderr, "failed to allocate memory for %u transforms\n", count);
+        return 1;
+    }
+
+    for (idx = 0; idx < count; ++idx)
+    {
+        pos[idx] = vec3_make(rand() / (float)RAND_MAX, rand() / (float)RAND_MAX, rand() / (float)RAND_MAX);
+        scale[idx] = vec3_make(1.0f + idx % 3, 1.0f, 0.5f);
+        rotation[idx] = quat_from_axis_angle(vec3_make(0.0f, 1.0f, 0.0f), (float)(idx % 360));
+    }
+
+    for (iter = 0; iter < ITERATIONS; ++iter)
+    {
+        start = bench_now();
+        mat4_compose_batch_scalar(out[0].m, 16, pos, scale, rotation, count);
+        scalar_time += bench_now() - start;
+
+        start = bench_now();
+        mat4_compose_batch(out[0].m, 16, pos, scale, rotation, count);
+        batch_time += bench_now() - start;
+    }
+
+    start = bench_now();
+    for (idx = 0; idx < count; ++idx)
+    {
+        mat4_mul(&product, &out[idx], &out[(idx + 1) % count]);
+        sink += product.m[0];
+    }
+    mul_time = bench_now() - start;
+
+    printf("%u transforms, %d iterations, simd path: %s\n", count, ITERATIONS, math3d_simd_name());
+    printf("  compose scalar: %8.3f ms (%7.2f Mmat/s)\n", scalar_time * 1000.0 / ITERATIONS, count * ITERATIONS / scalar_time * 1e-6);
+    printf("  compose batch:  %8.3f ms (%7.2f Mmat/s, %.2fx)\n", batch_time * 1000.0 / ITERATIONS, count * ITERATIONS / batch_time * 1e-6,
+            scalar_time / batch_time);
+    printf("  mat4_mul:       %8.3f ms (%7.2f Mmul/s) [%g]\n", mul_time * 1000.0, count / mul_time * 1e-6, sink);
+
+    free(pos);
+    free(scale);
+    free(rotation);
+    free(out);
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+
+#include "bench.h"
+#include "mesh.h"
+#include "meshfile.h"
+#include "obj.h"
+
+// writes a UV sphere as OBJ text, converts it to a mesh file once, then times
+// loading each: parsing and welding the text against mapping the binary file.
+// the mapped load also reads every vertex and index so page faults are
+// counted, the way a first upload would touch them.
+
+#define RUNS 10
+
+static int __write_sphere(const char * path, unsigned int rings)
+{
+    unsigned int segments = rings * 2;
+    FILE * fp = fopen(path, "w");
+
+    if (!fp) return 0;
+
+    for (unsigned int ring = 0; ring <= rings; ++ring)
+    {
+        for (unsigned int segment = 0; segment <= segments; ++segment)
+        {
+            double theta = M_PI * ring / rings, phi = 2.0 * M_PI * segment / segments;
+            double x = sin(theta) * cos(phi), y = cos(theta), z = sin(theta) * sin(phi);
+
+            fprintf(fp, "v %f %f %f\nvn %f %f %f\n", x, y, z, x, y, z);
+        }
+    }
+
+    for (unsigned int ring = 0; ring < rings; ++ring)
+    {
+        for (unsigned int segment = 0; segment < segments; ++segment)
+        {
+            unsigned int a = ring * (segments + 1) + segment + 1, b = a + segments + 1;
+            fprintf(fp, "f %u//%u %u//%u %u//%u %u//%u\n", a, a, b, b, b + 1, b + 1, a + 1, a + 1);
+        }
+    }
+
+    return fclose(fp) == 0;
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned int rings = argc > 1 ? strtoul(argv[1], NULL, 10) : 512;
+    const char * obj_path = "bench_meshload.obj", * mesh_path = "bench_meshload.mesh";
+    GLfloat distance = 0.0f;
+    double start = 0.0, parse_time = 0.0, map_time = 0.0;
+    double checksum = 0.0;
+    mesh_t mesh;
+    meshfile_t file;
+    render_def_t def;
+
+    if (!__write_sphere(obj_path, rings) || obj_load(obj_path, &mesh) != status_success
+            || mesh_optimize_vertex_cache(&mesh) != status_success || mesh_optimize_vertex_fetch(&mesh) != status_success
+            || meshfile_write(mesh_path, &mesh, &distance, 1) != status_success)
+    {
+        fprintf(stderr, "failed to prepare the test files\n");
+        return 1;
+    }
+    printf("%u vertices, %u triangles\n", mesh.num_vertices, mesh.num_indices / 3);
+    mesh_destroy(&mesh);
+
+    for (int run = 0; run < RUNS; ++run)
+    {
+        start = bench_now();
+        if (obj_load(obj_path, &mesh) != status_success) return 1;
+        parse_time += bench_now() - start;
+        checksum += mesh.vertices[0];
+        mesh_destroy(&mesh);
+
+        start = bench_now();
+        if (meshfile_open(&file, mesh_path) != status_success) return 1;
+        memset(&def, 0, sizeof(def));
+        meshfile_fill_def(&file, &def);
+        for (GLsizei idx = 0; idx < def.num_vertices * 3; idx += 16) checksum += def.vertices[idx] + def.normals[idx];
+        for (GLsizei idx = 0; idx < def.num_indices; idx += 32)
+        {
+            checksum += def.index_type == GL_UNSIGNED_SHORT ? ((const GLushort *)def.indices)[idx] : ((const GLuint *)def.indices)[idx];
+        }
+        meshfile_close(&file);
+        map_time += bench_now() - start;
+    }
+
+    printf("  OBJ parse + weld:   %8.3f ms\n", parse_time * 1000.0 / RUNS);
+    printf("  mesh file mmap:     %8.3f ms (%.0fx)\n", map_time * 1000.0 / RUNS, parse_time / map_time);
+    printf("  (checksum %g)\n", checksum);
+
+    remove(obj_path);
+    remove(mesh_path);
+
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "jobs.h"
+#include "render.h"
+
+// scatters rotated, scaled cubes through a volume and casts two kinds of
+// rays at them: a grid of picking rays fanned out from one eye, whose
+// neighbors start and head alike, and sight lines between random points,
+// which share nothing. each set is cast one ray at a time and as a batch on
+// the job workers; reports rays per second, and checks both ways agree.
+// needs no GL context: the cube def is built by render_init.
+
+#define WORLD_SIZE 500.0f
+#define PICK_GRID 256
+#define SIGHT_LINES (PICK_GRID * PICK_GRID)
+#define ROUNDS 4
+
+static float __randf(float lo, float hi)
+{
+    return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+static void __cast(const char * label, const render_ray_t * rays, unsigned int count, render_ray_hit_t * single,
+        render_ray_hit_t * batch)
+{
+    double start = 0.0, single_time = 0.0, batch_time = 0.0;
+    unsigned int hits = 0, mismatches = 0;
+
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        start = bench_now();
+        for (unsigned int idx = 0; idx < count; ++idx) render_raycast(&rays[idx], &single[idx]);
+        single_time += bench_now() - start;
+
+        start = bench_now();
+        hits = render_raycast_batch(rays, count, batch);
+        batch_time += bench_now() - start;
+    }
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        mismatches += single[idx].object != batch[idx].object || fabsf(single[idx].distance - batch[idx].distance) > 1e-4f;
+    }
+
+    printf("%s: %u rays, %u hits, %u mismatches\n", label, count, hits, mismatches);
+    printf("  one at a time: %10.0f rays/s\n", count * ROUNDS / single_time);
+    printf("  batched:       %10.0f rays/s (%.2fx)\n", count * ROUNDS / batch_time, single_time / batch_time);
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned int num_objects = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000, workers = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+    render_ray_t * rays = malloc(SIGHT_LINES * sizeof(render_ray_t));
+    render_ray_hit_t * single = malloc(SIGHT_LINES * sizeof(render_ray_hit_t)), * batch = malloc(SIGHT_LINES * sizeof(render_ray_hit_t));
+    double start = 0.0;
+
+    if (!rays || !single || !batch || jobs_init(workers) != status_success || render_init() != status_success)
+    {
+        fprintf(stderr, "failed to initialize\n");
+        return 1;
+    }
+
+    srand(1);
+    start = bench_now();
+    // added through ctxs so each is placed as it is created
+    for (unsigned int idx = 0; idx < num_objects; ++idx)
+    {
+        render_ctx_t * ctx = calloc(1, sizeof(render_ctx_t));
+        float scale = __randf(0.5f, 4.0f);
+
+        if (!ctx)
+        {
+            fprintf(stderr, "failed to allocate memory for %u objects\n", num_objects);
+            return 1;
+        }
+
+        ctx->pos[0] = __randf(-WORLD_SIZE, WORLD_SIZE);
+        ctx->pos[1] = __randf(-WORLD_SIZE, WORLD_SIZE);
+        ctx->pos[2] = __randf(-WORLD_SIZE, WORLD_SIZE);
+        ctx->scale[0] = scale;
+        ctx->scale[1] = scale * __randf(0.5f, 2.0f);
+        ctx->scale[2] = scale;
+        ctx->rotation_angle = __randf(0.0f, 360.0f);
+        ctx->rotation_vector[0] = __randf(-1.0f, 1.0f);
+        ctx->rotation_vector[1] = 1.0f;
+        ctx->rotation_vector[2] = __randf(-1.0f, 1.0f);
+        ctx->object_type = render_object_cube;
+        ctx->polygon_mode = GL_FILL;
+        if (render_add_object(ctx) != status_success) return 1;
+    }
+
+    printf("%u objects placed in %.3f ms, on %u threads\n", num_objects, (bench_now() - start) * 1000.0, jobs_num_threads());
+
+    // a 90 degree fan from the side of the volume looking in
+    for (unsigned int y = 0; y < PICK_GRID; ++y)
+    {
+        for (unsigned int x = 0; x < PICK_GRID; ++x)
+        {
+            render_ray_t * ray = &rays[y * PICK_GRID + x];
+
+            ray->origin[0] = 0.0f;
+            ray->origin[1] = 0.0f;
+            ray->origin[2] = 2.0f * WORLD_SIZE;
+            ray->direction[0] = 2.0f * x / (PICK_GRID - 1) - 1.0f;
+            ray->direction[1] = 2.0f * y / (PICK_GRID - 1) - 1.0f;
+            ray->direction[2] = -1.0f;
+            ray->max_distance = 4.0f * WORLD_SIZE;
+        }
+    }
+    __cast("picking grid", rays, PICK_GRID * PICK_GRID, single, batch);
+
+    for (unsigned int idx = 0; idx < SIGHT_LINES; ++idx)
+    {
+        render_ray_t * ray = &rays[idx];
+        float target[3];
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            ray->origin[axis] = __randf(-WORLD_SIZE, WORLD_SIZE);
+            target[axis] = __randf(-WORLD_SIZE, WORLD_SIZE);
+            ray->direction[axis] = target[axis] - ray->origin[axis];
+        }
+        ray->max_distance = sqrtf(ray->direction[0] * ray->direction[0] + ray->direction[1] * ray->direction[1]
+                + ray->direction[2] * ray->direction[2]);
+    }
+    __cast("sight lines ", rays, SIGHT_LINES, single, batch);
+
+    free(rays);
+    free(single);
+    free(batch);
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "engine.h"
+#include "logging.h"
+#include "render.h"
+#include "text.h"
+
+// fills the screen with 125 lines of 80 characters every frame, a few of them
+// changing each frame like a stats overlay would, and reports glyphs per
+// second through the batched atlas renderer. in a compatibility context the
+// same text is then drawn with FTGL texture fonts, one draw per glyph.
+
+#define WARMUP_FRAMES 20
+#define MEASURED_FRAMES 200
+#define NUM_LINES 125
+#define LINE_CHARS 80
+#define DYNAMIC_LINES 5
+
+static void prerun_callback(void);
+static void render_callback();
+static void postrender_callback();
+static void __make_line(unsigned int line, char * buf);
+static const char * __font_path = "res/fonts/PressStart2P.ttf";
+static unsigned int __pixel_height = 8;
+static text_font_t __font = 0;
+static FTGLfont * __ftgl_font = NULL;
+static int __num_modes = 1;
+static unsigned int __frame = 0;
+static double __last_frame_start = 0.0;
+static double __frame_time[2] = { 0.0 };
+static unsigned long __glyphs[2] = { 0 };
+static unsigned long __draw_calls[2] = { 0 };
+static engine_ctx_t __engine_ctx;
+
+int main(int argc, char ** argv)
+{
+    int status = 0;
+
+    if (argc > 1) __font_path = argv[1];
+    if (argc > 2) __pixel_height = strtoul(argv[2], NULL, 10);
+
+    memset(&__engine_ctx, 0, sizeof(__engine_ctx));
+    __engine_ctx.window_width = 1280;
+    __engine_ctx.window_height = 1024;
+    __engine_ctx.core_profile = (argc > 3 && strcmp(argv[3], "--core") == 0);
+    strncpy(__engine_ctx.window_title, "bench_text", sizeof(__engine_ctx.window_title));
+    if ((status = engine_init(&__engine_ctx)) != status_success) return status;
+
+    engine_register_prerun_callback(prerun_callback);
+    engine_register_render_callback(render_callback);
+    engine_register_postrender_callback(postrender_callback);
+
+    if ((status = engine_run()) != status_success) return status;
+
+    printf("%d lines of %d characters from %s at %u pixels, %d frames per mode\n", NUM_LINES, LINE_CHARS, __font_path,
+            __pixel_height, MEASURED_FRAMES);
+    for (int mode = 0; mode < __num_modes; ++mode)
+    {
+        double seconds = __frame_time[mode] / MEASURED_FRAMES;
+
+        printf("  %s %6lu glyphs in %5lu calls, %8.3f ms/frame, %12.0f glyphs/s\n", mode == 0 ? "atlas:" : "FTGL: ",
+                __glyphs[mode], __draw_calls[mode], seconds * 1000.0, seconds > 0.0 ? __glyphs[mode] / seconds : 0.0);
+    }
+
+    if (__ftgl_font) ftglDestroyFont(__ftgl_font);
+
+    return 0;
+}
+
+static void prerun_callback(void)
+{
+    glfwSwapInterval(0);
+
+    if (text_load_font(__font_path, __pixel_height, &__font) != status_success)
+    {
+        engine_stop();
+        return;
+    }
+
+    // FTGL needs the fixed-function pipeline
+    if (render_get_backend() != render_backend_fixed) return;
+
+    if (!(__ftgl_font = ftglCreateTextureFont(__font_path)) || !ftglSetFontFaceSize(__ftgl_font, __pixel_height, 72))
+    {
+        LOG_ERROR("FTGL failed to load %s, measuring the atlas only\n", __font_path);
+        return;
+    }
+
+    __num_modes = 2;
+}
+
+static void render_callback()
+{
+    int mode = (__frame < WARMUP_FRAMES + MEASURED_FRAMES ? 0 : 1);
+    GLfloat color[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    char line[LINE_CHARS + 1];
+
+    if (mode != 0) return;
+
+    for (unsigned int idx = 0; idx < NUM_LINES; ++idx)
+    {
+        __make_line(idx, line);
+        color[1] = (idx % 3) / 3.0f + 0.33f;
+        text_draw(__font, 0.0f, (GLfloat)(idx * __pixel_height), line, color);
+    }
+}
+
+static void postrender_callback()
+{
+    int mode = (__frame < WARMUP_FRAMES + MEASURED_FRAMES ? 0 : 1);
+    unsigned int frame_in_mode = __frame - mode * (WARMUP_FRAMES + MEASURED_FRAMES);
+    double now = glfwGetTime();
+    text_stats_t stats;
+
+    // the atlas draws after this callback, so whole frames are timed, start to start
+    if (frame_in_mode >= WARMUP_FRAMES) __frame_time[mode] += now - __last_frame_start;
+    __last_frame_start = now;
+
+    if (mode == 0)
+    {
+        text_get_stats(&stats);
+        __glyphs[0] = stats.glyphs_drawn;
+        __draw_calls[0] = stats.draw_calls;
+    }
+    else
+    {
+        GLint viewport[4];
+        char line[LINE_CHARS + 1];
+
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT);
+        glDisable(GL_LIGHTING);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glOrtho(0.0, viewport[2], 0.0, viewport[3], -1.0, 1.0);
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+
+        __glyphs[1] = 0;
+        for (unsigned int idx = 0; idx < NUM_LINES; ++idx)
+        {
+            __make_line(idx, line);
+            glColor4f(1.0f, (idx % 3) / 3.0f + 0.33f, 1.0f, 1.0f);
+            glLoadIdentity();
+            glTranslatef(0.0f, (GLfloat)(viewport[3] - (idx + 1) * __pixel_height), 0.0f);
+            ftglRenderFont(__ftgl_font, line, FTGL_RENDER_ALL);
+            for (const char * c = line; *c; ++c) __glyphs[1] += (*c != ' ');
+        }
+        __draw_calls[1] = __glyphs[1];
+
+        glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPopAttrib();
+    }
+
+    if (++__frame == __num_modes * (WARMUP_FRAMES + MEASURED_FRAMES)) engine_stop();
+}
+
+// the first lines change every frame, the rest stay put and come from the run cache
+static void __make_line(unsigned int line, char * buf)
+{
+    static const char * filler = "the quick brown fox jumps over the lazy dog. THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG! ";
+    int len = 0, filler_len = strlen(filler);
+
+    if (line < DYNAMIC_LINES) len = snprintf(buf, LINE_CHARS + 1, "frame %8u line %3u: %10.3f ms ", __frame, line,
+            __frame_time[0] * 1000.0);
+    else len = snprintf(buf, LINE_CHARS + 1, "line %3u: ", line);
+
+    for (; len < LINE_CHARS; ++len) buf[len] = filler[(len + line) % filler_len];
+    buf[LINE_CHARS] = '\0';
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "bench.h"
+#include "jobs.h"
+#include "render.h"
+#include "voxel.h"
+
+// fills a hilly terrain with caves, meshes every chunk of it, then digs one
+// block per chunk per round and remeshes what changed. reports chunks meshed
+// per second and the triangles each chunk would take as separate cubes, with
+// hidden-face removal alone and after greedy merging. meshing needs no GL
+// context: the chunk defs are prebuilt, so nothing is uploaded here.
+
+#define CHUNKS_ACROSS 16
+#define CHUNKS_HIGH 4
+#define ROUNDS 20
+#define VOXEL_DEF_ID_BASE 1000
+
+static int __terrain_height(int x, int z)
+{
+    return (int)(48.0 + 24.0 * sin(x * 0.045) * cos(z * 0.037) + 8.0 * sin((x + z) * 0.11));
+}
+
+static void __print_triangles(const char * label, const voxel_stats_t * stats, double seconds)
+{
+    double cubes = stats->solid_blocks * 12.0, culled = stats->faces_visible * 2.0, greedy = stats->quads * 2.0;
+
+    printf("%s: %5lu chunks in %8.3f ms, %8.0f chunks/s\n", label, stats->chunks_meshed, seconds * 1000.0,
+            seconds > 0.0 ? stats->chunks_meshed / seconds : 0.0);
+    printf("  triangles: %12.0f as cubes, %10.0f with hidden faces removed, %9.0f merged (%.1f%% of culled, %.2f%% of cubes)\n",
+            cubes, culled, greedy, culled > 0.0 ? 100.0 * greedy / culled : 0.0, cubes > 0.0 ? 100.0 * greedy / cubes : 0.0);
+}
+
+int main(int argc, char ** argv)
+{
+    unsigned int workers = argc > 1 ? strtoul(argv[1], NULL, 10) : 0, meshed = 0;
+    int size = CHUNKS_ACROSS * VOXEL_CHUNK_SIZE;
+    double start = 0.0, fill_time = 0.0, mesh_time = 0.0, remesh_time = 0.0;
+    voxel_stats_t first, total, remesh;
+    voxel_world_t world;
+
+    if (jobs_init(workers) != status_success || render_init() != status_success
+            || voxel_world_init(&world, VOXEL_DEF_ID_BASE) != status_success)
+    {
+        fprintf(stderr, "failed to initialize\n");
+        return 1;
+    }
+
+    srand(1);
+    start = bench_now();
+    for (int z = 0; z < size; ++z)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            int height = __terrain_height(x, z);
+
+            for (int y = 0; y < height && y < CHUNKS_HIGH * VOXEL_CHUNK_SIZE; ++y)
+            {
+                // winding caves below the surface layers
+                if (y < height - 4 && sin(x * 0.13) * sin(y * 0.21) * sin(z * 0.17) > 0.35) continue;
+                voxel_set_block(&world, x, y, z, 1);
+            }
+        }
+    }
+    fill_time = bench_now() - start;
+
+    start = bench_now();
+    voxel_world_update(&world, &meshed);
+    mesh_time = bench_now() - start;
+    voxel_get_stats(&world, &first);
+
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        for (int cz = 0; cz < CHUNKS_ACROSS; ++cz)
+        {
+            for (int cx = 0; cx < CHUNKS_ACROSS; ++cx)
+            {
+                int x = cx * VOXEL_CHUNK_SIZE + rand() % VOXEL_CHUNK_SIZE, z = cz * VOXEL_CHUNK_SIZE + rand() % VOXEL_CHUNK_SIZE;
+                voxel_set_block(&world, x, rand() % (__terrain_height(x, z) - 1), z, 0);
+            }
+        }
+
+        start = bench_now();
+        voxel_world_update(&world, &meshed);
+        remesh_time += bench_now() - start;
+    }
+
+    voxel_get_stats(&world, &total);
+    remesh = total;
+    remesh.chunks_meshed -= first.chunks_meshed;
+    remesh.solid_blocks -= first.solid_blocks;
+    remesh.faces_visible -= first.faces_visible;
+    remesh.quads -= first.quads;
+
+    printf("%d x %d x %d chunks of %d^3 on %u threads, filled in %.3f ms\n", CHUNKS_ACROSS, CHUNKS_HIGH, CHUNKS_ACROSS,
+            VOXEL_CHUNK_SIZE, jobs_num_threads(), fill_time * 1000.0);
+    __print_triangles("first mesh", &first, mesh_time);
+    __print_triangles("remeshes  ", &remesh, remesh_time);
+    printf("  meshing jobs alone: %.0f chunks/s\n", total.mesh_seconds > 0.0 ? total.chunks_meshed / total.mesh_seconds : 0.0);
+
+    voxel_world_destroy(&world);
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef __ANIM_H__
+#define __ANIM_H__
+
+#include "common.h"
+#include "math3d.h"
+#include "render.h"
+
+// keyframe animation of render object transforms and colors. a track plays
+// one channel of one object through its keys, looping or holding the last.
+// each channel keeps its keys and tracks as parallel arrays, so an update walks
+// them in order: the job workers split the tracks into ranges, find each
+// track's keys from where the last update left it, gather the keys into one
+// array per component and interpolate a lane of tracks per instruction
+// (vec_lerp_batch, quat_slerp_batch). the samples are then written into the
+// objects with render_objects_set_*.
+
+typedef enum
+{
+    anim_position = 0,              // keys of 3 floats
+    anim_rotation,                  // 4: a quaternion as x, y, z, w
+    anim_scale,                     // 3
+    anim_color,                     // 4: r, g, b, a
+    anim_channel_count
+} anim_channel_e;
+
+typedef struct
+{
+    // keys of every track on the channel, each track's together and in time order
+    float * key_times;
+    float * key_values[4];          // one array per component
+    unsigned int num_keys;
+    unsigned int key_capacity;
+    // tracks
+    render_handle_t * targets;
+    unsigned int * first_keys;
+    unsigned int * key_counts;
+    unsigned int * cursors;         // the key the last sample came after, counted from the track's first
+    float * times;                  // kept within the track's keys
+    float * speeds;
+    unsigned char * loops;
+    unsigned int num_tracks;
+    unsigned int track_capacity;
+    // the last samples, packed vec3_t, quat_t or vec4_t by channel
+    float * samples;
+} anim_channel_t;
+
+typedef struct
+{
+    anim_channel_t channels[anim_channel_count];
+} anim_t;
+
+status_e anim_init(anim_t * anim);
+status_e anim_destroy(anim_t * anim);
+// times must increase; values holds count keys of the channel's size, one after the other. rotation keys are
+// normalized. the track starts at its first key, at speed 1.
+status_e anim_add_track(anim_t * anim, render_handle_t object, anim_channel_e channel, const float * times,
+        const float * values, unsigned int count, int loop);
+// drops every track of object; walks all of them, as do the two below
+void anim_remove(anim_t * anim, render_handle_t object);
+// time counts from each track's first key, so objects sharing keys can play them out of step
+void anim_set_time(anim_t * anim, render_handle_t object, float time);
+// negative speeds play backwards
+void anim_set_speed(anim_t * anim, render_handle_t object, float speed);
+// moves every track on by delta times its speed and samples it into its channel's samples
+void anim_sample(anim_t * anim, float delta);
+// writes the last samples into their objects
+void anim_apply(const anim_t * anim);
+void anim_update(anim_t * anim, float delta);
+
+#endif  // __ANIM_H__
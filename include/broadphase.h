@@ -0,0 +1,97 @@
+#ifndef __BROADPHASE_H__
+#define __BROADPHASE_H__
+
+#include "common.h"
+#include "hash.h"
+#include "math3d.h"
+
+// finds the pairs of boxes that overlap among many moving ones, for the
+// narrow phase to look at. two methods:
+// sweep and prune keeps every box's endpoints sorted along each axis from one
+// update to the next. objects move little between frames, so insertion sort
+// only has to carry each endpoint past the few it crossed, and each crossing
+// of one box's start over another's end is where an overlap may begin: the
+// pair set is patched there instead of being found again, and the pairs it
+// held are tested again to drop those that ended. it is quickest
+// while most boxes drift and slowest when many cross at once (teleports, big
+// boxes sweeping through crowds).
+// the grid drops each box into the uniform cells it touches, sorts the cells
+// and tests the boxes that share one, starting over every update: no
+// coherence to exploit, nor to lose, which suits boxes of about a cell that
+// all move fast. (sweep and prune starts over the same way when many boxes
+// were added at once, or moved further than sorting them back in is worth,
+// going by what the last start over cost: it sorts the axes outright and
+// sweeps one for pairs.)
+// proxies are ids handed out by broadphase_add and stay valid until removed.
+
+#define BROADPHASE_NULL (-1)
+
+typedef enum
+{
+    broadphase_sap = 0,
+    broadphase_grid,
+} broadphase_method_e;
+
+typedef struct
+{
+    int a;                          // proxies, a < b
+    int b;
+} broadphase_pair_t;
+
+typedef struct
+{
+    float value;
+    unsigned int proxy;             // times 2, plus 1 for the box's max
+} broadphase_endpoint_t;
+
+typedef struct
+{
+    broadphase_method_e method;
+    float cell_size;                // grid only
+    // proxies, by id
+    vec3_t * min;
+    vec3_t * max;
+    void ** data;
+    int * next_free;                // the free list link (-1 ends it), -2 while in use
+    unsigned int capacity;
+    unsigned int num_proxies;
+    int free_list;
+    // sweep and prune: each axis sorted by value, mins before maxes of equal value
+    broadphase_endpoint_t * endpoints[3];
+    unsigned int num_endpoints;
+    unsigned int endpoint_capacity;
+    unsigned int num_unsorted;      // appended since the last update
+    hash_t pair_index;              // packed pair to its index in pairs, plus 1
+    unsigned long long sweep_tests; // boxes the last sort anew tested each min against, summed
+    // radix sort input and scratch: a packed cell and proxy for each cell each box touches, or
+    // the endpoints of an axis being sorted anew
+    unsigned long long * cell_keys;
+    unsigned int * cell_proxies;
+    unsigned int cell_capacity;
+    // what the last update found
+    broadphase_pair_t * pairs;
+    unsigned int num_pairs;
+    unsigned int pair_capacity;
+    unsigned long swaps;            // sweep and prune endpoint swaps in the last update
+    int rebuilt;                    // whether it sorted the axes anew, after giving up on any swaps made
+} broadphase_t;
+
+// return 0 to stop early
+typedef int (*broadphase_pair_cb)(void * a, void * b, void * user);
+
+// cell_size is only used by the grid; about the size of a typical box works best
+status_e broadphase_init(broadphase_t * bp, broadphase_method_e method, float cell_size);
+status_e broadphase_destroy(broadphase_t * bp);
+int broadphase_add(broadphase_t * bp, vec3_t min, vec3_t max, void * data);
+// the pairs it was in are dropped at once
+status_e broadphase_remove(broadphase_t * bp, int proxy);
+// takes effect at the next update
+void broadphase_move(broadphase_t * bp, int proxy, vec3_t min, vec3_t max);
+void * broadphase_get_data(const broadphase_t * bp, int proxy);
+// finds the overlapping pairs into bp->pairs, in no particular order, and returns how many there are.
+// the buffer is reused by the next update.
+unsigned int broadphase_update(broadphase_t * bp);
+// calls cb with the data of both proxies of each pair the last update found; returns how many it was called for
+unsigned int broadphase_for_each_pair(const broadphase_t * bp, broadphase_pair_cb cb, void * user);
+
+#endif  // __BROADPHASE_H__
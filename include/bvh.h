@@ -0,0 +1,82 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include "common.h"
+#include "cull.h"
+#include "math3d.h"
+
+// dynamic AABB tree. leaves store fattened boxes so small movements do not
+// touch the tree; leaves that leave their fat box are removed and reinserted
+// (refitting and rotating their ancestors on the way up, so the height stays
+// logarithmic however the leaves arrive), and bvh_optimize rebuilds the
+// whole tree with a binned SAH once incremental updates have degraded it.
+
+#define BVH_NULL (-1)
+#define BVH_PACKET 4                // rays traced together by bvh_raycast
+
+typedef struct
+{
+    vec3_t min;
+    vec3_t max;
+} bvh_aabb_t;
+
+typedef struct
+{
+    bvh_aabb_t box;
+    int parent;                     // doubles as the free list link
+    int left;
+    int right;                      // BVH_NULL for leaves
+    int height;                     // 0 for leaves, -1 for free nodes
+    void * data;
+} bvh_node_t;
+
+typedef struct
+{
+    bvh_node_t * nodes;
+    int root;
+    int free_list;
+    unsigned int capacity;
+    unsigned int num_leaves;
+    float margin;                   // how far a leaf box is fattened on each side
+    unsigned long updates;          // leaf inserts/removes since the last cost check
+    float rebuild_cost;             // SAH cost right after the last rebuild
+} bvh_t;
+
+typedef struct
+{
+    vec3_t origin;
+    vec3_t direction;               // distances along the ray are in lengths of it
+    float max_t;
+} bvh_ray_t;
+
+// return 0 to stop the query early
+typedef int (*bvh_query_cb)(void * data, int inside, void * user);
+// exact distance from point to the object stored in a leaf
+typedef float (*bvh_distance_fn)(void * data, vec3_t point, void * user);
+// exact test of ray ray_index of the packet against the object stored in a leaf: the t of its
+// nearest hit below max_t, or a negative value for none
+typedef float (*bvh_ray_fn)(void * data, const bvh_ray_t * ray, unsigned int ray_index, float max_t, void * user);
+
+status_e bvh_init(bvh_t * tree, float margin);
+status_e bvh_destroy(bvh_t * tree);
+int bvh_insert(bvh_t * tree, const bvh_aabb_t * box, void * data);
+status_e bvh_remove(bvh_t * tree, int proxy);
+// returns 1 when the leaf had to move in the tree, 0 when its fat box still contained box
+int bvh_update(bvh_t * tree, int proxy, const bvh_aabb_t * box);
+void * bvh_get_data(const bvh_t * tree, int proxy);
+// rebuilds with SAH when the tree costs more than max_ratio times what it did after the last rebuild
+int bvh_optimize(bvh_t * tree, float max_ratio);
+status_e bvh_rebuild(bvh_t * tree);
+float bvh_cost(const bvh_t * tree);
+unsigned int bvh_query_aabb(const bvh_t * tree, const bvh_aabb_t * box, bvh_query_cb cb, void * user);
+// inside is 1 for leaves whose whole subtree was found inside the frustum
+unsigned int bvh_query_frustum(const bvh_t * tree, const cull_frustum_t * frustum, bvh_query_cb cb, void * user);
+void * bvh_nearest(const bvh_t * tree, vec3_t point, float max_distance, bvh_distance_fn fn, void * user, float * distance);
+// traces up to BVH_PACKET rays down the tree together, each node tested against all of them with one
+// SIMD slab test, so rays that start and head alike (picking around a cursor, sight lines from one
+// spot) share the traversal. data and t receive each ray's nearest hit, NULL and -1 for misses.
+// returns how many rays hit.
+unsigned int bvh_raycast(const bvh_t * tree, const bvh_ray_t * rays, unsigned int count, bvh_ray_fn fn, void * user,
+        void ** data, float * t);
+
+#endif  // __BVH_H__
@@ -0,0 +1,51 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include "common.h"
+
+// frame capture without stalling the pipeline. each captured frame is read
+// with glReadPixels into one of a ring of pixel buffer objects, which is
+// mapped CAPTURE_LATENCY frames later once its fence has signaled, so the
+// copy overlaps the next frames instead of waiting for this one to finish.
+// the pixels are handed to a background thread that writes them as PNG
+// files or raw dumps. contexts without pixel buffer objects read
+// synchronously, contexts without fences map on age alone.
+// only the thread owning the context may call these, except capture_get_stats.
+
+#define CAPTURE_RING_SIZE 3         // frames in flight on the GPU
+#define CAPTURE_LATENCY 2           // frames before a read is mapped, if its fence has signaled by then
+#define CAPTURE_MAX_QUEUED 8        // frames held from being read to being written before capture_frame blocks
+#define CAPTURE_MAX_PATH 256
+
+typedef enum
+{
+    capture_format_png = 0,         // 8-bit RGB, one file per frame
+    capture_format_raw,             // RGBA rows top to bottom, one file per frame or all frames appended to one
+} capture_format_e;
+
+typedef struct
+{
+    unsigned long frames_read;      // glReadPixels issued
+    unsigned long frames_written;
+    unsigned long write_errors;
+    unsigned long readback_stalls;  // reads mapped before their fence had signaled
+    unsigned long encoder_stalls;   // frames that waited for the writer to catch up
+} capture_stats_t;
+
+status_e capture_init(void);
+// creates the pixel buffers for the current context
+status_e capture_prerun(void);
+// captures the next num_frames frames (0 until capture_stop) to path, a printf pattern given the frame's
+// number in the capture (from 0) as an unsigned int: at most one of %d, %i, %u, %x, %X or %o (with flags, width
+// and precision), and %% for a literal %. a raw path without a number gets every frame appended.
+status_e capture_start(const char * path, capture_format_e format, unsigned int num_frames);
+// stops capturing and maps the reads still in flight; they are written in the background
+void capture_stop(void);
+int capture_active(void);
+// reads the finished frame back and collects earlier reads (the engine calls it before swapping buffers)
+void capture_frame(void);
+// blocks until every frame handed to the writer is on disk
+void capture_wait(void);
+void capture_get_stats(capture_stats_t * stats);
+
+#endif  // __CAPTURE_H__
@@ -0,0 +1,93 @@
+#ifndef __CMDLIST_H__
+#define __CMDLIST_H__
+
+#include "common.h"
+
+// render command lists: GL calls recorded as plain structs, without touching
+// the context, so any thread can fill one. lists recorded in parallel for
+// consecutive parts of a frame are played back one after another by the
+// thread owning the context, issuing the calls a serial loop would have.
+// pointers handed to a command are read at playback, so what they point at
+// must stay put until then.
+
+typedef enum
+{
+    cmdlist_op_enable = 0,
+    cmdlist_op_disable,
+    cmdlist_op_blend_func,
+    cmdlist_op_depth_mask,
+    cmdlist_op_polygon_mode,
+    cmdlist_op_vertex_arrays,       // glVertexPointer and glNormalPointer of 3 floats per vertex
+    cmdlist_op_instance_attribs,    // consecutive vec4 attributes read per instance from a buffer
+    cmdlist_op_draw,                // glDrawElements with a model matrix multiplied onto the modelview and a color
+    cmdlist_op_draw_instanced,
+} cmdlist_op_e;
+
+typedef struct
+{
+    cmdlist_op_e op;
+    union
+    {
+        GLenum cap;
+        GLenum mode;
+        GLboolean flag;
+        struct
+        {
+            GLenum sfactor;
+            GLenum dfactor;
+        } blend;
+        struct
+        {
+            const GLfloat * vertices;
+            const GLfloat * normals;
+        } arrays;
+        struct
+        {
+            GLuint buffer;
+            GLintptr offset;        // of the first instance's first attribute
+            GLsizei stride;         // bytes from one instance to the next
+            GLuint first_attrib;
+            GLuint num_attribs;
+        } instances;
+        struct
+        {
+            const GLfloat * model;  // NULL to draw with the modelview as it is
+            const GLfloat * color;  // NULL to keep the current color
+            GLsizei count;
+            GLenum type;
+            const GLvoid * indices;
+            GLsizei num_instances;  // cmdlist_op_draw_instanced only
+        } draw;
+    } args;
+} cmdlist_cmd_t;
+
+typedef struct
+{
+    cmdlist_cmd_t * cmds;
+    unsigned int len;
+    unsigned int capacity;
+    unsigned int draws;             // draw commands recorded
+    status_e status;                // status_error once a command could not be recorded
+} cmdlist_t;
+
+void cmdlist_init(cmdlist_t * list);
+void cmdlist_destroy(cmdlist_t * list);
+// empties the list but keeps its storage for the next recording
+void cmdlist_reset(cmdlist_t * list);
+status_e cmdlist_enable(cmdlist_t * list, GLenum cap);
+status_e cmdlist_disable(cmdlist_t * list, GLenum cap);
+status_e cmdlist_blend_func(cmdlist_t * list, GLenum sfactor, GLenum dfactor);
+status_e cmdlist_depth_mask(cmdlist_t * list, GLboolean flag);
+status_e cmdlist_polygon_mode(cmdlist_t * list, GLenum mode);
+status_e cmdlist_vertex_arrays(cmdlist_t * list, const GLfloat * vertices, const GLfloat * normals);
+status_e cmdlist_instance_attribs(cmdlist_t * list, GLuint buffer, GLintptr offset, GLsizei stride,
+        GLuint first_attrib, GLuint num_attribs);
+// GL_TRIANGLES
+status_e cmdlist_draw(cmdlist_t * list, const GLfloat * model, const GLfloat * color, GLsizei count, GLenum type,
+        const GLvoid * indices);
+status_e cmdlist_draw_instanced(cmdlist_t * list, GLsizei count, GLenum type, const GLvoid * indices, GLsizei num_instances);
+// plays the lists in order, from the thread owning the context. fails without issuing anything
+// when one of them is missing commands.
+status_e cmdlist_play(const cmdlist_t * lists, unsigned int num_lists);
+
+#endif  // __CMDLIST_H__
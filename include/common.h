@@ -1,6 +1,10 @@
 #ifndef __COMMON_H__
 #define __COMMON_H__
 
+#ifndef __APPLE__
+#   define GL_GLEXT_PROTOTYPES
+#   define GLFW_INCLUDE_GLEXT
+#endif
 #include <GLFW/glfw3.h>
 #ifdef __APPLE__
 #   define __gl_h_
@@ -0,0 +1,30 @@
+#ifndef __CULL_H__
+#define __CULL_H__
+
+#include "common.h"
+#include "math3d.h"
+
+typedef enum
+{
+    cull_outside = 0,
+    cull_inside,
+    cull_intersecting,
+} cull_result_e;
+
+// planes are (a, b, c, d) with unit normals pointing into the frustum:
+// a point p is inside a plane when a*p.x + b*p.y + c*p.z + d >= 0
+typedef struct
+{
+    float planes[6][4];
+} cull_frustum_t;
+
+void cull_frustum_extract(cull_frustum_t * frustum, const mat4_t * view_projection);
+// classifies count spheres given as parallel x/y/z/radius arrays, writing one cull_result_e per sphere.
+// returns how many are not outside.
+unsigned int cull_spheres(const cull_frustum_t * frustum, const float * x, const float * y, const float * z,
+        const float * radius, unsigned int count, unsigned char * results);
+cull_result_e cull_aabb(const cull_frustum_t * frustum, vec3_t min, vec3_t max);
+// world-space bounds of a local AABB under an affine transform
+void cull_transform_aabb(const mat4_t * m, vec3_t min, vec3_t max, vec3_t * out_min, vec3_t * out_max);
+
+#endif  // __CULL_H__
@@ -9,10 +9,13 @@ typedef struct
     int window_height;
     char window_title[100];
     int mouse_disabled;
+    int core_profile;           // create a 3.3 core profile context, which selects the renderer's core backend
+    int hidden_window;          // for headless runs, e.g. software rendering under a virtual X server
 } engine_ctx_t;
 
 status_e engine_init(engine_ctx_t * ctx);
 status_e engine_run(void);
+status_e engine_stop(void);
 
 typedef void (*engine_key_cb)(GLFWwindow * window, int key, int scancode, int action, int mods);
 typedef void (*engine_mouse_pos_cb)(GLFWwindow * window, double xpos, double ypos);
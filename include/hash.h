@@ -0,0 +1,28 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include "common.h"
+
+// open-addressing (linear probing) map of unsigned long keys to pointers
+
+typedef struct
+{
+    unsigned long key;
+    void * value;
+    int used;
+} hash_entry_t;
+
+typedef struct
+{
+    unsigned int len;
+    unsigned int capacity;  // always a power of two
+    hash_entry_t * entries;
+} hash_t;
+
+status_e hash_init(hash_t * h);
+status_e hash_destroy(hash_t * h);
+void * hash_get(const hash_t * h, unsigned long key);
+status_e hash_set(hash_t * h, unsigned long key, void * value);
+void * hash_remove(hash_t * h, unsigned long key);
+
+#endif  // __HASH_H__
@@ -0,0 +1,16 @@
+#ifndef __JOBS_H__
+#define __JOBS_H__
+
+#include "common.h"
+
+// fixed pool of worker threads for data-parallel loops. the calling thread
+// takes part in the work, so a pool of n workers runs n + 1 ranges at once.
+
+typedef void (*jobs_range_fn)(unsigned int begin, unsigned int end, void * data);
+
+status_e jobs_init(unsigned int num_workers);
+unsigned int jobs_num_threads(void);
+// splits [0, count) into ranges of at most grain items and blocks until fn has run on all of them
+status_e jobs_parallel_for(unsigned int count, unsigned int grain, jobs_range_fn fn, void * data);
+
+#endif  // __JOBS_H__
@@ -0,0 +1,99 @@
+#ifndef __MATH3D_H__
+#define __MATH3D_H__
+
+#include "common.h"
+
+// vector, matrix and quaternion math. matrices are column-major like OpenGL's.
+// SSE/AVX paths are chosen at compile time (see the simd option in SConstruct),
+// the scalar path is always built so results can be compared against it.
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define MATH_ALIGN(n) __attribute__((aligned(n)))
+#else
+#   define MATH_ALIGN(n)
+#endif
+
+typedef struct
+{
+    float x, y, z;
+} vec3_t;
+
+typedef struct
+{
+    float x, y, z, w;
+} MATH_ALIGN(16) vec4_t;
+
+typedef struct
+{
+    float m[16];
+} MATH_ALIGN(16) mat4_t;
+
+typedef struct
+{
+    float x, y, z, w;
+} MATH_ALIGN(16) quat_t;
+
+vec3_t vec3_make(float x, float y, float z);
+vec3_t vec3_add(vec3_t a, vec3_t b);
+vec3_t vec3_sub(vec3_t a, vec3_t b);
+vec3_t vec3_scale(vec3_t v, float s);
+vec3_t vec3_mul(vec3_t a, vec3_t b);
+vec3_t vec3_min(vec3_t a, vec3_t b);
+vec3_t vec3_max(vec3_t a, vec3_t b);
+vec3_t vec3_lerp(vec3_t a, vec3_t b, float t);
+float vec3_dot(vec3_t a, vec3_t b);
+vec3_t vec3_cross(vec3_t a, vec3_t b);
+float vec3_length(vec3_t v);
+vec3_t vec3_normalize(vec3_t v);
+
+vec4_t vec4_make(float x, float y, float z, float w);
+vec4_t vec4_add(vec4_t a, vec4_t b);
+vec4_t vec4_scale(vec4_t v, float s);
+vec4_t vec4_lerp(vec4_t a, vec4_t b, float t);
+float vec4_dot(vec4_t a, vec4_t b);
+
+void mat4_identity(mat4_t * out);
+void mat4_mul(mat4_t * out, const mat4_t * a, const mat4_t * b);
+vec4_t mat4_mul_vec4(const mat4_t * m, vec4_t v);
+vec3_t mat4_mul_point(const mat4_t * m, vec3_t p);
+void mat4_transpose(mat4_t * out, const mat4_t * m);
+int mat4_inverse(mat4_t * out, const mat4_t * m);
+void mat4_translation(mat4_t * out, vec3_t t);
+void mat4_scaling(mat4_t * out, vec3_t s);
+void mat4_rotation(mat4_t * out, float angle_degrees, vec3_t axis);
+void mat4_from_quat(mat4_t * out, quat_t q);
+void mat4_perspective(mat4_t * out, float fovy_degrees, float aspect, float z_near, float z_far);
+void mat4_compose(mat4_t * out, vec3_t pos, vec3_t scale, quat_t rotation);
+
+quat_t quat_identity(void);
+quat_t quat_from_axis_angle(vec3_t axis, float angle_degrees);
+quat_t quat_mul(quat_t a, quat_t b);
+quat_t quat_normalize(quat_t q);
+quat_t quat_nlerp(quat_t a, quat_t b, float t);
+quat_t quat_slerp(quat_t a, quat_t b, float t);
+vec3_t quat_rotate(quat_t q, vec3_t v);
+
+// builds translate * scale * rotate model matrices (the order glTranslatef,
+// glScalef, glRotatef produce) for count objects. consecutive matrices are
+// written out_stride floats apart so they can land directly in interleaved
+// buffers; pass 16 for a packed mat4_t array.
+void mat4_compose_batch(float * out, unsigned int out_stride,
+        const vec3_t * pos, const vec3_t * scale, const quat_t * rotation, unsigned int count);
+void mat4_compose_batch_scalar(float * out, unsigned int out_stride,
+        const vec3_t * pos, const vec3_t * scale, const quat_t * rotation, unsigned int count);
+// interpolate count values stored component by component, component c of value idx at a[c][idx] (keyframes
+// gathered from many tracks, say), each with its own t. out may alias a.
+void vec_lerp_batch(float * const * out, const float * const * a, const float * const * b, const float * t,
+        unsigned int components, unsigned int count);
+void vec_lerp_batch_scalar(float * const * out, const float * const * a, const float * const * b, const float * t,
+        unsigned int components, unsigned int count);
+// the same for unit quaternions (x, y, z, w), along the shorter arc. slerp's acos and sines do not vectorize,
+// so this is nlerp with t first bent by a polynomial fitted to slerp's pace (after Kapoulkine's onlerp):
+// within 0.1 degree of quat_slerp, against 8 for plain nlerp
+void quat_slerp_batch(float * const * out, const float * const * a, const float * const * b, const float * t,
+        unsigned int count);
+void quat_slerp_batch_scalar(float * const * out, const float * const * a, const float * const * b, const float * t,
+        unsigned int count);
+const char * math3d_simd_name(void);
+
+#endif  // __MATH3D_H__
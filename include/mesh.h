@@ -0,0 +1,36 @@
+#ifndef __MESH_H__
+#define __MESH_H__
+
+#include "common.h"
+
+// indexed triangle lists and the optimizations done on them before upload.
+// welding merges vertices with identical position and normal, and every
+// primitive type is turned into plain triangles. the index order is then
+// tuned for the post-transform vertex cache (Forsyth's linear-speed
+// algorithm), and vertices are renumbered in first-use order so fetching
+// them walks memory forward.
+
+#define MESH_CACHE_SIZE 16     // FIFO size assumed when measuring ACMR
+
+typedef struct
+{
+    GLfloat * vertices;
+    GLfloat * normals;
+    unsigned int num_vertices;
+    unsigned int * indices;     // GL_TRIANGLES
+    unsigned int num_indices;
+} mesh_t;
+
+// indices may be NULL, in which case vertex_mode walks the vertices in order; otherwise it walks
+// num_indices indices of index_type (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT)
+status_e mesh_build(mesh_t * mesh, const GLfloat * vertices, const GLfloat * normals, GLsizei num_vertices,
+        const GLvoid * indices, GLsizei num_indices, GLenum index_type, GLenum vertex_mode);
+void mesh_destroy(mesh_t * mesh);
+status_e mesh_optimize_vertex_cache(mesh_t * mesh);
+status_e mesh_optimize_vertex_fetch(mesh_t * mesh);
+// average cache miss ratio: vertices transformed per triangle with a FIFO cache of cache_size entries
+float mesh_acmr(const unsigned int * indices, unsigned int num_indices, unsigned int num_vertices, unsigned int cache_size);
+// expands to non-indexed GL_TRIANGLES, num_indices vertices in malloc'ed arrays owned by the caller
+status_e mesh_unindex(const mesh_t * mesh, GLfloat ** out_vertices, GLfloat ** out_normals);
+
+#endif  // __MESH_H__
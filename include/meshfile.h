@@ -0,0 +1,64 @@
+#ifndef __MESHFILE_H__
+#define __MESHFILE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "mesh.h"
+#include "render.h"
+
+// binary mesh container, laid out exactly as the renderer draws it so a file
+// is mmap'ed and its streams are handed to render_def_t without parsing or
+// copying. little endian; a header describes up to MESHFILE_MAX_LEVELS
+// levels of detail, each being positions, normals (3 floats per vertex) and
+// GL_TRIANGLES indices (16-bit when the level has at most 65536 vertices).
+// every stream starts at a multiple of MESHFILE_ALIGN from the file start.
+// the streams are expected to be welded and cache-ordered already (see
+// tools/obj2mesh.c); index values are trusted, only the header is checked.
+
+#define MESHFILE_MAGIC "OEMF"
+#define MESHFILE_VERSION 1
+#define MESHFILE_ALIGN 64
+#define MESHFILE_MAX_LEVELS RENDER_MAX_LODS
+
+typedef struct
+{
+    uint32_t num_vertices;
+    uint32_t num_indices;
+    uint32_t index_size;            // 2 or 4 bytes
+    float distance;                 // view distance from which this level is drawn, 0 for the finest
+    uint64_t vertex_offset;         // byte offsets from the start of the file
+    uint64_t normal_offset;
+    uint64_t index_offset;
+} meshfile_level_t;
+
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t header_size;           // sizeof(meshfile_header_t) when written
+    uint32_t num_levels;
+    float bounds_min[3];
+    float bounds_max[3];
+    float bounds_center[3];
+    float bounds_radius;
+    meshfile_level_t levels[MESHFILE_MAX_LEVELS];
+} meshfile_header_t;
+
+typedef struct
+{
+    void * data;
+    size_t size;
+    const meshfile_header_t * header;
+} meshfile_t;
+
+status_e meshfile_open(meshfile_t * file, const char * path);
+status_e meshfile_close(meshfile_t * file);
+// points def's geometry, levels of detail and bounds into the mapping and marks it
+// RENDER_DEF_PREBUILT, so the file must stay open for as long as def is registered
+status_e meshfile_fill_def(const meshfile_t * file, render_def_t * def);
+// levels must be ready to draw (see mesh_optimize_vertex_cache), distances has one entry per level
+status_e meshfile_write(const char * path, const mesh_t * levels, const GLfloat * distances, unsigned int num_levels);
+
+#endif  // __MESHFILE_H__
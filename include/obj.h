@@ -0,0 +1,17 @@
+#ifndef __OBJ_H__
+#define __OBJ_H__
+
+#include <stddef.h>
+
+#include "common.h"
+#include "mesh.h"
+
+// Wavefront OBJ geometry. only v, vn and f statements are read: faces with
+// more than three corners are fanned, corners are v, v/vt, v//vn or v/vt/vn
+// with 1-based or negative (relative) indices, and faces without normals get
+// their face normal. the result is welded but not reordered (see mesh.h).
+status_e obj_load(const char * path, mesh_t * mesh);
+// text[length] must be '\0'
+status_e obj_parse(const char * text, size_t length, mesh_t * mesh);
+
+#endif  // __OBJ_H__
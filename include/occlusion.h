@@ -0,0 +1,42 @@
+#ifndef __OCCLUSION_H__
+#define __OCCLUSION_H__
+
+#include "common.h"
+#include "math3d.h"
+
+// CPU occlusion culling. occluder triangles are rasterized into a small depth
+// buffer (nearest depth per texel, tiles in parallel), then a hierarchical-Z
+// pyramid keeps the farthest depth of each 2x2 block one level up. a box is
+// occluded when its nearest point lies behind the farthest occluder depth
+// over the screen rectangle it covers.
+
+#define OCCLUSION_TILE 32
+#define OCCLUSION_MAX_LEVELS 10
+
+typedef struct
+{
+    unsigned int width;             // powers of two, at least OCCLUSION_TILE
+    unsigned int height;
+    unsigned int num_levels;
+    float * levels[OCCLUSION_MAX_LEVELS];   // depth in [0, 1], level 0 being the rasterized buffer
+    float * triangles;              // screen-space occluder triangles, x, y, z per corner
+    unsigned int num_triangles;
+    unsigned int triangle_capacity;
+    float * projected;              // scratch for one occluder's vertices, x, y, z and whether it is in front of the near plane
+    unsigned int projected_capacity;
+    mat4_t view_projection;
+} occlusion_t;
+
+status_e occlusion_init(occlusion_t * occ, unsigned int width, unsigned int height);
+status_e occlusion_destroy(occlusion_t * occ);
+// clears the buffer and drops last frame's occluders
+void occlusion_begin(occlusion_t * occ, const mat4_t * view_projection);
+// queues the geometry of vertex_mode (see simplify_triangle_corner), placed in the world by model.
+// indices may be NULL, otherwise vertex_mode walks num_indices indices of index_type as in mesh_build
+status_e occlusion_add_occluder(occlusion_t * occ, const mat4_t * model, const GLfloat * vertices, GLsizei num_vertices,
+        const GLvoid * indices, GLsizei num_indices, GLenum index_type, GLenum vertex_mode);
+void occlusion_rasterize(occlusion_t * occ);
+// 1 when the world-space box may be visible, 0 when it is hidden behind the occluders
+int occlusion_test_aabb(const occlusion_t * occ, vec3_t min, vec3_t max);
+
+#endif  // __OCCLUSION_H__
@@ -0,0 +1,76 @@
+#ifndef __REGION_H__
+#define __REGION_H__
+
+#include <stdint.h>
+
+#include "common.h"
+#include "math3d.h"
+#include "voxel.h"
+
+// voxel worlds paged from disk around the camera. the world is cut into
+// regions of REGION_CHUNKS^3 chunks, each kept in its own file: a header
+// with an offset table, then every chunk that has solid blocks, deflated
+// on its own so one can be read without the others. a background thread
+// reads and inflates the regions within the streaming radius, nearest
+// first; region_stream_update hands their chunks to the voxel world a few
+// at a time and drops regions that fell out of range, farthest first, or
+// once the memory budget is reached. little endian.
+// only the thread owning the context may call these, except region_write.
+
+#define REGION_MAGIC "OERF"
+#define REGION_VERSION 1
+#define REGION_BITS 3
+#define REGION_CHUNKS (1 << REGION_BITS)                    // per axis
+#define REGION_MAX_CHUNKS (REGION_CHUNKS * REGION_CHUNKS * REGION_CHUNKS)
+#define REGION_SIZE (REGION_CHUNKS * VOXEL_CHUNK_SIZE)      // in blocks
+#define REGION_MAX_PATH 256
+#define REGION_APPLY_CHUNKS 32      // chunks handed to or taken from the voxel world per update at most
+
+typedef struct
+{
+    uint64_t offset;                // from the start of the file, 0 for a chunk of air
+    uint32_t size;                  // deflated
+    uint32_t num_solid;
+} region_entry_t;
+
+// chunks are indexed x fastest, then y, then z, within the region
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t header_size;           // sizeof(region_header_t) when written
+    uint32_t chunk_size;            // VOXEL_CHUNK_SIZE when written
+    int32_t coords[3];              // in regions
+    uint32_t num_chunks;            // entries with an offset
+    region_entry_t entries[REGION_MAX_CHUNKS];
+} region_header_t;
+
+typedef struct
+{
+    unsigned long regions_loaded;
+    unsigned long regions_unloaded;
+    unsigned long regions_evicted;  // unloaded while still in range, to stay within the budget
+    unsigned long chunks_applied;
+    unsigned long bytes_read;
+    unsigned long read_errors;
+    unsigned int regions_resident;  // loaded, or being handed to the voxel world
+    unsigned int regions_pending;   // queued for or being read by the I/O thread
+    size_t resident_bytes;          // chunk storage of the resident regions
+    size_t budget_bytes;
+} region_stats_t;
+
+// the file holding the region at rx, ry, rz under dir; fails rather than cut the name short
+status_e region_path(char * path, size_t len, const char * dir, int rx, int ry, int rz);
+// writes the chunks world holds in the region at rx, ry, rz to path
+status_e region_write(const char * path, const voxel_world_t * world, int rx, int ry, int rz);
+
+// streams regions from dir into world, keeping those within radius (in blocks) of the camera and
+// at most budget_bytes of chunk storage. dir must leave room in REGION_MAX_PATH for the file names.
+status_e region_stream_start(voxel_world_t * world, const char * dir, float radius, size_t budget_bytes);
+// stops the I/O thread; the chunks handed over stay in the world
+void region_stream_stop(void);
+// call once a frame with the camera position in world space
+void region_stream_update(vec3_t camera);
+void region_stream_get_stats(region_stats_t * stats);
+
+#endif  // __REGION_H__
@@ -2,6 +2,7 @@
 #define __RENDER_H__
 
 #include "common.h"
+#include "math3d.h"
 
 typedef enum
 {
@@ -9,6 +10,68 @@ typedef enum
     render_object_count
 } render_object_e;
 
+#define RENDER_MAX_LODS 4
+
+// render_def_t flags
+#define RENDER_DEF_PREBUILT 0x1     // geometry, levels and bounds are already indexed, welded, cache-ordered GL_TRIANGLES
+                                    // (e.g. filled by meshfile_fill_def), so they are drawn in place and never copied
+
+typedef struct
+{
+    GLfloat * vertices;
+    GLfloat * normals;
+    GLsizei num_vertices;
+    GLenum vertex_mode;
+    GLvoid * indices;               // optional, vertex_mode then walks num_indices of these instead of the vertices
+    GLsizei num_indices;
+    GLenum index_type;              // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    GLfloat distance;               // view distance from which this level replaces the finer ones
+} render_lod_t;
+
+typedef struct
+{
+    unsigned long id;               // key in the renderer's def table, must be unique
+    GLfloat * vertices; 
+    GLfloat * normals;
+    GLsizei num_vertices;
+    GLenum vertex_mode;
+    GLvoid * indices;               // optional index buffer, as in render_lod_t
+    GLsizei num_indices;
+    GLenum index_type;
+    unsigned int flags;             // RENDER_DEF_* bits
+    unsigned int sort_slot;         // render queue grouping key (managed by the renderer)
+    GLfloat bounds_min[3];          // local-space AABB (computed by render_add_def unless prebuilt)
+    GLfloat bounds_max[3];
+    GLfloat bounds_center[3];       // local-space bounding sphere (computed by render_add_def unless prebuilt)
+    GLfloat bounds_radius;
+    // coarser levels by increasing distance, the arrays above being the finest. levels that only
+    // have a distance set are generated from the full mesh by render_add_def.
+    render_lod_t lods[RENDER_MAX_LODS - 1];
+    unsigned int num_lods;
+    // what is actually drawn for each level: welded, indexed GL_TRIANGLES in vertex cache order (managed by the renderer)
+    render_lod_t meshes[RENDER_MAX_LODS];
+    GLfloat acmr_before;            // vertices transformed per triangle of the finest level as given and as drawn
+    GLfloat acmr_after;             // (computed by render_add_def unless prebuilt)
+    // core backend copies of meshes: vertex array, vertex buffer (positions then normals) and index buffer
+    // per level, uploaded the first time a level is drawn (managed by the renderer)
+    GLuint gpu_arrays[RENDER_MAX_LODS];
+    GLuint gpu_buffers[RENDER_MAX_LODS][2];
+    // where meshes were placed in the core backend's shared buffers for indirect drawing, valid
+    // while mega_generation is current (managed by the renderer)
+    GLuint mega_first_index[RENDER_MAX_LODS];
+    GLint mega_base_vertex[RENDER_MAX_LODS];
+    unsigned long mega_generation;
+} render_def_t;
+
+// objects are stored by the renderer and referred to by handle. a handle goes stale when its
+// object is destroyed, so it never aliases a later object.
+typedef unsigned int render_handle_t;
+
+#define RENDER_NULL_HANDLE 0
+
+// compatibility record for render_add_object: the renderer copies it into an object of its own,
+// so after writing fields of an added ctx directly, render_ctx_mark_dirty must be called (the
+// render_ctx_set_* helpers do it) for the change to show
 typedef struct
 {
     GLfloat pos[4];
@@ -19,25 +82,151 @@ typedef struct
     render_object_e object_type;    // pre-defined object type whose def to use
     unsigned long def_id;           // points to the associated render def
     GLenum polygon_mode;
+    int is_static;                  // see render_object_set_static
+    render_def_t * def;             // cached def_id resolution for render_object (managed by the renderer)
+    unsigned long def_generation;   // def registry generation the cached def was resolved in
+    render_handle_t handle;         // object created by render_add_object (managed by the renderer)
 } render_ctx_t;
 
+typedef enum
+{
+    render_backend_fixed = 0,       // compatibility profile: fixed-function lighting and the matrix stack
+    render_backend_core,            // 3.3 core profile: GLSL lighting fed from uniform buffers
+} render_backend_e;
+
+// mirrors the fixed-function light 0 and front material with GL_COLOR_MATERIAL driving
+// ambient and diffuse from each object's color, so both backends light alike
 typedef struct
 {
-    unsigned long id; // TODO hash table mapping id -> def
-    GLfloat * vertices; 
-    GLfloat * normals;
-    GLsizei num_vertices;
-    GLenum vertex_mode;
-} render_def_t;
+    int enabled;
+    GLfloat global_ambient[4];
+    GLfloat light_position[4];      // eye space, w = 0 for a directional light
+    GLfloat light_ambient[4];
+    GLfloat light_diffuse[4];
+    GLfloat light_specular[4];
+    GLfloat material_specular[4];
+    GLfloat material_shininess;
+} render_lighting_t;
+
+#define RENDER_STATS_HISTORY 128   // frames kept for render_get_stats_history
+
+typedef struct
+{
+    unsigned long objects_submitted;
+    unsigned long objects_culled;
+    unsigned long objects_occluded;     // passed frustum culling but hidden behind occluders
+    GLfloat occluded_percent;           // share of the frustum-visible objects that were occluded
+    unsigned long draw_calls;
+    unsigned long indirect_draws;       // draws packed into multi-draw-indirect calls
+    unsigned long vertices_submitted;   // indices drawn, once per instance
+    unsigned long primitives_submitted;
+    unsigned long state_changes;        // the three below, plus pass, vertex source, vertex array and program changes
+    unsigned long polygon_mode_changes;
+    unsigned long attrib_stack_ops;     // glPushAttrib and glPopAttrib
+    unsigned long buffer_binds;
+    unsigned long bytes_uploaded;       // buffer data and streamed spans
+    unsigned long def_gpu_bytes;        // held by defs and static batches in GPU buffers when the stats were taken, not per frame
+} render_stats_t;
+
+typedef struct
+{
+    void * data;                    // write-only, and only until the next render_prerender
+    GLuint buffer;
+    GLintptr offset;                // of data within buffer
+    GLsizeiptr size;
+} render_stream_span_t;
+
+// return 0 to stop a query early
+typedef int (*render_query_cb)(render_handle_t object, void * data);
+
+typedef struct
+{
+    GLfloat origin[3];
+    GLfloat direction[3];           // normalized by the query, so distances are in world units
+    GLfloat max_distance;
+} render_ray_t;
+
+typedef struct
+{
+    render_handle_t object;         // RENDER_NULL_HANDLE when the ray hit nothing
+    GLfloat distance;               // -1 when the ray hit nothing
+    GLfloat point[3];               // world space
+    GLfloat normal[3];              // world space, of the triangle hit, facing back along the ray
+    unsigned int triangle;          // in the finest level of the object's def
+} render_ray_hit_t;
 
 status_e render_init(void);
+// picks the backend from the current context: core profile contexts get render_backend_core
 status_e render_prerun(void);
+render_backend_e render_get_backend(void);
+void render_set_lighting(const render_lighting_t * lighting);
 void render_prerender(void);
+// the core backend has no matrix stack, so it draws with identity matrices until this is called
+void render_set_camera(const mat4_t * view, const mat4_t * projection);
 void render_objects(void);
-void render_object(const render_ctx_t * ctx);
+void render_object(render_ctx_t * ctx);
+// new objects sit at the origin, unscaled, unrotated, white and filled. def_id is only used when type is render_object_count.
+render_handle_t render_create_object(render_object_e type, unsigned long def_id);
+status_e render_destroy_object(render_handle_t object);
+int render_object_valid(render_handle_t object);
+void render_object_set_position(render_handle_t object, GLfloat x, GLfloat y, GLfloat z);
+void render_object_set_scale(render_handle_t object, GLfloat x, GLfloat y, GLfloat z);
+void render_object_set_rotation(render_handle_t object, GLfloat angle, GLfloat x, GLfloat y, GLfloat z);
+void render_object_set_color(render_handle_t object, GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+void render_object_set_polygon_mode(render_handle_t object, GLenum polygon_mode);
+// static objects are merged with the others in their grid cell and polygon mode into one world-space batch,
+// drawn with one call when any of them is visible. changing one rebuilds its batch, so leave moving objects dynamic.
+void render_object_set_static(render_handle_t object, int is_static);
+// set one field of many objects at once, such as an animation's samples; handles that no longer resolve are skipped
+void render_objects_set_positions(const render_handle_t * objects, const vec3_t * positions, unsigned int count);
+void render_objects_set_scales(const render_handle_t * objects, const vec3_t * scales, unsigned int count);
+void render_objects_set_rotations(const render_handle_t * objects, const quat_t * rotations, unsigned int count);
+void render_objects_set_colors(const render_handle_t * objects, const vec4_t * colors, unsigned int count);
+status_e render_object_get_position(render_handle_t object, GLfloat pos[3]);
+// world-space AABB as of the last render_objects call, or since the object was created
+status_e render_object_get_bounds(render_handle_t object, GLfloat min[3], GLfloat max[3]);
+// the ctx an object was added through, NULL for objects made with render_create_object
+render_ctx_t * render_object_get_ctx(render_handle_t object);
+// render_ctx_t shim: the ctx is copied into a new object, and setting through either side updates both
 status_e render_add_object(render_ctx_t * ctx);
 status_e render_remove_object(render_ctx_t * ctx);
+void render_ctx_set_position(render_ctx_t * ctx, GLfloat x, GLfloat y, GLfloat z);
+void render_ctx_set_scale(render_ctx_t * ctx, GLfloat x, GLfloat y, GLfloat z);
+void render_ctx_set_rotation(render_ctx_t * ctx, GLfloat angle, GLfloat x, GLfloat y, GLfloat z);
+void render_ctx_mark_dirty(render_ctx_t * ctx);
 status_e render_add_def(render_def_t * def);
+// rebuilds a registered def from its changed source arrays, as removing and adding it would, but the objects
+// drawing it keep it
+status_e render_update_def(render_def_t * def);
 status_e render_remove_def(render_def_t * def);
+void render_set_instancing(int enabled);
+// core backend only: draw all runs of equal pass and polygon mode with one multi-draw-indirect call
+void render_set_indirect(int enabled);
+void render_set_culling(int enabled);
+void render_set_occlusion_culling(int enabled);
+// counters of the frame so far, from every thread
+void render_get_stats(render_stats_t * stats);
+// closes the frame's counters into the history and starts new ones (engine_run calls it after each frame)
+void render_stats_next_frame(void);
+// copies up to max_frames of the latest closed frames, oldest first, and returns how many there were
+unsigned int render_get_stats_history(render_stats_t * history, unsigned int max_frames);
+// scratch space in a GPU buffer for data drawn this frame only, alignment being a power of two (the uniform
+// buffer offset alignment for spans bound as uniform buffers). fails once the frame's region is full, which
+// grows it from the next frame on. leaves GL_ARRAY_BUFFER unbound.
+status_e render_stream_alloc(GLsizeiptr size, GLsizeiptr alignment, render_stream_span_t * span);
+// call between writing spans and drawing from them
+void render_stream_flush(void);
+// spatial queries over the added objects where they were last placed: objects created or moved since the last
+// render_objects are indexed first, all together
+unsigned int render_query_aabb(const GLfloat min[3], const GLfloat max[3], render_query_cb cb, void * data);
+unsigned int render_query_frustum(const mat4_t * view_projection, render_query_cb cb, void * data);
+render_handle_t render_query_nearest(const GLfloat point[3], GLfloat max_distance, GLfloat * distance);
+// nearest object whose triangles the ray crosses within max_distance: candidates come from the spatial index and
+// their exact world bounds, then the finest level of their def is tested triangle by triangle. returns 1 on a hit.
+// a line of sight between two points is clear when a ray from one with max_distance reaching the other misses.
+int render_raycast(const render_ray_t * ray, render_ray_hit_t * hit);
+// casts count rays on the job workers, neighbors traced together as one packet, so rays that start and head
+// alike should be next to each other. returns how many hit.
+unsigned int render_raycast_batch(const render_ray_t * rays, unsigned int count, render_ray_hit_t * hits);
 
 #endif  // __RENDER_H__
@@ -0,0 +1,17 @@
+#ifndef __SHADER_H__
+#define __SHADER_H__
+
+#include "common.h"
+
+typedef struct
+{
+    GLuint location;
+    const char * name;
+} shader_attrib_t;
+
+status_e shader_compile(GLenum type, const char * source, GLuint * shader);
+status_e shader_create_program(const char * vertex_source, const char * fragment_source,
+        const shader_attrib_t * attribs, unsigned int num_attribs, GLuint * program);
+status_e shader_destroy_program(GLuint program);
+
+#endif  // __SHADER_H__
@@ -0,0 +1,18 @@
+#ifndef __SIMPLIFY_H__
+#define __SIMPLIFY_H__
+
+#include "common.h"
+
+// quadric error metric edge-collapse simplification (Garland/Heckbert).
+// takes non-indexed GL_TRIANGLES, GL_QUADS, GL_TRIANGLE_STRIP or
+// GL_TRIANGLE_FAN geometry, welds coincident positions and collapses edges
+// until at most target_triangles remain. the result is non-indexed
+// GL_TRIANGLES with normals smoothed across edges flatter than a crease
+// angle. *out_vertices and *out_normals are malloc'ed and owned by the caller.
+status_e simplify_mesh(const GLfloat * vertices, GLsizei num_vertices, GLenum vertex_mode, unsigned int target_triangles,
+        GLfloat ** out_vertices, GLfloat ** out_normals, GLsizei * out_num_vertices);
+unsigned int simplify_count_triangles(GLsizei num_vertices, GLenum vertex_mode);
+// index of the vertex making up corner (0-2) of triangle tri when geometry of vertex_mode is split into triangles
+unsigned int simplify_triangle_corner(GLsizei tri, int corner, GLenum vertex_mode);
+
+#endif  // __SIMPLIFY_H__
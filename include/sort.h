@@ -0,0 +1,11 @@
+#ifndef __SORT_H__
+#define __SORT_H__
+
+#include "common.h"
+
+// stable LSD radix sort of 64-bit keys carrying a 32-bit payload each.
+// tmp_keys and tmp_values must hold count elements; the result ends up in keys/values.
+void sort_radix_u64(unsigned long long * keys, unsigned int * values,
+        unsigned long long * tmp_keys, unsigned int * tmp_values, unsigned int count);
+
+#endif  // __SORT_H__
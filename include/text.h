@@ -0,0 +1,44 @@
+#ifndef __TEXT_H__
+#define __TEXT_H__
+
+#include "common.h"
+
+// batched text for HUDs and overlays. glyphs are rasterized with FreeType once
+// into a single-channel atlas texture, packed in shelves; the atlas doubles
+// when full and then evicts its least recently used shelf. strings are laid
+// out once into cached runs of positioned quads, so drawing a string that was
+// drawn before is a copy. everything queued in a frame goes out as one vertex
+// buffer and one draw per TEXT_BATCH_GLYPHS glyphs, on either render backend.
+// only the thread owning the context may call these.
+
+#define TEXT_MAX_FONTS 8
+#define TEXT_BATCH_GLYPHS 16384     // quads one draw can index with 16-bit indices
+
+// 0 is never a valid font
+typedef unsigned int text_font_t;
+
+typedef struct
+{
+    unsigned long glyphs_drawn;
+    unsigned long draw_calls;
+    unsigned long glyphs_rasterized;    // atlas misses
+    unsigned long shelves_evicted;
+    unsigned long runs_laid_out;        // run cache misses
+    unsigned int atlas_width;
+    unsigned int atlas_height;
+} text_stats_t;
+
+status_e text_init(void);
+// creates the atlas texture and program for the current context, after render_prerun picked the backend
+status_e text_prerun(void);
+status_e text_load_font(const char * path, unsigned int pixel_height, text_font_t * font);
+// queues UTF-8 text with the top left of its first line at x, y in pixels from the top left of the
+// viewport. '\n' starts a new line.
+status_e text_draw(text_font_t font, GLfloat x, GLfloat y, const char * str, const GLfloat color[4]);
+status_e text_measure(text_font_t font, const char * str, GLfloat * width, GLfloat * height);
+// draws everything queued since the last flush over the viewport (the engine calls it after the postrender callback)
+void text_flush(void);
+// counters of the last flushed frame, except the atlas size which is current
+void text_get_stats(text_stats_t * stats);
+
+#endif  // __TEXT_H__
@@ -0,0 +1,88 @@
+#ifndef __VOXEL_H__
+#define __VOXEL_H__
+
+#include "common.h"
+#include "hash.h"
+#include "array.h"
+#include "render.h"
+
+// block worlds stored as dense VOXEL_CHUNK_SIZE^3 chunks, each drawn as one
+// render object with one def. a chunk is meshed whole: faces between two
+// solid blocks are dropped, including across chunk borders, and the faces
+// left in each slice are merged greedily into the largest rectangles, so a
+// flat wall is two triangles per chunk. setting a block marks its chunk,
+// and the neighbors it borders, for remeshing; voxel_world_update meshes all
+// marked chunks on the job workers and rebuilds their defs in place.
+// the update waits for its meshes: the jobs read the blocks of each chunk and
+// its six neighbors, which the caller may change or unload as soon as it
+// returns, and the job pool runs one loop at a time, so meshes left running
+// would hold up culling and ray casts as well. the mesh budget bounds the
+// wait instead.
+// only the thread owning the context may call these.
+
+#define VOXEL_CHUNK_BITS 5
+#define VOXEL_CHUNK_SIZE (1 << VOXEL_CHUNK_BITS)
+#define VOXEL_CHUNK_BLOCKS (VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE)
+
+// 0 is air, anything else is solid
+typedef unsigned char voxel_block_t;
+
+typedef struct
+{
+    int coords[3];                              // in chunks; the chunk spans coords * VOXEL_CHUNK_SIZE up
+    voxel_block_t blocks[VOXEL_CHUNK_BLOCKS];   // x fastest, then y, then z
+    unsigned int num_solid;
+    int dirty;
+    render_def_t def;                           // registered while it has geometry
+    render_handle_t object;
+    // what the last meshing produced, GL_TRIANGLES in chunk-local block units
+    GLfloat * vertices;
+    GLfloat * normals;
+    GLvoid * indices;
+    unsigned int num_vertices;
+    unsigned int num_indices;
+    unsigned int num_faces;                     // faces next to air, before merging
+    unsigned int num_quads;                     // after merging
+} voxel_chunk_t;
+
+typedef struct
+{
+    unsigned long chunks_meshed;
+    unsigned long solid_blocks;                 // in the chunks meshed, 12 triangles each drawn as cubes
+    unsigned long faces_visible;                // 2 triangles each with hidden-face removal alone
+    unsigned long quads;                        // 2 triangles each after greedy merging
+    double mesh_seconds;                        // wall time of the meshing jobs
+} voxel_stats_t;
+
+typedef struct
+{
+    hash_t chunks;                              // by packed coords
+    array_t list;
+    array_t dirty;                              // chunks to remesh at the next update
+    unsigned long next_def_id;
+    unsigned int mesh_budget;                   // chunks meshed per update at most, 0 for all
+    GLfloat color[4];
+    voxel_stats_t stats;
+} voxel_world_t;
+
+// chunk defs get ids from def_id_base up, which must not collide with other defs
+status_e voxel_world_init(voxel_world_t * world, unsigned long def_id_base);
+// destroys the chunk objects and removes their defs
+status_e voxel_world_destroy(voxel_world_t * world);
+void voxel_world_set_color(voxel_world_t * world, GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+status_e voxel_set_block(voxel_world_t * world, int x, int y, int z, voxel_block_t block);
+// replaces a whole chunk's blocks, creating it if needed
+status_e voxel_set_chunk(voxel_world_t * world, int cx, int cy, int cz, const voxel_block_t * blocks);
+// destroys a chunk and its object; its neighbors are remeshed with their faces against it showing
+status_e voxel_remove_chunk(voxel_world_t * world, int cx, int cy, int cz);
+// air outside any chunk
+voxel_block_t voxel_get_block(const voxel_world_t * world, int x, int y, int z);
+voxel_chunk_t * voxel_get_chunk(const voxel_world_t * world, int cx, int cy, int cz);
+// spreads remeshing over several updates, oldest changes first, to keep frame times even
+void voxel_world_set_mesh_budget(voxel_world_t * world, unsigned int max_chunks);
+// remeshes the chunks changed since the last update, up to the budget, returns how many were
+status_e voxel_world_update(voxel_world_t * world, unsigned int * num_meshed);
+// totals since voxel_world_init
+void voxel_get_stats(const voxel_world_t * world, voxel_stats_t * stats);
+
+#endif  // __VOXEL_H__
@@ -0,0 +1,392 @@
+#include <math.h>
+#include <string.h>
+
+#include "jobs.h"
+#include "logging.h"
+
+#include "anim.h"
+
+#define ANIM_GRAIN 256              // tracks per job range, gathered on the stack
+#define ANIM_CURSOR_STEPS 4         // keys walked forward from the cursor before searching instead
+
+struct __sample_job
+{
+    anim_channel_t * channel;
+    unsigned int components;
+    int rotation;
+    float delta;
+};
+
+static const unsigned int __components[anim_channel_count] = { 3, 4, 3, 4 };
+
+static status_e __anim_sanity_check(const anim_t * anim);
+static void __channel_free(anim_channel_t * channel);
+static status_e __track_reserve(anim_channel_t * channel, unsigned int capacity);
+static status_e __key_reserve(anim_channel_t * channel, unsigned int capacity);
+static unsigned int __key_search(const float * times, unsigned int begin, unsigned int end, float time);
+static unsigned int __key_find(const float * times, unsigned int count, unsigned int cursor, float time);
+static float __track_advance(anim_channel_t * channel, unsigned int track, float delta);
+static void __sample_range(unsigned int begin, unsigned int end, void * data);
+
+status_e anim_init(anim_t * anim)
+{
+    if (!anim)
+    {
+        LOG_ERROR("anim is NULL!\n");
+        return status_error;
+    }
+
+    memset(anim, 0, sizeof(anim_t));
+
+    return status_success;
+}
+
+status_e anim_destroy(anim_t * anim)
+{
+    status_e status = __anim_sanity_check(anim);
+    if (status != status_success) return status;
+
+    for (int channel = 0; channel < anim_channel_count; ++channel) __channel_free(&anim->channels[channel]);
+    memset(anim, 0, sizeof(anim_t));
+
+    return status_success;
+}
+
+status_e anim_add_track(anim_t * anim, render_handle_t object, anim_channel_e channel, const float * times,
+        const float * values, unsigned int count, int loop)
+{
+    anim_channel_t * ch = NULL;
+    unsigned int components = 0, track = 0;
+    status_e status = __anim_sanity_check(anim);
+    if (status != status_success) return status;
+
+    if (channel < 0 || channel >= anim_channel_count || !times || !values || count == 0)
+    {
+        LOG_ERROR("bad track! (channel = %d, times = %p, values = %p, count = %u)\n", channel, times, values, count);
+        return status_error;
+    }
+
+    for (unsigned int idx = 1; idx < count; ++idx)
+    {
+        if (!(times[idx] > times[idx - 1]))
+        {
+            LOG_ERROR("key times must increase (key %u at %f after %f)\n", idx, times[idx], times[idx - 1]);
+            return status_error;
+        }
+    }
+
+    ch = &anim->channels[channel];
+    components = __components[channel];
+
+    if (ch->num_tracks == ch->track_capacity && __track_reserve(ch, ch->track_capacity ? ch->track_capacity * 2 : 64) != status_success)
+    {
+        return status_error;
+    }
+
+    if (__key_reserve(ch, ch->num_keys + count) != status_success) return status_error;
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        const float * value = values + idx * components;
+        float scale = 1.0f;
+
+        if (channel == anim_rotation)
+        {
+            float len = sqrtf(value[0] * value[0] + value[1] * value[1] + value[2] * value[2] + value[3] * value[3]);
+
+            if (len == 0.0f)
+            {
+                LOG_ERROR("rotation key %u is not a rotation\n", idx);
+                return status_error;
+            }
+            scale = 1.0f / len;
+        }
+
+        ch->key_times[ch->num_keys + idx] = times[idx];
+        for (unsigned int c = 0; c < components; ++c) ch->key_values[c][ch->num_keys + idx] = value[c] * scale;
+    }
+
+    track = ch->num_tracks++;
+    ch->targets[track] = object;
+    ch->first_keys[track] = ch->num_keys;
+    ch->key_counts[track] = count;
+    ch->cursors[track] = 0;
+    ch->times[track] = times[0];
+    ch->speeds[track] = 1.0f;
+    ch->loops[track] = loop != 0;
+    ch->num_keys += count;
+
+    return status_success;
+}
+
+void anim_remove(anim_t * anim, render_handle_t object)
+{
+    if (__anim_sanity_check(anim) != status_success) return;
+
+    // tracks keep their order, so their keys, appended in the same order, can close up behind them
+    for (int channel = 0; channel < anim_channel_count; ++channel)
+    {
+        anim_channel_t * ch = &anim->channels[channel];
+        unsigned int kept = 0, keys = 0;
+
+        for (unsigned int track = 0; track < ch->num_tracks; ++track)
+        {
+            unsigned int first = ch->first_keys[track], count = ch->key_counts[track];
+
+            if (ch->targets[track] == object) continue;
+
+            memmove(ch->key_times + keys, ch->key_times + first, count * sizeof(float));
+            for (unsigned int c = 0; c < __components[channel]; ++c)
+            {
+                memmove(ch->key_values[c] + keys, ch->key_values[c] + first, count * sizeof(float));
+            }
+
+            ch->targets[kept] = ch->targets[track];
+            ch->first_keys[kept] = keys;
+            ch->key_counts[kept] = count;
+            ch->cursors[kept] = ch->cursors[track];
+            ch->times[kept] = ch->times[track];
+            ch->speeds[kept] = ch->speeds[track];
+            ch->loops[kept] = ch->loops[track];
+            keys += count;
+            ++kept;
+        }
+
+        ch->num_tracks = kept;
+        ch->num_keys = keys;
+    }
+}
+
+void anim_set_time(anim_t * anim, render_handle_t object, float time)
+{
+    if (__anim_sanity_check(anim) != status_success) return;
+
+    for (int channel = 0; channel < anim_channel_count; ++channel)
+    {
+        anim_channel_t * ch = &anim->channels[channel];
+
+        for (unsigned int track = 0; track < ch->num_tracks; ++track)
+        {
+            if (ch->targets[track] != object) continue;
+
+            ch->times[track] = ch->key_times[ch->first_keys[track]];
+            __track_advance(ch, track, time);
+        }
+    }
+}
+
+void anim_set_speed(anim_t * anim, render_handle_t object, float speed)
+{
+    if (__anim_sanity_check(anim) != status_success) return;
+
+    for (int channel = 0; channel < anim_channel_count; ++channel)
+    {
+        anim_channel_t * ch = &anim->channels[channel];
+
+        for (unsigned int track = 0; track < ch->num_tracks; ++track)
+        {
+            if (ch->targets[track] == object) ch->speeds[track] = speed;
+        }
+    }
+}
+
+void anim_sample(anim_t * anim, float delta)
+{
+    if (__anim_sanity_check(anim) != status_success) return;
+
+    for (int channel = 0; channel < anim_channel_count; ++channel)
+    {
+        struct __sample_job job = { &anim->channels[channel], __components[channel], channel == anim_rotation, delta };
+
+        jobs_parallel_for(job.channel->num_tracks, ANIM_GRAIN, __sample_range, &job);
+    }
+}
+
+void anim_apply(const anim_t * anim)
+{
+    const anim_channel_t * ch = NULL;
+
+    if (__anim_sanity_check(anim) != status_success) return;
+
+    ch = &anim->channels[anim_position];
+    if (ch->num_tracks) render_objects_set_positions(ch->targets, (const vec3_t *) ch->samples, ch->num_tracks);
+    ch = &anim->channels[anim_rotation];
+    if (ch->num_tracks) render_objects_set_rotations(ch->targets, (const quat_t *) ch->samples, ch->num_tracks);
+    ch = &anim->channels[anim_scale];
+    if (ch->num_tracks) render_objects_set_scales(ch->targets, (const vec3_t *) ch->samples, ch->num_tracks);
+    ch = &anim->channels[anim_color];
+    if (ch->num_tracks) render_objects_set_colors(ch->targets, (const vec4_t *) ch->samples, ch->num_tracks);
+}
+
+void anim_update(anim_t * anim, float delta)
+{
+    anim_sample(anim, delta);
+    anim_apply(anim);
+}
+
+static status_e __anim_sanity_check(const anim_t * anim)
+{
+    if (!anim)
+    {
+        LOG_ERROR("anim is NULL!\n");
+        return status_error;
+    }
+
+    return status_success;
+}
+
+static void __channel_free(anim_channel_t * channel)
+{
+    free(channel->key_times);
+    for (int c = 0; c < 4; ++c) free(channel->key_values[c]);
+    free(channel->targets);
+    free(channel->first_keys);
+    free(channel->key_counts);
+    free(channel->cursors);
+    free(channel->times);
+    free(channel->speeds);
+    free(channel->loops);
+    free(channel->samples);
+}
+
+// each realloc that succeeds is kept, so a failure halfway leaves the old capacity usable
+static status_e __track_reserve(anim_channel_t * channel, unsigned int capacity)
+{
+    void * p = NULL;
+
+    if (!(p = realloc(channel->targets, capacity * sizeof(render_handle_t)))) goto fail;
+    channel->targets = p;
+    if (!(p = realloc(channel->first_keys, capacity * sizeof(unsigned int)))) goto fail;
+    channel->first_keys = p;
+    if (!(p = realloc(channel->key_counts, capacity * sizeof(unsigned int)))) goto fail;
+    channel->key_counts = p;
+    if (!(p = realloc(channel->cursors, capacity * sizeof(unsigned int)))) goto fail;
+    channel->cursors = p;
+    if (!(p = realloc(channel->times, capacity * sizeof(float)))) goto fail;
+    channel->times = p;
+    if (!(p = realloc(channel->speeds, capacity * sizeof(float)))) goto fail;
+    channel->speeds = p;
+    if (!(p = realloc(channel->loops, capacity * sizeof(unsigned char)))) goto fail;
+    channel->loops = p;
+    // room for a whole quat_t or vec4_t per track whatever the channel
+    if (!(p = realloc(channel->samples, capacity * 4 * sizeof(float)))) goto fail;
+    channel->samples = p;
+    channel->track_capacity = capacity;
+
+    return status_success;
+
+fail:
+    LOG_ERROR("failed to allocate memory for %u tracks\n", capacity);
+    return status_error;
+}
+
+static status_e __key_reserve(anim_channel_t * channel, unsigned int capacity)
+{
+    void * p = NULL;
+
+    if (capacity <= channel->key_capacity) return status_success;
+
+    capacity = capacity > 2 * channel->key_capacity ? capacity : 2 * channel->key_capacity;
+    if (!(p = realloc(channel->key_times, capacity * sizeof(float)))) goto fail;
+    channel->key_times = p;
+    for (int c = 0; c < 4; ++c)
+    {
+        if (!(p = realloc(channel->key_values[c], capacity * sizeof(float)))) goto fail;
+        channel->key_values[c] = p;
+    }
+    channel->key_capacity = capacity;
+
+    return status_success;
+
+fail:
+    LOG_ERROR("failed to allocate memory for %u keys\n", capacity);
+    return status_error;
+}
+
+// the last key in [begin, end) at or before time, or begin if none is
+static unsigned int __key_search(const float * times, unsigned int begin, unsigned int end, float time)
+{
+    while (end - begin > 1)
+    {
+        unsigned int middle = begin + (end - begin) / 2;
+
+        if (times[middle] <= time) begin = middle;
+        else end = middle;
+    }
+
+    return begin;
+}
+
+// the key starting the segment time falls in, of the count - 1. time mostly moves on a little each update,
+// so the cursor's segment or one just after it is the likely answer
+static unsigned int __key_find(const float * times, unsigned int count, unsigned int cursor, float time)
+{
+    if (time < times[cursor]) return __key_search(times, 0, cursor, time);
+
+    for (int step = 0; cursor + 2 < count && times[cursor + 1] <= time; ++step, ++cursor)
+    {
+        if (step == ANIM_CURSOR_STEPS) return __key_search(times, cursor, count - 1, time);
+    }
+
+    return cursor;
+}
+
+// returns the track's new time, wrapped into its keys when looping and held at the ends otherwise
+static float __track_advance(anim_channel_t * channel, unsigned int track, float delta)
+{
+    const float * times = channel->key_times + channel->first_keys[track];
+    float start = times[0], length = times[channel->key_counts[track] - 1] - start;
+    float time = channel->times[track] + delta;
+
+    if (channel->loops[track] && length > 0.0f && (time < start || time >= start + length))
+    {
+        // a frame's step rarely goes round more than once, and fmodf costs more than all the rest
+        time = time >= start + length && time < start + 2.0f * length ? time - length : start + fmodf(time - start, length);
+        time = time < start ? time + length : time;
+    }
+    else if (!channel->loops[track])
+    {
+        time = time < start ? start : time > start + length ? start + length : time;
+    }
+
+    return channel->times[track] = time;
+}
+
+// finds each track's segment and gathers its keys component by component, then interpolates the lot
+static void __sample_range(unsigned int begin, unsigned int end, void * data)
+{
+    const struct __sample_job * job = data;
+    anim_channel_t * ch = job->channel;
+    unsigned int count = end - begin, components = job->components;
+    float a[4][ANIM_GRAIN], b[4][ANIM_GRAIN], t[ANIM_GRAIN], out[4][ANIM_GRAIN];
+    const float * ap[4] = { a[0], a[1], a[2], a[3] }, * bp[4] = { b[0], b[1], b[2], b[3] };
+    float * outp[4] = { out[0], out[1], out[2], out[3] };
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        unsigned int track = begin + idx, first = ch->first_keys[track], keys = ch->key_counts[track];
+        const float * times = ch->key_times + first;
+        float time = __track_advance(ch, track, job->delta * ch->speeds[track]);
+        unsigned int key = keys > 1 ? __key_find(times, keys, ch->cursors[track], time) : 0, next = keys > 1 ? key + 1 : 0;
+
+        ch->cursors[track] = key;
+        t[idx] = keys > 1 ? (time - times[key]) / (times[next] - times[key]) : 0.0f;
+        t[idx] = t[idx] < 0.0f ? 0.0f : t[idx] > 1.0f ? 1.0f : t[idx];
+
+        for (unsigned int c = 0; c < components; ++c)
+        {
+            a[c][idx] = ch->key_values[c][first + key];
+            b[c][idx] = ch->key_values[c][first + next];
+        }
+    }
+
+    if (job->rotation) quat_slerp_batch(outp, ap, bp, t, count);
+    else vec_lerp_batch(outp, ap, bp, t, components, count);
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        float * sample = ch->samples + (begin + idx) * components;
+
+        for (unsigned int c = 0; c < components; ++c) sample[c] = out[c][idx];
+    }
+}
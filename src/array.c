@@ -239,7 +239,7 @@ static status_e __array_resize(array_t * a, unsigned int size)
         }
     }
     
-    if (!(a->data = realloc(a->data, size)))
+    if (!(a->data = realloc(a->data, size * sizeof(void *))))
     {
         LOG_ERROR("array %p failed to resize to size %d\n", a, size);
         return status_error;
@@ -247,7 +247,7 @@ static status_e __array_resize(array_t * a, unsigned int size)
 
     if (size > a->capacity)
     {
-        memset(a->data + a->capacity, 0, size - a->capacity);
+        memset(a->data + a->capacity, 0, (size - a->capacity) * sizeof(void *));
     }
 
     a->capacity = size;
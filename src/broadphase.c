@@ -0,0 +1,667 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "logging.h"
+#include "sort.h"
+
+#include "broadphase.h"
+
+#define PROXY_IN_USE (-2)
+#define CELL_BITS 21
+#define CELL_MASK ((1ULL << CELL_BITS) - 1)
+#define SAP_BULK_INSERT 64          // endpoints added since the last update past which the axes are sorted anew
+#define SAP_SWAPS_PER_ENDPOINT 16   // what sorting an axis anew costs, in swaps, per endpoint
+#define SAP_TESTS_PER_SWAP 2        // rebuild sweep tests that cost about one swap
+
+// a box open in the rebuild sweep, its other two axes side by side so the sweep reads them in order
+typedef struct
+{
+    float min[2];
+    float max[2];
+    unsigned int proxy;
+} __open_box_t;
+
+static status_e __broadphase_sanity_check(const broadphase_t * bp);
+static int __proxy_valid(const broadphase_t * bp, int proxy);
+static status_e __proxy_reserve(broadphase_t * bp, unsigned int capacity);
+static status_e __endpoint_reserve(broadphase_t * bp, unsigned int capacity);
+static status_e __pair_reserve(broadphase_t * bp, unsigned int capacity);
+static status_e __cell_reserve(broadphase_t * bp, unsigned int capacity);
+static int __overlaps(const broadphase_t * bp, unsigned int a, unsigned int b);
+static unsigned long __pair_key(unsigned int a, unsigned int b);
+static void __pair_push(broadphase_t * bp, unsigned int a, unsigned int b);
+static void __pair_add(broadphase_t * bp, unsigned int a, unsigned int b);
+static void __pair_remove(broadphase_t * bp, unsigned int a, unsigned int b);
+static double __sap_read_axis(broadphase_t * bp, int axis);
+static int __sap_sort_axis(broadphase_t * bp, int axis, unsigned long budget);
+static void __sap_rebuild(broadphase_t * bp);
+static unsigned long long __endpoint_key(float value, unsigned int proxy);
+static unsigned long long __cell_key(int x, int y, int z);
+static void __grid_update(broadphase_t * bp);
+
+status_e broadphase_init(broadphase_t * bp, broadphase_method_e method, float cell_size)
+{
+    if (!bp)
+    {
+        LOG_ERROR("bp is NULL!\n");
+        return status_error;
+    }
+
+    if (method == broadphase_grid && !(cell_size > 0.0f))
+    {
+        LOG_ERROR("grid cells must have a positive size (cell_size = %f)\n", cell_size);
+        return status_error;
+    }
+
+    memset(bp, 0, sizeof(broadphase_t));
+    bp->method = method;
+    bp->cell_size = cell_size;
+    bp->free_list = BROADPHASE_NULL;
+
+    if (hash_init(&bp->pair_index) != status_success)
+    {
+        LOG_ERROR("failed to allocate memory for the pair index\n");
+        return status_error;
+    }
+
+    return status_success;
+}
+
+status_e broadphase_destroy(broadphase_t * bp)
+{
+    status_e status = __broadphase_sanity_check(bp);
+    if (status != status_success) return status;
+
+    free(bp->min);
+    free(bp->max);
+    free(bp->data);
+    free(bp->next_free);
+    for (int axis = 0; axis < 3; ++axis) free(bp->endpoints[axis]);
+    hash_destroy(&bp->pair_index);
+    free(bp->cell_keys);
+    free(bp->cell_proxies);
+    free(bp->pairs);
+    memset(bp, 0, sizeof(broadphase_t));
+    bp->free_list = BROADPHASE_NULL;
+
+    return status_success;
+}
+
+int broadphase_add(broadphase_t * bp, vec3_t min, vec3_t max, void * data)
+{
+    int proxy = BROADPHASE_NULL;
+
+    if (__broadphase_sanity_check(bp) != status_success) return BROADPHASE_NULL;
+
+    if (bp->free_list == BROADPHASE_NULL && __proxy_reserve(bp, bp->capacity ? bp->capacity * 2 : 64) != status_success)
+    {
+        return BROADPHASE_NULL;
+    }
+
+    if (bp->method == broadphase_sap && __endpoint_reserve(bp, bp->num_endpoints + 2) != status_success)
+    {
+        return BROADPHASE_NULL;
+    }
+
+    proxy = bp->free_list;
+    bp->free_list = bp->next_free[proxy];
+    bp->next_free[proxy] = PROXY_IN_USE;
+    bp->min[proxy] = min;
+    bp->max[proxy] = max;
+    bp->data[proxy] = data;
+    ++bp->num_proxies;
+
+    // appended at the end of each axis, the next update sorts them in and finds their pairs on the way
+    if (bp->method == broadphase_sap)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            bp->endpoints[axis][bp->num_endpoints].proxy = 2 * proxy;
+            bp->endpoints[axis][bp->num_endpoints + 1].proxy = 2 * proxy + 1;
+        }
+        bp->num_endpoints += 2;
+        bp->num_unsorted += 2;
+    }
+
+    return proxy;
+}
+
+status_e broadphase_remove(broadphase_t * bp, int proxy)
+{
+    status_e status = __broadphase_sanity_check(bp);
+    if (status != status_success) return status;
+
+    if (!__proxy_valid(bp, proxy))
+    {
+        LOG_ERROR("proxy %d is not in broadphase %p!\n", proxy, bp);
+        return status_error;
+    }
+
+    for (unsigned int idx = 0; idx < bp->num_pairs;)
+    {
+        broadphase_pair_t pair = bp->pairs[idx];
+
+        if (pair.a != proxy && pair.b != proxy)
+        {
+            ++idx;
+            continue;
+        }
+
+        // the last pair takes this one's place, so idx is looked at again
+        if (bp->method == broadphase_sap)
+        {
+            __pair_remove(bp, pair.a, pair.b);
+        }
+        else
+        {
+            bp->pairs[idx] = bp->pairs[--bp->num_pairs];
+        }
+    }
+
+    if (bp->method == broadphase_sap)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            broadphase_endpoint_t * endpoints = bp->endpoints[axis];
+            unsigned int kept = 0;
+
+            for (unsigned int idx = 0; idx < bp->num_endpoints; ++idx)
+            {
+                if ((int)(endpoints[idx].proxy >> 1) != proxy) endpoints[kept++] = endpoints[idx];
+            }
+        }
+        bp->num_endpoints -= 2;
+        if (bp->num_unsorted > bp->num_endpoints) bp->num_unsorted = bp->num_endpoints;
+    }
+
+    bp->next_free[proxy] = bp->free_list;
+    bp->free_list = proxy;
+    bp->data[proxy] = NULL;
+    --bp->num_proxies;
+
+    return status_success;
+}
+
+void broadphase_move(broadphase_t * bp, int proxy, vec3_t min, vec3_t max)
+{
+    if (__broadphase_sanity_check(bp) != status_success) return;
+
+    if (!__proxy_valid(bp, proxy))
+    {
+        LOG_ERROR("proxy %d is not in broadphase %p!\n", proxy, bp);
+        return;
+    }
+
+    bp->min[proxy] = min;
+    bp->max[proxy] = max;
+}
+
+void * broadphase_get_data(const broadphase_t * bp, int proxy)
+{
+    if (__broadphase_sanity_check(bp) != status_success || !__proxy_valid(bp, proxy)) return NULL;
+
+    return bp->data[proxy];
+}
+
+unsigned int broadphase_update(broadphase_t * bp)
+{
+    if (__broadphase_sanity_check(bp) != status_success) return 0;
+
+    bp->swaps = 0;
+    bp->rebuilt = 0;
+
+    if (bp->method == broadphase_sap && bp->num_unsorted > SAP_BULK_INSERT)
+    {
+        // each endpoint appended would be carried down past half the others on average
+        __sap_rebuild(bp);
+    }
+    else if (bp->method == broadphase_sap)
+    {
+        // when many boxes jumped far (teleports, a respawn wave), carrying each endpoint past everything
+        // in its way costs more than starting over. starting over sorts each axis and makes a test for
+        // each box open along the sweep at every min, and both the tests and the swaps drifting takes
+        // grow with how crowded the axes are, so the budget is what the last rebuild cost. the estimate
+        // assumes endpoints are spread evenly; where they bunch up the sort gives up once over budget,
+        // and the pairs patched so far are found again
+        unsigned long budget = (unsigned long)SAP_SWAPS_PER_ENDPOINT * bp->num_endpoints + bp->sweep_tests / SAP_TESTS_PER_SWAP;
+        double estimate = 0.0;
+
+        for (int axis = 0; axis < 3; ++axis) estimate += __sap_read_axis(bp, axis);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (estimate > budget || !__sap_sort_axis(bp, axis, budget))
+            {
+                __sap_rebuild(bp);
+                break;
+            }
+        }
+
+        // the sort only finds where overlaps begin: nearly every max carried below a min belongs to boxes
+        // that never overlapped, so rather than look each one up, the pairs left over are tested again
+        for (unsigned int idx = 0; idx < bp->num_pairs && !bp->rebuilt;)
+        {
+            broadphase_pair_t pair = bp->pairs[idx];
+
+            // the last pair takes this one's place, so idx is looked at again
+            if (__overlaps(bp, pair.a, pair.b)) ++idx;
+            else __pair_remove(bp, pair.a, pair.b);
+        }
+        bp->num_unsorted = 0;
+    }
+    else
+    {
+        __grid_update(bp);
+    }
+
+    return bp->num_pairs;
+}
+
+unsigned int broadphase_for_each_pair(const broadphase_t * bp, broadphase_pair_cb cb, void * user)
+{
+    unsigned int idx = 0;
+
+    if (__broadphase_sanity_check(bp) != status_success || !cb) return 0;
+
+    for (idx = 0; idx < bp->num_pairs; ++idx)
+    {
+        if (!cb(bp->data[bp->pairs[idx].a], bp->data[bp->pairs[idx].b], user)) return idx + 1;
+    }
+
+    return idx;
+}
+
+static status_e __broadphase_sanity_check(const broadphase_t * bp)
+{
+    if (!bp)
+    {
+        LOG_ERROR("bp is NULL!\n");
+        return status_error;
+    }
+
+    return status_success;
+}
+
+static int __proxy_valid(const broadphase_t * bp, int proxy)
+{
+    return proxy >= 0 && (unsigned int)proxy < bp->capacity && bp->next_free[proxy] == PROXY_IN_USE;
+}
+
+static status_e __proxy_reserve(broadphase_t * bp, unsigned int capacity)
+{
+    vec3_t * min = NULL, * max = NULL;
+    void ** data = NULL;
+    int * next_free = NULL;
+
+    // each realloc that succeeds is kept, so a failure halfway leaves the old capacity usable
+    if (!(min = realloc(bp->min, capacity * sizeof(vec3_t)))) goto fail;
+    bp->min = min;
+    if (!(max = realloc(bp->max, capacity * sizeof(vec3_t)))) goto fail;
+    bp->max = max;
+    if (!(data = realloc(bp->data, capacity * sizeof(void *)))) goto fail;
+    bp->data = data;
+    if (!(next_free = realloc(bp->next_free, capacity * sizeof(int)))) goto fail;
+    bp->next_free = next_free;
+
+    // thread the new ids onto the free list, lowest first
+    for (unsigned int idx = bp->capacity; idx < capacity; ++idx)
+    {
+        bp->next_free[idx] = idx + 1 < capacity ? (int)idx + 1 : bp->free_list;
+        bp->data[idx] = NULL;
+    }
+    bp->free_list = bp->capacity;
+    bp->capacity = capacity;
+
+    return status_success;
+
+fail:
+    LOG_ERROR("failed to allocate memory for %u proxies\n", capacity);
+    return status_error;
+}
+
+static status_e __endpoint_reserve(broadphase_t * bp, unsigned int capacity)
+{
+    if (capacity <= bp->endpoint_capacity) return status_success;
+
+    capacity = capacity > 2 * bp->endpoint_capacity ? capacity : 2 * bp->endpoint_capacity;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        broadphase_endpoint_t * endpoints = realloc(bp->endpoints[axis], capacity * sizeof(broadphase_endpoint_t));
+
+        if (!endpoints)
+        {
+            LOG_ERROR("failed to allocate memory for %u endpoints\n", capacity);
+            return status_error;
+        }
+        bp->endpoints[axis] = endpoints;
+    }
+    bp->endpoint_capacity = capacity;
+
+    return status_success;
+}
+
+static status_e __pair_reserve(broadphase_t * bp, unsigned int capacity)
+{
+    broadphase_pair_t * pairs = NULL;
+
+    if (capacity <= bp->pair_capacity) return status_success;
+
+    capacity = capacity > 2 * bp->pair_capacity ? capacity : 2 * bp->pair_capacity;
+    if (!(pairs = realloc(bp->pairs, capacity * sizeof(broadphase_pair_t))))
+    {
+        LOG_ERROR("failed to allocate memory for %u pairs\n", capacity);
+        return status_error;
+    }
+    bp->pairs = pairs;
+    bp->pair_capacity = capacity;
+
+    return status_success;
+}
+
+// keys and proxies get twice the room, the second half being the radix sort's scratch
+static status_e __cell_reserve(broadphase_t * bp, unsigned int capacity)
+{
+    unsigned long long * keys = NULL;
+    unsigned int * proxies = NULL;
+
+    if (capacity <= bp->cell_capacity) return status_success;
+
+    capacity = capacity > 2 * bp->cell_capacity ? capacity : 2 * bp->cell_capacity;
+    if (!(keys = realloc(bp->cell_keys, 2 * capacity * sizeof(unsigned long long))))
+    {
+        LOG_ERROR("failed to allocate memory for %u grid cells\n", capacity);
+        return status_error;
+    }
+    bp->cell_keys = keys;
+
+    if (!(proxies = realloc(bp->cell_proxies, 2 * capacity * sizeof(unsigned int))))
+    {
+        LOG_ERROR("failed to allocate memory for %u grid cells\n", capacity);
+        return status_error;
+    }
+    bp->cell_proxies = proxies;
+    bp->cell_capacity = capacity;
+
+    return status_success;
+}
+
+// touching counts
+static int __overlaps(const broadphase_t * bp, unsigned int a, unsigned int b)
+{
+    const vec3_t * min = bp->min, * max = bp->max;
+
+    // & rather than &&: the sort tests at every crossing, and nearly all fail at no predictable step
+    return (min[a].x <= max[b].x) & (max[a].x >= min[b].x) & (min[a].y <= max[b].y) & (max[a].y >= min[b].y)
+        & (min[a].z <= max[b].z) & (max[a].z >= min[b].z);
+}
+
+static unsigned long __pair_key(unsigned int a, unsigned int b)
+{
+    return a < b ? ((unsigned long)a << 32) | b : ((unsigned long)b << 32) | a;
+}
+
+static void __pair_push(broadphase_t * bp, unsigned int a, unsigned int b)
+{
+    if (__pair_reserve(bp, bp->num_pairs + 1) != status_success) return;
+
+    bp->pairs[bp->num_pairs].a = a < b ? a : b;
+    bp->pairs[bp->num_pairs].b = a < b ? b : a;
+    ++bp->num_pairs;
+}
+
+// the index makes adding a pair found again on another axis a no-op
+static void __pair_add(broadphase_t * bp, unsigned int a, unsigned int b)
+{
+    unsigned long key = __pair_key(a, b);
+
+    if (hash_get(&bp->pair_index, key)) return;
+
+    __pair_push(bp, a, b);
+    if (hash_set(&bp->pair_index, key, (void *)(uintptr_t)bp->num_pairs) != status_success) --bp->num_pairs;
+}
+
+static void __pair_remove(broadphase_t * bp, unsigned int a, unsigned int b)
+{
+    uintptr_t idx = (uintptr_t)hash_remove(&bp->pair_index, __pair_key(a, b));
+    broadphase_pair_t * last = NULL;
+
+    if (idx-- == 0) return;
+
+    last = &bp->pairs[--bp->num_pairs];
+    if (idx == bp->num_pairs) return;
+
+    bp->pairs[idx] = *last;
+    hash_set(&bp->pair_index, __pair_key(last->a, last->b), (void *)(uintptr_t)(idx + 1));
+}
+
+// reads the values of one axis again, and estimates the swaps sorting it will take: how far each endpoint
+// moved times how many endpoints there were per unit along the axis, plus half the sorted ones for each
+// endpoint appended since the last update
+static double __sap_read_axis(broadphase_t * bp, int axis)
+{
+    broadphase_endpoint_t * endpoints = bp->endpoints[axis];
+    const float * min = &bp->min[0].x + axis, * max = &bp->max[0].x + axis;
+    unsigned int sorted = bp->num_endpoints - bp->num_unsorted;
+    double moved = 0.0, extent = sorted > 1 ? endpoints[sorted - 1].value - endpoints[0].value : 0.0;
+
+    for (unsigned int idx = 0; idx < bp->num_endpoints; ++idx)
+    {
+        unsigned int proxy = endpoints[idx].proxy;
+        float value = (proxy & 1 ? max : min)[3 * (proxy >> 1)];
+
+        if (idx < sorted) moved += fabsf(value - endpoints[idx].value);
+        endpoints[idx].value = value;
+    }
+
+    return (extent > 0.0 ? moved * sorted / extent : 0.0) + 0.5 * sorted * bp->num_unsorted;
+}
+
+// insertion sort of one axis read by __sap_read_axis. a min carried below a max starts an overlap along
+// this axis, which is an overlap of the boxes if the other axes agree; overlaps that ended are left to
+// broadphase_update. returns 0, leaving the axis half sorted, once the update has made more than budget swaps
+static int __sap_sort_axis(broadphase_t * bp, int axis, unsigned long budget)
+{
+    broadphase_endpoint_t * endpoints = bp->endpoints[axis];
+
+    for (unsigned int idx = 1; idx < bp->num_endpoints; ++idx)
+    {
+        broadphase_endpoint_t moving = endpoints[idx];
+        unsigned int slot = idx;
+
+        // equal values keep mins first, so touching boxes overlap here as in __overlaps
+        while (slot > 0 && (moving.value < endpoints[slot - 1].value
+                    || (moving.value == endpoints[slot - 1].value && !(moving.proxy & 1) && (endpoints[slot - 1].proxy & 1))))
+        {
+            unsigned int passed = endpoints[slot - 1].proxy;
+
+            if (!(moving.proxy & 1) && (passed & 1) && __overlaps(bp, moving.proxy >> 1, passed >> 1))
+            {
+                __pair_add(bp, moving.proxy >> 1, passed >> 1);
+            }
+
+            endpoints[slot] = endpoints[slot - 1];
+            --slot;
+            ++bp->swaps;
+        }
+
+        endpoints[slot] = moving;
+        if (bp->swaps > budget) return 0;
+    }
+
+    return 1;
+}
+
+// radix sorts each axis, then sweeps along one keeping the boxes whose range on it is open: a box
+// overlaps exactly those of them it overlaps on the other axes. the sweep takes the axis along which
+// boxes overlap least, found by counting the boxes open at each min; a world spread thin along x
+// would otherwise test most boxes against most others
+static void __sap_rebuild(broadphase_t * bp)
+{
+    __open_box_t * open = NULL;
+    unsigned int * open_slot = NULL, num_open = 0;
+    unsigned long long tests[3] = { 0 };
+    int sweep = 0, others[2] = { 1, 2 };
+
+    if (__cell_reserve(bp, bp->num_endpoints) != status_success) return;
+    if (!(open = malloc(bp->num_proxies * sizeof(__open_box_t))) || !(open_slot = malloc(bp->capacity * sizeof(unsigned int))))
+    {
+        LOG_ERROR("failed to allocate memory to sweep %u proxies\n", bp->num_proxies);
+        free(open);
+        return;
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        broadphase_endpoint_t * endpoints = bp->endpoints[axis];
+        const float * min = &bp->min[0].x + axis, * max = &bp->max[0].x + axis;
+
+        for (unsigned int idx = 0; idx < bp->num_endpoints; ++idx)
+        {
+            unsigned int proxy = endpoints[idx].proxy;
+
+            bp->cell_keys[idx] = __endpoint_key((proxy & 1 ? max : min)[3 * (proxy >> 1)], proxy);
+            bp->cell_proxies[idx] = proxy;
+        }
+
+        sort_radix_u64(bp->cell_keys, bp->cell_proxies, bp->cell_keys + bp->cell_capacity, bp->cell_proxies + bp->cell_capacity,
+                bp->num_endpoints);
+
+        for (unsigned int idx = 0; idx < bp->num_endpoints; ++idx)
+        {
+            unsigned int proxy = bp->cell_proxies[idx];
+
+            endpoints[idx].proxy = proxy;
+            endpoints[idx].value = (proxy & 1 ? max : min)[3 * (proxy >> 1)];
+            if (proxy & 1) --num_open;
+            else tests[axis] += num_open++;
+        }
+    }
+
+    sweep = tests[1] < tests[sweep] ? 1 : sweep;
+    sweep = tests[2] < tests[sweep] ? 2 : sweep;
+    others[0] = sweep == 0 ? 1 : 0;
+    others[1] = sweep == 2 ? 1 : 2;
+
+    hash_destroy(&bp->pair_index);
+    hash_init(&bp->pair_index);
+    bp->num_pairs = 0;
+
+    for (unsigned int idx = 0; idx < bp->num_endpoints; ++idx)
+    {
+        unsigned int proxy = bp->endpoints[sweep][idx].proxy >> 1;
+        const float * min = &bp->min[proxy].x, * max = &bp->max[proxy].x;
+        __open_box_t box = { { min[others[0]], min[others[1]] }, { max[others[0]], max[others[1]] }, proxy };
+
+        if (bp->endpoints[sweep][idx].proxy & 1)
+        {
+            open[open_slot[proxy]] = open[--num_open];
+            open_slot[open[open_slot[proxy]].proxy] = open_slot[proxy];
+            continue;
+        }
+
+        // every open box overlaps this one along the sweep already
+        for (unsigned int other = 0; other < num_open; ++other)
+        {
+            // & rather than &&: most tests fail, at no predictable step
+            if ((box.min[0] <= open[other].max[0]) & (box.max[0] >= open[other].min[0])
+                    & (box.min[1] <= open[other].max[1]) & (box.max[1] >= open[other].min[1]))
+            {
+                __pair_add(bp, proxy, open[other].proxy);
+            }
+        }
+
+        open_slot[proxy] = num_open;
+        open[num_open++] = box;
+    }
+
+    bp->sweep_tests = tests[sweep];
+    bp->num_unsorted = 0;
+    bp->rebuilt = 1;
+    free(open);
+    free(open_slot);
+}
+
+// orders like the insertion sort: by value, then mins before maxes. flipping the sign bit of positive floats
+// and every bit of negative ones makes their bits compare as unsigned integers
+static unsigned long long __endpoint_key(float value, unsigned int proxy)
+{
+    uint32_t bits = 0;
+
+    memcpy(&bits, &value, sizeof(bits));
+    bits ^= bits & 0x80000000u ? 0xffffffffu : 0x80000000u;
+
+    return ((unsigned long long)bits << 1) | (proxy & 1);
+}
+
+static unsigned long long __cell_key(int x, int y, int z)
+{
+    unsigned long long bias = 1ULL << (CELL_BITS - 1);
+
+    return ((((unsigned long long)(long long)x + bias) & CELL_MASK) << (2 * CELL_BITS))
+        | ((((unsigned long long)(long long)y + bias) & CELL_MASK) << CELL_BITS)
+        | (((unsigned long long)(long long)z + bias) & CELL_MASK);
+}
+
+static void __grid_update(broadphase_t * bp)
+{
+    float inverse = 1.0f / bp->cell_size;
+    unsigned int count = 0, begin = 0;
+
+    bp->num_pairs = 0;
+
+    for (unsigned int proxy = 0; proxy < bp->capacity; ++proxy)
+    {
+        int lo[3], hi[3];
+
+        if (bp->next_free[proxy] != PROXY_IN_USE) continue;
+
+        lo[0] = (int)floorf(bp->min[proxy].x * inverse);
+        lo[1] = (int)floorf(bp->min[proxy].y * inverse);
+        lo[2] = (int)floorf(bp->min[proxy].z * inverse);
+        hi[0] = (int)floorf(bp->max[proxy].x * inverse);
+        hi[1] = (int)floorf(bp->max[proxy].y * inverse);
+        hi[2] = (int)floorf(bp->max[proxy].z * inverse);
+
+        if (__cell_reserve(bp, count + (hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1)) != status_success) return;
+
+        for (int z = lo[2]; z <= hi[2]; ++z)
+        {
+            for (int y = lo[1]; y <= hi[1]; ++y)
+            {
+                for (int x = lo[0]; x <= hi[0]; ++x)
+                {
+                    bp->cell_keys[count] = __cell_key(x, y, z);
+                    bp->cell_proxies[count++] = proxy;
+                }
+            }
+        }
+    }
+
+    sort_radix_u64(bp->cell_keys, bp->cell_proxies, bp->cell_keys + bp->cell_capacity, bp->cell_proxies + bp->cell_capacity, count);
+
+    // every pair of boxes sharing a cell; boxes sharing several are only reported from the one holding the
+    // min corner of their intersection
+    for (unsigned int end = 0; end <= count; ++end)
+    {
+        if (end < count && bp->cell_keys[end] == bp->cell_keys[begin]) continue;
+
+        for (unsigned int i = begin; i < end; ++i)
+        {
+            for (unsigned int j = i + 1; j < end; ++j)
+            {
+                unsigned int a = bp->cell_proxies[i], b = bp->cell_proxies[j];
+
+                if (!__overlaps(bp, a, b)) continue;
+
+                if (__cell_key((int)floorf(fmaxf(bp->min[a].x, bp->min[b].x) * inverse),
+                            (int)floorf(fmaxf(bp->min[a].y, bp->min[b].y) * inverse),
+                            (int)floorf(fmaxf(bp->min[a].z, bp->min[b].z) * inverse)) != bp->cell_keys[begin]) continue;
+
+                __pair_push(bp, a, b);
+            }
+        }
+
+        begin = end;
+    }
+}
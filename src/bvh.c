@@ -0,0 +1,1043 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+#include "logging.h"
+
+#include "bvh.h"
+
+#define SAH_BINS 16
+#define QUERY_STACK 128             // entries kept on the C stack; deeper trees borrow from the heap
+#define BVH_PREDICT 4.0f
+
+// a ray packet laid out for the slab test: origins and reciprocal directions by axis, one lane per ray
+typedef struct
+{
+    float origin[3][BVH_PACKET];
+    float inverse[3][BVH_PACKET];
+} __packet_t;
+
+typedef struct
+{
+    int node;
+    int mask;                       // rays that entered the node
+    float t_near[BVH_PACKET];       // where they entered it
+} __packet_entry_t;
+
+static status_e __bvh_sanity_check(const bvh_t * tree);
+static int __alloc_node(bvh_t * tree);
+static void __free_node(bvh_t * tree, int node);
+static void __insert_leaf(bvh_t * tree, int leaf);
+static void __remove_leaf(bvh_t * tree, int leaf);
+static void __refit(bvh_t * tree, int node);
+static int __balance(bvh_t * tree, int node);
+static void * __query_stack(const bvh_t * tree, void * local, size_t size, unsigned int copies);
+static int __build(bvh_t * tree, int * leaves, bvh_aabb_t * boxes, vec3_t * centroids, unsigned int count,
+        const bvh_aabb_t * bounds, const bvh_aabb_t * centroid_bounds);
+static bvh_aabb_t __union(const bvh_aabb_t * a, const bvh_aabb_t * b);
+static void __grow(bvh_aabb_t * box, vec3_t point);
+static float __area(const bvh_aabb_t * box);
+static int __contains(const bvh_aabb_t * outer, const bvh_aabb_t * inner);
+static int __overlaps(const bvh_aabb_t * a, const bvh_aabb_t * b);
+static float __distance_sq(const bvh_aabb_t * box, vec3_t point);
+static int __slab(const __packet_t * packet, const bvh_aabb_t * box, const float * max_t, float * t_near);
+static int __nearer(const float * a, int a_mask, const float * b, int b_mask);
+
+status_e bvh_init(bvh_t * tree, float margin)
+{
+    if (!tree)
+    {
+        LOG_ERROR("tree is NULL!\n");
+        return status_error;
+    }
+
+    memset(tree, 0, sizeof(bvh_t));
+    tree->root = BVH_NULL;
+    tree->free_list = BVH_NULL;
+    tree->margin = margin;
+
+    return status_success;
+}
+
+status_e bvh_destroy(bvh_t * tree)
+{
+    if (!tree)
+    {
+        LOG_ERROR("tree is NULL!\n");
+        return status_error;
+    }
+
+    free(tree->nodes);
+
+    return bvh_init(tree, tree->margin);
+}
+
+int bvh_insert(bvh_t * tree, const bvh_aabb_t * box, void * data)
+{
+    int leaf = BVH_NULL;
+    vec3_t margin;
+
+    if (__bvh_sanity_check(tree) != status_success || !box) return BVH_NULL;
+
+    if ((leaf = __alloc_node(tree)) == BVH_NULL) return BVH_NULL;
+
+    margin = vec3_make(tree->margin, tree->margin, tree->margin);
+    tree->nodes[leaf].box.min = vec3_sub(box->min, margin);
+    tree->nodes[leaf].box.max = vec3_add(box->max, margin);
+    tree->nodes[leaf].data = data;
+    tree->nodes[leaf].height = 0;
+
+    __insert_leaf(tree, leaf);
+    ++tree->num_leaves;
+    ++tree->updates;
+
+    return leaf;
+}
+
+status_e bvh_remove(bvh_t * tree, int proxy)
+{
+    if (__bvh_sanity_check(tree) != status_success) return status_error;
+
+    if (proxy < 0 || (unsigned int)proxy >= tree->capacity || tree->nodes[proxy].height != 0)
+    {
+        LOG_ERROR("proxy %d is not a leaf of tree %p!\n", proxy, tree);
+        return status_error;
+    }
+
+    __remove_leaf(tree, proxy);
+    __free_node(tree, proxy);
+    --tree->num_leaves;
+    ++tree->updates;
+
+    return status_success;
+}
+
+int bvh_update(bvh_t * tree, int proxy, const bvh_aabb_t * box)
+{
+    bvh_aabb_t * old = NULL;
+    vec3_t margin, displacement;
+
+    if (__bvh_sanity_check(tree) != status_success || !box) return 0;
+
+    if (proxy < 0 || (unsigned int)proxy >= tree->capacity || tree->nodes[proxy].height != 0)
+    {
+        LOG_ERROR("proxy %d is not a leaf of tree %p!\n", proxy, tree);
+        return 0;
+    }
+
+    if (__contains(&tree->nodes[proxy].box, box)) return 0;
+
+    // stretch the new fat box along the direction the object went, assuming it keeps moving that way
+    old = &tree->nodes[proxy].box;
+    displacement = vec3_scale(vec3_sub(vec3_add(box->min, box->max), vec3_add(old->min, old->max)), 0.5f * BVH_PREDICT);
+
+    __remove_leaf(tree, proxy);
+
+    margin = vec3_make(tree->margin, tree->margin, tree->margin);
+    old->min = vec3_add(vec3_sub(box->min, margin), vec3_min(displacement, vec3_make(0.0f, 0.0f, 0.0f)));
+    old->max = vec3_add(vec3_add(box->max, margin), vec3_max(displacement, vec3_make(0.0f, 0.0f, 0.0f)));
+
+    __insert_leaf(tree, proxy);
+    tree->updates += 2;
+
+    return 1;
+}
+
+void * bvh_get_data(const bvh_t * tree, int proxy)
+{
+    if (__bvh_sanity_check(tree) != status_success) return NULL;
+    if (proxy < 0 || (unsigned int)proxy >= tree->capacity || tree->nodes[proxy].height != 0) return NULL;
+
+    return tree->nodes[proxy].data;
+}
+
+float bvh_cost(const bvh_t * tree)
+{
+    // SAH cost up to a constant: the summed surface area of the internal nodes
+    float cost = 0.0f;
+
+    for (unsigned int idx = 0; idx < tree->capacity; ++idx)
+    {
+        if (tree->nodes[idx].height > 0) cost += __area(&tree->nodes[idx].box);
+    }
+
+    return cost;
+}
+
+int bvh_optimize(bvh_t * tree, float max_ratio)
+{
+    float cost = 0.0f;
+
+    if (__bvh_sanity_check(tree) != status_success) return 0;
+
+    // measuring the cost walks every node, so only look once enough has changed to matter
+    if (tree->updates < tree->num_leaves / 4 + 64) return 0;
+
+    tree->updates = 0;
+    cost = bvh_cost(tree);
+    if (tree->rebuild_cost > 0.0f && cost <= tree->rebuild_cost * max_ratio) return 0;
+
+    LOG_DEBUG("rebuilding tree %p (%u leaves, cost %.1f, last rebuild %.1f)\n", tree, tree->num_leaves, cost, tree->rebuild_cost);
+
+    return bvh_rebuild(tree) == status_success;
+}
+
+status_e bvh_rebuild(bvh_t * tree)
+{
+    int * leaves = NULL;
+    bvh_aabb_t * boxes = NULL, bounds, centroid_bounds;
+    vec3_t * centroids = NULL;
+    unsigned int count = 0;
+
+    if (__bvh_sanity_check(tree) != status_success) return status_error;
+
+    if (tree->num_leaves == 0) return status_success;
+
+    // boxes and centroids are copied out and partitioned alongside the leaf ids so the
+    // build streams through memory instead of chasing leaves across the node pool
+    leaves = malloc(tree->num_leaves * sizeof(int));
+    boxes = malloc(tree->num_leaves * sizeof(bvh_aabb_t));
+    centroids = malloc(tree->num_leaves * sizeof(vec3_t));
+    if (!leaves || !boxes || !centroids)
+    {
+        LOG_ERROR("failed to allocate memory to rebuild %u leaves\n", tree->num_leaves);
+        free(leaves);
+        free(boxes);
+        free(centroids);
+        return status_error;
+    }
+
+    // keep the leaves (their ids are handed out as proxies) and recycle every internal node
+    for (unsigned int idx = 0; idx < tree->capacity; ++idx)
+    {
+        bvh_node_t * node = &tree->nodes[idx];
+
+        if (node->height == 0)
+        {
+            leaves[count] = idx;
+            boxes[count] = node->box;
+            centroids[count] = vec3_scale(vec3_add(node->box.min, node->box.max), 0.5f);
+            ++count;
+        }
+        else if (node->height > 0)
+        {
+            __free_node(tree, idx);
+        }
+    }
+
+    if (count != tree->num_leaves)
+    {
+        LOG_ERROR("tree %p: found %u leaves, expected %u\n", tree, count, tree->num_leaves);
+        free(leaves);
+        free(boxes);
+        free(centroids);
+        return status_error;
+    }
+
+    bounds = boxes[0];
+    centroid_bounds.min = centroid_bounds.max = centroids[0];
+    for (unsigned int idx = 1; idx < count; ++idx)
+    {
+        bounds = __union(&bounds, &boxes[idx]);
+        __grow(&centroid_bounds, centroids[idx]);
+    }
+
+    tree->root = __build(tree, leaves, boxes, centroids, count, &bounds, &centroid_bounds);
+    tree->nodes[tree->root].parent = BVH_NULL;
+    tree->rebuild_cost = bvh_cost(tree);
+    tree->updates = 0;
+
+    free(leaves);
+    free(boxes);
+    free(centroids);
+
+    return tree->root == BVH_NULL ? status_error : status_success;
+}
+
+unsigned int bvh_query_aabb(const bvh_t * tree, const bvh_aabb_t * box, bvh_query_cb cb, void * user)
+{
+    int local[QUERY_STACK], * stack = NULL, top = 0;
+    unsigned int hits = 0;
+
+    if (__bvh_sanity_check(tree) != status_success || !box || !cb || tree->root == BVH_NULL) return 0;
+    if (!(stack = __query_stack(tree, local, sizeof(int), 1))) return 0;
+
+    stack[top++] = tree->root;
+    while (top > 0)
+    {
+        const bvh_node_t * node = &tree->nodes[stack[--top]];
+
+        if (!__overlaps(&node->box, box)) continue;
+
+        if (node->height == 0)
+        {
+            ++hits;
+            if (!cb(node->data, __contains(box, &node->box), user)) break;
+            continue;
+        }
+
+        stack[top++] = node->left;
+        stack[top++] = node->right;
+    }
+
+    if (stack != local) free(stack);
+
+    return hits;
+}
+
+// stack has room for the deepest walk down from root
+static int __report_subtree(const bvh_t * tree, int root, bvh_query_cb cb, void * user, unsigned int * hits, int * stack)
+{
+    int top = 0;
+
+    stack[top++] = root;
+    while (top > 0)
+    {
+        const bvh_node_t * node = &tree->nodes[stack[--top]];
+
+        if (node->height == 0)
+        {
+            ++*hits;
+            if (!cb(node->data, 1, user)) return 0;
+            continue;
+        }
+
+        stack[top++] = node->left;
+        stack[top++] = node->right;
+    }
+
+    return 1;
+}
+
+unsigned int bvh_query_frustum(const bvh_t * tree, const cull_frustum_t * frustum, bvh_query_cb cb, void * user)
+{
+    int local[QUERY_STACK], * stack = NULL, * inside = NULL, top = 0;
+    unsigned int hits = 0;
+
+    if (__bvh_sanity_check(tree) != status_success || !frustum || !cb || tree->root == BVH_NULL) return 0;
+    // the second half walks the subtrees found entirely inside
+    if (!(stack = __query_stack(tree, local, sizeof(int), 2))) return 0;
+    inside = stack + tree->nodes[tree->root].height + 2;
+
+    stack[top++] = tree->root;
+    while (top > 0)
+    {
+        int idx = stack[--top];
+        const bvh_node_t * node = &tree->nodes[idx];
+        cull_result_e result = cull_aabb(frustum, node->box.min, node->box.max);
+
+        if (result == cull_outside) continue;
+
+        // nothing below a node that is entirely inside needs another plane test
+        if (result == cull_inside)
+        {
+            if (!__report_subtree(tree, idx, cb, user, &hits, inside)) break;
+            continue;
+        }
+
+        if (node->height == 0)
+        {
+            ++hits;
+            if (!cb(node->data, 0, user)) break;
+            continue;
+        }
+
+        stack[top++] = node->left;
+        stack[top++] = node->right;
+    }
+
+    if (stack != local) free(stack);
+
+    return hits;
+}
+
+void * bvh_nearest(const bvh_t * tree, vec3_t point, float max_distance, bvh_distance_fn fn, void * user, float * distance)
+{
+    int local[QUERY_STACK], * stack = NULL, top = 0;
+    float best_sq = max_distance * max_distance;
+    void * best = NULL;
+
+    if (__bvh_sanity_check(tree) != status_success || tree->root == BVH_NULL) return NULL;
+    if (!(stack = __query_stack(tree, local, sizeof(int), 1))) return NULL;
+
+    stack[top++] = tree->root;
+    while (top > 0)
+    {
+        const bvh_node_t * node = &tree->nodes[stack[--top]];
+        float node_sq = __distance_sq(&node->box, point);
+
+        // branch and bound: a box further away than the best hit cannot hold anything closer
+        if (node_sq > best_sq) continue;
+
+        if (node->height == 0)
+        {
+            float leaf_distance = fn ? fn(node->data, point, user) : sqrtf(node_sq);
+            if (leaf_distance * leaf_distance <= best_sq)
+            {
+                best_sq = leaf_distance * leaf_distance;
+                best = node->data;
+            }
+            continue;
+        }
+
+        // visit the closer child first so the bound tightens sooner
+        if (__distance_sq(&tree->nodes[node->left].box, point) < __distance_sq(&tree->nodes[node->right].box, point))
+        {
+            stack[top++] = node->right;
+            stack[top++] = node->left;
+        }
+        else
+        {
+            stack[top++] = node->left;
+            stack[top++] = node->right;
+        }
+    }
+
+    if (stack != local) free(stack);
+    if (distance) *distance = best ? sqrtf(best_sq) : -1.0f;
+
+    return best;
+}
+
+unsigned int bvh_raycast(const bvh_t * tree, const bvh_ray_t * rays, unsigned int count, bvh_ray_fn fn, void * user,
+        void ** data, float * t)
+{
+    __packet_entry_t local[QUERY_STACK], * stack = NULL;
+    __packet_t packet;
+    float best[BVH_PACKET];
+    unsigned int hits = 0;
+    int top = 0;
+
+    if (__bvh_sanity_check(tree) != status_success || !rays || !fn || !data || !t) return 0;
+
+    if (count == 0 || count > BVH_PACKET)
+    {
+        LOG_ERROR("packets hold 1 to %d rays, not %u\n", BVH_PACKET, count);
+        return 0;
+    }
+
+    // lanes past count are given a negative range, so the slab test never lets them in
+    for (unsigned int lane = 0; lane < BVH_PACKET; ++lane)
+    {
+        const float * origin = &rays[lane < count ? lane : 0].origin.x, * direction = &rays[lane < count ? lane : 0].direction.x;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            packet.origin[axis][lane] = origin[axis];
+            // a tiny stand-in for zero keeps the slab distances finite
+            packet.inverse[axis][lane] = 1.0f / (direction[axis] != 0.0f ? direction[axis] : 1e-20f);
+        }
+
+        best[lane] = lane < count ? rays[lane].max_t : -1.0f;
+        if (lane < count)
+        {
+            data[lane] = NULL;
+            t[lane] = -1.0f;
+        }
+    }
+
+    if (tree->root == BVH_NULL || !(stack = __query_stack(tree, local, sizeof(__packet_entry_t), 1))) return 0;
+
+    stack[0].node = tree->root;
+    stack[0].mask = __slab(&packet, &tree->nodes[tree->root].box, best, stack[0].t_near);
+    top = stack[0].mask ? 1 : 0;
+
+    while (top > 0)
+    {
+        __packet_entry_t * entry = &stack[--top];
+        const bvh_node_t * node = &tree->nodes[entry->node];
+        __packet_entry_t children[2];
+        int mask = 0;
+
+        // rays that found something nearer since the node was pushed are done with it
+        for (int lane = 0; lane < BVH_PACKET; ++lane)
+        {
+            if ((entry->mask >> lane) & 1 && entry->t_near[lane] <= best[lane]) mask |= 1 << lane;
+        }
+
+        if (!mask) continue;
+
+        if (node->height == 0)
+        {
+            for (int lane = 0; lane < BVH_PACKET; ++lane)
+            {
+                float hit = (mask >> lane) & 1 ? fn(node->data, &rays[lane], lane, best[lane], user) : -1.0f;
+
+                if (hit < 0.0f || hit >= best[lane]) continue;
+
+                best[lane] = t[lane] = hit;
+                data[lane] = node->data;
+            }
+            continue;
+        }
+
+        children[0].node = node->left;
+        children[0].mask = __slab(&packet, &tree->nodes[node->left].box, best, children[0].t_near) & mask;
+        children[1].node = node->right;
+        children[1].mask = __slab(&packet, &tree->nodes[node->right].box, best, children[1].t_near) & mask;
+
+        // the nearer child goes on top so the rays' ranges shrink before the other is visited
+        if (__nearer(children[0].t_near, children[0].mask, children[1].t_near, children[1].mask))
+        {
+            if (children[1].mask) stack[top++] = children[1];
+            if (children[0].mask) stack[top++] = children[0];
+        }
+        else
+        {
+            if (children[0].mask) stack[top++] = children[0];
+            if (children[1].mask) stack[top++] = children[1];
+        }
+    }
+
+    if (stack != local) free(stack);
+    for (unsigned int lane = 0; lane < count; ++lane) hits += data[lane] != NULL;
+
+    return hits;
+}
+
+static status_e __bvh_sanity_check(const bvh_t * tree)
+{
+    if (!tree)
+    {
+        LOG_ERROR("tree is NULL!\n");
+        return status_error;
+    }
+
+    if (tree->num_leaves > tree->capacity)
+    {
+        LOG_ERROR("tree %p: overflow! leaves = %u, capacity = %u\n", tree, tree->num_leaves, tree->capacity);
+        return status_error;
+    }
+
+    return status_success;
+}
+
+static int __alloc_node(bvh_t * tree)
+{
+    int node = BVH_NULL;
+
+    if (tree->free_list == BVH_NULL)
+    {
+        unsigned int capacity = tree->capacity ? tree->capacity * 2 : 64;
+        bvh_node_t * nodes = realloc(tree->nodes, capacity * sizeof(bvh_node_t));
+
+        if (!nodes)
+        {
+            LOG_ERROR("failed to grow tree %p to %u nodes\n", tree, capacity);
+            return BVH_NULL;
+        }
+
+        tree->nodes = nodes;
+        for (unsigned int idx = tree->capacity; idx < capacity; ++idx)
+        {
+            tree->nodes[idx].height = -1;
+            tree->nodes[idx].parent = idx + 1 < capacity ? (int)idx + 1 : BVH_NULL;
+        }
+        tree->free_list = tree->capacity;
+        tree->capacity = capacity;
+    }
+
+    node = tree->free_list;
+    tree->free_list = tree->nodes[node].parent;
+    tree->nodes[node].parent = BVH_NULL;
+    tree->nodes[node].left = BVH_NULL;
+    tree->nodes[node].right = BVH_NULL;
+    tree->nodes[node].height = 0;
+    tree->nodes[node].data = NULL;
+
+    return node;
+}
+
+static void __free_node(bvh_t * tree, int node)
+{
+    tree->nodes[node].parent = tree->free_list;
+    tree->nodes[node].height = -1;
+    tree->free_list = node;
+}
+
+static void __insert_leaf(bvh_t * tree, int leaf)
+{
+    bvh_aabb_t leaf_box = tree->nodes[leaf].box;
+    int sibling = tree->root, old_parent = BVH_NULL, new_parent = BVH_NULL;
+
+    if (tree->root == BVH_NULL)
+    {
+        tree->root = leaf;
+        tree->nodes[leaf].parent = BVH_NULL;
+        return;
+    }
+
+    // descend towards the child whose box grows the least (surface area heuristic)
+    while (tree->nodes[sibling].height > 0)
+    {
+        const bvh_node_t * node = &tree->nodes[sibling];
+        bvh_aabb_t combined = __union(&node->box, &leaf_box);
+        float area = __area(&node->box), combined_area = __area(&combined);
+        float cost = 2.0f * combined_area, inheritance = 2.0f * (combined_area - area);
+        float child_cost[2];
+        int children[2] = { node->left, node->right };
+
+        for (int side = 0; side < 2; ++side)
+        {
+            const bvh_node_t * child = &tree->nodes[children[side]];
+            bvh_aabb_t child_combined = __union(&child->box, &leaf_box);
+
+            child_cost[side] = child->height == 0 ? __area(&child_combined) + inheritance
+                : __area(&child_combined) - __area(&child->box) + inheritance;
+        }
+
+        if (cost < child_cost[0] && cost < child_cost[1]) break;
+
+        sibling = child_cost[0] < child_cost[1] ? children[0] : children[1];
+    }
+
+    old_parent = tree->nodes[sibling].parent;
+    if ((new_parent = __alloc_node(tree)) == BVH_NULL) return;
+
+    tree->nodes[new_parent].parent = old_parent;
+    tree->nodes[new_parent].box = __union(&leaf_box, &tree->nodes[sibling].box);
+    tree->nodes[new_parent].height = tree->nodes[sibling].height + 1;
+    tree->nodes[new_parent].left = sibling;
+    tree->nodes[new_parent].right = leaf;
+    tree->nodes[sibling].parent = new_parent;
+    tree->nodes[leaf].parent = new_parent;
+
+    if (old_parent == BVH_NULL)
+    {
+        tree->root = new_parent;
+    }
+    else if (tree->nodes[old_parent].left == sibling)
+    {
+        tree->nodes[old_parent].left = new_parent;
+    }
+    else
+    {
+        tree->nodes[old_parent].right = new_parent;
+    }
+
+    __refit(tree, new_parent);
+}
+
+static void __remove_leaf(bvh_t * tree, int leaf)
+{
+    int parent = tree->nodes[leaf].parent, grandparent = BVH_NULL, sibling = BVH_NULL;
+
+    if (leaf == tree->root)
+    {
+        tree->root = BVH_NULL;
+        return;
+    }
+
+    grandparent = tree->nodes[parent].parent;
+    sibling = tree->nodes[parent].left == leaf ? tree->nodes[parent].right : tree->nodes[parent].left;
+
+    // the sibling takes the parent's place
+    if (grandparent == BVH_NULL)
+    {
+        tree->root = sibling;
+        tree->nodes[sibling].parent = BVH_NULL;
+    }
+    else
+    {
+        if (tree->nodes[grandparent].left == parent)
+        {
+            tree->nodes[grandparent].left = sibling;
+        }
+        else
+        {
+            tree->nodes[grandparent].right = sibling;
+        }
+        tree->nodes[sibling].parent = grandparent;
+    }
+
+    __free_node(tree, parent);
+    tree->nodes[leaf].parent = BVH_NULL;
+
+    __refit(tree, grandparent);
+}
+
+static void __refit(bvh_t * tree, int node)
+{
+    while (node != BVH_NULL)
+    {
+        bvh_node_t * n = NULL;
+        const bvh_node_t * left = NULL, * right = NULL;
+
+        // rotating on the way up keeps the height logarithmic however the leaves arrive
+        node = __balance(tree, node);
+        n = &tree->nodes[node];
+        left = &tree->nodes[n->left];
+        right = &tree->nodes[n->right];
+
+        n->box = __union(&left->box, &right->box);
+        n->height = 1 + (left->height > right->height ? left->height : right->height);
+        node = n->parent;
+    }
+}
+
+// when one child of node is more than one level taller than the other, the
+// taller child takes node's place and node takes the taller of its grandchildren
+// (an AVL rotation). returns whichever node now roots the subtree.
+static int __balance(bvh_t * tree, int node)
+{
+    bvh_node_t * a = &tree->nodes[node];
+    int up = BVH_NULL, up_left = 0, balance = 0;
+    bvh_node_t * b = NULL, * f = NULL, * g = NULL;
+    int kept = BVH_NULL, moved = BVH_NULL;
+
+    if (a->height < 2) return node;
+
+    balance = tree->nodes[a->right].height - tree->nodes[a->left].height;
+    if (balance > 1)
+    {
+        up = a->right;
+        up_left = 0;
+    }
+    else if (balance < -1)
+    {
+        up = a->left;
+        up_left = 1;
+    }
+    else
+    {
+        return node;
+    }
+
+    b = &tree->nodes[up];
+    f = &tree->nodes[b->left];
+    g = &tree->nodes[b->right];
+
+    // up keeps its taller child and hands the other to node, in up's old place
+    if (f->height > g->height)
+    {
+        kept = b->left;
+        moved = b->right;
+    }
+    else
+    {
+        kept = b->right;
+        moved = b->left;
+    }
+
+    b->parent = a->parent;
+    if (a->parent == BVH_NULL) tree->root = up;
+    else if (tree->nodes[a->parent].left == node) tree->nodes[a->parent].left = up;
+    else tree->nodes[a->parent].right = up;
+
+    if (up_left)
+    {
+        a->left = moved;
+        b->left = kept;
+        b->right = node;
+    }
+    else
+    {
+        a->right = moved;
+        b->left = node;
+        b->right = kept;
+    }
+    a->parent = up;
+    tree->nodes[moved].parent = node;
+
+    a->box = __union(&tree->nodes[a->left].box, &tree->nodes[a->right].box);
+    a->height = 1 + (tree->nodes[a->left].height > tree->nodes[a->right].height
+            ? tree->nodes[a->left].height : tree->nodes[a->right].height);
+    b->box = __union(&tree->nodes[b->left].box, &tree->nodes[b->right].box);
+    b->height = 1 + (tree->nodes[b->left].height > tree->nodes[b->right].height
+            ? tree->nodes[b->left].height : tree->nodes[b->right].height);
+
+    return up;
+}
+
+// a depth first walk holds at most one pending node per level, plus the one in hand
+static void * __query_stack(const bvh_t * tree, void * local, size_t size, unsigned int copies)
+{
+    size_t needed = (size_t)(tree->nodes[tree->root].height + 2) * copies;
+    void * stack = NULL;
+
+    if (needed <= QUERY_STACK) return local;
+
+    if (!(stack = malloc(needed * size)))
+    {
+        LOG_ERROR("failed to allocate a query stack of %lu entries for tree %p\n", (unsigned long)needed, tree);
+    }
+
+    return stack;
+}
+
+static int __build(bvh_t * tree, int * leaves, bvh_aabb_t * boxes, vec3_t * centroids, unsigned int count,
+        const bvh_aabb_t * bounds, const bvh_aabb_t * centroid_bounds)
+{
+    bvh_aabb_t bin_boxes[SAH_BINS], bin_centroids[SAH_BINS], left_boxes[SAH_BINS], child_bounds[2], child_centroids[2];
+    unsigned int bin_counts[SAH_BINS], left_counts[SAH_BINS], split = 0, best_bin = 0, idx = 0;
+    float best_cost = FLT_MAX, extent = 0.0f, axis_min = 0.0f, scale = 0.0f;
+    int axis = 0, node = BVH_NULL, left = BVH_NULL, right = BVH_NULL;
+
+    if (count == 1) return leaves[0];
+
+    // bin along the widest centroid axis
+    extent = centroid_bounds->max.x - centroid_bounds->min.x;
+    if (centroid_bounds->max.y - centroid_bounds->min.y > extent)
+    {
+        axis = 1;
+        extent = centroid_bounds->max.y - centroid_bounds->min.y;
+    }
+    if (centroid_bounds->max.z - centroid_bounds->min.z > extent)
+    {
+        axis = 2;
+        extent = centroid_bounds->max.z - centroid_bounds->min.z;
+    }
+
+    if (extent > 0.0f)
+    {
+        axis_min = (&centroid_bounds->min.x)[axis];
+        scale = SAH_BINS / extent * 0.9999f;
+
+        memset(bin_counts, 0, sizeof(bin_counts));
+        for (idx = 0; idx < count; ++idx)
+        {
+            unsigned int bin = (unsigned int)(((&centroids[idx].x)[axis] - axis_min) * scale);
+
+            if (bin_counts[bin]++)
+            {
+                bin_boxes[bin] = __union(&bin_boxes[bin], &boxes[idx]);
+                __grow(&bin_centroids[bin], centroids[idx]);
+            }
+            else
+            {
+                bin_boxes[bin] = boxes[idx];
+                bin_centroids[bin].min = bin_centroids[bin].max = centroids[idx];
+            }
+        }
+
+        // sweep from the left accumulating boxes, then evaluate every split from the right
+        for (idx = 0; idx < SAH_BINS; ++idx)
+        {
+            left_counts[idx] = bin_counts[idx] + (idx ? left_counts[idx - 1] : 0);
+            if (idx == 0 || left_counts[idx - 1] == 0) left_boxes[idx] = bin_boxes[idx];
+            else if (bin_counts[idx]) left_boxes[idx] = __union(&left_boxes[idx - 1], &bin_boxes[idx]);
+            else left_boxes[idx] = left_boxes[idx - 1];
+        }
+
+        {
+            bvh_aabb_t right_box;
+            unsigned int right_count = 0;
+
+            for (idx = SAH_BINS - 1; idx > 0; --idx)
+            {
+                if (bin_counts[idx])
+                {
+                    right_box = right_count ? __union(&right_box, &bin_boxes[idx]) : bin_boxes[idx];
+                    right_count += bin_counts[idx];
+                }
+
+                if (right_count && left_counts[idx - 1])
+                {
+                    float cost = left_counts[idx - 1] * __area(&left_boxes[idx - 1]) + right_count * __area(&right_box);
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_bin = idx;
+                    }
+                }
+            }
+        }
+    }
+
+    if (best_cost < FLT_MAX)
+    {
+        // partition in place: everything binned below best_bin goes left
+        unsigned int lo = 0, hi = count;
+        int seen[2] = { 0, 0 };
+
+        while (lo < hi)
+        {
+            unsigned int bin = (unsigned int)(((&centroids[lo].x)[axis] - axis_min) * scale);
+            if (bin < best_bin)
+            {
+                ++lo;
+            }
+            else
+            {
+                int tmp_leaf = leaves[lo];
+                bvh_aabb_t tmp_box = boxes[lo];
+                vec3_t tmp_centroid = centroids[lo];
+                --hi;
+                leaves[lo] = leaves[hi];
+                boxes[lo] = boxes[hi];
+                centroids[lo] = centroids[hi];
+                leaves[hi] = tmp_leaf;
+                boxes[hi] = tmp_box;
+                centroids[hi] = tmp_centroid;
+            }
+        }
+        split = lo;
+
+        // the children's bounds fall out of the bins, so no pass over the leaves is needed to find them
+        for (idx = 0; idx < SAH_BINS; ++idx)
+        {
+            int side = idx >= best_bin;
+
+            if (!bin_counts[idx]) continue;
+
+            if (!seen[side]++)
+            {
+                child_bounds[side] = bin_boxes[idx];
+                child_centroids[side] = bin_centroids[idx];
+            }
+            else
+            {
+                child_bounds[side] = __union(&child_bounds[side], &bin_boxes[idx]);
+                child_centroids[side] = __union(&child_centroids[side], &bin_centroids[idx]);
+            }
+        }
+    }
+    else
+    {
+        // coincident centroids: any split is as good as another
+        split = count / 2;
+        for (int side = 0; side < 2; ++side)
+        {
+            unsigned int begin = side ? split : 0, end = side ? count : split;
+
+            child_bounds[side] = boxes[begin];
+            child_centroids[side].min = child_centroids[side].max = centroids[begin];
+            for (idx = begin + 1; idx < end; ++idx)
+            {
+                child_bounds[side] = __union(&child_bounds[side], &boxes[idx]);
+                __grow(&child_centroids[side], centroids[idx]);
+            }
+        }
+    }
+
+    left = __build(tree, leaves, boxes, centroids, split, &child_bounds[0], &child_centroids[0]);
+    right = __build(tree, leaves + split, boxes + split, centroids + split, count - split, &child_bounds[1], &child_centroids[1]);
+    if (left == BVH_NULL || right == BVH_NULL || (node = __alloc_node(tree)) == BVH_NULL) return BVH_NULL;
+
+    tree->nodes[node].box = *bounds;
+    tree->nodes[node].left = left;
+    tree->nodes[node].right = right;
+    tree->nodes[node].height = 1 + (tree->nodes[left].height > tree->nodes[right].height
+            ? tree->nodes[left].height : tree->nodes[right].height);
+    tree->nodes[left].parent = node;
+    tree->nodes[right].parent = node;
+
+    return node;
+}
+
+static bvh_aabb_t __union(const bvh_aabb_t * a, const bvh_aabb_t * b)
+{
+    bvh_aabb_t box;
+
+    // spelled out rather than through vec3_min/max (or fminf, which is a libm call without -ffast-math):
+    // this is the innermost operation of both insertion and rebuilds
+    box.min.x = a->min.x < b->min.x ? a->min.x : b->min.x;
+    box.min.y = a->min.y < b->min.y ? a->min.y : b->min.y;
+    box.min.z = a->min.z < b->min.z ? a->min.z : b->min.z;
+    box.max.x = a->max.x > b->max.x ? a->max.x : b->max.x;
+    box.max.y = a->max.y > b->max.y ? a->max.y : b->max.y;
+    box.max.z = a->max.z > b->max.z ? a->max.z : b->max.z;
+
+    return box;
+}
+
+static void __grow(bvh_aabb_t * box, vec3_t point)
+{
+    box->min.x = box->min.x < point.x ? box->min.x : point.x;
+    box->min.y = box->min.y < point.y ? box->min.y : point.y;
+    box->min.z = box->min.z < point.z ? box->min.z : point.z;
+    box->max.x = box->max.x > point.x ? box->max.x : point.x;
+    box->max.y = box->max.y > point.y ? box->max.y : point.y;
+    box->max.z = box->max.z > point.z ? box->max.z : point.z;
+}
+
+static float __area(const bvh_aabb_t * box)
+{
+    float dx = box->max.x - box->min.x, dy = box->max.y - box->min.y, dz = box->max.z - box->min.z;
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static int __contains(const bvh_aabb_t * outer, const bvh_aabb_t * inner)
+{
+    return outer->min.x <= inner->min.x && outer->min.y <= inner->min.y && outer->min.z <= inner->min.z
+        && outer->max.x >= inner->max.x && outer->max.y >= inner->max.y && outer->max.z >= inner->max.z;
+}
+
+static int __overlaps(const bvh_aabb_t * a, const bvh_aabb_t * b)
+{
+    return a->min.x <= b->max.x && a->max.x >= b->min.x && a->min.y <= b->max.y && a->max.y >= b->min.y
+        && a->min.z <= b->max.z && a->max.z >= b->min.z;
+}
+
+static float __distance_sq(const bvh_aabb_t * box, vec3_t point)
+{
+    float dx = fmaxf(fmaxf(box->min.x - point.x, 0.0f), point.x - box->max.x);
+    float dy = fmaxf(fmaxf(box->min.y - point.y, 0.0f), point.y - box->max.y);
+    float dz = fmaxf(fmaxf(box->min.z - point.z, 0.0f), point.z - box->max.z);
+
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Kay/Kajiya slabs for every ray of the packet at once: returns the mask of rays that cross box
+// between 0 and their max_t, and where each one enters it
+static int __slab(const __packet_t * packet, const bvh_aabb_t * box, const float * max_t, float * t_near)
+{
+#if defined(__SSE2__)
+    const float * min = &box->min.x, * max = &box->max.x;
+    __m128 near = _mm_setzero_ps(), far = _mm_loadu_ps(max_t);
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        __m128 origin = _mm_loadu_ps(packet->origin[axis]), inverse = _mm_loadu_ps(packet->inverse[axis]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min[axis]), origin), inverse);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max[axis]), origin), inverse);
+
+        near = _mm_max_ps(near, _mm_min_ps(t0, t1));
+        far = _mm_min_ps(far, _mm_max_ps(t0, t1));
+    }
+
+    _mm_storeu_ps(t_near, near);
+
+    return _mm_movemask_ps(_mm_cmple_ps(near, far));
+#else
+    const float * min = &box->min.x, * max = &box->max.x;
+    int mask = 0;
+
+    for (int lane = 0; lane < BVH_PACKET; ++lane)
+    {
+        float near = 0.0f, far = max_t[lane];
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float t0 = (min[axis] - packet->origin[axis][lane]) * packet->inverse[axis][lane];
+            float t1 = (max[axis] - packet->origin[axis][lane]) * packet->inverse[axis][lane];
+
+            near = fmaxf(near, t0 < t1 ? t0 : t1);
+            far = fminf(far, t0 < t1 ? t1 : t0);
+        }
+
+        t_near[lane] = near;
+        mask |= (near <= far) << lane;
+    }
+
+    return mask;
+#endif
+}
+
+// whether the first ray to enter a is ahead of the first to enter b
+static int __nearer(const float * a, int a_mask, const float * b, int b_mask)
+{
+    float a_min = FLT_MAX, b_min = FLT_MAX;
+
+    for (int lane = 0; lane < BVH_PACKET; ++lane)
+    {
+        if ((a_mask >> lane) & 1 && a[lane] < a_min) a_min = a[lane];
+        if ((b_mask >> lane) & 1 && b[lane] < b_min) b_min = b[lane];
+    }
+
+    return a_min <= b_min;
+}
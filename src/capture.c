@@ -0,0 +1,618 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "logging.h"
+
+#include "capture.h"
+
+#define CAPTURE_WAIT_NS 1000000000ULL
+#define CAPTURE_PNG_LEVEL Z_BEST_SPEED  // the writer has to keep up with the frame rate
+#define CAPTURE_PNG_FILTER_UP 2
+
+typedef struct __frame_s
+{
+    unsigned char * pixels;         // RGBA rows bottom to top, as read
+    size_t capacity;
+    int width;
+    int height;
+    unsigned long number;           // in its capture
+    capture_format_e format;
+    int append;                     // opens path to append to, unless it is the capture's first frame
+    char path[CAPTURE_MAX_PATH];
+    struct __frame_s * next;
+} __frame_t;
+
+typedef struct
+{
+    GLuint pbo;
+    GLsizeiptr size;                // of the buffer's store
+    GLsync fence;
+    unsigned long issued;           // capture_frame call it was read in
+    __frame_t * frame;              // the pixels are copied to once mapped
+} __slot_t;
+
+static int __initialized = 0;
+static int __prerun_done = 0;
+static int __use_pbo = 0;
+static int __use_fences = 0;
+static __slot_t __slots[CAPTURE_RING_SIZE];
+static unsigned int __slot_head = 0;            // oldest read in flight
+static unsigned int __slot_count = 0;
+static unsigned long __frame_counter = 0;
+// the capture being taken
+static int __capturing = 0;
+static char __path[CAPTURE_MAX_PATH];
+static capture_format_e __format = capture_format_png;
+static int __append = 0;
+static unsigned long __next_number = 0;
+static unsigned long __num_frames = 0;          // 0 for no limit
+// the writer. everything from here to the scratch buffers is guarded by __lock
+static pthread_t __writer;
+static pthread_mutex_t __lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __queued_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t __done_cond = PTHREAD_COND_INITIALIZER;
+static __frame_t * __queue_head = NULL;
+static __frame_t * __queue_tail = NULL;
+static __frame_t * __free_frames = NULL;
+static unsigned int __frames_in_use = 0;        // between being read and being written
+static int __shutting_down = 0;
+static capture_stats_t __stats;
+// only the writer touches these
+static unsigned char * __png_rows = NULL;
+static size_t __png_rows_capacity = 0;
+static unsigned char * __png_data = NULL;
+static size_t __png_data_capacity = 0;
+
+static void __capture_shutdown(void);
+static int __path_conversions(const char * path);
+static int __slot_ready(const __slot_t * slot);
+static void __collect_oldest(void);
+static __frame_t * __frame_acquire(int width, int height);
+static void __frame_submit(__frame_t * frame);
+static void __frame_release(__frame_t * frame);
+static void * __writer_main(void * arg);
+static status_e __write_frame(__frame_t * frame);
+static status_e __write_raw(FILE * file, const __frame_t * frame);
+static status_e __write_png(FILE * file, const __frame_t * frame);
+static status_e __png_chunk(FILE * file, const char * type, const unsigned char * data, size_t len);
+static void __put_be32(unsigned char * out, unsigned long value);
+
+status_e capture_init(void)
+{
+    if (__initialized)
+    {
+        LOG_ERROR("capture already initialized\n");
+        return status_error;
+    }
+
+    atexit(__capture_shutdown);
+
+    __shutting_down = 0;
+    if (pthread_create(&__writer, NULL, __writer_main, NULL) != 0)
+    {
+        LOG_ERROR("failed to start the capture writer\n");
+        return status_error;
+    }
+
+    memset(&__stats, 0, sizeof(__stats));
+    __initialized = 1;
+
+    return status_success;
+}
+
+status_e capture_prerun(void)
+{
+    GLint gl_major = 0, gl_minor = 0;
+
+    if (!__initialized)
+    {
+        LOG_ERROR("capture not initialized\n");
+        return status_error;
+    }
+
+    glGetIntegerv(GL_MAJOR_VERSION, &gl_major);
+    glGetIntegerv(GL_MINOR_VERSION, &gl_minor);
+
+    __use_pbo = gl_major >= 3 || (gl_major == 2 && gl_minor >= 1) || glfwExtensionSupported("GL_ARB_pixel_buffer_object");
+    __use_fences = gl_major > 3 || (gl_major == 3 && gl_minor >= 2) || glfwExtensionSupported("GL_ARB_sync");
+    if (!__use_pbo) LOG_DEBUG("no pixel buffer objects, captured frames are read synchronously\n");
+    else if (!__use_fences) LOG_DEBUG("no fences, captured frames are mapped %d frames after being read\n", CAPTURE_LATENCY);
+
+    // a new context starts with no reads in flight
+    memset(__slots, 0, sizeof(__slots));
+    __slot_head = __slot_count = 0;
+    if (__use_pbo)
+    {
+        for (unsigned int idx = 0; idx < CAPTURE_RING_SIZE; ++idx) glGenBuffers(1, &__slots[idx].pbo);
+    }
+
+    __prerun_done = 1;
+
+    return status_success;
+}
+
+status_e capture_start(const char * path, capture_format_e format, unsigned int num_frames)
+{
+    char longest[CAPTURE_MAX_PATH];
+    int conversions = 0;
+
+    if (!__initialized)
+    {
+        LOG_ERROR("capture not initialized\n");
+        return status_error;
+    }
+
+    if (!path || strlen(path) >= CAPTURE_MAX_PATH)
+    {
+        LOG_ERROR("invalid capture path! (path = %p)\n", path);
+        return status_error;
+    }
+
+    if (format != capture_format_png && format != capture_format_raw)
+    {
+        LOG_ERROR("invalid capture format %d\n", format);
+        return status_error;
+    }
+
+    if (__capturing)
+    {
+        LOG_ERROR("already capturing to %s\n", __path);
+        return status_error;
+    }
+
+    // the path becomes a printf format, so it may only ever be given the one number
+    if ((conversions = __path_conversions(path)) < 0 || conversions > 1)
+    {
+        LOG_ERROR("%s must hold at most one integer conversion, and no other %% but %%%%\n", path);
+        return status_error;
+    }
+
+    // the widest numbers in unsigned and signed conversions
+    if ((size_t)snprintf(longest, sizeof(longest), path, UINT_MAX) >= sizeof(longest)
+            || (size_t)snprintf(longest, sizeof(longest), path, (unsigned int)INT_MIN) >= sizeof(longest))
+    {
+        LOG_ERROR("the frame names of %s would not fit in %d bytes\n", path, CAPTURE_MAX_PATH);
+        return status_error;
+    }
+
+    strcpy(__path, path);
+    __format = format;
+    __append = (format == capture_format_raw && conversions == 0);
+    __next_number = 0;
+    __num_frames = num_frames;
+    __capturing = 1;
+
+    LOG_DEBUG("capturing %u frames to %s\n", num_frames, path);
+
+    return status_success;
+}
+
+void capture_stop(void)
+{
+    __capturing = 0;
+    while (__slot_count > 0) __collect_oldest();
+}
+
+int capture_active(void)
+{
+    return __capturing;
+}
+
+void capture_frame(void)
+{
+    __frame_t * frame = NULL;
+    __slot_t * slot = NULL;
+    int width = 0, height = 0;
+
+    if (!__prerun_done) return;
+
+    ++__frame_counter;
+
+    // reads are collected in the order they were issued, so frames appended to one file stay in order
+    while (__slot_count > 0 && __slot_ready(&__slots[__slot_head])) __collect_oldest();
+
+    if (!__capturing) return;
+
+    glfwGetFramebufferSize(glfwGetCurrentContext(), &width, &height);
+    if (width <= 0 || height <= 0) return;
+
+    if (__use_pbo && __slot_count == CAPTURE_RING_SIZE) __collect_oldest();
+
+    if (!(frame = __frame_acquire(width, height))) return;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    if (!__use_pbo)
+    {
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, frame->pixels);
+        __frame_submit(frame);
+    }
+    else
+    {
+        GLsizeiptr size = (GLsizeiptr)width * height * 4;
+
+        slot = &__slots[(__slot_head + __slot_count) % CAPTURE_RING_SIZE];
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+        if (slot->size < size)
+        {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+            slot->size = size;
+        }
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        if (__use_fences) slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot->issued = __frame_counter;
+        slot->frame = frame;
+        ++__slot_count;
+    }
+
+    pthread_mutex_lock(&__lock);
+    ++__stats.frames_read;
+    pthread_mutex_unlock(&__lock);
+
+    if (__num_frames > 0 && __next_number == __num_frames) __capturing = 0;
+}
+
+void capture_wait(void)
+{
+    // frames still in flight are in use but not handed to the writer yet
+    pthread_mutex_lock(&__lock);
+    while (__frames_in_use > __slot_count) pthread_cond_wait(&__done_cond, &__lock);
+    pthread_mutex_unlock(&__lock);
+}
+
+void capture_get_stats(capture_stats_t * stats)
+{
+    if (!stats)
+    {
+        LOG_ERROR("stats is NULL!\n");
+        return;
+    }
+
+    pthread_mutex_lock(&__lock);
+    memcpy(stats, &__stats, sizeof(__stats));
+    pthread_mutex_unlock(&__lock);
+}
+
+static void __capture_shutdown(void)
+{
+    __frame_t * frame = NULL;
+
+    if (!__initialized) return;
+
+    LOG_DEBUG("shutting down...\n");
+
+    // the writer finishes what is queued first
+    pthread_mutex_lock(&__lock);
+    __shutting_down = 1;
+    pthread_cond_broadcast(&__queued_cond);
+    pthread_mutex_unlock(&__lock);
+    pthread_join(__writer, NULL);
+
+    // reads still in flight went with the context
+    for (unsigned int idx = 0; idx < __slot_count; ++idx) __frame_release(__slots[(__slot_head + idx) % CAPTURE_RING_SIZE].frame);
+    __slot_count = 0;
+
+    while ((frame = __free_frames))
+    {
+        __free_frames = frame->next;
+        free(frame->pixels);
+        free(frame);
+    }
+
+    free(__png_rows);
+    free(__png_data);
+    __png_rows = __png_data = NULL;
+    __png_rows_capacity = __png_data_capacity = 0;
+    __prerun_done = 0;
+    __capturing = 0;
+    __initialized = 0;
+
+    LOG_DEBUG("shutdown complete\n");
+}
+
+// counts the conversions in path: %% escapes, and d, i, u, x, X or o with flags, width and precision but no
+// length, as they are handed an unsigned int. -1 for anything else.
+static int __path_conversions(const char * path)
+{
+    int count = 0;
+
+    while ((path = strchr(path, '%')))
+    {
+        if (*++path == '%')
+        {
+            ++path;
+            continue;
+        }
+
+        path += strspn(path, "-+ #0");
+        path += strspn(path, "0123456789");
+        if (*path == '.')
+        {
+            ++path;
+            path += strspn(path, "0123456789");
+        }
+
+        if (!*path || !strchr("diuxXo", *path)) return -1;
+        ++path;
+        ++count;
+    }
+
+    return count;
+}
+
+// old enough and, where fences tell, finished on the GPU
+static int __slot_ready(const __slot_t * slot)
+{
+    GLenum result = GL_TIMEOUT_EXPIRED;
+
+    if (__frame_counter - slot->issued < CAPTURE_LATENCY) return 0;
+    if (!slot->fence) return 1;
+
+    result = glClientWaitSync(slot->fence, 0, 0);
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+// maps the oldest read, waiting for it if it is not done yet
+static void __collect_oldest(void)
+{
+    __slot_t * slot = &__slots[__slot_head];
+    const void * map = NULL;
+
+    __slot_head = (__slot_head + 1) % CAPTURE_RING_SIZE;
+    --__slot_count;
+
+    if (slot->fence)
+    {
+        if (glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            pthread_mutex_lock(&__lock);
+            ++__stats.readback_stalls;
+            pthread_mutex_unlock(&__lock);
+
+            while (glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, CAPTURE_WAIT_NS) == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(slot->fence);
+        slot->fence = NULL;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->pbo);
+    if ((map = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY)))
+    {
+        memcpy(slot->frame->pixels, map, (size_t)slot->frame->width * slot->frame->height * 4);
+    }
+    if (!map || glUnmapBuffer(GL_PIXEL_PACK_BUFFER) != GL_TRUE)
+    {
+        LOG_ERROR("failed to map captured frame %lu\n", slot->frame->number);
+        map = NULL;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (map) __frame_submit(slot->frame);
+    else __frame_release(slot->frame);
+    slot->frame = NULL;
+}
+
+// takes the capture's next number, waiting for the writer when too many frames are held
+static __frame_t * __frame_acquire(int width, int height)
+{
+    size_t bytes = (size_t)width * height * 4;
+    __frame_t * frame = NULL;
+
+    pthread_mutex_lock(&__lock);
+    if (__frames_in_use == CAPTURE_MAX_QUEUED)
+    {
+        ++__stats.encoder_stalls;
+        while (__frames_in_use == CAPTURE_MAX_QUEUED) pthread_cond_wait(&__done_cond, &__lock);
+    }
+    ++__frames_in_use;
+    if ((frame = __free_frames)) __free_frames = frame->next;
+    pthread_mutex_unlock(&__lock);
+
+    if (!frame && !(frame = calloc(1, sizeof(__frame_t))))
+    {
+        LOG_ERROR("failed to allocate memory for a captured frame\n");
+        __frame_release(NULL);
+        return NULL;
+    }
+
+    if (frame->capacity < bytes)
+    {
+        unsigned char * pixels = realloc(frame->pixels, bytes);
+        if (!pixels)
+        {
+            LOG_ERROR("failed to allocate memory for a %dx%d captured frame\n", width, height);
+            __frame_release(frame);
+            return NULL;
+        }
+
+        frame->pixels = pixels;
+        frame->capacity = bytes;
+    }
+
+    frame->width = width;
+    frame->height = height;
+    frame->format = __format;
+    frame->number = __next_number;
+    frame->append = __append && __next_number > 0;
+    snprintf(frame->path, CAPTURE_MAX_PATH, __path, (unsigned int)__next_number);
+    frame->next = NULL;
+    ++__next_number;
+
+    return frame;
+}
+
+static void __frame_submit(__frame_t * frame)
+{
+    pthread_mutex_lock(&__lock);
+    if (__queue_tail) __queue_tail->next = frame;
+    else __queue_head = frame;
+    __queue_tail = frame;
+    pthread_cond_signal(&__queued_cond);
+    pthread_mutex_unlock(&__lock);
+}
+
+// NULL just gives back the frame's place in __frames_in_use
+static void __frame_release(__frame_t * frame)
+{
+    pthread_mutex_lock(&__lock);
+    if (frame)
+    {
+        frame->next = __free_frames;
+        __free_frames = frame;
+    }
+    --__frames_in_use;
+    pthread_cond_broadcast(&__done_cond);
+    pthread_mutex_unlock(&__lock);
+}
+
+static void * __writer_main(void * arg)
+{
+    __frame_t * frame = NULL;
+    status_e status = status_success;
+
+    pthread_mutex_lock(&__lock);
+    for (;;)
+    {
+        while (!__queue_head && !__shutting_down) pthread_cond_wait(&__queued_cond, &__lock);
+        if (!(frame = __queue_head)) break;
+
+        if (!(__queue_head = frame->next)) __queue_tail = NULL;
+        pthread_mutex_unlock(&__lock);
+
+        status = __write_frame(frame);
+
+        pthread_mutex_lock(&__lock);
+        if (status == status_success) ++__stats.frames_written;
+        else ++__stats.write_errors;
+        frame->next = __free_frames;
+        __free_frames = frame;
+        --__frames_in_use;
+        pthread_cond_broadcast(&__done_cond);
+    }
+    pthread_mutex_unlock(&__lock);
+
+    return NULL;
+}
+
+static status_e __write_frame(__frame_t * frame)
+{
+    FILE * file = fopen(frame->path, frame->append ? "ab" : "wb");
+    status_e status = status_success;
+
+    if (!file)
+    {
+        LOG_ERROR("failed to open %s\n", frame->path);
+        return status_error;
+    }
+
+    if (frame->format == capture_format_png) status = __write_png(file, frame);
+    else status = __write_raw(file, frame);
+    if (fclose(file) != 0) status = status_error;
+
+    if (status != status_success) LOG_ERROR("failed to write captured frame %lu to %s\n", frame->number, frame->path);
+
+    return status;
+}
+
+static status_e __write_raw(FILE * file, const __frame_t * frame)
+{
+    size_t stride = (size_t)frame->width * 4;
+
+    for (int row = frame->height - 1; row >= 0; --row)
+    {
+        if (fwrite(frame->pixels + row * stride, stride, 1, file) != 1) return status_error;
+    }
+
+    return status_success;
+}
+
+static status_e __write_png(FILE * file, const __frame_t * frame)
+{
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    size_t stride = (size_t)frame->width * 4, row_bytes = 1 + (size_t)frame->width * 3;
+    size_t rows_bytes = row_bytes * frame->height;
+    uLongf data_bytes = compressBound(rows_bytes);
+    unsigned char header[13];
+
+    if (__png_rows_capacity < rows_bytes)
+    {
+        unsigned char * rows = realloc(__png_rows, rows_bytes);
+        if (!rows) return status_error;
+        __png_rows = rows;
+        __png_rows_capacity = rows_bytes;
+    }
+
+    if (__png_data_capacity < data_bytes)
+    {
+        unsigned char * data = realloc(__png_data, data_bytes);
+        if (!data) return status_error;
+        __png_data = data;
+        __png_data_capacity = data_bytes;
+    }
+
+    // top row first, alpha dropped, each row stored as its difference from the one above
+    for (int y = 0; y < frame->height; ++y)
+    {
+        const unsigned char * src = frame->pixels + (frame->height - 1 - y) * stride;
+        const unsigned char * above = src + stride;
+        unsigned char * out = __png_rows + y * row_bytes;
+
+        *out++ = CAPTURE_PNG_FILTER_UP;
+        if (y == 0)
+        {
+            for (int x = 0; x < frame->width; ++x, out += 3, src += 4) memcpy(out, src, 3);
+            continue;
+        }
+
+        for (int x = 0; x < frame->width; ++x, out += 3, src += 4, above += 4)
+        {
+            out[0] = src[0] - above[0];
+            out[1] = src[1] - above[1];
+            out[2] = src[2] - above[2];
+        }
+    }
+
+    if (compress2(__png_data, &data_bytes, __png_rows, rows_bytes, CAPTURE_PNG_LEVEL) != Z_OK) return status_error;
+
+    __put_be32(header, frame->width);
+    __put_be32(header + 4, frame->height);
+    header[8] = 8;          // bits per channel
+    header[9] = 2;          // RGB
+    header[10] = 0;         // deflate
+    header[11] = 0;         // adaptive filtering
+    header[12] = 0;         // not interlaced
+
+    if (fwrite(signature, sizeof(signature), 1, file) != 1) return status_error;
+    if (__png_chunk(file, "IHDR", header, sizeof(header)) != status_success) return status_error;
+    if (__png_chunk(file, "IDAT", __png_data, data_bytes) != status_success) return status_error;
+    return __png_chunk(file, "IEND", NULL, 0);
+}
+
+static status_e __png_chunk(FILE * file, const char * type, const unsigned char * data, size_t len)
+{
+    unsigned char len_bytes[4], crc_bytes[4];
+    uLong crc = crc32(0L, (const Bytef *)type, 4);
+
+    if (len > 0) crc = crc32(crc, data, len);
+    __put_be32(len_bytes, len);
+    __put_be32(crc_bytes, crc);
+
+    if (fwrite(len_bytes, 4, 1, file) != 1 || fwrite(type, 4, 1, file) != 1) return status_error;
+    if (len > 0 && fwrite(data, len, 1, file) != 1) return status_error;
+    if (fwrite(crc_bytes, 4, 1, file) != 1) return status_error;
+
+    return status_success;
+}
+
+static void __put_be32(unsigned char * out, unsigned long value)
+{
+    out[0] = (value >> 24) & 0xff;
+    out[1] = (value >> 16) & 0xff;
+    out[2] = (value >> 8) & 0xff;
+    out[3] = value & 0xff;
+}
@@ -0,0 +1,237 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "cmdlist.h"
+
+#define CMDLIST_INITIAL_CAPACITY 256
+
+static cmdlist_cmd_t * __push(cmdlist_t * list, cmdlist_op_e op);
+static void __play(const cmdlist_cmd_t * cmd);
+
+void cmdlist_init(cmdlist_t * list)
+{
+    memset(list, 0, sizeof(cmdlist_t));
+    list->status = status_success;
+}
+
+void cmdlist_destroy(cmdlist_t * list)
+{
+    free(list->cmds);
+    cmdlist_init(list);
+}
+
+void cmdlist_reset(cmdlist_t * list)
+{
+    list->len = 0;
+    list->draws = 0;
+    list->status = status_success;
+}
+
+status_e cmdlist_enable(cmdlist_t * list, GLenum cap)
+{
+    cmdlist_cmd_t * cmd = __push(list, cmdlist_op_enable);
+    if (!cmd) return status_error;
+
+    cmd->args.cap = cap;
+    return status_success;
+}
+
+status_e cmdlist_disable(cmdlist_t * list, GLenum cap)
+{
+    cmdlist_cmd_t * cmd = __push(list, cmdlist_op_disable);
+    if (!cmd) return status_error;
+
+    cmd->args.cap = cap;
+    return status_success;
+}
+
+status_e cmdlist_blend_func(cmdlist_t * list, GLenum sfactor, GLenum dfactor)
+{
+    cmdlist_cmd_t * cmd = __push(list, cmdlist_op_blend_func);
+    if (!cmd) return status_error;
+
+    cmd->args.blend.sfactor = sfactor;
+    cmd->args.blend.dfactor = dfactor;
+    return status_success;
+}
+
+status_e cmdlist_depth_mask(cmdlist_t * list, GLboolean flag)
+{
+    cmdlist_cmd_t * cmd = __push(list, cmdlist_op_depth_mask);
+    if (!cmd) return status_error;
+
+    cmd->args.flag = flag;
+    return status_success;
+}
+
+status_e cmdlist_polygon_mode(cmdlist_t * list, GLenum mode)
+{
+    cmdlist_cmd_t * cmd = __push(list, cmdlist_op_polygon_mode);
+    if (!cmd) return status_error;
+
+    cmd->args.mode = mode;
+    return status_success;
+}
+
+status_e cmdlist_vertex_arrays(cmdlist_t * list, const GLfloat * vertices, const GLfloat * normals)
+{
+    cmdlist_cmd_t * cmd = __push(list, cmdlist_op_vertex_arrays);
+    if (!cmd) return status_error;
+
+    cmd->args.arrays.vertices = vertices;
+    cmd->args.arrays.normals = normals;
+    return status_success;
+}
+
+status_e cmdlist_instance_attribs(cmdlist_t * list, GLuint buffer, GLintptr offset, GLsizei stride,
+        GLuint first_attrib, GLuint num_attribs)
+{
+    cmdlist_cmd_t * cmd = __push(list, cmdlist_op_instance_attribs);
+    if (!cmd) return status_error;
+
+    cmd->args.instances.buffer = buffer;
+    cmd->args.instances.offset = offset;
+    cmd->args.instances.stride = stride;
+    cmd->args.instances.first_attrib = first_attrib;
+    cmd->args.instances.num_attribs = num_attribs;
+    return status_success;
+}
+
+status_e cmdlist_draw(cmdlist_t * list, const GLfloat * model, const GLfloat * color, GLsizei count, GLenum type,
+        const GLvoid * indices)
+{
+    cmdlist_cmd_t * cmd = __push(list, cmdlist_op_draw);
+    if (!cmd) return status_error;
+
+    cmd->args.draw.model = model;
+    cmd->args.draw.color = color;
+    cmd->args.draw.count = count;
+    cmd->args.draw.type = type;
+    cmd->args.draw.indices = indices;
+    cmd->args.draw.num_instances = 1;
+    ++list->draws;
+    return status_success;
+}
+
+status_e cmdlist_draw_instanced(cmdlist_t * list, GLsizei count, GLenum type, const GLvoid * indices, GLsizei num_instances)
+{
+    cmdlist_cmd_t * cmd = __push(list, cmdlist_op_draw_instanced);
+    if (!cmd) return status_error;
+
+    cmd->args.draw.model = NULL;
+    cmd->args.draw.color = NULL;
+    cmd->args.draw.count = count;
+    cmd->args.draw.type = type;
+    cmd->args.draw.indices = indices;
+    cmd->args.draw.num_instances = num_instances;
+    ++list->draws;
+    return status_success;
+}
+
+status_e cmdlist_play(const cmdlist_t * lists, unsigned int num_lists)
+{
+    if (!lists && num_lists > 0)
+    {
+        LOG_ERROR("lists is NULL!\n");
+        return status_error;
+    }
+
+    // a list that lost commands would leave gaps or wrong state in the frame, so nothing is drawn
+    for (unsigned int idx = 0; idx < num_lists; ++idx)
+    {
+        if (lists[idx].status != status_success)
+        {
+            LOG_ERROR("command list #%u is incomplete\n", idx);
+            return status_error;
+        }
+    }
+
+    for (unsigned int idx = 0; idx < num_lists; ++idx)
+    {
+        for (unsigned int cmd = 0; cmd < lists[idx].len; ++cmd) __play(&lists[idx].cmds[cmd]);
+    }
+
+    return status_success;
+}
+
+static cmdlist_cmd_t * __push(cmdlist_t * list, cmdlist_op_e op)
+{
+    cmdlist_cmd_t * cmd = NULL;
+
+    if (list->status != status_success) return NULL;
+
+    if (list->len == list->capacity)
+    {
+        unsigned int capacity = list->capacity ? list->capacity * 2 : CMDLIST_INITIAL_CAPACITY;
+        cmdlist_cmd_t * cmds = realloc(list->cmds, capacity * sizeof(cmdlist_cmd_t));
+
+        if (!cmds)
+        {
+            LOG_ERROR("failed to allocate memory for %u commands\n", capacity);
+            list->status = status_error;
+            return NULL;
+        }
+
+        list->cmds = cmds;
+        list->capacity = capacity;
+    }
+
+    cmd = &list->cmds[list->len++];
+    cmd->op = op;
+
+    return cmd;
+}
+
+static void __play(const cmdlist_cmd_t * cmd)
+{
+    switch (cmd->op)
+    {
+        case cmdlist_op_enable:
+            glEnable(cmd->args.cap);
+            break;
+        case cmdlist_op_disable:
+            glDisable(cmd->args.cap);
+            break;
+        case cmdlist_op_blend_func:
+            glBlendFunc(cmd->args.blend.sfactor, cmd->args.blend.dfactor);
+            break;
+        case cmdlist_op_depth_mask:
+            glDepthMask(cmd->args.flag);
+            break;
+        case cmdlist_op_polygon_mode:
+            glPolygonMode(GL_FRONT_AND_BACK, cmd->args.mode);
+            break;
+        case cmdlist_op_vertex_arrays:
+            glNormalPointer(GL_FLOAT, 0, cmd->args.arrays.normals);
+            glVertexPointer(3, GL_FLOAT, 0, cmd->args.arrays.vertices);
+            break;
+        case cmdlist_op_instance_attribs:
+            glBindBuffer(GL_ARRAY_BUFFER, cmd->args.instances.buffer);
+            for (GLuint attrib = 0; attrib < cmd->args.instances.num_attribs; ++attrib)
+            {
+                glVertexAttribPointer(cmd->args.instances.first_attrib + attrib, 4, GL_FLOAT, GL_FALSE, cmd->args.instances.stride,
+                        (const GLvoid *)(cmd->args.instances.offset + attrib * 4 * sizeof(GLfloat)));
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            break;
+        case cmdlist_op_draw:
+            if (cmd->args.draw.color) glColor4fv(cmd->args.draw.color);
+            if (!cmd->args.draw.model)
+            {
+                glDrawElements(GL_TRIANGLES, cmd->args.draw.count, cmd->args.draw.type, cmd->args.draw.indices);
+                break;
+            }
+
+            glPushMatrix();
+            glMultMatrixf(cmd->args.draw.model);
+            glDrawElements(GL_TRIANGLES, cmd->args.draw.count, cmd->args.draw.type, cmd->args.draw.indices);
+            glPopMatrix();
+            break;
+        case cmdlist_op_draw_instanced:
+            glDrawElementsInstanced(GL_TRIANGLES, cmd->args.draw.count, cmd->args.draw.type, cmd->args.draw.indices,
+                    cmd->args.draw.num_instances);
+            break;
+    }
+}
@@ -0,0 +1,176 @@
+#include <math.h>
+
+#if defined(__AVX__)
+#   include <immintrin.h>
+#elif defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+#include "logging.h"
+
+#include "cull.h"
+
+void cull_frustum_extract(cull_frustum_t * frustum, const mat4_t * view_projection)
+{
+    // Gribb/Hartmann: each plane is the last row of the clip matrix plus or minus one of the others
+    const float * m = view_projection->m;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int side = 0; side < 2; ++side)
+        {
+            float * plane = frustum->planes[axis * 2 + side];
+            float sign = side == 0 ? 1.0f : -1.0f, len = 0.0f;
+
+            for (int col = 0; col < 4; ++col)
+            {
+                plane[col] = m[col * 4 + 3] + sign * m[col * 4 + axis];
+            }
+
+            len = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            if (len > 0.0f)
+            {
+                for (int col = 0; col < 4; ++col)
+                {
+                    plane[col] /= len;
+                }
+            }
+        }
+    }
+}
+
+static unsigned int __cull_spheres_scalar(const cull_frustum_t * frustum, const float * x, const float * y,
+        const float * z, const float * radius, unsigned int count, unsigned char * results)
+{
+    unsigned int visible = 0;
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        cull_result_e result = cull_inside;
+
+        for (int plane = 0; plane < 6; ++plane)
+        {
+            const float * p = frustum->planes[plane];
+            float dist = p[0] * x[idx] + p[1] * y[idx] + p[2] * z[idx] + p[3];
+
+            if (dist < -radius[idx])
+            {
+                result = cull_outside;
+                break;
+            }
+
+            if (dist < radius[idx]) result = cull_intersecting;
+        }
+
+        results[idx] = result;
+        if (result != cull_outside) ++visible;
+    }
+
+    return visible;
+}
+
+unsigned int cull_spheres(const cull_frustum_t * frustum, const float * x, const float * y, const float * z,
+        const float * radius, unsigned int count, unsigned char * results)
+{
+    unsigned int idx = 0, visible = 0;
+
+    if (!frustum || !x || !y || !z || !radius || !results)
+    {
+        LOG_ERROR("NULL argument! (frustum = %p, x = %p, y = %p, z = %p, radius = %p, results = %p)\n",
+                frustum, x, y, z, radius, results);
+        return 0;
+    }
+
+#if defined(__AVX__)
+    // eight spheres against one plane per instruction
+    for (; idx + 8 <= count; idx += 8)
+    {
+        __m256 sx = _mm256_loadu_ps(x + idx), sy = _mm256_loadu_ps(y + idx), sz = _mm256_loadu_ps(z + idx);
+        __m256 r = _mm256_loadu_ps(radius + idx), neg_r = _mm256_sub_ps(_mm256_setzero_ps(), r);
+        __m256 outside = _mm256_setzero_ps(), intersecting = _mm256_setzero_ps();
+        int outside_bits = 0, intersecting_bits = 0;
+
+        for (int plane = 0; plane < 6; ++plane)
+        {
+            const float * p = frustum->planes[plane];
+            __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, _mm256_set1_ps(p[0])), _mm256_mul_ps(sy, _mm256_set1_ps(p[1]))),
+                    _mm256_add_ps(_mm256_mul_ps(sz, _mm256_set1_ps(p[2])), _mm256_set1_ps(p[3])));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(dist, neg_r, _CMP_LT_OQ));
+            intersecting = _mm256_or_ps(intersecting, _mm256_cmp_ps(dist, r, _CMP_LT_OQ));
+        }
+
+        outside_bits = _mm256_movemask_ps(outside);
+        intersecting_bits = _mm256_movemask_ps(intersecting);
+        for (int lane = 0; lane < 8; ++lane)
+        {
+            cull_result_e result = (outside_bits >> lane) & 1 ? cull_outside
+                : (intersecting_bits >> lane) & 1 ? cull_intersecting : cull_inside;
+            results[idx + lane] = result;
+            visible += result != cull_outside;
+        }
+    }
+#elif defined(__SSE2__)
+    // four spheres against one plane per instruction
+    for (; idx + 4 <= count; idx += 4)
+    {
+        __m128 sx = _mm_loadu_ps(x + idx), sy = _mm_loadu_ps(y + idx), sz = _mm_loadu_ps(z + idx);
+        __m128 r = _mm_loadu_ps(radius + idx), neg_r = _mm_sub_ps(_mm_setzero_ps(), r);
+        __m128 outside = _mm_setzero_ps(), intersecting = _mm_setzero_ps();
+        int outside_bits = 0, intersecting_bits = 0;
+
+        for (int plane = 0; plane < 6; ++plane)
+        {
+            const float * p = frustum->planes[plane];
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, _mm_set1_ps(p[0])), _mm_mul_ps(sy, _mm_set1_ps(p[1]))),
+                    _mm_add_ps(_mm_mul_ps(sz, _mm_set1_ps(p[2])), _mm_set1_ps(p[3])));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, neg_r));
+            intersecting = _mm_or_ps(intersecting, _mm_cmplt_ps(dist, r));
+        }
+
+        outside_bits = _mm_movemask_ps(outside);
+        intersecting_bits = _mm_movemask_ps(intersecting);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            cull_result_e result = (outside_bits >> lane) & 1 ? cull_outside
+                : (intersecting_bits >> lane) & 1 ? cull_intersecting : cull_inside;
+            results[idx + lane] = result;
+            visible += result != cull_outside;
+        }
+    }
+#endif
+
+    return visible + __cull_spheres_scalar(frustum, x + idx, y + idx, z + idx, radius + idx, count - idx, results + idx);
+}
+
+cull_result_e cull_aabb(const cull_frustum_t * frustum, vec3_t min, vec3_t max)
+{
+    cull_result_e result = cull_inside;
+
+    for (int plane = 0; plane < 6; ++plane)
+    {
+        const float * p = frustum->planes[plane];
+        // the corners furthest along and against the plane normal
+        float px = p[0] >= 0.0f ? max.x : min.x, nx = p[0] >= 0.0f ? min.x : max.x;
+        float py = p[1] >= 0.0f ? max.y : min.y, ny = p[1] >= 0.0f ? min.y : max.y;
+        float pz = p[2] >= 0.0f ? max.z : min.z, nz = p[2] >= 0.0f ? min.z : max.z;
+
+        if (p[0] * px + p[1] * py + p[2] * pz + p[3] < 0.0f) return cull_outside;
+        if (p[0] * nx + p[1] * ny + p[2] * nz + p[3] < 0.0f) result = cull_intersecting;
+    }
+
+    return result;
+}
+
+void cull_transform_aabb(const mat4_t * m, vec3_t min, vec3_t max, vec3_t * out_min, vec3_t * out_max)
+{
+    // Arvo: transform the center and grow the extents by the absolute matrix
+    vec3_t center = vec3_scale(vec3_add(min, max), 0.5f), extent = vec3_scale(vec3_sub(max, min), 0.5f);
+    vec3_t world_center = mat4_mul_point(m, center), world_extent;
+
+    world_extent.x = fabsf(m->m[0]) * extent.x + fabsf(m->m[4]) * extent.y + fabsf(m->m[8]) * extent.z;
+    world_extent.y = fabsf(m->m[1]) * extent.x + fabsf(m->m[5]) * extent.y + fabsf(m->m[9]) * extent.z;
+    world_extent.z = fabsf(m->m[2]) * extent.x + fabsf(m->m[6]) * extent.y + fabsf(m->m[10]) * extent.z;
+
+    *out_min = vec3_sub(world_center, world_extent);
+    *out_max = vec3_add(world_center, world_extent);
+}
@@ -1,6 +1,9 @@
 #include "array.h"
+#include "capture.h"
+#include "jobs.h"
 #include "logging.h"
 #include "render.h"
+#include "text.h"
 
 #include "engine.h"
 
@@ -56,6 +59,7 @@ static engine_render_cb __postrender_cb = NULL;
 static engine_update_cb __update_cb = NULL;
 static double __last_frame_update = 0.0;
 static engine_prerun_cb __prerun_cb = NULL;
+static GLFWwindow * __window = NULL;
 
 static void __engine_shutdown(void);
 static void __error_callback(int error, const char * description);
@@ -148,12 +152,30 @@ status_e engine_init(engine_ctx_t * ctx)
     glfwGetVersion(&glfw_major, &glfw_minor, &glfw_rev);
     LOG_DEBUG("running with GLFW v%d.%d.%d\n", glfw_major, glfw_minor, glfw_rev);
 
+    if ((status = jobs_init(0)) != status_success)
+    {
+        LOG_ERROR("failed to initialize job system!\n");
+        return status;
+    }
+
     if ((status = render_init()) != status_success)
     {
         LOG_ERROR("failed to initialized renderer!\n");
         return status;
     }
 
+    if ((status = text_init()) != status_success)
+    {
+        LOG_ERROR("failed to initialize text!\n");
+        return status;
+    }
+
+    if ((status = capture_init()) != status_success)
+    {
+        LOG_ERROR("failed to initialize capture!\n");
+        return status;
+    }
+
     __engine_initialized = 1;
 
     LOG_DEBUG("engine initialization complete\n");
@@ -213,6 +235,19 @@ status_e engine_run(void)
         return status_error;
     }
 
+    if (__ctx->core_profile)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    }
+
+    if (__ctx->hidden_window)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    }
+
     window = glfwCreateWindow(__ctx->window_width, __ctx->window_height, __ctx->window_title, NULL, NULL);
     if (!window)
     {
@@ -220,6 +255,8 @@ status_e engine_run(void)
         return status_error;
     }
 
+    __window = window;
+
     glfwSetKeyCallback(window, __key_callback);
     glfwSetCursorPosCallback(window, __mouse_pos_callback);
     if (__ctx->mouse_disabled)
@@ -265,6 +302,17 @@ status_e engine_run(void)
 	LOG_ERROR("renderer failed (%d) to setup prerun\n", status);
 	return status;
     }
+
+    // not fatal, text just doesn't show
+    if (text_prerun() != status_success)
+    {
+        LOG_ERROR("text failed to setup prerun, text is disabled\n");
+    }
+
+    if (capture_prerun() != status_success)
+    {
+        LOG_ERROR("capture failed to setup prerun\n");
+    }
     
     if (__prerun_cb) __prerun_cb();
 
@@ -280,19 +328,39 @@ status_e engine_run(void)
         if (__render_cb) __render_cb();
         render_objects();
 	if (__postrender_cb) __postrender_cb();
+        text_flush();
+        capture_frame();
         
         glfwSwapBuffers(window);
+        render_stats_next_frame();
 
         glfwPollEvents();
     }
 
+    // reads still in flight need the context
+    capture_stop();
+
     glfwDestroyWindow(window);
+    __window = NULL;
 
     LOG_DEBUG("window destroyed\n");
 
     return status_success;
 }
 
+status_e engine_stop(void)
+{
+    if (!__window)
+    {
+        LOG_ERROR("engine is not running!\n");
+        return status_error;
+    }
+
+    glfwSetWindowShouldClose(__window, GL_TRUE);
+
+    return status_success;
+}
+
 static void __error_callback(int error, const char * description)
 {
     LOG_ERROR("%s\n", description);
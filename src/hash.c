@@ -0,0 +1,204 @@
+#include <string.h>
+
+#include "logging.h"
+
+#include "hash.h"
+
+static status_e __hash_sanity_check(const hash_t * h);
+static status_e __hash_resize(hash_t * h, unsigned int capacity);
+static unsigned int __hash_slot(const hash_t * h, unsigned long key);
+
+status_e hash_init(hash_t * h)
+{
+    unsigned int capacity = 16;
+
+    if (!h)
+    {
+        LOG_ERROR("hash is NULL!\n");
+        return status_error;
+    }
+
+    if (h->len)
+    {
+        LOG_ERROR("hash is not empty (len = %d)!\n", h->len);
+        return status_error;
+    }
+
+    if (h->entries)
+    {
+        LOG_ERROR("entries is not NULL! (h->entries = %p)\n", h->entries);
+        return status_error;
+    }
+
+    while (capacity < h->capacity) capacity <<= 1;
+
+    if (!(h->entries = calloc(capacity, sizeof(hash_entry_t))))
+    {
+        LOG_ERROR("failed to allocate memory for hash\n");
+        return status_error;
+    }
+
+    h->capacity = capacity;
+    h->len = 0;
+
+    return status_success;
+}
+
+status_e hash_destroy(hash_t * h)
+{
+    if (__hash_sanity_check(h) != status_success) return status_error;
+
+    free(h->entries);
+    h->entries = NULL;
+    h->len = 0;
+    h->capacity = 0;
+
+    return status_success;
+}
+
+void * hash_get(const hash_t * h, unsigned long key)
+{
+    unsigned int slot = 0;
+
+    if (__hash_sanity_check(h) != status_success) return NULL;
+
+    for (slot = __hash_slot(h, key); h->entries[slot].used; slot = (slot + 1) & (h->capacity - 1))
+    {
+        if (h->entries[slot].key == key) return h->entries[slot].value;
+    }
+
+    return NULL;
+}
+
+status_e hash_set(hash_t * h, unsigned long key, void * value)
+{
+    status_e status = status_success;
+    unsigned int slot = 0;
+
+    if ((status = __hash_sanity_check(h)) != status_success) return status;
+
+    // keep the load factor under 3/4 so probe sequences stay short
+    if ((h->len + 1) * 4 > h->capacity * 3)
+    {
+        if ((status = __hash_resize(h, h->capacity * 2)) != status_success) return status;
+    }
+
+    for (slot = __hash_slot(h, key); h->entries[slot].used; slot = (slot + 1) & (h->capacity - 1))
+    {
+        if (h->entries[slot].key == key)
+        {
+            h->entries[slot].value = value;
+            return status_success;
+        }
+    }
+
+    h->entries[slot].key = key;
+    h->entries[slot].value = value;
+    h->entries[slot].used = 1;
+    ++h->len;
+
+    return status_success;
+}
+
+void * hash_remove(hash_t * h, unsigned long key)
+{
+    unsigned int slot = 0, next = 0, home = 0, mask = 0;
+    void * value = NULL;
+
+    if (__hash_sanity_check(h) != status_success) return NULL;
+
+    mask = h->capacity - 1;
+
+    for (slot = __hash_slot(h, key); h->entries[slot].used; slot = (slot + 1) & mask)
+    {
+        if (h->entries[slot].key == key) break;
+    }
+
+    if (!h->entries[slot].used)
+    {
+        LOG_ERROR("unable to find key %lu in hash %p!\n", key, h);
+        return NULL;
+    }
+
+    value = h->entries[slot].value;
+
+    // backward-shift deletion: pull later members of the probe run into the hole so that no tombstones are needed
+    for (next = (slot + 1) & mask; h->entries[next].used; next = (next + 1) & mask)
+    {
+        home = __hash_slot(h, h->entries[next].key);
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            h->entries[slot] = h->entries[next];
+            slot = next;
+        }
+    }
+
+    memset(&h->entries[slot], 0, sizeof(hash_entry_t));
+    --h->len;
+
+    return value;
+}
+
+static status_e __hash_sanity_check(const hash_t * h)
+{
+    if (!h)
+    {
+        LOG_ERROR("hash is NULL!\n");
+        return status_error;
+    }
+
+    if (!h->entries)
+    {
+        LOG_ERROR("hash %p: entries is NULL!\n", h);
+        return status_error;
+    }
+
+    if (h->len >= h->capacity)
+    {
+        LOG_ERROR("hash %p: overflow! len = %d, capacity = %d\n", h, h->len, h->capacity);
+        return status_error;
+    }
+
+    return status_success;
+}
+
+static status_e __hash_resize(hash_t * h, unsigned int capacity)
+{
+    hash_entry_t * old_entries = h->entries;
+    unsigned int old_capacity = h->capacity, idx = 0, slot = 0;
+
+    if (!(h->entries = calloc(capacity, sizeof(hash_entry_t))))
+    {
+        LOG_ERROR("hash %p failed to resize to capacity %d\n", h, capacity);
+        h->entries = old_entries;
+        return status_error;
+    }
+
+    h->capacity = capacity;
+
+    for (idx = 0; idx < old_capacity; ++idx)
+    {
+        if (!old_entries[idx].used) continue;
+
+        for (slot = __hash_slot(h, old_entries[idx].key); h->entries[slot].used; slot = (slot + 1) & (capacity - 1));
+        h->entries[slot] = old_entries[idx];
+    }
+
+    free(old_entries);
+
+    return status_success;
+}
+
+static unsigned int __hash_slot(const hash_t * h, unsigned long key)
+{
+    // 64-bit finalizer from MurmurHash3; ids are often sequential so they must be mixed before masking
+    unsigned long long x = key;
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    return (unsigned int)x & (h->capacity - 1);
+}
@@ -0,0 +1,200 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "logging.h"
+
+#include "jobs.h"
+
+#define MAX_WORKERS 64
+
+typedef struct
+{
+    jobs_range_fn fn;
+    void * data;
+    unsigned int count;
+    unsigned int grain;
+    unsigned int num_ranges;
+    unsigned int next_range;        // claimed with atomic increments
+    unsigned int done_ranges;       // guarded by __lock
+    unsigned int active_workers;    // guarded by __lock
+} __job_t;
+
+static int __initialized = 0;
+static pthread_t __workers[MAX_WORKERS];
+static unsigned int __num_workers = 0;
+static pthread_mutex_t __lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t __submit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t __done_cond = PTHREAD_COND_INITIALIZER;
+static __job_t __job;
+static unsigned long __job_generation = 0;
+static int __shutting_down = 0;
+
+static void __jobs_shutdown(void);
+static void * __worker_main(void * arg);
+static void __run_ranges(__job_t * job);
+
+status_e jobs_init(unsigned int num_workers)
+{
+    long num_cpus = 0;
+
+    if (__initialized)
+    {
+        LOG_ERROR("job system already initialized\n");
+        return status_error;
+    }
+
+    // one thread per core, the caller being one of them
+    if (num_workers == 0)
+    {
+        num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = num_cpus > 1 ? (unsigned int)num_cpus - 1 : 0;
+    }
+    if (num_workers > MAX_WORKERS) num_workers = MAX_WORKERS;
+
+    LOG_DEBUG("starting %u job workers\n", num_workers);
+
+    atexit(__jobs_shutdown);
+
+    __shutting_down = 0;
+    for (__num_workers = 0; __num_workers < num_workers; ++__num_workers)
+    {
+        if (pthread_create(&__workers[__num_workers], NULL, __worker_main, NULL) != 0)
+        {
+            LOG_ERROR("failed to start job worker #%u\n", __num_workers);
+            break;
+        }
+    }
+
+    __initialized = 1;
+
+    return status_success;
+}
+
+unsigned int jobs_num_threads(void)
+{
+    return __num_workers + 1;
+}
+
+status_e jobs_parallel_for(unsigned int count, unsigned int grain, jobs_range_fn fn, void * data)
+{
+    if (!fn)
+    {
+        LOG_ERROR("fn is NULL!\n");
+        return status_error;
+    }
+
+    if (count == 0) return status_success;
+    if (grain == 0) grain = 1;
+
+    // not worth waking anyone up for, but callers may index per-range results, so ranges stay the same size
+    if (__num_workers == 0 || count <= grain)
+    {
+        for (unsigned int begin = 0; begin < count; begin += grain)
+        {
+            fn(begin, count - begin > grain ? begin + grain : count, data);
+        }
+        return status_success;
+    }
+
+    // one job in flight at a time; callers from several threads simply queue up here
+    pthread_mutex_lock(&__submit_lock);
+
+    pthread_mutex_lock(&__lock);
+    __job.fn = fn;
+    __job.data = data;
+    __job.count = count;
+    __job.grain = grain;
+    __job.num_ranges = (count + grain - 1) / grain;
+    __job.next_range = 0;
+    __job.done_ranges = 0;
+    __job.active_workers = 0;
+    ++__job_generation;
+    pthread_cond_broadcast(&__work_cond);
+    pthread_mutex_unlock(&__lock);
+
+    __run_ranges(&__job);
+
+    pthread_mutex_lock(&__lock);
+    // workers still inside __run_ranges must be out before the job can be reused
+    while (__job.done_ranges < __job.num_ranges || __job.active_workers > 0)
+    {
+        pthread_cond_wait(&__done_cond, &__lock);
+    }
+    __job.fn = NULL;
+    pthread_mutex_unlock(&__lock);
+
+    pthread_mutex_unlock(&__submit_lock);
+
+    return status_success;
+}
+
+static void __run_ranges(__job_t * job)
+{
+    unsigned int range = 0, done = 0;
+
+    while ((range = __atomic_fetch_add(&job->next_range, 1, __ATOMIC_RELAXED)) < job->num_ranges)
+    {
+        unsigned int begin = range * job->grain;
+        unsigned int end = begin + job->grain < job->count ? begin + job->grain : job->count;
+
+        job->fn(begin, end, job->data);
+        ++done;
+    }
+
+    if (done == 0) return;
+
+    pthread_mutex_lock(&__lock);
+    job->done_ranges += done;
+    if (job->done_ranges == job->num_ranges) pthread_cond_broadcast(&__done_cond);
+    pthread_mutex_unlock(&__lock);
+}
+
+static void * __worker_main(void * arg)
+{
+    unsigned long seen_generation = 0;
+
+    pthread_mutex_lock(&__lock);
+    while (!__shutting_down)
+    {
+        if (__job_generation == seen_generation || !__job.fn)
+        {
+            pthread_cond_wait(&__work_cond, &__lock);
+            continue;
+        }
+
+        seen_generation = __job_generation;
+        ++__job.active_workers;
+        pthread_mutex_unlock(&__lock);
+
+        __run_ranges(&__job);
+
+        pthread_mutex_lock(&__lock);
+        if (--__job.active_workers == 0) pthread_cond_broadcast(&__done_cond);
+    }
+    pthread_mutex_unlock(&__lock);
+
+    return NULL;
+}
+
+static void __jobs_shutdown(void)
+{
+    if (!__initialized) return;
+
+    LOG_DEBUG("shutting down...\n");
+
+    pthread_mutex_lock(&__lock);
+    __shutting_down = 1;
+    pthread_cond_broadcast(&__work_cond);
+    pthread_mutex_unlock(&__lock);
+
+    for (unsigned int idx = 0; idx < __num_workers; ++idx)
+    {
+        pthread_join(__workers[idx], NULL);
+    }
+
+    __num_workers = 0;
+    __initialized = 0;
+
+    LOG_DEBUG("shutdown complete\n");
+}
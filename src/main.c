@@ -1,11 +1,24 @@
+#include <math.h>
 #include <memory.h>
 #include <string.h>
 #include <time.h>
 
+#include "anim.h"
 #include "array.h"
+#include "broadphase.h"
 #include "engine.h"
 #include "logging.h"
+#include "math3d.h"
+#include "region.h"
 #include "render.h"
+#include "voxel.h"
+
+#define WORLD_STREAM_RADIUS 384.0f      // in blocks
+#define WORLD_STREAM_BUDGET (256 << 20) // bytes of chunks
+#define WORLD_MESH_BUDGET 16            // chunks remeshed per frame
+#define PICK_DISTANCE 100.0f            // the far plane
+#define CUBE_SWAY 0.35f                 // how far the lower cubes swing either way, past the gap between them
+#define CUBE_SPIN_PERIOD 12.0f          // seconds per turn
 
 static void key_callback(GLFWwindow * window, int key, int scancode, int action, int mods);
 static void mouse_pos_callback(GLFWwindow * window, double xpos, double ypos);
@@ -19,16 +32,27 @@ static void update_callback(double delta);
 static void setup_scene(void);
 static int setup_lighting(void);
 static int add_objects_to_scene(void);
+static int add_terrain_to_scene(void);
 static void remove_objects_from_scene(void);
+static int log_contact(void * a, void * b, void * user);
+static int add_spin(render_ctx_t * ctx, float time, float speed);
 static int __camera_movement_direction[3] = { 0 };
 static GLdouble __camera_movement_inc[3] = { 1.0, 0.0, 0.5 };
 static GLdouble __camera_pos[3] = { 0.0 };
 static GLdouble __camera_rotation[2] = { 0.0 };
 static int __camera_rotation_direction[2] = { 0 };
 static GLdouble __camera_rotation_inc[2] = { 90.0, 60.0 };
+static vec3_t __camera_eye = { 0.0f, 0.0f, 0.0f };     // world space, from the last view
+static vec3_t __camera_forward = { 0.0f, 0.0f, -1.0f };
 static double __mouse_pos[2] = { 0.0 };
 static double __mouse_pos_last_frame[2] = { 0.0 };
 static array_t __cubes;
+static broadphase_t __contacts;                         // the cubes' bounds, for which of them touch
+static double __sway_time = 0.0;
+static unsigned int __num_contacts = 0;
+static anim_t __spins;
+static voxel_world_t __terrain;
+static const char * __world_dir = NULL;                 // region files streamed into the terrain, see region.h
 engine_ctx_t __engine_ctx;
 
 int main(int argc, char ** argv)
@@ -45,6 +69,11 @@ int main(int argc, char ** argv)
     __engine_ctx.window_height = 720;
     strncpy(__engine_ctx.window_title, "cubeworld", sizeof(__engine_ctx.window_title));
     __engine_ctx.mouse_disabled = 1;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "--core") == 0) __engine_ctx.core_profile = 1;
+        else if (strcmp(argv[arg], "--world") == 0 && arg + 1 < argc) __world_dir = argv[++arg];
+    }
     if ((status = engine_init(&__engine_ctx)) != status_success)
     {
         LOG_ERROR("engine_init failed (%d)\n", status);
@@ -180,6 +209,22 @@ static void mouse_enter_callback(GLFWwindow * window, int entered)
 static void mouse_button_callback(GLFWwindow * window, int button, int action, int mods)
 {
     LOG_DEBUG("window = %p, button = %d, action = %d, mods = %02x\n", window, button, action, mods);
+
+    // recolor whatever is under the crosshair
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+    {
+        render_ray_t ray = {
+            .origin = { __camera_eye.x, __camera_eye.y, __camera_eye.z },
+            .direction = { __camera_forward.x, __camera_forward.y, __camera_forward.z },
+            .max_distance = PICK_DISTANCE,
+        };
+        render_ray_hit_t hit;
+
+        if (!render_raycast(&ray, &hit)) return;
+
+        LOG_DEBUG("picked object %u at %.2f (%.2f, %.2f, %.2f)\n", hit.object, hit.distance, hit.point[0], hit.point[1], hit.point[2]);
+        render_object_set_color(hit.object, rand() / (GLfloat)RAND_MAX, rand() / (GLfloat)RAND_MAX, rand() / (GLfloat)RAND_MAX, 1.0f);
+    }
 }
 
 static void mouse_scroll_callback(GLFWwindow * window, double xoffset, double yoffset)
@@ -195,30 +240,35 @@ static void framebuffer_size_callback(GLFWwindow * window, int width, int height
 
 static void render_callback()
 {
-    // hud
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    glBegin(GL_LINES);
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glVertex3f(-0.01f, 0.0f, -1.0f);
-    glVertex3f(0.01f, 0.0f, -1.0f);
-    glVertex3f(0.0f, -0.01f, -1.0f);
-    glVertex3f(0.0f, 0.01f, -1.0f);
-    glEnd();
-
-    // camera
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    
-    // deprecated but multi-platform and functional
-    gluPerspective(45, __engine_ctx.window_width / (double)__engine_ctx.window_height, 0.01, 100);
+    mat4_t projection, translation, yaw, pitch, view, inverse;
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    // hud (immediate mode only exists in the compatibility profile)
+    if (!__engine_ctx.core_profile)
+    {
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        glBegin(GL_LINES);
+        glColor3f(1.0f, 1.0f, 1.0f);
+        glVertex3f(-0.01f, 0.0f, -1.0f);
+        glVertex3f(0.01f, 0.0f, -1.0f);
+        glVertex3f(0.0f, -0.01f, -1.0f);
+        glVertex3f(0.0f, 0.01f, -1.0f);
+        glEnd();
+    }
 
-    glTranslated(__camera_pos[0], __camera_pos[1], __camera_pos[2]);
-    glRotated(__camera_rotation[0], 0.0, 1.0, 0.0);
-    glRotated(__camera_rotation[1], 1.0, 0.0, 0.0);
+    // camera
+    mat4_perspective(&projection, 45.0f, __engine_ctx.window_width / (float)__engine_ctx.window_height, 0.01f, 100.0f);
+    mat4_translation(&translation, vec3_make(__camera_pos[0], __camera_pos[1], __camera_pos[2]));
+    mat4_rotation(&yaw, __camera_rotation[0], vec3_make(0.0f, 1.0f, 0.0f));
+    mat4_rotation(&pitch, __camera_rotation[1], vec3_make(1.0f, 0.0f, 0.0f));
+    mat4_mul(&view, &translation, &yaw);
+    mat4_mul(&view, &view, &pitch);
+    render_set_camera(&view, &projection);
+    if (mat4_inverse(&inverse, &view))
+    {
+        __camera_eye = mat4_mul_point(&inverse, vec3_make(0.0f, 0.0f, 0.0f));
+        __camera_forward = vec3_sub(mat4_mul_point(&inverse, vec3_make(0.0f, 0.0f, -1.0f)), __camera_eye);
+    }
 }
 
 static void postrender_callback()
@@ -279,14 +329,35 @@ static void update_callback(double delta)
     __update_camera_rotation(delta, 0);
     __update_camera_rotation(delta, 1);
 
-    // rotate cubes
-    /*
+    // page regions in and out around the camera, then remesh any terrain chunks that changed
+    region_stream_update(__camera_eye);
+    voxel_world_update(&__terrain, NULL);
+
+    // sway the lower cubes into each other, then find the ones touching from the bounds of the last frame
+    __sway_time += delta;
     for (unsigned long idx = 0; idx < __cubes.len; ++idx)
     {
         render_ctx_t * ctx = (render_ctx_t *) array_get(&__cubes, idx);
-        ctx->rotation_angle += delta * 5.0f;
+        GLfloat min[3], max[3];
+
+        if (idx % 2 == 0)
+        {
+            render_ctx_set_position(ctx, -2.25f + 1.5f * (idx / 2) + CUBE_SWAY * sin(__sway_time + idx), ctx->pos[1], ctx->pos[2]);
+        }
+
+        if (render_object_get_bounds(ctx->handle, min, max) != status_success) continue;
+        broadphase_move(&__contacts, idx, vec3_make(min[0], min[1], min[2]), vec3_make(max[0], max[1], max[2]));
     }
-    */
+
+    if (broadphase_update(&__contacts) != __num_contacts)
+    {
+        __num_contacts = __contacts.num_pairs;
+        LOG_DEBUG("%u cube contacts\n", __num_contacts);
+        broadphase_for_each_pair(&__contacts, log_contact, NULL);
+    }
+
+    // spin cubes
+    anim_update(&__spins, delta);
 }
 
 static void setup_scene(void)
@@ -294,27 +365,25 @@ static void setup_scene(void)
     if (!setup_lighting()) return;
 
     if (!add_objects_to_scene()) return;
+
+    if (!add_terrain_to_scene()) return;
 }
 
 static int setup_lighting(void)
 {
-    GLfloat mat_ambient[] = { 1.0, 1.0, 1.0, 1.0 };
-    GLfloat mat_diffuse[] = { 1.0, 1.0, 1.0, 1.0 };
-    GLfloat mat_specular[] = { 1.0, 1.0, 1.0, 1.0 };
-    //GLfloat mat_emission[] = { 0.1, 0.1, 0.1, 1.0 }; // makes all materials same color
-    GLfloat mat_shininess[] = { 128.0 };
-    GLfloat light0_position[] = { 1.0, 1.0, 1.0, 0.0 };
-    glShadeModel (GL_SMOOTH);
-
-    glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-    glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
-    //glMaterialfv(GL_FRONT, GL_EMISSION, mat_emission);
-    glLightfv(GL_LIGHT0, GL_POSITION, light0_position); // TODO need more lights?
-
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
+    // ambient and diffuse material colors come from each object's color
+    render_lighting_t lighting = {
+        .enabled = 1,
+        .global_ambient = { 0.2, 0.2, 0.2, 1.0 },
+        .light_position = { 1.0, 1.0, 1.0, 0.0 }, // TODO need more lights?
+        .light_ambient = { 0.0, 0.0, 0.0, 1.0 },
+        .light_diffuse = { 1.0, 1.0, 1.0, 1.0 },
+        .light_specular = { 1.0, 1.0, 1.0, 1.0 },
+        .material_specular = { 1.0, 1.0, 1.0, 1.0 },
+        .material_shininess = 128.0,
+    };
+
+    render_set_lighting(&lighting);
 
     return 1;
 }
@@ -324,6 +393,8 @@ static int add_objects_to_scene(void)
     srand(time(0));
 
     array_init(&__cubes);
+    if (broadphase_init(&__contacts, broadphase_sap, 0.0f) != status_success) return 0;
+    if (anim_init(&__spins) != status_success) return 0;
     atexit(remove_objects_from_scene);
     for (int x = 0; x < 4; ++x)
     {
@@ -349,14 +420,83 @@ static int add_objects_to_scene(void)
             if (array_push(&__cubes, ctx) != status_success) return 0;
     
             if (render_add_object(ctx) != status_success) return 0;
+
+            // proxies match the cubes' indices, as they are the first handed out
+            if (broadphase_add(&__contacts, vec3_make(ctx->pos[0] - 0.5f, ctx->pos[1] - 0.5f, ctx->pos[2] - 0.5f),
+                        vec3_make(ctx->pos[0] + 0.5f, ctx->pos[1] + 0.5f, ctx->pos[2] + 0.5f), ctx) == BROADPHASE_NULL) return 0;
+
+            // the rows spin opposite ways, out of step
+            if (!add_spin(ctx, x * CUBE_SPIN_PERIOD / 8.0f, y % 2 == 0 ? 1.0f : -1.0f)) return 0;
         } 
     }
 
     return 1;
 }
 
+static int add_terrain_to_scene(void)
+{
+    if (voxel_world_init(&__terrain, 1000) != status_success) return 0;
+    voxel_world_set_color(&__terrain, 0.35f, 0.6f, 0.3f, 1.0f);
+
+    // a streamed world arrives a region at a time, so its remeshing is spread over frames
+    if (__world_dir)
+    {
+        voxel_world_set_mesh_budget(&__terrain, WORLD_MESH_BUDGET);
+        return region_stream_start(&__terrain, __world_dir, WORLD_STREAM_RADIUS, WORLD_STREAM_BUDGET) == status_success;
+    }
+
+    // rolling hills below the cubes, meshed by the first update
+    for (int z = -64; z < 16; ++z)
+    {
+        for (int x = -40; x < 40; ++x)
+        {
+            int height = (int)(2.0 + 2.0 * sin(x * 0.15) * cos(z * 0.11));
+
+            for (int y = -8; y < height - 4; ++y)
+            {
+                if (voxel_set_block(&__terrain, x, y, z, 1) != status_success) return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
 static void remove_objects_from_scene(void)
 {
+    region_stream_stop();
+    anim_destroy(&__spins);
+    broadphase_destroy(&__contacts);
     array_destroy(&__cubes);
 }
 
+static int log_contact(void * a, void * b, void * user)
+{
+    LOG_DEBUG("cubes %u and %u touch\n", ((render_ctx_t *) a)->handle, ((render_ctx_t *) b)->handle);
+
+    return 1;
+}
+
+// a turn in thirds, as slerp takes the short way between keys
+static int add_spin(render_ctx_t * ctx, float time, float speed)
+{
+    vec3_t axis = vec3_make(ctx->rotation_vector[0], ctx->rotation_vector[1], ctx->rotation_vector[2]);
+    float times[4], keys[4][4];
+
+    for (int key = 0; key < 4; ++key)
+    {
+        quat_t q = quat_from_axis_angle(axis, ctx->rotation_angle + 120.0f * key);
+
+        times[key] = key * CUBE_SPIN_PERIOD / 3.0f;
+        keys[key][0] = q.x;
+        keys[key][1] = q.y;
+        keys[key][2] = q.z;
+        keys[key][3] = q.w;
+    }
+
+    if (anim_add_track(&__spins, ctx->handle, anim_rotation, times, &keys[0][0], 4, 1) != status_success) return 0;
+    anim_set_time(&__spins, ctx->handle, time);
+    anim_set_speed(&__spins, ctx->handle, speed);
+
+    return 1;
+}
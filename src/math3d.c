@@ -0,0 +1,707 @@
+#include <math.h>
+#include <string.h>
+
+#if defined(__AVX__)
+#   include <immintrin.h>
+#elif defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+#include "logging.h"
+
+#include "math3d.h"
+
+#define DEG_TO_RAD(d) ((d) * (float)M_PI / 180.0f)
+
+vec3_t vec3_make(float x, float y, float z)
+{
+    vec3_t v = { x, y, z };
+    return v;
+}
+
+vec3_t vec3_add(vec3_t a, vec3_t b)
+{
+    return vec3_make(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+vec3_t vec3_sub(vec3_t a, vec3_t b)
+{
+    return vec3_make(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+vec3_t vec3_scale(vec3_t v, float s)
+{
+    return vec3_make(v.x * s, v.y * s, v.z * s);
+}
+
+vec3_t vec3_mul(vec3_t a, vec3_t b)
+{
+    return vec3_make(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+
+vec3_t vec3_min(vec3_t a, vec3_t b)
+{
+    return vec3_make(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z);
+}
+
+vec3_t vec3_max(vec3_t a, vec3_t b)
+{
+    return vec3_make(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z);
+}
+
+vec3_t vec3_lerp(vec3_t a, vec3_t b, float t)
+{
+    return vec3_make(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+}
+
+float vec3_dot(vec3_t a, vec3_t b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+vec3_t vec3_cross(vec3_t a, vec3_t b)
+{
+    return vec3_make(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+float vec3_length(vec3_t v)
+{
+    return sqrtf(vec3_dot(v, v));
+}
+
+vec3_t vec3_normalize(vec3_t v)
+{
+    float len = vec3_length(v);
+    return len > 0.0f ? vec3_scale(v, 1.0f / len) : v;
+}
+
+vec4_t vec4_make(float x, float y, float z, float w)
+{
+    vec4_t v = { x, y, z, w };
+    return v;
+}
+
+vec4_t vec4_add(vec4_t a, vec4_t b)
+{
+    return vec4_make(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+}
+
+vec4_t vec4_scale(vec4_t v, float s)
+{
+    return vec4_make(v.x * s, v.y * s, v.z * s, v.w * s);
+}
+
+vec4_t vec4_lerp(vec4_t a, vec4_t b, float t)
+{
+    return vec4_make(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t);
+}
+
+float vec4_dot(vec4_t a, vec4_t b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+void mat4_identity(mat4_t * out)
+{
+    memset(out, 0, sizeof(mat4_t));
+    out->m[0] = out->m[5] = out->m[10] = out->m[15] = 1.0f;
+}
+
+void mat4_mul(mat4_t * out, const mat4_t * a, const mat4_t * b)
+{
+    mat4_t result;
+
+#if defined(__SSE2__)
+    __m128 a0 = _mm_load_ps(&a->m[0]), a1 = _mm_load_ps(&a->m[4]), a2 = _mm_load_ps(&a->m[8]), a3 = _mm_load_ps(&a->m[12]);
+
+    // every column of the result is a linear combination of a's columns
+    for (int col = 0; col < 4; ++col)
+    {
+        const float * bc = &b->m[col * 4];
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+        _mm_store_ps(&result.m[col * 4], r);
+    }
+#else
+    for (int col = 0; col < 4; ++col)
+    {
+        for (int row = 0; row < 4; ++row)
+        {
+            result.m[col * 4 + row] = a->m[row] * b->m[col * 4] + a->m[4 + row] * b->m[col * 4 + 1]
+                + a->m[8 + row] * b->m[col * 4 + 2] + a->m[12 + row] * b->m[col * 4 + 3];
+        }
+    }
+#endif
+
+    *out = result;
+}
+
+vec4_t mat4_mul_vec4(const mat4_t * m, vec4_t v)
+{
+    vec4_t result;
+
+#if defined(__SSE2__)
+    __m128 r = _mm_mul_ps(_mm_load_ps(&m->m[0]), _mm_set1_ps(v.x));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(&m->m[4]), _mm_set1_ps(v.y)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(&m->m[8]), _mm_set1_ps(v.z)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(&m->m[12]), _mm_set1_ps(v.w)));
+    _mm_store_ps(&result.x, r);
+#else
+    result.x = m->m[0] * v.x + m->m[4] * v.y + m->m[8] * v.z + m->m[12] * v.w;
+    result.y = m->m[1] * v.x + m->m[5] * v.y + m->m[9] * v.z + m->m[13] * v.w;
+    result.z = m->m[2] * v.x + m->m[6] * v.y + m->m[10] * v.z + m->m[14] * v.w;
+    result.w = m->m[3] * v.x + m->m[7] * v.y + m->m[11] * v.z + m->m[15] * v.w;
+#endif
+
+    return result;
+}
+
+vec3_t mat4_mul_point(const mat4_t * m, vec3_t p)
+{
+    vec4_t r = mat4_mul_vec4(m, vec4_make(p.x, p.y, p.z, 1.0f));
+    return vec3_make(r.x, r.y, r.z);
+}
+
+void mat4_transpose(mat4_t * out, const mat4_t * m)
+{
+    mat4_t result;
+
+    for (int col = 0; col < 4; ++col)
+    {
+        for (int row = 0; row < 4; ++row)
+        {
+            result.m[row * 4 + col] = m->m[col * 4 + row];
+        }
+    }
+
+    *out = result;
+}
+
+int mat4_inverse(mat4_t * out, const mat4_t * m)
+{
+    // cofactor expansion; returns 0 and leaves out untouched for singular matrices
+    const float * a = m->m;
+    float inv[16], det = 0.0f;
+
+    inv[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+    inv[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+    inv[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+    inv[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+    inv[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+    inv[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+    inv[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+    inv[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+    inv[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+    inv[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+    inv[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+    inv[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+    inv[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+    inv[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+    inv[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+    inv[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+    det = a[0] * inv[0] + a[1] * inv[4] + a[2] * inv[8] + a[3] * inv[12];
+    if (det == 0.0f) return 0;
+
+    det = 1.0f / det;
+    for (int idx = 0; idx < 16; ++idx)
+    {
+        out->m[idx] = inv[idx] * det;
+    }
+
+    return 1;
+}
+
+void mat4_translation(mat4_t * out, vec3_t t)
+{
+    mat4_identity(out);
+    out->m[12] = t.x;
+    out->m[13] = t.y;
+    out->m[14] = t.z;
+}
+
+void mat4_scaling(mat4_t * out, vec3_t s)
+{
+    mat4_identity(out);
+    out->m[0] = s.x;
+    out->m[5] = s.y;
+    out->m[10] = s.z;
+}
+
+void mat4_rotation(mat4_t * out, float angle_degrees, vec3_t axis)
+{
+    mat4_from_quat(out, quat_from_axis_angle(axis, angle_degrees));
+}
+
+void mat4_from_quat(mat4_t * out, quat_t q)
+{
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    out->m[0] = 1.0f - 2.0f * (yy + zz);
+    out->m[1] = 2.0f * (xy + wz);
+    out->m[2] = 2.0f * (xz - wy);
+    out->m[3] = 0.0f;
+    out->m[4] = 2.0f * (xy - wz);
+    out->m[5] = 1.0f - 2.0f * (xx + zz);
+    out->m[6] = 2.0f * (yz + wx);
+    out->m[7] = 0.0f;
+    out->m[8] = 2.0f * (xz + wy);
+    out->m[9] = 2.0f * (yz - wx);
+    out->m[10] = 1.0f - 2.0f * (xx + yy);
+    out->m[11] = 0.0f;
+    out->m[12] = out->m[13] = out->m[14] = 0.0f;
+    out->m[15] = 1.0f;
+}
+
+void mat4_perspective(mat4_t * out, float fovy_degrees, float aspect, float z_near, float z_far)
+{
+    // same matrix gluPerspective builds
+    float f = 1.0f / tanf(DEG_TO_RAD(fovy_degrees) * 0.5f);
+
+    memset(out, 0, sizeof(mat4_t));
+    out->m[0] = f / aspect;
+    out->m[5] = f;
+    out->m[10] = (z_far + z_near) / (z_near - z_far);
+    out->m[11] = -1.0f;
+    out->m[14] = 2.0f * z_far * z_near / (z_near - z_far);
+}
+
+void mat4_compose(mat4_t * out, vec3_t pos, vec3_t scale, quat_t rotation)
+{
+    mat4_compose_batch_scalar(out->m, 16, &pos, &scale, &rotation, 1);
+}
+
+quat_t quat_identity(void)
+{
+    quat_t q = { 0.0f, 0.0f, 0.0f, 1.0f };
+    return q;
+}
+
+quat_t quat_from_axis_angle(vec3_t axis, float angle_degrees)
+{
+    quat_t q = quat_identity();
+    float len = vec3_length(axis), half = DEG_TO_RAD(angle_degrees) * 0.5f, s = 0.0f;
+
+    // glRotatef treats a zero axis as no rotation
+    if (len == 0.0f || angle_degrees == 0.0f) return q;
+
+    s = sinf(half) / len;
+    q.x = axis.x * s;
+    q.y = axis.y * s;
+    q.z = axis.z * s;
+    q.w = cosf(half);
+
+    return q;
+}
+
+quat_t quat_mul(quat_t a, quat_t b)
+{
+    quat_t q;
+
+    q.x = a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y;
+    q.y = a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x;
+    q.z = a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w;
+    q.w = a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z;
+
+    return q;
+}
+
+quat_t quat_normalize(quat_t q)
+{
+    float len = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+
+    if (len == 0.0f) return quat_identity();
+
+    len = 1.0f / len;
+    q.x *= len;
+    q.y *= len;
+    q.z *= len;
+    q.w *= len;
+
+    return q;
+}
+
+quat_t quat_nlerp(quat_t a, quat_t b, float t)
+{
+    float sign = (a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w) < 0.0f ? -1.0f : 1.0f;
+    quat_t q;
+
+    q.x = a.x + (sign * b.x - a.x) * t;
+    q.y = a.y + (sign * b.y - a.y) * t;
+    q.z = a.z + (sign * b.z - a.z) * t;
+    q.w = a.w + (sign * b.w - a.w) * t;
+
+    return quat_normalize(q);
+}
+
+quat_t quat_slerp(quat_t a, quat_t b, float t)
+{
+    float cos_theta = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    float theta = 0.0f, sin_theta = 0.0f, wa = 0.0f, wb = 0.0f;
+    quat_t q;
+
+    // take the short way around
+    if (cos_theta < 0.0f)
+    {
+        cos_theta = -cos_theta;
+        b.x = -b.x;
+        b.y = -b.y;
+        b.z = -b.z;
+        b.w = -b.w;
+    }
+
+    // nearly parallel: the sine below loses all precision and nlerp is indistinguishable
+    if (cos_theta > 0.9995f) return quat_nlerp(a, b, t);
+
+    theta = acosf(cos_theta);
+    sin_theta = sinf(theta);
+    wa = sinf((1.0f - t) * theta) / sin_theta;
+    wb = sinf(t * theta) / sin_theta;
+
+    q.x = a.x * wa + b.x * wb;
+    q.y = a.y * wa + b.y * wb;
+    q.z = a.z * wa + b.z * wb;
+    q.w = a.w * wa + b.w * wb;
+
+    return q;
+}
+
+vec3_t quat_rotate(quat_t q, vec3_t v)
+{
+    vec3_t u = vec3_make(q.x, q.y, q.z);
+    vec3_t t = vec3_scale(vec3_cross(u, v), 2.0f);
+
+    return vec3_add(vec3_add(v, vec3_scale(t, q.w)), vec3_cross(u, t));
+}
+
+void mat4_compose_batch_scalar(float * out, unsigned int out_stride,
+        const vec3_t * pos, const vec3_t * scale, const quat_t * rotation, unsigned int count)
+{
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        const quat_t * q = &rotation[idx];
+        const vec3_t * s = &scale[idx];
+        float * m = out + idx * out_stride;
+        float xx = q->x * q->x, yy = q->y * q->y, zz = q->z * q->z;
+        float xy = q->x * q->y, xz = q->x * q->z, yz = q->y * q->z;
+        float wx = q->w * q->x, wy = q->w * q->y, wz = q->w * q->z;
+
+        // scale applies after rotation, so it scales the rows of the rotation
+        m[0] = s->x * (1.0f - 2.0f * (yy + zz));
+        m[1] = s->y * 2.0f * (xy + wz);
+        m[2] = s->z * 2.0f * (xz - wy);
+        m[3] = 0.0f;
+        m[4] = s->x * 2.0f * (xy - wz);
+        m[5] = s->y * (1.0f - 2.0f * (xx + zz));
+        m[6] = s->z * 2.0f * (yz + wx);
+        m[7] = 0.0f;
+        m[8] = s->x * 2.0f * (xz + wy);
+        m[9] = s->y * 2.0f * (yz - wx);
+        m[10] = s->z * (1.0f - 2.0f * (xx + yy));
+        m[11] = 0.0f;
+        m[12] = pos[idx].x;
+        m[13] = pos[idx].y;
+        m[14] = pos[idx].z;
+        m[15] = 1.0f;
+    }
+}
+
+#if defined(__SSE2__)
+
+// loads the x, y and z of four packed vec3s (three unaligned loads) into one register each
+static void __load_vec3x4(const vec3_t * v, __m128 * x, __m128 * y, __m128 * z)
+{
+    const float * f = &v->x;
+    __m128 a = _mm_loadu_ps(f), b = _mm_loadu_ps(f + 4), c = _mm_loadu_ps(f + 8);
+
+    // a = x0 y0 z0 x1, b = y1 z1 x2 y2, c = z2 x3 y3 z3
+    *x = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 2, 3, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)),
+            _MM_SHUFFLE(2, 0, 1, 0));
+    *y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+            _MM_SHUFFLE(2, 0, 2, 0));
+    *z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+            _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+static void __load_quatx4(const quat_t * q, __m128 * x, __m128 * y, __m128 * z, __m128 * w)
+{
+    __m128 a = _mm_loadu_ps(&q[0].x), b = _mm_loadu_ps(&q[1].x), c = _mm_loadu_ps(&q[2].x), d = _mm_loadu_ps(&q[3].x);
+
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    *x = a;
+    *y = b;
+    *z = c;
+    *w = d;
+}
+
+#endif
+
+#if defined(__AVX__)
+
+#define LANES 8
+typedef __m256 lane_t;
+#define lane_set1 _mm256_set1_ps
+#define lane_add _mm256_add_ps
+#define lane_sub _mm256_sub_ps
+#define lane_mul _mm256_mul_ps
+#define lane_div _mm256_div_ps
+#define lane_sqrt _mm256_sqrt_ps
+#define lane_and _mm256_and_ps
+#define lane_xor _mm256_xor_ps
+#define lane_load _mm256_loadu_ps
+#define lane_store _mm256_storeu_ps
+
+static void __load_vec3(const vec3_t * v, lane_t * x, lane_t * y, lane_t * z)
+{
+    __m128 x0, y0, z0, x1, y1, z1;
+
+    __load_vec3x4(v, &x0, &y0, &z0);
+    __load_vec3x4(v + 4, &x1, &y1, &z1);
+    *x = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+    *y = _mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1);
+    *z = _mm256_insertf128_ps(_mm256_castps128_ps256(z0), z1, 1);
+}
+
+static void __load_quat(const quat_t * q, lane_t * x, lane_t * y, lane_t * z, lane_t * w)
+{
+    __m128 x0, y0, z0, w0, x1, y1, z1, w1;
+
+    __load_quatx4(q, &x0, &y0, &z0, &w0);
+    __load_quatx4(q + 4, &x1, &y1, &z1, &w1);
+    *x = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+    *y = _mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1);
+    *z = _mm256_insertf128_ps(_mm256_castps128_ps256(z0), z1, 1);
+    *w = _mm256_insertf128_ps(_mm256_castps128_ps256(w0), w1, 1);
+}
+
+// transposes four 8-lane rows into one matrix column per object; the 128-bit
+// halves are transposed independently so the upper half holds objects 4..7
+static void __store_column(float * out, unsigned int out_stride, int col, lane_t a, lane_t b, lane_t c, lane_t d)
+{
+    __m256 t0 = _mm256_unpacklo_ps(a, b), t1 = _mm256_unpackhi_ps(a, b);
+    __m256 t2 = _mm256_unpacklo_ps(c, d), t3 = _mm256_unpackhi_ps(c, d);
+    __m256 r[4];
+
+    r[0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    r[1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    r[2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    r[3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+    for (int obj = 0; obj < 4; ++obj)
+    {
+        _mm_storeu_ps(out + obj * out_stride + col * 4, _mm256_castps256_ps128(r[obj]));
+        _mm_storeu_ps(out + (obj + 4) * out_stride + col * 4, _mm256_extractf128_ps(r[obj], 1));
+    }
+}
+
+#elif defined(__SSE2__)
+
+#define LANES 4
+typedef __m128 lane_t;
+#define lane_set1 _mm_set1_ps
+#define lane_add _mm_add_ps
+#define lane_sub _mm_sub_ps
+#define lane_mul _mm_mul_ps
+#define lane_div _mm_div_ps
+#define lane_sqrt _mm_sqrt_ps
+#define lane_and _mm_and_ps
+#define lane_xor _mm_xor_ps
+#define lane_load _mm_loadu_ps
+#define lane_store _mm_storeu_ps
+#define __load_vec3 __load_vec3x4
+#define __load_quat __load_quatx4
+
+static void __store_column(float * out, unsigned int out_stride, int col, lane_t a, lane_t b, lane_t c, lane_t d)
+{
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    _mm_storeu_ps(out + col * 4, a);
+    _mm_storeu_ps(out + out_stride + col * 4, b);
+    _mm_storeu_ps(out + 2 * out_stride + col * 4, c);
+    _mm_storeu_ps(out + 3 * out_stride + col * 4, d);
+}
+
+#endif
+
+void mat4_compose_batch(float * out, unsigned int out_stride,
+        const vec3_t * pos, const vec3_t * scale, const quat_t * rotation, unsigned int count)
+{
+    unsigned int idx = 0;
+
+    if (!out || !pos || !scale || !rotation)
+    {
+        LOG_ERROR("NULL buffer! (out = %p, pos = %p, scale = %p, rotation = %p)\n", out, pos, scale, rotation);
+        return;
+    }
+
+#if defined(LANES)
+    {
+        const lane_t one = lane_set1(1.0f), two = lane_set1(2.0f), zero = lane_set1(0.0f);
+
+        // each lane is one object, so every instruction below works on LANES matrices at once
+        for (; idx + LANES <= count; idx += LANES)
+        {
+            lane_t qx, qy, qz, qw, sx, sy, sz, px, py, pz, xx, yy, zz, xy, xz, yz, wx, wy, wz;
+            float * dst = out + idx * out_stride;
+
+            __load_quat(rotation + idx, &qx, &qy, &qz, &qw);
+            __load_vec3(scale + idx, &sx, &sy, &sz);
+            __load_vec3(pos + idx, &px, &py, &pz);
+
+            xx = lane_mul(qx, qx), yy = lane_mul(qy, qy), zz = lane_mul(qz, qz);
+            xy = lane_mul(qx, qy), xz = lane_mul(qx, qz), yz = lane_mul(qy, qz);
+            wx = lane_mul(qw, qx), wy = lane_mul(qw, qy), wz = lane_mul(qw, qz);
+
+            __store_column(dst, out_stride, 0,
+                    lane_mul(sx, lane_sub(one, lane_mul(two, lane_add(yy, zz)))),
+                    lane_mul(sy, lane_mul(two, lane_add(xy, wz))),
+                    lane_mul(sz, lane_mul(two, lane_sub(xz, wy))),
+                    zero);
+            __store_column(dst, out_stride, 1,
+                    lane_mul(sx, lane_mul(two, lane_sub(xy, wz))),
+                    lane_mul(sy, lane_sub(one, lane_mul(two, lane_add(xx, zz)))),
+                    lane_mul(sz, lane_mul(two, lane_add(yz, wx))),
+                    zero);
+            __store_column(dst, out_stride, 2,
+                    lane_mul(sx, lane_mul(two, lane_add(xz, wy))),
+                    lane_mul(sy, lane_mul(two, lane_sub(yz, wx))),
+                    lane_mul(sz, lane_sub(one, lane_mul(two, lane_add(xx, yy)))),
+                    zero);
+            __store_column(dst, out_stride, 3, px, py, pz, one);
+        }
+    }
+#endif
+
+    mat4_compose_batch_scalar(out + idx * out_stride, out_stride, pos + idx, scale + idx, rotation + idx, count - idx);
+}
+
+void vec_lerp_batch(float * const * out, const float * const * a, const float * const * b, const float * t,
+        unsigned int components, unsigned int count)
+{
+    unsigned int idx = 0;
+
+    if (!out || !a || !b || !t)
+    {
+        LOG_ERROR("NULL buffer! (out = %p, a = %p, b = %p, t = %p)\n", out, a, b, t);
+        return;
+    }
+
+#if defined(LANES)
+    for (; idx + LANES <= count; idx += LANES)
+    {
+        lane_t lt = lane_load(t + idx);
+
+        for (unsigned int c = 0; c < components; ++c)
+        {
+            lane_t la = lane_load(a[c] + idx);
+            lane_store(out[c] + idx, lane_add(la, lane_mul(lane_sub(lane_load(b[c] + idx), la), lt)));
+        }
+    }
+#endif
+
+    for (; idx < count; ++idx)
+    {
+        for (unsigned int c = 0; c < components; ++c) out[c][idx] = a[c][idx] + (b[c][idx] - a[c][idx]) * t[idx];
+    }
+}
+
+void vec_lerp_batch_scalar(float * const * out, const float * const * a, const float * const * b, const float * t,
+        unsigned int components, unsigned int count)
+{
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        for (unsigned int c = 0; c < components; ++c) out[c][idx] = a[c][idx] + (b[c][idx] - a[c][idx]) * t[idx];
+    }
+}
+
+void quat_slerp_batch(float * const * out, const float * const * a, const float * const * b, const float * t,
+        unsigned int count)
+{
+    unsigned int idx = 0;
+
+    if (!out || !a || !b || !t)
+    {
+        LOG_ERROR("NULL buffer! (out = %p, a = %p, b = %p, t = %p)\n", out, a, b, t);
+        return;
+    }
+
+#if defined(LANES)
+    {
+        const lane_t sign_bit = lane_set1(-0.0f), half = lane_set1(0.5f), one = lane_set1(1.0f);
+
+        // each lane is one quaternion, as in the scalar version below
+        for (; idx + LANES <= count; idx += LANES)
+        {
+            lane_t qa[4], qb[4], q[4], lt = lane_load(t + idx), d = lane_set1(0.0f), sign, k, h, len;
+
+            for (int c = 0; c < 4; ++c)
+            {
+                qa[c] = lane_load(a[c] + idx);
+                qb[c] = lane_load(b[c] + idx);
+                d = lane_add(d, lane_mul(qa[c], qb[c]));
+            }
+
+            sign = lane_and(d, sign_bit);
+            d = lane_xor(d, sign);
+            h = lane_sub(lt, half);
+            k = lane_add(lane_mul(lane_mul(h, h), lane_add(lane_set1(1.0904f), lane_mul(d, lane_add(lane_set1(-3.2452f),
+                                    lane_mul(d, lane_sub(lane_set1(3.55645f), lane_mul(d, lane_set1(1.43519f)))))))),
+                    lane_add(lane_set1(0.848013f), lane_mul(d, lane_add(lane_set1(-1.06021f), lane_mul(d, lane_set1(0.215638f))))));
+            lt = lane_add(lt, lane_mul(lane_mul(lt, h), lane_mul(lane_sub(lt, one), k)));
+
+            len = lane_set1(0.0f);
+            for (int c = 0; c < 4; ++c)
+            {
+                q[c] = lane_add(qa[c], lane_mul(lane_sub(lane_xor(qb[c], sign), qa[c]), lt));
+                len = lane_add(len, lane_mul(q[c], q[c]));
+            }
+
+            len = lane_sqrt(len);
+            for (int c = 0; c < 4; ++c) lane_store(out[c] + idx, lane_div(q[c], len));
+        }
+    }
+#endif
+
+    quat_slerp_batch_scalar((float * const []) { out[0] + idx, out[1] + idx, out[2] + idx, out[3] + idx },
+            (const float * const []) { a[0] + idx, a[1] + idx, a[2] + idx, a[3] + idx },
+            (const float * const []) { b[0] + idx, b[1] + idx, b[2] + idx, b[3] + idx }, t + idx, count - idx);
+}
+
+void quat_slerp_batch_scalar(float * const * out, const float * const * a, const float * const * b, const float * t,
+        unsigned int count)
+{
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        float d = a[0][idx] * b[0][idx] + a[1][idx] * b[1][idx] + a[2][idx] * b[2][idx] + a[3][idx] * b[3][idx];
+        float sign = d < 0.0f ? -1.0f : 1.0f, h = t[idx] - 0.5f, k = 0.0f, bent = 0.0f, q[4], len = 0.0f;
+
+        // nlerp turns slowest at the ends, so it lags slerp over the first half and leads over the second, the
+        // more so the wider the arc: t is pushed forward, then back, by as much
+        d *= sign;
+        k = (1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f))) * h * h + 0.848013f + d * (-1.06021f + d * 0.215638f);
+        bent = t[idx] + t[idx] * h * (t[idx] - 1.0f) * k;
+
+        for (int c = 0; c < 4; ++c)
+        {
+            q[c] = a[c][idx] + (sign * b[c][idx] - a[c][idx]) * bent;
+            len += q[c] * q[c];
+        }
+
+        len = sqrtf(len);
+        for (int c = 0; c < 4; ++c) out[c][idx] = q[c] / len;
+    }
+}
+
+const char * math3d_simd_name(void)
+{
+#if defined(__AVX__)
+    return "avx";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,450 @@
+#include <math.h>
+#include <string.h>
+
+#include "logging.h"
+#include "simplify.h"
+
+#include "mesh.h"
+
+// vertex cache optimization scores vertices by their position in a simulated
+// LRU cache (the three most recent ones share a fixed score so the last
+// triangle's vertices are not favoured over each other) and by how few
+// triangles still use them, so vertices that are nearly done get finished
+// off. each step emits the best scoring triangle among those touching the
+// cache, only rescoring what the step changed.
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRIANGLE_SCORE 0.75f
+#define FORSYTH_VALENCE_SCALE 2.0f
+#define FORSYTH_VALENCE_POWER 0.5f
+#define FORSYTH_VALENCE_TABLE 32
+
+#define INVALID_INDEX (~0U)
+
+typedef struct
+{
+    GLfloat v[6];               // position and normal
+    unsigned int index;
+} __weld_t;
+
+typedef struct
+{
+    float cache[FORSYTH_CACHE_SIZE];
+    float valence[FORSYTH_VALENCE_TABLE];
+} __scores_t;
+
+static int __weld_compare(const void * a, const void * b);
+static unsigned int __input_index(const GLvoid * indices, GLenum index_type, unsigned int pos);
+static void __scores_init(__scores_t * scores);
+static float __vertex_score(const __scores_t * scores, int cache_pos, unsigned int remaining);
+
+status_e mesh_build(mesh_t * mesh, const GLfloat * vertices, const GLfloat * normals, GLsizei num_vertices,
+        const GLvoid * indices, GLsizei num_indices, GLenum index_type, GLenum vertex_mode)
+{
+    unsigned int num_triangles = simplify_count_triangles(indices ? num_indices : num_vertices, vertex_mode);
+    unsigned int * remap = NULL;
+    __weld_t * weld = NULL;
+
+    if (!mesh || !vertices)
+    {
+        LOG_ERROR("mesh or vertices is NULL! (mesh = %p, vertices = %p)\n", mesh, vertices);
+        return status_error;
+    }
+
+    if (indices && index_type != GL_UNSIGNED_SHORT && index_type != GL_UNSIGNED_INT)
+    {
+        LOG_ERROR("unsupported index type 0x%x\n", index_type);
+        return status_error;
+    }
+
+    if (num_triangles == 0)
+    {
+        LOG_ERROR("no triangles in %d vertices / %d indices of mode 0x%x\n", num_vertices, num_indices, vertex_mode);
+        return status_error;
+    }
+
+    memset(mesh, 0, sizeof(mesh_t));
+    weld = malloc(num_vertices * sizeof(__weld_t));
+    remap = malloc(num_vertices * sizeof(unsigned int));
+    mesh->vertices = malloc(num_vertices * 3 * sizeof(GLfloat));
+    mesh->normals = malloc(num_vertices * 3 * sizeof(GLfloat));
+    mesh->indices = malloc(num_triangles * 3 * sizeof(unsigned int));
+    if (!weld || !remap || !mesh->vertices || !mesh->normals || !mesh->indices)
+    {
+        LOG_ERROR("failed to allocate memory to index %d vertices\n", num_vertices);
+        free(weld);
+        free(remap);
+        mesh_destroy(mesh);
+        return status_error;
+    }
+
+    // weld by sorting, the same way simplify does; adding 0 turns -0 into 0 so the two compare equal
+    for (GLsizei idx = 0; idx < num_vertices; ++idx)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            weld[idx].v[axis] = vertices[idx * 3 + axis] + 0.0f;
+            weld[idx].v[axis + 3] = normals ? normals[idx * 3 + axis] + 0.0f : 0.0f;
+        }
+        weld[idx].index = idx;
+    }
+    qsort(weld, num_vertices, sizeof(__weld_t), __weld_compare);
+
+    for (GLsizei idx = 0; idx < num_vertices; ++idx)
+    {
+        if (idx == 0 || __weld_compare(&weld[idx - 1], &weld[idx]) != 0)
+        {
+            memcpy(mesh->vertices + mesh->num_vertices * 3, weld[idx].v, 3 * sizeof(GLfloat));
+            memcpy(mesh->normals + mesh->num_vertices * 3, weld[idx].v + 3, 3 * sizeof(GLfloat));
+            ++mesh->num_vertices;
+        }
+        remap[weld[idx].index] = mesh->num_vertices - 1;
+    }
+
+    for (unsigned int tri = 0; tri < num_triangles; ++tri)
+    {
+        unsigned int * out = mesh->indices + mesh->num_indices;
+
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            unsigned int vertex = simplify_triangle_corner(tri, corner, vertex_mode);
+
+            if (indices) vertex = __input_index(indices, index_type, vertex);
+            if (vertex >= (unsigned int)num_vertices)
+            {
+                LOG_ERROR("index %u is out of range (%d vertices)\n", vertex, num_vertices);
+                free(weld);
+                free(remap);
+                mesh_destroy(mesh);
+                return status_error;
+            }
+
+            out[corner] = remap[vertex];
+        }
+
+        // welding can make triangles degenerate, and they draw nothing
+        if (out[0] != out[1] && out[1] != out[2] && out[2] != out[0]) mesh->num_indices += 3;
+    }
+
+    free(weld);
+    free(remap);
+
+    return status_success;
+}
+
+void mesh_destroy(mesh_t * mesh)
+{
+    if (!mesh) return;
+
+    free(mesh->vertices);
+    free(mesh->normals);
+    free(mesh->indices);
+    memset(mesh, 0, sizeof(mesh_t));
+}
+
+status_e mesh_optimize_vertex_cache(mesh_t * mesh)
+{
+    unsigned int num_triangles = 0, emitted_count = 0, cursor = 0, best = 0, cache_len = 0;
+    unsigned int * offsets = NULL, * remaining = NULL, * adjacency = NULL, * out = NULL;
+    unsigned int cache[FORSYTH_CACHE_SIZE + 3], new_cache[FORSYTH_CACHE_SIZE + 3];
+    int * cache_pos = NULL;
+    float * vertex_scores = NULL, * triangle_scores = NULL, best_score = -1.0f;
+    unsigned char * emitted = NULL;
+    __scores_t scores;
+
+    if (!mesh)
+    {
+        LOG_ERROR("mesh is NULL!\n");
+        return status_error;
+    }
+
+    num_triangles = mesh->num_indices / 3;
+    if (num_triangles == 0) return status_success;
+
+    offsets = calloc(mesh->num_vertices + 1, sizeof(unsigned int));
+    remaining = calloc(mesh->num_vertices, sizeof(unsigned int));
+    adjacency = malloc(mesh->num_indices * sizeof(unsigned int));
+    out = malloc(mesh->num_indices * sizeof(unsigned int));
+    cache_pos = malloc(mesh->num_vertices * sizeof(int));
+    vertex_scores = malloc(mesh->num_vertices * sizeof(float));
+    triangle_scores = malloc(num_triangles * sizeof(float));
+    emitted = calloc(num_triangles, 1);
+    if (!offsets || !remaining || !adjacency || !out || !cache_pos || !vertex_scores || !triangle_scores || !emitted)
+    {
+        LOG_ERROR("failed to allocate memory to reorder %u triangles\n", num_triangles);
+        free(offsets);
+        free(remaining);
+        free(adjacency);
+        free(out);
+        free(cache_pos);
+        free(vertex_scores);
+        free(triangle_scores);
+        free(emitted);
+        return status_error;
+    }
+
+    __scores_init(&scores);
+
+    // triangles using each vertex, packed: vertex v owns adjacency[offsets[v]] onwards
+    for (unsigned int idx = 0; idx < mesh->num_indices; ++idx) ++offsets[mesh->indices[idx] + 1];
+    for (unsigned int v = 0; v < mesh->num_vertices; ++v) offsets[v + 1] += offsets[v];
+    for (unsigned int idx = 0; idx < mesh->num_indices; ++idx)
+    {
+        unsigned int v = mesh->indices[idx];
+        adjacency[offsets[v] + remaining[v]++] = idx / 3;
+    }
+
+    for (unsigned int v = 0; v < mesh->num_vertices; ++v)
+    {
+        cache_pos[v] = -1;
+        vertex_scores[v] = __vertex_score(&scores, -1, remaining[v]);
+    }
+
+    for (unsigned int tri = 0; tri < num_triangles; ++tri)
+    {
+        const unsigned int * t = mesh->indices + tri * 3;
+
+        triangle_scores[tri] = vertex_scores[t[0]] + vertex_scores[t[1]] + vertex_scores[t[2]];
+        if (triangle_scores[tri] > best_score)
+        {
+            best_score = triangle_scores[tri];
+            best = tri;
+        }
+    }
+
+    for (emitted_count = 0; emitted_count < num_triangles; ++emitted_count)
+    {
+        const unsigned int * t = NULL;
+        unsigned int new_len = 0;
+
+        // nothing in the cache has triangles left: start over from the next unused one
+        if (best == INVALID_INDEX)
+        {
+            while (emitted[cursor]) ++cursor;
+            best = cursor;
+        }
+
+        t = mesh->indices + best * 3;
+        memcpy(out + emitted_count * 3, t, 3 * sizeof(unsigned int));
+        emitted[best] = 1;
+
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            unsigned int v = t[corner], * list = adjacency + offsets[v];
+
+            for (unsigned int idx = 0; idx < remaining[v]; ++idx)
+            {
+                if (list[idx] != best) continue;
+
+                list[idx] = list[remaining[v] - 1];
+                --remaining[v];
+                break;
+            }
+
+            new_cache[new_len++] = v;
+        }
+
+        for (unsigned int idx = 0; idx < cache_len; ++idx)
+        {
+            if (cache[idx] != t[0] && cache[idx] != t[1] && cache[idx] != t[2]) new_cache[new_len++] = cache[idx];
+        }
+
+        // vertices pushed past the end leave the cache but still get rescored below
+        for (unsigned int idx = 0; idx < new_len; ++idx)
+        {
+            unsigned int v = new_cache[idx];
+
+            cache_pos[v] = idx < FORSYTH_CACHE_SIZE ? (int)idx : -1;
+            vertex_scores[v] = __vertex_score(&scores, cache_pos[v], remaining[v]);
+        }
+
+        cache_len = new_len < FORSYTH_CACHE_SIZE ? new_len : FORSYTH_CACHE_SIZE;
+        memcpy(cache, new_cache, cache_len * sizeof(unsigned int));
+
+        best = INVALID_INDEX;
+        best_score = -1.0f;
+        for (unsigned int idx = 0; idx < new_len; ++idx)
+        {
+            unsigned int v = new_cache[idx];
+
+            for (unsigned int adj = 0; adj < remaining[v]; ++adj)
+            {
+                unsigned int tri = adjacency[offsets[v] + adj];
+                const unsigned int * other = mesh->indices + tri * 3;
+
+                triangle_scores[tri] = vertex_scores[other[0]] + vertex_scores[other[1]] + vertex_scores[other[2]];
+                if (triangle_scores[tri] > best_score)
+                {
+                    best_score = triangle_scores[tri];
+                    best = tri;
+                }
+            }
+        }
+    }
+
+    free(mesh->indices);
+    mesh->indices = out;
+
+    free(offsets);
+    free(remaining);
+    free(adjacency);
+    free(cache_pos);
+    free(vertex_scores);
+    free(triangle_scores);
+    free(emitted);
+
+    return status_success;
+}
+
+status_e mesh_optimize_vertex_fetch(mesh_t * mesh)
+{
+    unsigned int * remap = NULL, next = 0;
+    GLfloat * vertices = NULL, * normals = NULL;
+
+    if (!mesh)
+    {
+        LOG_ERROR("mesh is NULL!\n");
+        return status_error;
+    }
+
+    remap = malloc(mesh->num_vertices * sizeof(unsigned int));
+    vertices = malloc(mesh->num_vertices * 3 * sizeof(GLfloat));
+    normals = malloc(mesh->num_vertices * 3 * sizeof(GLfloat));
+    if (!remap || !vertices || !normals)
+    {
+        LOG_ERROR("failed to allocate memory to reorder %u vertices\n", mesh->num_vertices);
+        free(remap);
+        free(vertices);
+        free(normals);
+        return status_error;
+    }
+
+    // number vertices in the order the indices first reach them; unreferenced ones are dropped
+    memset(remap, 0xff, mesh->num_vertices * sizeof(unsigned int));
+    for (unsigned int idx = 0; idx < mesh->num_indices; ++idx)
+    {
+        unsigned int v = mesh->indices[idx];
+
+        if (remap[v] == INVALID_INDEX)
+        {
+            memcpy(vertices + next * 3, mesh->vertices + v * 3, 3 * sizeof(GLfloat));
+            memcpy(normals + next * 3, mesh->normals + v * 3, 3 * sizeof(GLfloat));
+            remap[v] = next++;
+        }
+
+        mesh->indices[idx] = remap[v];
+    }
+
+    free(mesh->vertices);
+    free(mesh->normals);
+    mesh->vertices = vertices;
+    mesh->normals = normals;
+    mesh->num_vertices = next;
+
+    free(remap);
+
+    return status_success;
+}
+
+float mesh_acmr(const unsigned int * indices, unsigned int num_indices, unsigned int num_vertices, unsigned int cache_size)
+{
+    unsigned int * stamps = NULL, time = cache_size + 1, misses = 0;
+
+    if (!indices || num_indices < 3) return 0.0f;
+
+    if (!(stamps = calloc(num_vertices, sizeof(unsigned int))))
+    {
+        LOG_ERROR("failed to allocate memory to measure %u vertices\n", num_vertices);
+        return 0.0f;
+    }
+
+    // a FIFO only moves on a miss, so a vertex is cached while fewer than cache_size misses came after it
+    for (unsigned int idx = 0; idx < num_indices; ++idx)
+    {
+        unsigned int v = indices[idx];
+
+        if (time - stamps[v] > cache_size)
+        {
+            stamps[v] = time++;
+            ++misses;
+        }
+    }
+
+    free(stamps);
+
+    return (float)misses / (num_indices / 3);
+}
+
+status_e mesh_unindex(const mesh_t * mesh, GLfloat ** out_vertices, GLfloat ** out_normals)
+{
+    if (!mesh || !out_vertices || !out_normals)
+    {
+        LOG_ERROR("mesh or an output is NULL! (mesh = %p, out_vertices = %p, out_normals = %p)\n", mesh, out_vertices, out_normals);
+        return status_error;
+    }
+
+    *out_vertices = malloc(mesh->num_indices * 3 * sizeof(GLfloat));
+    *out_normals = malloc(mesh->num_indices * 3 * sizeof(GLfloat));
+    if (!*out_vertices || !*out_normals)
+    {
+        LOG_ERROR("failed to allocate memory for %u vertices\n", mesh->num_indices);
+        free(*out_vertices);
+        free(*out_normals);
+        *out_vertices = *out_normals = NULL;
+        return status_error;
+    }
+
+    for (unsigned int idx = 0; idx < mesh->num_indices; ++idx)
+    {
+        memcpy(*out_vertices + idx * 3, mesh->vertices + mesh->indices[idx] * 3, 3 * sizeof(GLfloat));
+        memcpy(*out_normals + idx * 3, mesh->normals + mesh->indices[idx] * 3, 3 * sizeof(GLfloat));
+    }
+
+    return status_success;
+}
+
+static int __weld_compare(const void * a, const void * b)
+{
+    const __weld_t * wa = a, * wb = b;
+
+    for (int axis = 0; axis < 6; ++axis)
+    {
+        if (wa->v[axis] < wb->v[axis]) return -1;
+        if (wa->v[axis] > wb->v[axis]) return 1;
+    }
+
+    return 0;
+}
+
+static unsigned int __input_index(const GLvoid * indices, GLenum index_type, unsigned int pos)
+{
+    return index_type == GL_UNSIGNED_SHORT ? ((const GLushort *)indices)[pos] : ((const GLuint *)indices)[pos];
+}
+
+static void __scores_init(__scores_t * scores)
+{
+    for (int pos = 0; pos < FORSYTH_CACHE_SIZE; ++pos)
+    {
+        scores->cache[pos] = pos < 3 ? FORSYTH_LAST_TRIANGLE_SCORE
+            : powf(1.0f - (pos - 3) * (1.0f / (FORSYTH_CACHE_SIZE - 3)), FORSYTH_DECAY_POWER);
+    }
+
+    scores->valence[0] = 0.0f;
+    for (int count = 1; count < FORSYTH_VALENCE_TABLE; ++count)
+    {
+        scores->valence[count] = FORSYTH_VALENCE_SCALE * powf((float)count, -FORSYTH_VALENCE_POWER);
+    }
+}
+
+static float __vertex_score(const __scores_t * scores, int cache_pos, unsigned int remaining)
+{
+    float score = 0.0f;
+
+    // finished vertices are never picked again
+    if (remaining == 0) return -1.0f;
+
+    if (cache_pos >= 0) score = scores->cache[cache_pos];
+
+    return score + (remaining < FORSYTH_VALENCE_TABLE ? scores->valence[remaining]
+            : FORSYTH_VALENCE_SCALE * powf((float)remaining, -FORSYTH_VALENCE_POWER));
+}
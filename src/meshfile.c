@@ -0,0 +1,295 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logging.h"
+
+#include "meshfile.h"
+
+static status_e __check_header(const meshfile_t * file);
+static int __check_stream(const meshfile_t * file, uint64_t offset, uint64_t length);
+static uint64_t __align(uint64_t offset);
+static status_e __write_stream(FILE * fp, uint64_t * offset, const void * data, size_t length);
+
+status_e meshfile_open(meshfile_t * file, const char * path)
+{
+    struct stat st;
+    int fd = -1;
+
+    if (!file || !path)
+    {
+        LOG_ERROR("file or path is NULL! (file = %p, path = %p)\n", file, path);
+        return status_error;
+    }
+
+    memset(file, 0, sizeof(meshfile_t));
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        LOG_ERROR("failed to open %s\n", path);
+        return status_error;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(meshfile_header_t))
+    {
+        LOG_ERROR("%s is too small to be a mesh file\n", path);
+        close(fd);
+        return status_error;
+    }
+
+    // the mapping outlives the descriptor, and pages are only read in as the GPU driver or culling touches them
+    file->size = st.st_size;
+    file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file->data == MAP_FAILED)
+    {
+        LOG_ERROR("failed to map %s\n", path);
+        memset(file, 0, sizeof(meshfile_t));
+        return status_error;
+    }
+
+    file->header = file->data;
+    if (__check_header(file) != status_success)
+    {
+        LOG_ERROR("%s is not a valid version %d mesh file\n", path, MESHFILE_VERSION);
+        meshfile_close(file);
+        return status_error;
+    }
+
+    return status_success;
+}
+
+status_e meshfile_close(meshfile_t * file)
+{
+    if (!file)
+    {
+        LOG_ERROR("file is NULL!\n");
+        return status_error;
+    }
+
+    if (file->data && munmap(file->data, file->size) != 0)
+    {
+        LOG_ERROR("failed to unmap mesh file at %p\n", file->data);
+        return status_error;
+    }
+
+    memset(file, 0, sizeof(meshfile_t));
+
+    return status_success;
+}
+
+status_e meshfile_fill_def(const meshfile_t * file, render_def_t * def)
+{
+    const char * base = NULL;
+
+    if (!file || !file->header || !def)
+    {
+        LOG_ERROR("file or def is NULL! (file = %p, def = %p)\n", file, def);
+        return status_error;
+    }
+
+    base = file->data;
+
+    // the renderer never writes through these in a prebuilt def, so the read-only mapping is safe to point at
+    for (uint32_t idx = 0; idx < file->header->num_levels; ++idx)
+    {
+        const meshfile_level_t * level = &file->header->levels[idx];
+        render_lod_t lod;
+
+        lod.vertices = (GLfloat *)(base + level->vertex_offset);
+        lod.normals = (GLfloat *)(base + level->normal_offset);
+        lod.num_vertices = level->num_vertices;
+        lod.vertex_mode = GL_TRIANGLES;
+        lod.indices = (GLvoid *)(base + level->index_offset);
+        lod.num_indices = level->num_indices;
+        lod.index_type = level->index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        lod.distance = level->distance;
+
+        if (idx > 0)
+        {
+            def->lods[idx - 1] = lod;
+            continue;
+        }
+
+        def->vertices = lod.vertices;
+        def->normals = lod.normals;
+        def->num_vertices = lod.num_vertices;
+        def->vertex_mode = lod.vertex_mode;
+        def->indices = lod.indices;
+        def->num_indices = lod.num_indices;
+        def->index_type = lod.index_type;
+    }
+
+    def->num_lods = file->header->num_levels - 1;
+    memcpy(def->bounds_min, file->header->bounds_min, sizeof(def->bounds_min));
+    memcpy(def->bounds_max, file->header->bounds_max, sizeof(def->bounds_max));
+    memcpy(def->bounds_center, file->header->bounds_center, sizeof(def->bounds_center));
+    def->bounds_radius = file->header->bounds_radius;
+    def->flags |= RENDER_DEF_PREBUILT;
+
+    return status_success;
+}
+
+status_e meshfile_write(const char * path, const mesh_t * levels, const GLfloat * distances, unsigned int num_levels)
+{
+    meshfile_header_t header;
+    uint64_t offset = sizeof(meshfile_header_t);
+    float radius_sq = 0.0f;
+    status_e status = status_success;
+    FILE * fp = NULL;
+
+    if (!path || !levels || !distances)
+    {
+        LOG_ERROR("path, levels or distances is NULL! (path = %p, levels = %p, distances = %p)\n", path, levels, distances);
+        return status_error;
+    }
+
+    if (num_levels == 0 || num_levels > MESHFILE_MAX_LEVELS || levels[0].num_vertices == 0)
+    {
+        LOG_ERROR("cannot write %u levels, 1 to %d non-empty ones are supported\n", num_levels, MESHFILE_MAX_LEVELS);
+        return status_error;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MESHFILE_MAGIC, sizeof(header.magic));
+    header.version = MESHFILE_VERSION;
+    header.header_size = sizeof(meshfile_header_t);
+    header.num_levels = num_levels;
+
+    // same bounds render_add_def computes: the box, and a sphere around the box center
+    for (unsigned int idx = 0; idx < levels[0].num_vertices; ++idx)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float v = levels[0].vertices[idx * 3 + axis];
+
+            if (idx == 0 || v < header.bounds_min[axis]) header.bounds_min[axis] = v;
+            if (idx == 0 || v > header.bounds_max[axis]) header.bounds_max[axis] = v;
+        }
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        header.bounds_center[axis] = 0.5f * (header.bounds_min[axis] + header.bounds_max[axis]);
+    }
+
+    for (unsigned int idx = 0; idx < levels[0].num_vertices; ++idx)
+    {
+        float dx = levels[0].vertices[idx * 3] - header.bounds_center[0];
+        float dy = levels[0].vertices[idx * 3 + 1] - header.bounds_center[1];
+        float dz = levels[0].vertices[idx * 3 + 2] - header.bounds_center[2];
+
+        if (dx * dx + dy * dy + dz * dz > radius_sq) radius_sq = dx * dx + dy * dy + dz * dz;
+    }
+    header.bounds_radius = sqrtf(radius_sq);
+
+    for (unsigned int idx = 0; idx < num_levels; ++idx)
+    {
+        meshfile_level_t * level = &header.levels[idx];
+
+        level->num_vertices = levels[idx].num_vertices;
+        level->num_indices = levels[idx].num_indices;
+        level->index_size = levels[idx].num_vertices <= 0x10000 ? 2 : 4;
+        level->distance = distances[idx];
+        level->vertex_offset = offset = __align(offset);
+        offset += (uint64_t)level->num_vertices * 3 * sizeof(float);
+        level->normal_offset = offset = __align(offset);
+        offset += (uint64_t)level->num_vertices * 3 * sizeof(float);
+        level->index_offset = offset = __align(offset);
+        offset += (uint64_t)level->num_indices * level->index_size;
+    }
+
+    if (!(fp = fopen(path, "wb")))
+    {
+        LOG_ERROR("failed to open %s for writing\n", path);
+        return status_error;
+    }
+
+    offset = 0;
+    status = __write_stream(fp, &offset, &header, sizeof(header));
+
+    for (unsigned int idx = 0; idx < num_levels && status == status_success; ++idx)
+    {
+        const meshfile_level_t * level = &header.levels[idx];
+        const mesh_t * mesh = &levels[idx];
+
+        status = __write_stream(fp, &offset, mesh->vertices, level->num_vertices * 3 * sizeof(float));
+        if (status == status_success) status = __write_stream(fp, &offset, mesh->normals, level->num_vertices * 3 * sizeof(float));
+        if (status != status_success) break;
+
+        if (level->index_size == 4)
+        {
+            status = __write_stream(fp, &offset, mesh->indices, level->num_indices * sizeof(uint32_t));
+            continue;
+        }
+
+        // narrowed in chunks so huge levels don't need a second full copy
+        status = __write_stream(fp, &offset, NULL, 0);
+        for (unsigned int start = 0; start < level->num_indices && status == status_success; start += 4096)
+        {
+            uint16_t chunk[4096];
+            unsigned int count = level->num_indices - start < 4096 ? level->num_indices - start : 4096;
+
+            for (unsigned int corner = 0; corner < count; ++corner) chunk[corner] = (uint16_t)mesh->indices[start + corner];
+            if (fwrite(chunk, sizeof(uint16_t), count, fp) != count) status = status_error;
+            offset += count * sizeof(uint16_t);
+        }
+    }
+
+    if (fclose(fp) != 0) status = status_error;
+    if (status != status_success) LOG_ERROR("failed to write %s\n", path);
+
+    return status;
+}
+
+static status_e __check_header(const meshfile_t * file)
+{
+    const meshfile_header_t * header = file->header;
+
+    if (memcmp(header->magic, MESHFILE_MAGIC, sizeof(header->magic)) != 0) return status_error;
+    if (header->version != MESHFILE_VERSION || header->header_size != sizeof(meshfile_header_t)) return status_error;
+    if (header->num_levels == 0 || header->num_levels > MESHFILE_MAX_LEVELS) return status_error;
+
+    for (uint32_t idx = 0; idx < header->num_levels; ++idx)
+    {
+        const meshfile_level_t * level = &header->levels[idx];
+        uint64_t vertex_bytes = (uint64_t)level->num_vertices * 3 * sizeof(float);
+
+        if (level->index_size != 2 && level->index_size != 4) return status_error;
+        if (level->num_indices % 3 != 0) return status_error;
+        if (!__check_stream(file, level->vertex_offset, vertex_bytes)) return status_error;
+        if (!__check_stream(file, level->normal_offset, vertex_bytes)) return status_error;
+        if (!__check_stream(file, level->index_offset, (uint64_t)level->num_indices * level->index_size)) return status_error;
+    }
+
+    return status_success;
+}
+
+static int __check_stream(const meshfile_t * file, uint64_t offset, uint64_t length)
+{
+    return offset % MESHFILE_ALIGN == 0 && offset >= sizeof(meshfile_header_t) && offset <= file->size
+        && length <= file->size - offset;
+}
+
+static uint64_t __align(uint64_t offset)
+{
+    return (offset + MESHFILE_ALIGN - 1) & ~(uint64_t)(MESHFILE_ALIGN - 1);
+}
+
+// pads up to the next aligned offset before writing, keeping *offset in step with the file position
+static status_e __write_stream(FILE * fp, uint64_t * offset, const void * data, size_t length)
+{
+    static const char padding[MESHFILE_ALIGN] = { 0 };
+    uint64_t aligned = *offset == 0 ? 0 : __align(*offset);
+
+    if (fwrite(padding, 1, aligned - *offset, fp) != aligned - *offset) return status_error;
+    if (length > 0 && fwrite(data, 1, length, fp) != length) return status_error;
+
+    *offset = aligned + length;
+
+    return status_success;
+}
@@ -0,0 +1,261 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "obj.h"
+
+#define MAX_FACE_CORNERS 64
+
+typedef struct
+{
+    GLfloat * data;
+    unsigned int len;           // in floats
+    unsigned int capacity;
+} __floats_t;
+
+static status_e __floats_push(__floats_t * floats, const GLfloat * values, unsigned int count);
+static const char * __skip_spaces(const char * p, const char * end);
+static const char * __next_line(const char * p, const char * end);
+static int __resolve_index(long index, unsigned int count, unsigned int * out);
+static status_e __parse_face(const char * p, const char * end, unsigned int line, const __floats_t * positions,
+        const __floats_t * normals, __floats_t * out_vertices, __floats_t * out_normals);
+
+status_e obj_load(const char * path, mesh_t * mesh)
+{
+    FILE * fp = NULL;
+    char * text = NULL;
+    long length = 0;
+    status_e status = status_success;
+
+    if (!path || !mesh)
+    {
+        LOG_ERROR("path or mesh is NULL! (path = %p, mesh = %p)\n", path, mesh);
+        return status_error;
+    }
+
+    if (!(fp = fopen(path, "rb")))
+    {
+        LOG_ERROR("failed to open %s\n", path);
+        return status_error;
+    }
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        LOG_ERROR("failed to get the size of %s\n", path);
+        fclose(fp);
+        return status_error;
+    }
+
+    if (!(text = malloc(length + 1)) || fread(text, 1, length, fp) != (size_t)length)
+    {
+        LOG_ERROR("failed to read %ld bytes from %s\n", length, path);
+        free(text);
+        fclose(fp);
+        return status_error;
+    }
+    fclose(fp);
+    text[length] = '\0';
+
+    status = obj_parse(text, length, mesh);
+    free(text);
+
+    return status;
+}
+
+status_e obj_parse(const char * text, size_t length, mesh_t * mesh)
+{
+    const char * p = text, * end = text + length;
+    __floats_t positions = { NULL, 0, 0 }, normals = { NULL, 0, 0 };
+    __floats_t out_vertices = { NULL, 0, 0 }, out_normals = { NULL, 0, 0 };
+    status_e status = status_success;
+    unsigned int line = 1;
+
+    if (!text || !mesh)
+    {
+        LOG_ERROR("text or mesh is NULL! (text = %p, mesh = %p)\n", text, mesh);
+        return status_error;
+    }
+
+    for (; p < end && status == status_success; p = __next_line(p, end), ++line)
+    {
+        p = __skip_spaces(p, end);
+
+        if (end - p > 2 && (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')))
+        {
+            GLfloat v[3];
+            char * next = NULL;
+            int axis = 0;
+
+            for (p += 1; axis < 3; ++axis, p = next)
+            {
+                v[axis] = strtof(p, &next);
+                if (next == p) break;
+            }
+
+            status = axis < 3 ? status_error : __floats_push(&positions, v, 3);
+        }
+        else if (end - p > 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            GLfloat n[3];
+            char * next = NULL;
+            int axis = 0;
+
+            for (p += 2; axis < 3; ++axis, p = next)
+            {
+                n[axis] = strtof(p, &next);
+                if (next == p) break;
+            }
+
+            status = axis < 3 ? status_error : __floats_push(&normals, n, 3);
+        }
+        else if (end - p > 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            status = __parse_face(p + 1, end, line, &positions, &normals, &out_vertices, &out_normals);
+        }
+
+        if (status != status_success) LOG_ERROR("malformed statement on line %u\n", line);
+    }
+
+    if (status == status_success)
+    {
+        status = mesh_build(mesh, out_vertices.data, out_normals.data, out_vertices.len / 3, NULL, 0, 0, GL_TRIANGLES);
+    }
+
+    free(positions.data);
+    free(normals.data);
+    free(out_vertices.data);
+    free(out_normals.data);
+
+    return status;
+}
+
+static status_e __floats_push(__floats_t * floats, const GLfloat * values, unsigned int count)
+{
+    if (floats->len + count > floats->capacity)
+    {
+        unsigned int capacity = floats->capacity ? floats->capacity * 2 : 1024;
+        GLfloat * data = NULL;
+
+        while (capacity < floats->len + count) capacity *= 2;
+        if (!(data = realloc(floats->data, capacity * sizeof(GLfloat))))
+        {
+            LOG_ERROR("failed to allocate memory for %u floats\n", capacity);
+            return status_error;
+        }
+
+        floats->data = data;
+        floats->capacity = capacity;
+    }
+
+    memcpy(floats->data + floats->len, values, count * sizeof(GLfloat));
+    floats->len += count;
+
+    return status_success;
+}
+
+static const char * __skip_spaces(const char * p, const char * end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+static const char * __next_line(const char * p, const char * end)
+{
+    const char * newline = memchr(p, '\n', end - p);
+    return newline ? newline + 1 : end;
+}
+
+static int __resolve_index(long index, unsigned int count, unsigned int * out)
+{
+    // negative indices count back from the latest element
+    if (index < 0) index += count + 1;
+    if (index < 1 || index > (long)count) return 0;
+
+    *out = index - 1;
+    return 1;
+}
+
+static status_e __parse_face(const char * p, const char * end, unsigned int line, const __floats_t * positions,
+        const __floats_t * normals, __floats_t * out_vertices, __floats_t * out_normals)
+{
+    unsigned int corners[MAX_FACE_CORNERS][2], num_corners = 0;
+    int has_normals = 1;
+    const char * line_end = memchr(p, '\n', end - p);
+
+    if (!line_end) line_end = end;
+
+    while ((p = __skip_spaces(p, line_end)) < line_end && *p != '\r' && *p != '#')
+    {
+        char * next = NULL;
+        long index = strtol(p, &next, 10);
+
+        if (next == p || num_corners == MAX_FACE_CORNERS) return status_error;
+        if (!__resolve_index(index, positions->len / 3, &corners[num_corners][0])) return status_error;
+        p = next;
+
+        // skip the texture coordinate, then read the normal if there is one
+        corners[num_corners][1] = ~0U;
+        if (p < line_end && *p == '/')
+        {
+            ++p;
+            if (p < line_end && *p != '/')
+            {
+                strtol(p, &next, 10);
+                p = next;
+            }
+
+            if (p < line_end && *p == '/')
+            {
+                ++p;
+                index = strtol(p, &next, 10);
+                if (next == p || !__resolve_index(index, normals->len / 3, &corners[num_corners][1])) return status_error;
+                p = next;
+            }
+        }
+
+        if (corners[num_corners][1] == ~0U) has_normals = 0;
+        ++num_corners;
+    }
+
+    if (num_corners < 3)
+    {
+        LOG_ERROR("face with %u corners on line %u\n", num_corners, line);
+        return status_error;
+    }
+
+    for (unsigned int tri = 1; tri + 1 < num_corners; ++tri)
+    {
+        unsigned int fan[3] = { 0, tri, tri + 1 };
+        GLfloat face_normal[3] = { 0.0f, 0.0f, 0.0f };
+
+        if (!has_normals)
+        {
+            const GLfloat * a = positions->data + corners[0][0] * 3;
+            const GLfloat * b = positions->data + corners[tri][0] * 3;
+            const GLfloat * c = positions->data + corners[tri + 1][0] * 3;
+            GLfloat u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+            GLfloat length = 0.0f;
+
+            face_normal[0] = u[1] * v[2] - u[2] * v[1];
+            face_normal[1] = u[2] * v[0] - u[0] * v[2];
+            face_normal[2] = u[0] * v[1] - u[1] * v[0];
+            length = sqrtf(face_normal[0] * face_normal[0] + face_normal[1] * face_normal[1] + face_normal[2] * face_normal[2]);
+            for (int axis = 0; axis < 3 && length > 0.0f; ++axis) face_normal[axis] /= length;
+        }
+
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            const unsigned int * c = corners[fan[corner]];
+
+            if (__floats_push(out_vertices, positions->data + c[0] * 3, 3) != status_success) return status_error;
+            if (__floats_push(out_normals, has_normals ? normals->data + c[1] * 3 : face_normal, 3) != status_success)
+            {
+                return status_error;
+            }
+        }
+    }
+
+    return status_success;
+}
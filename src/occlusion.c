@@ -0,0 +1,437 @@
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#endif
+
+#include "jobs.h"
+#include "logging.h"
+#include "simplify.h"
+
+#include "occlusion.h"
+
+#define MIN_TRIANGLE_AREA 1e-6f
+#define TEST_SPAN 3
+
+static status_e __occlusion_sanity_check(const occlusion_t * occ);
+static status_e __reserve_triangles(occlusion_t * occ, unsigned int count);
+static status_e __reserve_projected(occlusion_t * occ, unsigned int count);
+static void __rasterize_tiles(unsigned int begin, unsigned int end, void * data);
+static void __rasterize_triangle(const occlusion_t * occ, const float * tri, int tile_x, int tile_y);
+static void __build_pyramid(occlusion_t * occ);
+static int __test_texel(const occlusion_t * occ, unsigned int level, int x, int y, int x0, int y0, int x1, int y1,
+        float depth);
+
+status_e occlusion_init(occlusion_t * occ, unsigned int width, unsigned int height)
+{
+    unsigned int level_width = width, level_height = height;
+
+    if (!occ)
+    {
+        LOG_ERROR("occ is NULL!\n");
+        return status_error;
+    }
+
+    if (width < OCCLUSION_TILE || height < OCCLUSION_TILE || (width & (width - 1)) || (height & (height - 1)))
+    {
+        LOG_ERROR("occlusion buffer must be a power of two of at least %d in each direction (%ux%u)\n",
+                OCCLUSION_TILE, width, height);
+        return status_error;
+    }
+
+    memset(occ, 0, sizeof(occlusion_t));
+    occ->width = width;
+    occ->height = height;
+
+    while (occ->num_levels < OCCLUSION_MAX_LEVELS && level_width > 0 && level_height > 0)
+    {
+        if (!(occ->levels[occ->num_levels] = malloc(level_width * level_height * sizeof(float))))
+        {
+            LOG_ERROR("failed to allocate memory for a %ux%u occlusion level\n", level_width, level_height);
+            occlusion_destroy(occ);
+            return status_error;
+        }
+
+        ++occ->num_levels;
+        level_width >>= 1;
+        level_height >>= 1;
+    }
+
+    return status_success;
+}
+
+status_e occlusion_destroy(occlusion_t * occ)
+{
+    if (!occ)
+    {
+        LOG_ERROR("occ is NULL!\n");
+        return status_error;
+    }
+
+    for (unsigned int level = 0; level < occ->num_levels; ++level)
+    {
+        free(occ->levels[level]);
+    }
+    free(occ->triangles);
+    free(occ->projected);
+    memset(occ, 0, sizeof(occlusion_t));
+
+    return status_success;
+}
+
+void occlusion_begin(occlusion_t * occ, const mat4_t * view_projection)
+{
+    if (__occlusion_sanity_check(occ) != status_success || !view_projection) return;
+
+    occ->view_projection = *view_projection;
+    occ->num_triangles = 0;
+
+    for (unsigned int idx = 0; idx < occ->width * occ->height; ++idx)
+    {
+        occ->levels[0][idx] = 1.0f;
+    }
+}
+
+status_e occlusion_add_occluder(occlusion_t * occ, const mat4_t * model, const GLfloat * vertices, GLsizei num_vertices,
+        const GLvoid * indices, GLsizei num_indices, GLenum index_type, GLenum vertex_mode)
+{
+    unsigned int count = simplify_count_triangles(indices ? num_indices : num_vertices, vertex_mode);
+    status_e status = status_success;
+    mat4_t mvp;
+
+    if ((status = __occlusion_sanity_check(occ)) != status_success) return status;
+
+    if (!model || !vertices)
+    {
+        LOG_ERROR("model or vertices is NULL! (model = %p, vertices = %p)\n", model, vertices);
+        return status_error;
+    }
+
+    if ((status = __reserve_triangles(occ, occ->num_triangles + count)) != status_success) return status;
+    if ((status = __reserve_projected(occ, num_vertices)) != status_success) return status;
+
+    mat4_mul(&mvp, &occ->view_projection, model);
+
+    // project each vertex once, however many triangles share it
+    for (GLsizei idx = 0; idx < num_vertices; ++idx)
+    {
+        const GLfloat * v = vertices + idx * 3;
+        vec4_t clip = mat4_mul_vec4(&mvp, vec4_make(v[0], v[1], v[2], 1.0f));
+        float * out = occ->projected + idx * 4;
+
+        // clipping against the near plane is not worth it here, leaving a triangle out is always safe
+        out[3] = clip.w > 0.0f && clip.z >= -clip.w;
+        if (!out[3]) continue;
+
+        out[0] = (clip.x / clip.w * 0.5f + 0.5f) * occ->width;
+        out[1] = (clip.y / clip.w * 0.5f + 0.5f) * occ->height;
+        out[2] = clip.z / clip.w * 0.5f + 0.5f;
+    }
+
+    for (unsigned int tri = 0; tri < count; ++tri)
+    {
+        float * out = occ->triangles + occ->num_triangles * 9;
+        int clipped = 0;
+
+        for (int corner = 0; corner < 3 && !clipped; ++corner)
+        {
+            unsigned int vertex = simplify_triangle_corner(tri, corner, vertex_mode);
+            const float * p = NULL;
+
+            if (indices) vertex = index_type == GL_UNSIGNED_SHORT ? ((const GLushort *)indices)[vertex] : ((const GLuint *)indices)[vertex];
+            if (vertex >= (unsigned int)num_vertices)
+            {
+                LOG_ERROR("index %u is out of range (%d vertices)\n", vertex, num_vertices);
+                return status_error;
+            }
+
+            p = occ->projected + vertex * 4;
+            clipped = !p[3];
+            memcpy(out + corner * 3, p, 3 * sizeof(float));
+        }
+
+        if (!clipped) ++occ->num_triangles;
+    }
+
+    return status_success;
+}
+
+void occlusion_rasterize(occlusion_t * occ)
+{
+    if (__occlusion_sanity_check(occ) != status_success) return;
+
+    // tiles never share texels, so each one is rasterized without locks
+    if (occ->num_triangles > 0)
+    {
+        jobs_parallel_for((occ->width / OCCLUSION_TILE) * (occ->height / OCCLUSION_TILE), 1, __rasterize_tiles, occ);
+    }
+
+    __build_pyramid(occ);
+}
+
+int occlusion_test_aabb(const occlusion_t * occ, vec3_t min, vec3_t max)
+{
+    float screen_min[3] = { 0.0f }, screen_max[3] = { 0.0f };
+    int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    unsigned int level = 0;
+
+    if (__occlusion_sanity_check(occ) != status_success) return 1;
+
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        vec4_t clip = mat4_mul_vec4(&occ->view_projection, vec4_make(corner & 1 ? max.x : min.x,
+                    corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z, 1.0f));
+        float screen[3];
+
+        // a box reaching through the near plane covers an unbounded part of the screen
+        if (clip.w <= 0.0f || clip.z < -clip.w) return 1;
+
+        screen[0] = (clip.x / clip.w * 0.5f + 0.5f) * occ->width;
+        screen[1] = (clip.y / clip.w * 0.5f + 0.5f) * occ->height;
+        screen[2] = clip.z / clip.w * 0.5f + 0.5f;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (corner == 0 || screen[axis] < screen_min[axis]) screen_min[axis] = screen[axis];
+            if (corner == 0 || screen[axis] > screen_max[axis]) screen_max[axis] = screen[axis];
+        }
+    }
+
+    // grow the rectangle by a texel: occluders are sampled at texel centers, so their edges are only
+    // accurate to a texel and an object peeking out from behind one must still see an empty texel
+    x0 = (int)floorf(screen_min[0]) - 1;
+    y0 = (int)floorf(screen_min[1]) - 1;
+    x1 = (int)floorf(screen_max[0]) + 1;
+    y1 = (int)floorf(screen_max[1]) + 1;
+    if (x1 < 0 || y1 < 0 || x0 >= (int)occ->width || y0 >= (int)occ->height) return 1;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= (int)occ->width) x1 = occ->width - 1;
+    if (y1 >= (int)occ->height) y1 = occ->height - 1;
+
+    // start from the level where the rectangle spans a handful of texels, each of which holds the farthest
+    // depth below it. only texels that fail there are refined, so the common fully hidden or clearly
+    // visible cases cost a few reads while coarse texels overhanging the rectangle don't cause misses
+    while (level + 1 < occ->num_levels && ((x1 >> level) - (x0 >> level) > TEST_SPAN || (y1 >> level) - (y0 >> level) > TEST_SPAN)) ++level;
+
+    for (int y = y0 >> level; y <= y1 >> level; ++y)
+    {
+        for (int x = x0 >> level; x <= x1 >> level; ++x)
+        {
+            if (__test_texel(occ, level, x, y, x0, y0, x1, y1, screen_min[2])) return 1;
+        }
+    }
+
+    return 0;
+}
+
+static status_e __occlusion_sanity_check(const occlusion_t * occ)
+{
+    if (!occ)
+    {
+        LOG_ERROR("occ is NULL!\n");
+        return status_error;
+    }
+
+    if (occ->num_levels == 0 || !occ->levels[0])
+    {
+        LOG_ERROR("occlusion buffer %p is not initialized!\n", occ);
+        return status_error;
+    }
+
+    return status_success;
+}
+
+static status_e __reserve_triangles(occlusion_t * occ, unsigned int count)
+{
+    unsigned int capacity = occ->triangle_capacity ? occ->triangle_capacity : 256;
+    float * triangles = NULL;
+
+    if (count <= occ->triangle_capacity) return status_success;
+
+    while (capacity < count) capacity *= 2;
+
+    if (!(triangles = realloc(occ->triangles, capacity * 9 * sizeof(float))))
+    {
+        LOG_ERROR("failed to allocate memory for %u occluder triangles\n", capacity);
+        return status_error;
+    }
+
+    occ->triangles = triangles;
+    occ->triangle_capacity = capacity;
+
+    return status_success;
+}
+
+static status_e __reserve_projected(occlusion_t * occ, unsigned int count)
+{
+    float * projected = NULL;
+
+    if (count <= occ->projected_capacity) return status_success;
+
+    if (!(projected = realloc(occ->projected, count * 4 * sizeof(float))))
+    {
+        LOG_ERROR("failed to allocate memory to project %u occluder vertices\n", count);
+        return status_error;
+    }
+
+    occ->projected = projected;
+    occ->projected_capacity = count;
+
+    return status_success;
+}
+
+static void __rasterize_tiles(unsigned int begin, unsigned int end, void * data)
+{
+    const occlusion_t * occ = data;
+    unsigned int tiles_x = occ->width / OCCLUSION_TILE;
+
+    for (unsigned int tile = begin; tile < end; ++tile)
+    {
+        int tile_x = (tile % tiles_x) * OCCLUSION_TILE, tile_y = (tile / tiles_x) * OCCLUSION_TILE;
+
+        for (unsigned int tri = 0; tri < occ->num_triangles; ++tri)
+        {
+            __rasterize_triangle(occ, occ->triangles + tri * 9, tile_x, tile_y);
+        }
+    }
+}
+
+static void __rasterize_triangle(const occlusion_t * occ, const float * tri, int tile_x, int tile_y)
+{
+    float a[3], b[3], c[3], area = 0.0f, dzdx = 0.0f, dzdy = 0.0f, zc = 0.0f;
+    float min_x = fminf(tri[0], fminf(tri[3], tri[6])), max_x = fmaxf(tri[0], fmaxf(tri[3], tri[6]));
+    float min_y = fminf(tri[1], fminf(tri[4], tri[7])), max_y = fmaxf(tri[1], fmaxf(tri[4], tri[7]));
+    int x0 = 0, x1 = 0, y0 = 0, y1 = 0;
+    float * depth = occ->levels[0];
+
+    // texels whose centers fall in both the triangle's bounds and the tile
+    x0 = (int)ceilf(min_x - 0.5f);
+    x1 = (int)floorf(max_x - 0.5f);
+    y0 = (int)ceilf(min_y - 0.5f);
+    y1 = (int)floorf(max_y - 0.5f);
+    if (x0 < tile_x) x0 = tile_x;
+    if (y0 < tile_y) y0 = tile_y;
+    if (x1 > tile_x + OCCLUSION_TILE - 1) x1 = tile_x + OCCLUSION_TILE - 1;
+    if (y1 > tile_y + OCCLUSION_TILE - 1) y1 = tile_y + OCCLUSION_TILE - 1;
+    if (x0 > x1 || y0 > y1) return;
+
+    // edge i runs from corner i to corner i + 1 and is a * x + b * y + c, positive on the inside
+    for (int edge = 0; edge < 3; ++edge)
+    {
+        const float * p = tri + edge * 3, * q = tri + ((edge + 1) % 3) * 3;
+
+        a[edge] = p[1] - q[1];
+        b[edge] = q[0] - p[0];
+        c[edge] = -(a[edge] * p[0] + b[edge] * p[1]);
+    }
+
+    area = a[0] * tri[6] + b[0] * tri[7] + c[0];
+    if (fabsf(area) < MIN_TRIANGLE_AREA) return;
+
+    // occluders are used from both sides, so flip clockwise triangles instead of dropping them
+    if (area < 0.0f)
+    {
+        for (int edge = 0; edge < 3; ++edge)
+        {
+            a[edge] = -a[edge];
+            b[edge] = -b[edge];
+            c[edge] = -c[edge];
+        }
+        area = -area;
+    }
+
+    // depth is linear in screen space: z = dzdx * x + dzdy * y + zc
+    {
+        float ex1 = tri[3] - tri[0], ey1 = tri[4] - tri[1], ez1 = tri[5] - tri[2];
+        float ex2 = tri[6] - tri[0], ey2 = tri[7] - tri[1], ez2 = tri[8] - tri[2];
+        float det = ex1 * ey2 - ex2 * ey1;
+
+        dzdx = (ez1 * ey2 - ez2 * ey1) / det;
+        dzdy = (ez2 * ex1 - ez1 * ex2) / det;
+        zc = tri[2] - dzdx * tri[0] - dzdy * tri[1];
+    }
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        float py = y + 0.5f;
+        float row[3] = { b[0] * py + c[0], b[1] * py + c[1], b[2] * py + c[2] }, row_z = dzdy * py + zc;
+        float * out = depth + y * occ->width;
+        int x = x0;
+
+#if defined(__SSE2__)
+        // four texels per step; tiles are a multiple of four wide, so stepping from an aligned x stays in the tile
+        __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]), vdzdx = _mm_set1_ps(dzdx);
+        __m128 r0 = _mm_set1_ps(row[0]), r1 = _mm_set1_ps(row[1]), r2 = _mm_set1_ps(row[2]), rz = _mm_set1_ps(row_z);
+        __m128 zero = _mm_setzero_ps();
+
+        for (x = x0 & ~3; x <= x1; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+            __m128 inside = _mm_and_ps(_mm_and_ps(
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero)),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero));
+            __m128 z = _mm_add_ps(_mm_mul_ps(vdzdx, px), rz), current;
+
+            if (!_mm_movemask_ps(inside)) continue;
+
+            current = _mm_loadu_ps(out + x);
+            _mm_storeu_ps(out + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(current, z)), _mm_andnot_ps(inside, current)));
+        }
+#else
+        for (; x <= x1; ++x)
+        {
+            float px = x + 0.5f, z = 0.0f;
+
+            if (a[0] * px + row[0] < 0.0f || a[1] * px + row[1] < 0.0f || a[2] * px + row[2] < 0.0f) continue;
+
+            z = dzdx * px + row_z;
+            if (z < out[x]) out[x] = z;
+        }
+#endif
+    }
+}
+
+static void __build_pyramid(occlusion_t * occ)
+{
+    for (unsigned int level = 1; level < occ->num_levels; ++level)
+    {
+        const float * src = occ->levels[level - 1];
+        float * dst = occ->levels[level];
+        unsigned int width = occ->width >> level, height = occ->height >> level, src_width = width * 2;
+
+        for (unsigned int y = 0; y < height; ++y)
+        {
+            for (unsigned int x = 0; x < width; ++x)
+            {
+                const float * quad = src + y * 2 * src_width + x * 2;
+                dst[y * width + x] = fmaxf(fmaxf(quad[0], quad[1]), fmaxf(quad[src_width], quad[src_width + 1]));
+            }
+        }
+    }
+}
+
+static int __test_texel(const occlusion_t * occ, unsigned int level, int x, int y, int x0, int y0, int x1, int y1,
+        float depth)
+{
+    if (occ->levels[level][y * (occ->width >> level) + x] < depth) return 0;
+    if (level == 0) return 1;
+
+    // something in this texel is behind the box, find out whether it is inside the rectangle
+    --level;
+    for (int child_y = y * 2; child_y <= y * 2 + 1; ++child_y)
+    {
+        if (child_y < y0 >> level || child_y > y1 >> level) continue;
+
+        for (int child_x = x * 2; child_x <= x * 2 + 1; ++child_x)
+        {
+            if (child_x < x0 >> level || child_x > x1 >> level) continue;
+            if (__test_texel(occ, level, child_x, child_y, x0, y0, x1, y1, depth)) return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,699 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "array.h"
+#include "hash.h"
+#include "logging.h"
+
+#include "region.h"
+
+#define REGION_KEY_BITS 21
+#define REGION_KEY_MASK ((1UL << REGION_KEY_BITS) - 1)
+#define REGION_HYSTERESIS (0.5f * REGION_SIZE)  // how far past the radius a region goes before it is dropped
+#define REGION_WRITE_LEVEL Z_BEST_COMPRESSION   // written once, inflated at the same speed whatever the level
+#define REGION_MAX_NAME (sizeof("/r.-2147483648.-2147483648.-2147483648.region") - 1)  // the longest region_path adds
+
+typedef enum
+{
+    __region_queued = 0,            // waiting for the I/O thread
+    __region_reading,               // owned by the I/O thread
+    __region_ready,                 // read, waiting for room in the budget
+    __region_applying,              // chunks being handed to the world
+    __region_resident,
+    __region_unloading,             // chunks being taken back out of the world
+    __region_skipped,               // read while the budget was full, retried once there is room
+} __region_state_e;
+
+typedef struct
+{
+    int coords[3];
+    unsigned long key;
+    __region_state_e state;
+    int cancelled;                  // fell out of range while being read
+    float distance;                 // from the camera to the region's box at the last update
+    voxel_block_t * blocks;         // num_chunks chunks, read and inflated, freed once handed over
+    unsigned short * chunks;        // index in the region of each chunk, kept to unload them
+    unsigned int num_chunks;
+    unsigned int next;              // chunks handed over, or still to take back when unloading
+    size_t bytes;                   // chunk storage once in the world
+} __region_t;
+
+static int __streaming = 0;
+static voxel_world_t * __world = NULL;
+static char __dir[REGION_MAX_PATH];
+static float __radius = 0.0f;
+// everything from here on is guarded by __lock; the I/O thread only touches queued and reading regions
+static pthread_t __reader;
+static pthread_mutex_t __lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __queued_cond = PTHREAD_COND_INITIALIZER;
+static int __stop = 0;
+static hash_t __table;              // regions by key
+static array_t __regions;
+static region_stats_t __stats;
+
+static unsigned long __region_key(int rx, int ry, int rz);
+static float __region_distance(const __region_t * region, vec3_t camera);
+static __region_t * __region_create(int rx, int ry, int rz);
+static void __region_free(__region_t * region);
+static int __region_drop(__region_t * region);
+static void __region_admit(__region_t * region);
+static __region_t * __farthest_resident(void);
+static void __chunk_coords(const __region_t * region, unsigned int idx, int * cx, int * cy, int * cz);
+static unsigned int __apply_work(unsigned int budget);
+static void * __reader_main(void * arg);
+static void __read_region(__region_t * region);
+static status_e __read_file(const char * path, const __region_t * region, __region_t * out, unsigned long * bytes_read);
+
+status_e region_path(char * path, size_t len, const char * dir, int rx, int ry, int rz)
+{
+    int written = 0;
+
+    if (!path || !dir)
+    {
+        LOG_ERROR("path or dir is NULL! (path = %p, dir = %p)\n", path, dir);
+        return status_error;
+    }
+
+    // a cut short name would open some other file, or none, and read as air
+    written = snprintf(path, len, "%s/r.%d.%d.%d.region", dir, rx, ry, rz);
+    if (written < 0 || (size_t)written >= len)
+    {
+        LOG_ERROR("the path of region %d, %d, %d under %s does not fit in %lu bytes\n", rx, ry, rz, dir, (unsigned long)len);
+        return status_error;
+    }
+
+    return status_success;
+}
+
+status_e region_write(const char * path, const voxel_world_t * world, int rx, int ry, int rz)
+{
+    region_header_t header;
+    unsigned char * buffers[REGION_MAX_CHUNKS] = { NULL };
+    uint64_t offset = sizeof(region_header_t);
+    status_e status = status_success;
+    FILE * fp = NULL;
+
+    if (!path || !world)
+    {
+        LOG_ERROR("path or world is NULL! (path = %p, world = %p)\n", path, world);
+        return status_error;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REGION_MAGIC, sizeof(header.magic));
+    header.version = REGION_VERSION;
+    header.header_size = sizeof(region_header_t);
+    header.chunk_size = VOXEL_CHUNK_SIZE;
+    header.coords[0] = rx;
+    header.coords[1] = ry;
+    header.coords[2] = rz;
+
+    for (unsigned int idx = 0; idx < REGION_MAX_CHUNKS && status == status_success; ++idx)
+    {
+        const voxel_chunk_t * chunk = voxel_get_chunk(world, rx * REGION_CHUNKS + (idx & (REGION_CHUNKS - 1)),
+                ry * REGION_CHUNKS + ((idx >> REGION_BITS) & (REGION_CHUNKS - 1)), rz * REGION_CHUNKS + (idx >> (2 * REGION_BITS)));
+        uLongf size = compressBound(VOXEL_CHUNK_BLOCKS);
+
+        // chunks of air are left out, like chunks the world never had
+        if (!chunk || chunk->num_solid == 0) continue;
+
+        if (!(buffers[idx] = malloc(size)) || compress2(buffers[idx], &size, chunk->blocks, VOXEL_CHUNK_BLOCKS,
+                    REGION_WRITE_LEVEL) != Z_OK)
+        {
+            LOG_ERROR("failed to deflate chunk %u of region (%d, %d, %d)\n", idx, rx, ry, rz);
+            status = status_error;
+            break;
+        }
+
+        header.entries[idx].offset = offset;
+        header.entries[idx].size = size;
+        header.entries[idx].num_solid = chunk->num_solid;
+        offset += size;
+        ++header.num_chunks;
+    }
+
+    if (status == status_success && !(fp = fopen(path, "wb")))
+    {
+        LOG_ERROR("failed to open %s for writing\n", path);
+        status = status_error;
+    }
+
+    if (status == status_success && fwrite(&header, sizeof(header), 1, fp) != 1) status = status_error;
+    for (unsigned int idx = 0; idx < REGION_MAX_CHUNKS && status == status_success; ++idx)
+    {
+        if (buffers[idx] && fwrite(buffers[idx], header.entries[idx].size, 1, fp) != 1) status = status_error;
+    }
+
+    if (fp && fclose(fp) != 0) status = status_error;
+    if (fp && status != status_success) LOG_ERROR("failed to write %s\n", path);
+
+    for (unsigned int idx = 0; idx < REGION_MAX_CHUNKS; ++idx) free(buffers[idx]);
+
+    return status;
+}
+
+status_e region_stream_start(voxel_world_t * world, const char * dir, float radius, size_t budget_bytes)
+{
+    if (!world || !dir)
+    {
+        LOG_ERROR("world or dir is NULL! (world = %p, dir = %p)\n", world, dir);
+        return status_error;
+    }
+
+    if (__streaming)
+    {
+        LOG_ERROR("already streaming from %s\n", __dir);
+        return status_error;
+    }
+
+    if (strlen(dir) + REGION_MAX_NAME >= sizeof(__dir))
+    {
+        LOG_ERROR("%s is too long to hold region files (at most %lu characters)\n", dir,
+                (unsigned long)(sizeof(__dir) - REGION_MAX_NAME - 1));
+        return status_error;
+    }
+
+    if (hash_init(&__table) != status_success || array_init(&__regions) != status_success)
+    {
+        LOG_ERROR("failed to allocate memory for streaming\n");
+        return status_error;
+    }
+
+    __world = world;
+    strncpy(__dir, dir, sizeof(__dir) - 1);
+    __dir[sizeof(__dir) - 1] = '\0';
+    __radius = radius;
+    __stop = 0;
+    memset(&__stats, 0, sizeof(__stats));
+    __stats.budget_bytes = budget_bytes;
+
+    if (pthread_create(&__reader, NULL, __reader_main, NULL) != 0)
+    {
+        LOG_ERROR("failed to start the region reader\n");
+        hash_destroy(&__table);
+        array_destroy(&__regions);
+        return status_error;
+    }
+
+    __streaming = 1;
+
+    return status_success;
+}
+
+void region_stream_stop(void)
+{
+    if (!__streaming) return;
+
+    pthread_mutex_lock(&__lock);
+    __stop = 1;
+    pthread_cond_broadcast(&__queued_cond);
+    pthread_mutex_unlock(&__lock);
+    pthread_join(__reader, NULL);
+
+    for (unsigned int idx = 0; idx < __regions.len; ++idx) __region_free(array_get(&__regions, idx));
+    hash_destroy(&__table);
+    array_destroy(&__regions);
+    __streaming = 0;
+}
+
+void region_stream_update(vec3_t camera)
+{
+    int center[3] = { (int)floorf(camera.x / REGION_SIZE), (int)floorf(camera.y / REGION_SIZE), (int)floorf(camera.z / REGION_SIZE) };
+    int reach = (int)ceilf(__radius / REGION_SIZE);
+    unsigned int queued = 0;
+
+    if (!__streaming) return;
+
+    pthread_mutex_lock(&__lock);
+
+    // drop what fell out of range, admit what the reader finished
+    for (unsigned int idx = 0; idx < __regions.len;)
+    {
+        __region_t * region = array_get(&__regions, idx);
+
+        region->distance = __region_distance(region, camera);
+        if (region->distance > __radius + REGION_HYSTERESIS)
+        {
+            if (!region->cancelled && __region_drop(region)) continue;
+        }
+        else if (region->cancelled)
+        {
+            // back in range before the reader was done with it
+            region->cancelled = 0;
+        }
+
+        if (region->state == __region_ready)
+        {
+            __region_admit(region);
+        }
+
+        ++idx;
+    }
+
+    // skipped regions are read again once they fit, or once the camera brought them nearer than what is resident
+    for (unsigned int idx = 0; idx < __regions.len; ++idx)
+    {
+        __region_t * region = array_get(&__regions, idx), * farthest = NULL;
+
+        if (region->state != __region_skipped) continue;
+        if (__stats.resident_bytes + region->bytes <= __stats.budget_bytes
+                || ((farthest = __farthest_resident()) && farthest->distance > region->distance))
+        {
+            region->state = __region_queued;
+            ++__stats.regions_pending;
+            ++queued;
+        }
+    }
+
+    // regions in range the table does not know yet
+    for (int rz = center[2] - reach; rz <= center[2] + reach && __stats.resident_bytes < __stats.budget_bytes; ++rz)
+    {
+        for (int ry = center[1] - reach; ry <= center[1] + reach; ++ry)
+        {
+            for (int rx = center[0] - reach; rx <= center[0] + reach; ++rx)
+            {
+                __region_t probe = { .coords = { rx, ry, rz } }, * region = NULL;
+                float distance = __region_distance(&probe, camera);
+
+                if (distance > __radius || hash_get(&__table, __region_key(rx, ry, rz))) continue;
+                if (!(region = __region_create(rx, ry, rz))) continue;
+
+                region->distance = distance;
+                ++__stats.regions_pending;
+                ++queued;
+            }
+        }
+    }
+
+    if (queued) pthread_cond_signal(&__queued_cond);
+    pthread_mutex_unlock(&__lock);
+
+    // applying and unloading regions belong to this thread, so the world is touched without the lock
+    __apply_work(REGION_APPLY_CHUNKS);
+}
+
+void region_stream_get_stats(region_stats_t * stats)
+{
+    if (!stats) return;
+
+    pthread_mutex_lock(&__lock);
+    *stats = __stats;
+    pthread_mutex_unlock(&__lock);
+}
+
+static unsigned long __region_key(int rx, int ry, int rz)
+{
+    unsigned long bias = 1UL << (REGION_KEY_BITS - 1);
+
+    return ((((unsigned long)(long)rx + bias) & REGION_KEY_MASK) << (2 * REGION_KEY_BITS))
+        | ((((unsigned long)(long)ry + bias) & REGION_KEY_MASK) << REGION_KEY_BITS)
+        | (((unsigned long)(long)rz + bias) & REGION_KEY_MASK);
+}
+
+// 0 inside the region
+static float __region_distance(const __region_t * region, vec3_t camera)
+{
+    float p[3] = { camera.x, camera.y, camera.z }, distance_sq = 0.0f;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float min = (float)region->coords[axis] * REGION_SIZE, max = min + REGION_SIZE;
+        float d = p[axis] < min ? min - p[axis] : (p[axis] > max ? p[axis] - max : 0.0f);
+        distance_sq += d * d;
+    }
+
+    return sqrtf(distance_sq);
+}
+
+// queued, with the lock held
+static __region_t * __region_create(int rx, int ry, int rz)
+{
+    __region_t * region = calloc(1, sizeof(__region_t));
+
+    if (!region)
+    {
+        LOG_ERROR("failed to allocate memory for region (%d, %d, %d)\n", rx, ry, rz);
+        return NULL;
+    }
+
+    region->coords[0] = rx;
+    region->coords[1] = ry;
+    region->coords[2] = rz;
+    region->key = __region_key(rx, ry, rz);
+    region->state = __region_queued;
+
+    if (hash_set(&__table, region->key, region) != status_success)
+    {
+        free(region);
+        return NULL;
+    }
+
+    if (array_push(&__regions, region) != status_success)
+    {
+        hash_remove(&__table, region->key);
+        free(region);
+        return NULL;
+    }
+
+    return region;
+}
+
+static void __region_free(__region_t * region)
+{
+    free(region->blocks);
+    free(region->chunks);
+    free(region);
+}
+
+// out of range, with the lock held: whatever state it is in, it leaves the table or starts unloading.
+// returns 1 if it was freed
+static int __region_drop(__region_t * region)
+{
+    switch (region->state)
+    {
+        case __region_reading:
+            // the reader hands it back as ready and it is freed then
+            region->cancelled = 1;
+            return 0;
+        case __region_applying:
+        case __region_resident:
+            free(region->blocks);
+            region->blocks = NULL;
+            region->state = __region_unloading;
+            __stats.resident_bytes -= region->bytes;
+            --__stats.regions_resident;
+            ++__stats.regions_unloaded;
+            return 0;
+        case __region_unloading:
+            return 0;
+        case __region_queued:
+            --__stats.regions_pending;
+            break;
+        default:
+            break;
+    }
+
+    hash_remove(&__table, region->key);
+    array_remove(&__regions, region);
+    __region_free(region);
+
+    return 1;
+}
+
+// with the lock held. makes room by evicting farther regions; a region farther than everything resident waits instead
+static void __region_admit(__region_t * region)
+{
+    __region_t * farthest = NULL;
+
+    --__stats.regions_pending;
+
+    if (region->cancelled)
+    {
+        region->state = __region_skipped;
+        region->cancelled = 0;
+        __region_drop(region);
+        return;
+    }
+
+    while (__stats.resident_bytes + region->bytes > __stats.budget_bytes && (farthest = __farthest_resident())
+            && farthest->distance > region->distance)
+    {
+        __region_drop(farthest);
+        ++__stats.regions_evicted;
+    }
+
+    if (__stats.resident_bytes + region->bytes > __stats.budget_bytes)
+    {
+        free(region->blocks);
+        free(region->chunks);
+        region->blocks = NULL;
+        region->chunks = NULL;
+        region->num_chunks = 0;
+        region->state = __region_skipped;
+        return;
+    }
+
+    region->state = __region_applying;
+    region->next = 0;
+    __stats.resident_bytes += region->bytes;
+    ++__stats.regions_resident;
+    ++__stats.regions_loaded;
+}
+
+static __region_t * __farthest_resident(void)
+{
+    __region_t * farthest = NULL;
+
+    for (unsigned int idx = 0; idx < __regions.len; ++idx)
+    {
+        __region_t * region = array_get(&__regions, idx);
+
+        // regions of air free nothing
+        if ((region->state != __region_applying && region->state != __region_resident) || region->bytes == 0) continue;
+        if (!farthest || region->distance > farthest->distance) farthest = region;
+    }
+
+    return farthest;
+}
+
+static void __chunk_coords(const __region_t * region, unsigned int idx, int * cx, int * cy, int * cz)
+{
+    unsigned int chunk = region->chunks[idx];
+
+    *cx = region->coords[0] * REGION_CHUNKS + (chunk & (REGION_CHUNKS - 1));
+    *cy = region->coords[1] * REGION_CHUNKS + ((chunk >> REGION_BITS) & (REGION_CHUNKS - 1));
+    *cz = region->coords[2] * REGION_CHUNKS + (chunk >> (2 * REGION_BITS));
+}
+
+// unloading first so the budget is met, then the nearest region being applied. the reader changes
+// the state of the regions it owns, so they are picked with the lock held
+static unsigned int __apply_work(unsigned int budget)
+{
+    unsigned int done = 0;
+
+    while (done < budget)
+    {
+        __region_t * target = NULL;
+
+        pthread_mutex_lock(&__lock);
+        for (unsigned int idx = 0; idx < __regions.len; ++idx)
+        {
+            __region_t * region = array_get(&__regions, idx);
+
+            if (region->state == __region_unloading)
+            {
+                target = region;
+                break;
+            }
+
+            if (region->state == __region_applying && (!target || region->distance < target->distance)) target = region;
+        }
+        pthread_mutex_unlock(&__lock);
+
+        if (!target) break;
+
+        if (target->state == __region_unloading)
+        {
+            for (; target->next > 0 && done < budget; ++done)
+            {
+                int cx = 0, cy = 0, cz = 0;
+
+                __chunk_coords(target, --target->next, &cx, &cy, &cz);
+                voxel_remove_chunk(__world, cx, cy, cz);
+            }
+
+            if (target->next > 0) break;
+
+            pthread_mutex_lock(&__lock);
+            hash_remove(&__table, target->key);
+            array_remove(&__regions, target);
+            pthread_mutex_unlock(&__lock);
+            __region_free(target);
+            continue;
+        }
+
+        for (; target->next < target->num_chunks && done < budget; ++done, ++target->next)
+        {
+            int cx = 0, cy = 0, cz = 0;
+
+            __chunk_coords(target, target->next, &cx, &cy, &cz);
+            voxel_set_chunk(__world, cx, cy, cz, &target->blocks[(size_t)target->next * VOXEL_CHUNK_BLOCKS]);
+            ++__stats.chunks_applied;
+        }
+
+        if (target->next == target->num_chunks)
+        {
+            pthread_mutex_lock(&__lock);
+            free(target->blocks);
+            target->blocks = NULL;
+            target->state = __region_resident;
+            pthread_mutex_unlock(&__lock);
+        }
+    }
+
+    return done;
+}
+
+static void * __reader_main(void * arg)
+{
+    pthread_mutex_lock(&__lock);
+
+    while (!__stop)
+    {
+        __region_t * nearest = NULL;
+
+        for (unsigned int idx = 0; idx < __regions.len; ++idx)
+        {
+            __region_t * region = array_get(&__regions, idx);
+
+            if (region->state != __region_queued) continue;
+            if (!nearest || region->distance < nearest->distance) nearest = region;
+        }
+
+        if (!nearest)
+        {
+            pthread_cond_wait(&__queued_cond, &__lock);
+            continue;
+        }
+
+        nearest->state = __region_reading;
+        pthread_mutex_unlock(&__lock);
+
+        __read_region(nearest);
+
+        pthread_mutex_lock(&__lock);
+        nearest->state = __region_ready;
+    }
+
+    pthread_mutex_unlock(&__lock);
+
+    return NULL;
+}
+
+// a missing file is a region of air; a damaged one is counted and treated as air too
+static void __read_region(__region_t * region)
+{
+    char path[REGION_MAX_PATH];
+    unsigned long bytes_read = 0;
+    status_e status = status_success;
+
+    if ((status = region_path(path, sizeof(path), __dir, region->coords[0], region->coords[1], region->coords[2])) == status_success)
+    {
+        status = __read_file(path, region, region, &bytes_read);
+    }
+    else
+    {
+        region->blocks = NULL;
+        region->chunks = NULL;
+        region->num_chunks = 0;
+    }
+
+    pthread_mutex_lock(&__lock);
+    __stats.bytes_read += bytes_read;
+    if (status != status_success) ++__stats.read_errors;
+    pthread_mutex_unlock(&__lock);
+
+    region->bytes = region->num_chunks * sizeof(voxel_chunk_t);
+}
+
+static status_e __read_file(const char * path, const __region_t * region, __region_t * out, unsigned long * bytes_read)
+{
+    region_header_t header;
+    unsigned char * data = NULL;
+    struct stat st;
+    uint64_t data_size = 0;
+    unsigned int count = 0;
+    status_e status = status_success;
+    int fd = -1;
+
+    out->blocks = NULL;
+    out->chunks = NULL;
+    out->num_chunks = 0;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+    {
+        if (errno == ENOENT) return status_success;
+
+        LOG_ERROR("failed to open %s\n", path);
+        return status_error;
+    }
+
+    // the header, then every chunk with one more read
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header) || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+            || memcmp(header.magic, REGION_MAGIC, sizeof(header.magic)) != 0 || header.version != REGION_VERSION
+            || header.header_size != sizeof(header) || header.chunk_size != VOXEL_CHUNK_SIZE
+            || header.coords[0] != region->coords[0] || header.coords[1] != region->coords[1]
+            || header.coords[2] != region->coords[2] || header.num_chunks > REGION_MAX_CHUNKS)
+    {
+        LOG_ERROR("%s is not a valid version %d region file\n", path, REGION_VERSION);
+        close(fd);
+        return status_error;
+    }
+
+    data_size = st.st_size - sizeof(header);
+    *bytes_read = sizeof(header);
+    if (header.num_chunks == 0)
+    {
+        close(fd);
+        return status_success;
+    }
+
+    data = malloc(data_size);
+    out->blocks = malloc((size_t)header.num_chunks * VOXEL_CHUNK_BLOCKS);
+    out->chunks = malloc(header.num_chunks * sizeof(unsigned short));
+    if (!data || !out->blocks || !out->chunks)
+    {
+        LOG_ERROR("failed to allocate memory for %u chunks of %s\n", header.num_chunks, path);
+        status = status_error;
+    }
+    else if (pread(fd, data, data_size, sizeof(header)) != (ssize_t)data_size)
+    {
+        LOG_ERROR("failed to read %s\n", path);
+        status = status_error;
+    }
+
+    close(fd);
+
+    for (unsigned int idx = 0; idx < REGION_MAX_CHUNKS && status == status_success; ++idx)
+    {
+        const region_entry_t * entry = &header.entries[idx];
+        uLongf size = VOXEL_CHUNK_BLOCKS;
+
+        if (entry->offset == 0) continue;
+
+        if (count == header.num_chunks || entry->offset < sizeof(header) || entry->offset - sizeof(header) + entry->size > data_size
+                || uncompress(&out->blocks[(size_t)count * VOXEL_CHUNK_BLOCKS], &size, &data[entry->offset - sizeof(header)],
+                    entry->size) != Z_OK || size != VOXEL_CHUNK_BLOCKS)
+        {
+            LOG_ERROR("chunk %u of %s is damaged\n", idx, path);
+            status = status_error;
+            break;
+        }
+
+        out->chunks[count++] = idx;
+    }
+
+    free(data);
+
+    if (status != status_success)
+    {
+        free(out->blocks);
+        free(out->chunks);
+        out->blocks = NULL;
+        out->chunks = NULL;
+        return status;
+    }
+
+    *bytes_read += data_size;
+    out->num_chunks = count;
+
+    return status_success;
+}
@@ -1,14 +1,731 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 #include "array.h"
+#include "bvh.h"
+#include "cmdlist.h"
+#include "cull.h"
+#include "hash.h"
+#include "jobs.h"
 #include "logging.h"
+#include "math3d.h"
+#include "mesh.h"
+#include "occlusion.h"
+#include "shader.h"
+#include "simplify.h"
+#include "sort.h"
 
 #include "render.h"
 
 static int __initialized = 0;
-static array_t __objects;
 static array_t __defs;
+static hash_t __def_table;
+static hash_t __def_users;                      // def id -> first object of that id, drawing the def or waiting for it
+static unsigned long __def_generation = 1;
+static unsigned int __def_next_sort_slot = render_object_count;
+static mat4_t __view;
+static mat4_t __projection;
+static int __camera_set = 0;
+static int __prerun_done = 0;
+static render_backend_e __backend = render_backend_fixed;
+// the fixed-function defaults
+static render_lighting_t __lighting = {
+    0,
+    { 0.2f, 0.2f, 0.2f, 1.0f },
+    { 0.0f, 0.0f, 1.0f, 0.0f },
+    { 0.0f, 0.0f, 0.0f, 1.0f },
+    { 1.0f, 1.0f, 1.0f, 1.0f },
+    { 1.0f, 1.0f, 1.0f, 1.0f },
+    { 0.0f, 0.0f, 0.0f, 1.0f },
+    0.0f,
+};
+
+// spatial index //////////////////////////////////////////////////////////////
+// every added object has a leaf in a dynamic AABB tree holding its world
+// bounds, made by the first refresh after the object is created so it goes
+// in where it was placed; render_objects and the queries refresh whatever
+// was created or moved since. leaves are fattened by BVH_MARGIN so objects
+// that only jiggle never touch the tree, and the tree is rebuilt with SAH
+// once reinsertions have made it BVH_REBUILD_RATIO times more expensive to
+// traverse.
+#define BVH_MARGIN 0.25f
+#define BVH_REBUILD_RATIO 1.5f
+
+static bvh_t __bvh;
+
+// leaves hold fat boxes, so queries filter candidates against exact bounds before reporting them
+struct __query
+{
+    render_query_cb cb;
+    void * data;
+    unsigned int hits;
+    union
+    {
+        const bvh_aabb_t * box;
+        const cull_frustum_t * frustum;
+    } region;
+    int exact_box;
+};
+// spatial index //////////////////////////////////////////////////////////////
+
+// ray casts //////////////////////////////////////////////////////////////////
+// rays go down the spatial index BVH_PACKET at a time (see bvh_raycast). the
+// object of a leaf they reach is tested against its exact world bounds, then
+// the ray is taken into the object's local space, where t is unchanged since
+// the transform is affine, and tested against each triangle of its def's
+// finest level. batches split their packets over the job workers; nothing is
+// written but each ray's own hit, so the jobs share no state.
+#define RAYCAST_GRAIN 8             // packets per job
+
+struct __raycast_batch
+{
+    const render_ray_t * rays;
+    render_ray_hit_t * hits;
+    unsigned int count;
+};
+// ray casts //////////////////////////////////////////////////////////////////
+
+// object storage /////////////////////////////////////////////////////////////
+// objects live in parallel streams indexed by a dense slot, so a pass only
+// pulls the fields it reads through the cache, and every stream starts on an
+// OBJECT_ALIGN boundary. destroying an object moves the last one into its
+// slot, so objects are referred to by handle: the low OBJECT_INDEX_BITS pick
+// an entry of __handle_slots, the rest is a generation that stale handles
+// fail to match. the bvh stores handles, as leaves outlive slot moves.
+// transforms, world bounds and bounding spheres are cached per object and only
+// recomputed for handles on the dirty list, so objects that do not move cost
+// nothing per frame.
+#define OBJECT_ALIGN 64
+#define OBJECT_INDEX_BITS 20
+#define OBJECT_INDEX_MASK ((1U << OBJECT_INDEX_BITS) - 1)
+#define OBJECT_GENERATION_MASK (~0U >> OBJECT_INDEX_BITS)
+
+// object flags
+#define OBJECT_DIRTY 0x1
+#define OBJECT_STATIC 0x2
+
+typedef struct
+{
+    void ** stream;
+    size_t size;
+} __stream_t;
+
+static unsigned int __object_len = 0;
+static unsigned int __object_capacity = 0;
+// read every frame by culling, sorting and submission
+static float * __object_center_x = NULL;        // world bounding sphere, radius < 0 without a def
+static float * __object_center_y = NULL;
+static float * __object_center_z = NULL;
+static float * __object_radius = NULL;
+static vec3_t * __object_positions = NULL;
+static render_def_t ** __object_defs = NULL;
+static unsigned char * __object_lods = NULL;    // level of detail drawn last frame
+static GLenum * __object_polygon_modes = NULL;
+static vec4_t * __object_colors = NULL;
+static mat4_t * __object_models = NULL;         // T * S * R
+static vec3_t * __object_world_min = NULL;
+static vec3_t * __object_world_max = NULL;
+// only read when an object changes
+static vec3_t * __object_scales = NULL;
+static quat_t * __object_rotations = NULL;
+static render_object_e * __object_types = NULL;
+static unsigned long * __object_def_ids = NULL;
+static unsigned char * __object_flags = NULL;
+static int * __object_proxies = NULL;
+static render_ctx_t ** __object_owners = NULL;  // ctx the object was added through, if any
+static struct __static_cluster_s ** __object_clusters = NULL;  // NULL unless drawn from a static batch
+static render_handle_t * __object_handles = NULL;
+// objects of one def id, linked by handle from __def_users
+static render_handle_t * __object_def_prev = NULL;
+static render_handle_t * __object_def_next = NULL;
+
+static __stream_t __object_streams[] = {
+    { (void **)&__object_center_x, sizeof(float) },
+    { (void **)&__object_center_y, sizeof(float) },
+    { (void **)&__object_center_z, sizeof(float) },
+    { (void **)&__object_radius, sizeof(float) },
+    { (void **)&__object_positions, sizeof(vec3_t) },
+    { (void **)&__object_defs, sizeof(render_def_t *) },
+    { (void **)&__object_lods, sizeof(unsigned char) },
+    { (void **)&__object_polygon_modes, sizeof(GLenum) },
+    { (void **)&__object_colors, sizeof(vec4_t) },
+    { (void **)&__object_models, sizeof(mat4_t) },
+    { (void **)&__object_world_min, sizeof(vec3_t) },
+    { (void **)&__object_world_max, sizeof(vec3_t) },
+    { (void **)&__object_scales, sizeof(vec3_t) },
+    { (void **)&__object_rotations, sizeof(quat_t) },
+    { (void **)&__object_types, sizeof(render_object_e) },
+    { (void **)&__object_def_ids, sizeof(unsigned long) },
+    { (void **)&__object_flags, sizeof(unsigned char) },
+    { (void **)&__object_proxies, sizeof(int) },
+    { (void **)&__object_owners, sizeof(render_ctx_t *) },
+    { (void **)&__object_clusters, sizeof(struct __static_cluster_s *) },
+    { (void **)&__object_handles, sizeof(render_handle_t) },
+    { (void **)&__object_def_prev, sizeof(render_handle_t) },
+    { (void **)&__object_def_next, sizeof(render_handle_t) },
+};
+
+// free entries hold the next free index instead of a slot
+static unsigned int * __handle_slots = NULL;
+static unsigned int * __handle_generations = NULL;
+static unsigned int __handle_capacity = 0;
+static unsigned int __handle_free = ~0U;
+
+// may hold handles destroyed since they were queued, those no longer resolve
+static render_handle_t * __dirty = NULL;
+static unsigned int __dirty_len = 0;
+static unsigned int __dirty_capacity = 0;
+// object storage /////////////////////////////////////////////////////////////
+
+// culling ////////////////////////////////////////////////////////////////////
+// the tree rejects whole regions against the frustum and accepts subtrees that
+// are entirely inside. leaves that straddle a plane are gathered at the front
+// of __visible and tested per object: world-space bounding spheres go into
+// parallel arrays so several are tested per instruction, and spheres that
+// still straddle are refined against the object's world AABB.
+#define CULL_GRAIN 2048
+
+static int __culling_enabled = 1;
+static cull_frustum_t __frustum;
+static unsigned int * __visible = NULL;        // slots
+static unsigned int __visible_len = 0;
+static unsigned int __cull_straddling = 0;
+static unsigned int __cull_contained = 0;
+static float * __cull_x = NULL;
+static float * __cull_y = NULL;
+static float * __cull_z = NULL;
+static float * __cull_radius = NULL;
+static unsigned char * __cull_results = NULL;
+static unsigned int __cull_capacity = 0;
+// culling ////////////////////////////////////////////////////////////////////
+
+// level of detail ////////////////////////////////////////////////////////////
+// levels are picked from the distance to the camera while queueing. an object
+// only changes level once it is LOD_HYSTERESIS past a threshold, so one
+// hovering around it does not flip every frame. generated levels keep
+// LOD_REDUCTION of the previous level's triangles.
+#define LOD_HYSTERESIS 0.1f
+#define LOD_REDUCTION 0.25f
+#define LOD_MIN_TRIANGLES 4
+
+static vec3_t __camera_pos;
+// level of detail ////////////////////////////////////////////////////////////
+
+// occlusion culling //////////////////////////////////////////////////////////
+// after frustum culling the visible objects that look biggest from the camera
+// are rasterized into a small CPU depth buffer, and everything visible is then
+// tested against its hierarchical-Z pyramid. occluders must be opaque and
+// filled, cover at least OCCLUSION_MIN_SIZE (radius over distance) and stay
+// within OCCLUSION_MAX_OCCLUDERS and OCCLUSION_MAX_TRIANGLES, so rasterizing
+// costs far less than the draws it saves.
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_MIN_SIZE 0.05f
+#define OCCLUSION_MAX_OCCLUDERS 64
+#define OCCLUSION_MAX_TRIANGLES 8192
+
+typedef struct
+{
+    float size;
+    unsigned int slot;
+} __occluder_t;
+
+static int __occlusion_enabled = 1;
+static int __occlusion_ready = 0;
+static occlusion_t __occlusion;
+static __occluder_t * __occluders = NULL;
+static unsigned int __occluders_capacity = 0;
+// occlusion culling //////////////////////////////////////////////////////////
+
+// render queue ///////////////////////////////////////////////////////////////
+// every frame each object emits a 64-bit sort key. sorting the keys brings
+// objects that share state together so submission only has to change what
+// differs between neighbours. key layout, msb first:
+//   pass (2) | polygon mode (2) | def sort slot (20) | lod (2) | view depth (24) | unused (14)
+#define QUEUE_PASS_SHIFT 62
+#define QUEUE_MODE_SHIFT 60
+#define QUEUE_DEF_SHIFT 40
+#define QUEUE_DEF_MASK 0xfffffULL
+#define QUEUE_LOD_SHIFT 38
+#define QUEUE_LOD_MASK 3ULL
+#define QUEUE_DEPTH_SHIFT 14
+#define QUEUE_DEPTH_MASK 0xffffffULL
+#define QUEUE_STATE_MASK (~0ULL << QUEUE_LOD_SHIFT)
+
+typedef enum
+{
+    __pass_opaque = 0,
+    __pass_transparent,
+} __pass_e;
+
+static unsigned long long * __queue_keys = NULL;
+static unsigned long long * __queue_tmp_keys = NULL;
+static unsigned int * __queue_items = NULL;
+static unsigned int * __queue_tmp_items = NULL;
+static unsigned int __queue_len = 0;
+static unsigned int __queue_capacity = 0;
+// render queue ///////////////////////////////////////////////////////////////
+
+// instancing /////////////////////////////////////////////////////////////////
+// objects sharing a def and polygon mode are drawn with a single instanced call.
+// per-instance data is the model matrix (4 columns) followed by the color.
+// changed instances less than INSTANCE_UPLOAD_GAP apart share one upload,
+// and once more than 1 / INSTANCE_STREAM_RATIO of them changed, the frame's
+// instances are written into the streaming buffer instead.
+#define INSTANCE_FLOATS 20
+#define INSTANCE_UPLOAD_GAP 16
+#define INSTANCE_STREAM_RATIO 2
+#define INSTANCE_GRAIN 2048                 // instances compared per job range
+#define INSTANCE_ATTRIB_MODEL 4
+#define INSTANCE_ATTRIB_COLOR 8
+
+static int __instancing_supported = 0;
+static int __instancing_enabled = 1;
+static GLuint __instance_program = 0;
+static GLint __instance_lighting_loc = -1;
+static GLuint __instance_vbo = 0;
+static GLfloat * __instance_data = NULL;     // last frame's instances, so only changed ones are uploaded
+static unsigned int * __instance_spans = NULL;  // begin and end of each changed span
+static unsigned int __instance_capacity = 0;
+static unsigned int __instance_len = 0;         // instances in __instance_data from the last frame
+static unsigned int __instance_buffer_len = 0;  // size of the buffer's store in instances
+static int __instance_buffer_stale = 0;         // the last frame streamed its instances, so the buffer lags behind
+
+// what comparing one job range of instances found; its spans start at the range's own instances
+typedef struct
+{
+    unsigned int num_spans;
+    unsigned int changed;
+} __instance_range_t;
+
+static __instance_range_t * __instance_ranges = NULL;    // one per INSTANCE_GRAIN of __instance_capacity
+
+// mirrors the fixed-function pipeline: per-vertex lighting of light 0 with
+// glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE) driven by the instance color
+static const char * __instance_vertex_source =
+    "#version 120\n"
+    "attribute vec4 inst_model0;\n"
+    "attribute vec4 inst_model1;\n"
+    "attribute vec4 inst_model2;\n"
+    "attribute vec4 inst_model3;\n"
+    "attribute vec4 inst_color;\n"
+    "uniform int lighting;\n"
+    "varying vec4 v_color;\n"
+    "void main()\n"
+    "{\n"
+    "    mat4 model = mat4(inst_model0, inst_model1, inst_model2, inst_model3);\n"
+    "    vec4 eye_pos = gl_ModelViewMatrix * (model * gl_Vertex);\n"
+    "    gl_Position = gl_ProjectionMatrix * eye_pos;\n"
+    "    if (lighting == 0) { v_color = inst_color; return; }\n"
+    "    // model is T*S*R, so its inverse transpose only differs by 1/scale^2 per row\n"
+    "    vec3 scale_sq = vec3(dot(vec3(model[0][0], model[1][0], model[2][0]), vec3(model[0][0], model[1][0], model[2][0])),\n"
+    "                         dot(vec3(model[0][1], model[1][1], model[2][1]), vec3(model[0][1], model[1][1], model[2][1])),\n"
+    "                         dot(vec3(model[0][2], model[1][2], model[2][2]), vec3(model[0][2], model[1][2], model[2][2])));\n"
+    "    vec3 n = normalize(gl_NormalMatrix * ((mat3(model) * gl_Normal) / scale_sq));\n"
+    "    vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+    "    float n_dot_l = max(dot(n, l), 0.0);\n"
+    "    vec4 color = gl_LightModel.ambient * inst_color + gl_LightSource[0].ambient * inst_color\n"
+    "               + n_dot_l * gl_LightSource[0].diffuse * inst_color;\n"
+    "    if (n_dot_l > 0.0)\n"
+    "    {\n"
+    "        float n_dot_h = max(dot(n, normalize(gl_LightSource[0].halfVector.xyz)), 0.0);\n"
+    "        color += pow(n_dot_h, gl_FrontMaterial.shininess) * gl_LightSource[0].specular * gl_FrontMaterial.specular;\n"
+    "    }\n"
+    "    v_color = vec4(color.rgb, inst_color.a);\n"
+    "}\n";
+
+static const char * __instance_fragment_source =
+    "#version 120\n"
+    "varying vec4 v_color;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = v_color;\n"
+    "}\n";
+// instancing /////////////////////////////////////////////////////////////////
+
+// command recording //////////////////////////////////////////////////////////
+// the compatibility backend records the render queue on the job workers, one
+// command list per RECORD_GRAIN queue items, and plays the lists back in
+// queue order. a list starts out not knowing what the one before it left
+// behind, so its first item sets the pass, polygon mode and arrays again.
+#define RECORD_GRAIN 1024
+
+// what instanced recording reads the instances from
+typedef struct
+{
+    GLuint buffer;
+    GLintptr base;
+} __record_instances_t;
+
+static cmdlist_t * __record_lists = NULL;
+static unsigned int __record_lists_capacity = 0;
+// command recording //////////////////////////////////////////////////////////
+
+// streaming //////////////////////////////////////////////////////////////////
+// per-frame dynamic data is written straight into one buffer split into
+// STREAM_FRAMES regions. each frame bump-allocates from its own region, and a
+// fence placed once the frame is done keeps the region from being handed out
+// again before the GPU has read it. with GL_ARB_buffer_storage the buffer stays
+// mapped persistently and coherently, so nothing is copied or flushed;
+// otherwise its store is orphaned every frame and mapped unsynchronized while
+// spans are written. a frame that runs out of room grows the regions at the
+// next frame boundary.
+#define STREAM_FRAMES 3
+#define STREAM_REGION_BYTES (1 << 22)
+#define STREAM_WAIT_NS 1000000
+
+typedef enum
+{
+    __stream_none = 0,
+    __stream_persistent,
+    __stream_orphaning,
+} __stream_mode_e;
+
+static __stream_mode_e __stream_mode = __stream_none;
+static GLuint __stream_buffer = 0;
+static char * __stream_map = NULL;          // where __stream_map_offset is mapped, NULL while unmapped
+static GLintptr __stream_map_offset = 0;
+static GLsizeiptr __stream_region_bytes = 0;
+static unsigned int __stream_region = 0;
+static GLintptr __stream_offset = 0;         // next free byte in the current region
+static GLsizeiptr __stream_demand = 0;      // bytes asked for this frame, including what did not fit
+static GLsync __stream_fences[STREAM_FRAMES];
+// streaming //////////////////////////////////////////////////////////////////
+
+// core profile ///////////////////////////////////////////////////////////////
+// without the matrix stack, client arrays or fixed-function lighting, camera
+// and lighting go into a per-frame uniform buffer and def levels are copied
+// into vertex arrays the first time they are drawn. per-object data is the
+// instance buffer, bound as a uniform buffer: every run of equal state is
+// drawn instanced from a CORE_BLOCK_BYTES window starting at the nearest
+// aligned offset below it, with object_base pointing at the run's first
+// object within the window.
+#define CORE_ATTRIB_POSITION 0
+#define CORE_ATTRIB_NORMAL 1
+#define CORE_FRAME_BINDING 0
+#define CORE_OBJECT_BINDING 1
+#define CORE_BLOCK_BYTES 16384          // GL_MAX_UNIFORM_BLOCK_SIZE is at least this
+#define CORE_BLOCK_VEC4S "1024"
+
+// std140 layout of the frame_data block
+typedef struct
+{
+    mat4_t view;
+    mat4_t projection;
+    GLfloat global_ambient[4];
+    GLfloat light_position[4];
+    GLfloat light_ambient[4];
+    GLfloat light_diffuse[4];
+    GLfloat light_specular[4];
+    GLfloat material_specular[4];
+    GLfloat params[4];                  // shininess, lighting enabled
+} __core_frame_t;
+
+static GLuint __core_program = 0;
+static GLint __core_base_loc = -1;
+static GLuint __core_frame_ubo = 0;
+static GLuint __core_object_ubo = 0;    // single objects drawn by render_object
+static GLint __core_ubo_align = 256;
+
+// frame_data and the lighting shared by the core programs, whose main() supplies the model matrix and color
+#define CORE_SHADER_COMMON \
+    "#version 330 core\n" \
+    "layout(std140) uniform frame_data\n" \
+    "{\n" \
+    "    mat4 view;\n" \
+    "    mat4 projection;\n" \
+    "    vec4 global_ambient;\n" \
+    "    vec4 light_position;\n" \
+    "    vec4 light_ambient;\n" \
+    "    vec4 light_diffuse;\n" \
+    "    vec4 light_specular;\n" \
+    "    vec4 material_specular;\n" \
+    "    vec4 params;\n" \
+    "};\n" \
+    "in vec3 position;\n" \
+    "in vec3 normal;\n" \
+    "out vec4 v_color;\n" \
+    "void shade(mat4 model, vec4 color)\n" \
+    "{\n" \
+    "    vec4 eye_pos = view * (model * vec4(position, 1.0));\n" \
+    "    gl_Position = projection * eye_pos;\n" \
+    "    if (params.y == 0.0) { v_color = color; return; }\n" \
+    "    // model is T*S*R and the view is rigid, so only 1/scale^2 per row separates this from the inverse transpose\n" \
+    "    vec3 scale_sq = vec3(dot(vec3(model[0][0], model[1][0], model[2][0]), vec3(model[0][0], model[1][0], model[2][0])),\n" \
+    "                         dot(vec3(model[0][1], model[1][1], model[2][1]), vec3(model[0][1], model[1][1], model[2][1])),\n" \
+    "                         dot(vec3(model[0][2], model[1][2], model[2][2]), vec3(model[0][2], model[1][2], model[2][2])));\n" \
+    "    vec3 n = normalize(mat3(view) * ((mat3(model) * normal) / scale_sq));\n" \
+    "    vec3 l = normalize(light_position.w == 0.0 ? light_position.xyz : light_position.xyz - eye_pos.xyz);\n" \
+    "    float n_dot_l = max(dot(n, l), 0.0);\n" \
+    "    vec4 lit = global_ambient * color + light_ambient * color + n_dot_l * light_diffuse * color;\n" \
+    "    if (n_dot_l > 0.0)\n" \
+    "    {\n" \
+    "        // infinite viewer, like the fixed-function default\n" \
+    "        float n_dot_h = max(dot(n, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0);\n" \
+    "        lit += pow(n_dot_h, params.x) * light_specular * material_specular;\n" \
+    "    }\n" \
+    "    v_color = vec4(lit.rgb, color.a);\n" \
+    "}\n"
+
+static const char * __core_vertex_source =
+    CORE_SHADER_COMMON
+    "layout(std140) uniform object_data\n"
+    "{\n"
+    "    vec4 objects[" CORE_BLOCK_VEC4S "];\n"
+    "};\n"
+    "uniform int object_base;\n"
+    "void main()\n"
+    "{\n"
+    "    int o = object_base + gl_InstanceID * 5;\n"
+    "    shade(mat4(objects[o], objects[o + 1], objects[o + 2], objects[o + 3]), objects[o + 4]);\n"
+    "}\n";
+
+static const char * __core_fragment_source =
+    "#version 330 core\n"
+    "in vec4 v_color;\n"
+    "out vec4 frag_color;\n"
+    "void main()\n"
+    "{\n"
+    "    frag_color = v_color;\n"
+    "}\n";
+// core profile ///////////////////////////////////////////////////////////////
+
+// indirect drawing ///////////////////////////////////////////////////////////
+// the core backend's other submission mode. def levels are appended to shared
+// vertex and index buffers the first time they are drawn, so each run of the
+// render queue becomes one DrawElementsIndirectCommand whose base_instance
+// points at the run's first instance, read as instanced vertex attributes.
+// all runs sharing a pass and polygon mode go out in a single
+// glMultiDrawElementsIndirect call, or as a loop of instanced draws where
+// multi-draw-indirect is missing. once removed defs account for most of
+// what the buffers hold, they are started over and live defs placed again.
+#define INDIRECT_ATTRIB_MODEL 2
+#define INDIRECT_ATTRIB_COLOR 6
+#define INDIRECT_VERTEX_FLOATS 6            // position then normal
+#define INDIRECT_INITIAL_VERTICES 65536
+#define INDIRECT_INITIAL_INDICES 262144
+
+// layout glMultiDrawElementsIndirect reads
+typedef struct
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+} __indirect_command_t;
+
+static int __indirect_supported = 0;
+static int __indirect_enabled = 1;
+static int __indirect_multi_draw = 0;
+static GLuint __indirect_program = 0;
+static GLuint __indirect_array = 0;
+static GLuint __indirect_vbo = 0;
+static GLuint __indirect_ibo = 0;
+static GLuint __indirect_command_buffer = 0;    // used when the streaming buffer is not
+static unsigned int __indirect_vertex_len = 0;
+static unsigned int __indirect_vertex_capacity = 0;
+static unsigned int __indirect_index_len = 0;
+static unsigned int __indirect_index_capacity = 0;
+static unsigned int __indirect_dead_vertices = 0;   // still held by removed defs
+static unsigned int __indirect_dead_indices = 0;
+static unsigned long __indirect_generation = 1;     // defs placed in an older one are not in the buffers
+static __indirect_command_t * __indirect_commands = NULL;
+static unsigned int __indirect_commands_capacity = 0;
+
+static const char * __indirect_vertex_source =
+    CORE_SHADER_COMMON
+    "in vec4 inst_model0;\n"
+    "in vec4 inst_model1;\n"
+    "in vec4 inst_model2;\n"
+    "in vec4 inst_model3;\n"
+    "in vec4 inst_color;\n"
+    "void main()\n"
+    "{\n"
+    "    shade(mat4(inst_model0, inst_model1, inst_model2, inst_model3), inst_color);\n"
+    "}\n";
+// indirect drawing ///////////////////////////////////////////////////////////
+
+// static batching ////////////////////////////////////////////////////////////
+// objects flagged static are drawn from merged geometry instead of one by one.
+// their finest level is transformed to world space and appended, with the
+// object's color per vertex, to the buffers of the cluster for the
+// STATIC_CLUSTER_SIZE grid cell their center falls in, one cluster per cell
+// and polygon mode. static objects still go through culling one by one, and a
+// cluster is drawn whole when any of its members is visible. a cluster is only
+// rebuilt when an object joins it, leaves it or changes in it. see-through
+// objects stay in the render queue, which sorts them back to front.
+#define STATIC_CLUSTER_SIZE 32.0f
+#define STATIC_CELL_BITS 20
+#define STATIC_CELL_MASK ((1UL << STATIC_CELL_BITS) - 1)
+#define STATIC_ATTRIB_COLOR 2
+
+typedef struct
+{
+    GLfloat position[3];
+    GLfloat normal[3];
+    GLubyte color[4];
+} __static_vertex_t;
+
+typedef struct __static_cluster_s
+{
+    unsigned long key;
+    GLenum polygon_mode;
+    render_handle_t * members;
+    unsigned int num_members;
+    unsigned int members_capacity;
+    int dirty;
+    unsigned long drawn_frame;              // last __static_frame a member was visible in
+    GLuint array;                           // core backend only
+    GLuint buffers[2];                      // vertices, then GL_UNSIGNED_INT indices
+    GLsizei num_indices;
+    GLsizeiptr gpu_bytes;
+} __static_cluster_t;
+
+static hash_t __static_table;               // clusters by key
+static array_t __static_clusters;
+static __static_cluster_t ** __static_visible = NULL;
+static unsigned int __static_visible_len = 0;
+static unsigned int __static_visible_capacity = 0;
+static unsigned long __static_frame = 0;
+static GLuint __static_program = 0;
+// scratch for merging
+static __static_vertex_t * __static_vertices = NULL;
+static unsigned int __static_vertices_capacity = 0;
+static GLuint * __static_indices = NULL;
+static unsigned int __static_indices_capacity = 0;
+
+static const char * __static_vertex_source =
+    CORE_SHADER_COMMON
+    "in vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    shade(mat4(1.0), color);\n"
+    "}\n";
+// static batching ////////////////////////////////////////////////////////////
+
+// statistics /////////////////////////////////////////////////////////////////
+// every thread counts into its own cache-line padded slot, claimed the first
+// time it counts, so workers recording commands never share a counter. the
+// slots are summed when the stats are read and cleared between frames, which
+// only the thread owning the context does, while no jobs are running.
+#define STATS_MAX_THREADS 128
+
+typedef union
+{
+    render_stats_t stats;
+    char pad[(sizeof(render_stats_t) + 63) & ~63];
+} __stats_slot_t;
+
+static __stats_slot_t __stats_slots[STATS_MAX_THREADS] __attribute__((aligned(64)));
+static unsigned int __stats_num_slots = 0;
+static render_stats_t __stats_dropped;          // shared by threads past the last slot, never read
+static __thread render_stats_t * __stats_local = NULL;
+static render_stats_t __stats_history[RENDER_STATS_HISTORY];
+static unsigned int __stats_history_len = 0;
+static unsigned int __stats_history_next = 0;
+static long __stats_def_gpu_bytes = 0;          // per-def buffers of the core backend
+// statistics /////////////////////////////////////////////////////////////////
+
 static void __render_shutdown(void);
 static status_e __ctx_sanity_check(const render_ctx_t * ctx);
 static status_e __def_sanity_check(const render_def_t * def);
+static render_def_t * __resolve_def(render_ctx_t * ctx);
+static void __ctx_model_matrix(const render_ctx_t * ctx, mat4_t * m);
+static status_e __object_reserve(unsigned int capacity);
+static render_handle_t __object_create(render_object_e type, unsigned long def_id, render_ctx_t * owner);
+static unsigned int __object_slot(render_handle_t object);
+static void __object_copy_ctx(unsigned int slot, const render_ctx_t * ctx);
+static void __object_resolve_def(unsigned int slot);
+static status_e __object_link_def(unsigned int slot);
+static void __object_unlink_def(unsigned int slot);
+static void __object_update_transform(unsigned int slot);
+static void __object_mark_dirty(unsigned int slot);
+static void __object_world_bounds(unsigned int slot, bvh_aabb_t * box);
+static void __object_free_all(void);
+static void __bvh_refresh(void);
+static int __bvh_collect(void * data, int inside, void * user);
+static int __query_filter(void * data, int inside, void * user);
+static float __query_distance(void * data, vec3_t point, void * user);
+static void __raycast_packet(const render_ray_t * rays, unsigned int count, render_ray_hit_t * hits);
+static void __raycast_range(unsigned int begin, unsigned int end, void * data);
+static float __raycast_object(void * data, const bvh_ray_t * ray, unsigned int ray_index, float max_t, void * user);
+static int __ray_box(const bvh_ray_t * ray, vec3_t min, vec3_t max, float max_t);
+static float __ray_triangle(vec3_t origin, vec3_t direction, vec3_t a, vec3_t b, vec3_t c);
+static status_e __instancing_init(void);
+static status_e __queue_reserve(unsigned int capacity);
+static void __def_compute_bounds(render_def_t * def);
+static status_e __def_build_meshes(render_def_t * def);
+static status_e __def_compile_level(const render_lod_t * source, render_lod_t * out, GLfloat * acmr_before, GLfloat * acmr_after);
+static void __def_free_meshes(render_def_t * def);
+static const render_lod_t * __def_lod(const render_def_t * def, unsigned int lod);
+static unsigned int __select_lod(const render_def_t * def, unsigned int current, GLfloat distance);
+static status_e __cull_reserve(unsigned int capacity);
+static void __cull_range(unsigned int begin, unsigned int end, void * data);
+static void __cull_objects(void);
+static int __occluder_compare(const void * a, const void * b);
+static void __occlusion_range(unsigned int begin, unsigned int end, void * data);
+static void __occlusion_cull(const mat4_t * view_projection);
+static void __queue_build(const mat4_t * view);
+static void __queue_set_pass(__pass_e pass);
+static void __queue_submit(void);
+static void __queue_submit_instanced(void);
+static int __queue_same_run(unsigned int a, unsigned int b);
+static void __record_queue(jobs_range_fn fn, void * data);
+static void __record_pass(cmdlist_t * list, __pass_e pass);
+static void __record_objects(unsigned int begin, unsigned int end, void * data);
+static void __record_instanced(unsigned int begin, unsigned int end, void * data);
+static status_e __core_init(void);
+static void __core_upload_def(render_def_t * def);
+static void __core_release_def(render_def_t * def);
+static GLsizeiptr __core_level_bytes(const render_lod_t * mesh);
+static void __core_begin(void);
+static void __core_end(void);
+static void __core_submit(void);
+static status_e __indirect_init(void);
+static status_e __indirect_reserve(unsigned int vertices, unsigned int indices);
+static GLuint __indirect_grow(GLenum target, GLuint buffer, GLsizeiptr used, GLsizeiptr size);
+static void __indirect_bind_geometry(void);
+static void __indirect_point_instances(GLuint buffer, GLintptr offset);
+static status_e __indirect_upload_def(render_def_t * def);
+static void __indirect_release_def(render_def_t * def);
+static void __indirect_flush(unsigned int first, unsigned int count, GLuint buffer, GLintptr base);
+static void __indirect_submit(void);
+static status_e __static_init(void);
+static void __static_place(unsigned int slot);
+static unsigned long __static_key(unsigned int slot);
+static __static_cluster_t * __static_cluster_get(unsigned long key, GLenum polygon_mode);
+static void __static_leave(unsigned int slot);
+static void __static_refresh(void);
+static void __static_rebuild(__static_cluster_t * cluster);
+static void __static_upload(__static_cluster_t * cluster, unsigned int num_vertices);
+static void __static_mark_visible(__static_cluster_t * cluster);
+static void __static_draw(void);
+static void __static_free_all(void);
+static status_e __instance_update(GLenum target, GLsizeiptr alignment, GLsizeiptr slack, GLuint * buffer, GLintptr * base);
+static void __instance_diff_range(unsigned int begin, unsigned int end, void * data);
+static void __instance_upload(GLenum target, unsigned int begin, unsigned int end);
+static status_e __stream_init(void);
+static status_e __stream_create(GLsizeiptr region_bytes);
+static void __stream_destroy(void);
+static void __stream_begin_frame(void);
+static void __stream_wait(unsigned int region);
+static render_stats_t * __stats_thread(void);
+static void __stats_sum(render_stats_t * total);
+static void __stats_add(render_stats_t * total, const render_stats_t * stats);
+static void __count_draw(render_stats_t * stats, GLsizei count, GLsizei instances);
+static void __bind_buffer(GLenum target, GLuint buffer);
+static void __bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+static void __bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+static void __buffer_data(GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage);
+static void __buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid * data);
+static void __bind_vertex_array(GLuint array);
+static void __use_program(GLuint program);
+static void __polygon_mode(GLenum mode);
+static void __push_attrib(GLbitfield mask);
+static void __pop_attrib(void);
 
 // cube ///////////////////////////////////////////////////////////////////////
 //    v6----- v5
@@ -41,6 +758,9 @@ static GLint __cube_num_vertices = 24;
 static GLenum __cube_vertex_mode = GL_QUADS;
 // cube //////////////////////////////////////////////////////////////////////
 
+// defs backing the pre-defined object types, indexed by render_object_e
+static render_def_t __builtin_defs[render_object_count];
+
 status_e render_init(void)
 {
     if (__initialized)
@@ -53,18 +773,50 @@ status_e render_init(void)
    
     atexit(__render_shutdown);
     
-    if (array_init(&__objects) != status_success)
+    if (array_init(&__defs) != status_success)
     {
-        LOG_ERROR("failed to allocate memory for object array\n");
+        LOG_ERROR("failed to allocate memory for definition array\n");
         return status_error;
     }
 
-    if (array_init(&__defs) != status_success)
+    if (hash_init(&__def_table) != status_success || hash_init(&__def_users) != status_success)
     {
-        LOG_ERROR("failed to allocate memory for definition array\n");
+        LOG_ERROR("failed to allocate memory for definition table\n");
+        return status_error;
+    }
+
+    if (bvh_init(&__bvh, BVH_MARGIN) != status_success)
+    {
+        LOG_ERROR("failed to initialize spatial index\n");
+        return status_error;
+    }
+
+    if (hash_init(&__static_table) != status_success || array_init(&__static_clusters) != status_success)
+    {
+        LOG_ERROR("failed to allocate memory for static batches\n");
         return status_error;
     }
 
+    // not fatal, objects just all count as unoccluded
+    if (!(__occlusion_ready = occlusion_init(&__occlusion, OCCLUSION_WIDTH, OCCLUSION_HEIGHT) == status_success))
+    {
+        LOG_ERROR("failed to initialize occlusion buffer, occlusion culling is disabled\n");
+    }
+
+    for (unsigned int type = 0; type < render_object_count; ++type)
+    {
+        __builtin_defs[type].sort_slot = type;
+    }
+    __builtin_defs[render_object_cube].vertices = __cube_vertices;
+    __builtin_defs[render_object_cube].normals = __cube_normals;
+    __builtin_defs[render_object_cube].num_vertices = __cube_num_vertices;
+    __builtin_defs[render_object_cube].vertex_mode = __cube_vertex_mode;
+    __def_compute_bounds(&__builtin_defs[render_object_cube]);
+    if (__def_build_meshes(&__builtin_defs[render_object_cube]) != status_success)
+    {
+        LOG_ERROR("failed to build the cube mesh\n");
+        return status_error;
+    }
 
     __initialized = 1;
 
@@ -75,180 +827,3780 @@ status_e render_init(void)
 
 status_e render_prerun(void)
 {
+    GLint profile = 0;
+
     //glEnable(GL_CULL_FACE);
     //glCullFace(GL_BACK);
     glEnable(GL_DEPTH_TEST);
+
+    if (__stream_init() != status_success)
+    {
+        LOG_DEBUG("streaming buffer unavailable, per-frame data goes through buffer updates\n");
+    }
+
+    glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+    if (profile & GL_CONTEXT_CORE_PROFILE_BIT)
+    {
+        LOG_DEBUG("core profile context, using the shader backend\n");
+        __backend = render_backend_core;
+        if (__core_init() != status_success)
+        {
+            LOG_ERROR("failed to initialize the core profile backend\n");
+            return status_error;
+        }
+
+        if (__static_init() != status_success)
+        {
+            LOG_ERROR("failed to initialize static batching\n");
+            return status_error;
+        }
+
+        if (__indirect_init() != status_success)
+        {
+            LOG_DEBUG("indirect drawing unavailable, drawing every run on its own\n");
+        }
+
+        __prerun_done = 1;
+        return status_success;
+    }
+
+    __backend = render_backend_fixed;
     glEnable(GL_COLOR_MATERIAL);
 
+    if (__instancing_init() != status_success)
+    {
+        LOG_DEBUG("instancing unavailable, falling back to one draw per object\n");
+    }
+
+    __prerun_done = 1;
+    render_set_lighting(&__lighting);
+
     return status_success;
 }
 
+render_backend_e render_get_backend(void)
+{
+    return __backend;
+}
+
+void render_set_lighting(const render_lighting_t * lighting)
+{
+    if (!lighting)
+    {
+        LOG_ERROR("lighting is NULL!\n");
+        return;
+    }
+
+    __lighting = *lighting;
+
+    // the core backend uploads it with every frame, and before prerun there is no context to set it on
+    if (__backend != render_backend_fixed || !__prerun_done) return;
+
+    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, __lighting.global_ambient);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, __lighting.material_specular);
+    glMaterialf(GL_FRONT, GL_SHININESS, __lighting.material_shininess);
+    glLightfv(GL_LIGHT0, GL_AMBIENT, __lighting.light_ambient);
+    glLightfv(GL_LIGHT0, GL_DIFFUSE, __lighting.light_diffuse);
+    glLightfv(GL_LIGHT0, GL_SPECULAR, __lighting.light_specular);
+
+    // the position is transformed by the modelview matrix, so it is set with none to stay in eye space
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glLightfv(GL_LIGHT0, GL_POSITION, __lighting.light_position);
+    glPopMatrix();
+
+    if (__lighting.enabled)
+    {
+        glEnable(GL_LIGHTING);
+        glEnable(GL_LIGHT0);
+    }
+    else
+    {
+        glDisable(GL_LIGHTING);
+    }
+}
+
 void render_prerender()
 {
     glClearColor(0.0, 0.0, 0.0, 0.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    __stream_begin_frame();
+}
+
+void render_set_camera(const mat4_t * view, const mat4_t * projection)
+{
+    if (!view || !projection)
+    {
+        LOG_ERROR("view or projection is NULL! (view = %p, projection = %p)\n", view, projection);
+        return;
+    }
+
+    __view = *view;
+    __projection = *projection;
+    __camera_set = 1;
+
+    if (__backend == render_backend_core) return;
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(__projection.m);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(__view.m);
 }
 
 void render_objects(void)
 {    
+    mat4_t view_projection;
+
+    // callers that drive the matrix stack directly still get culled against what they set up
+    if (!__camera_set && __backend == render_backend_fixed)
+    {
+        glGetFloatv(GL_MODELVIEW_MATRIX, __view.m);
+        glGetFloatv(GL_PROJECTION_MATRIX, __projection.m);
+    }
+
+    mat4_mul(&view_projection, &__projection, &__view);
+    cull_frustum_extract(&__frustum, &view_projection);
+
+    // the view matrix is [R | t] with R orthonormal, so the eye sits at -R^T * t
+    __camera_pos = vec3_make(-(__view.m[0] * __view.m[12] + __view.m[1] * __view.m[13] + __view.m[2] * __view.m[14]),
+            -(__view.m[4] * __view.m[12] + __view.m[5] * __view.m[13] + __view.m[6] * __view.m[14]),
+            -(__view.m[8] * __view.m[12] + __view.m[9] * __view.m[13] + __view.m[10] * __view.m[14]));
+
+    __bvh_refresh();
+    __static_refresh();
+    __cull_objects();
+    __occlusion_cull(&view_projection);
+    __queue_build(&__view);
+    if (__queue_len == 0 && __static_visible_len == 0) return;
+
+    if (__backend == render_backend_core)
+    {
+        __core_begin();
+        __static_draw();
+        if (__queue_len > 0)
+        {
+            if (__indirect_supported && __indirect_enabled)
+            {
+                __indirect_submit();
+            }
+            else
+            {
+                __core_submit();
+            }
+        }
+        __core_end();
+        return;
+    }
+
     glMatrixMode(GL_MODELVIEW); 
+
     glPushMatrix();
     //glLoadIdentity();
+    __push_attrib(GL_POLYGON_BIT | GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_CURRENT_BIT | GL_LIGHTING_BIT);
 
     glEnableClientState(GL_NORMAL_ARRAY);
     glEnableClientState(GL_VERTEX_ARRAY);
 
-    for (unsigned long idx = 0; idx < __objects.len; ++idx)
+    __static_draw();
+    if (__queue_len > 0)
     {
-        render_object(array_get(&__objects, idx)); 
-    }    
+        if (__instancing_supported && __instancing_enabled)
+        {
+            __queue_submit_instanced();
+        }
+        else
+        {
+            __queue_submit();
+        }
+    }
 
     glDisableClientState(GL_NORMAL_ARRAY);
     glDisableClientState(GL_VERTEX_ARRAY);
 
+    __pop_attrib();
     glPopMatrix();
 }
 
-void render_object(const render_ctx_t * ctx)
+void render_object(render_ctx_t * ctx)
 {
-    GLfloat * normals = NULL, * vertices = NULL;
-    GLsizei num_vertices = 0;
-    GLenum vertex_mode = GL_TRIANGLES;
+    render_def_t * def = NULL;
+    const render_lod_t * mesh = NULL;
+    mat4_t model;
 
     if (__ctx_sanity_check(ctx) != status_success) return;
 
-    switch (ctx->object_type)
-    {
-        case render_object_cube:
-            normals = __cube_normals;
-            vertices = __cube_vertices;
-            num_vertices = __cube_num_vertices;
-	    vertex_mode = __cube_vertex_mode;
-            break;
-        default:
-            break;
-    }
-
-    for (unsigned long idx = 0; !normals && idx < __defs.len; ++idx)
+    if (!(def = __resolve_def(ctx)))
     {
-        render_def_t * def = array_get(&__defs, idx);
-        if (def && def->id == ctx->def_id)
-        {
-            normals = def->normals;
-            vertices = def->vertices;
-            num_vertices = def->num_vertices;
-	    vertex_mode = def->vertex_mode;
-            break;
-        }
+        LOG_ERROR("ctx has no def!\n");
+        return;
     }
 
-    if (!normals)
+    mesh = __def_lod(def, 0);
+    if (!mesh->vertices || !mesh->normals)
     {
-        LOG_ERROR("normals array is NULL!\n");
+        LOG_ERROR("vertices or normals array is NULL!\n");
         return;
     }
 
-    if (!vertices)
+    if (mesh->num_indices == 0)
     {
-        LOG_ERROR("vertices array is NULL!\n");
+        LOG_ERROR("there are no triangles!\n");
         return;
     }
 
-    if (num_vertices == 0)
+    if (__backend == render_backend_core)
     {
-        LOG_ERROR("there are no vertices!\n");
+        GLfloat instance[INSTANCE_FLOATS];
+
+        __ctx_model_matrix(ctx, &model);
+        memcpy(instance, model.m, 16 * sizeof(GLfloat));
+        memcpy(instance + 16, ctx->color, 4 * sizeof(GLfloat));
+
+        __core_upload_def(def);
+        __core_begin();
+        __bind_buffer(GL_UNIFORM_BUFFER, __core_object_ubo);
+        __buffer_sub_data(GL_UNIFORM_BUFFER, 0, sizeof(instance), instance);
+        __bind_buffer_base(GL_UNIFORM_BUFFER, CORE_OBJECT_BINDING, __core_object_ubo);
+        glUniform1i(__core_base_loc, 0);
+        __polygon_mode(ctx->polygon_mode);
+        __bind_vertex_array(def->gpu_arrays[0]);
+        glDrawElementsInstanced(GL_TRIANGLES, mesh->num_indices, mesh->index_type, NULL, 1);
+        __core_end();
+
+        ++__stats_thread()->objects_submitted;
+        __count_draw(__stats_thread(), mesh->num_indices, 1);
         return;
     }
 
-    glPolygonMode(GL_FRONT_AND_BACK, ctx->polygon_mode);
+    __polygon_mode(ctx->polygon_mode);
     
-    glNormalPointer(GL_FLOAT, 0, normals);
-    glVertexPointer(3, GL_FLOAT, 0, vertices);
+    glNormalPointer(GL_FLOAT, 0, mesh->normals);
+    glVertexPointer(3, GL_FLOAT, 0, mesh->vertices);
 
     glPushMatrix();
     //glLoadIdentity();
-    glPushAttrib(GL_ALL_ATTRIB_BITS);
+    __push_attrib(GL_ALL_ATTRIB_BITS);
 
     glColor4fv(ctx->color);
     glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
-    glTranslatef(ctx->pos[0], ctx->pos[1], ctx->pos[2]);
-    glScalef(ctx->scale[0], ctx->scale[1], ctx->scale[2]);
-    glRotatef(ctx->rotation_angle, ctx->rotation_vector[0], ctx->rotation_vector[1], ctx->rotation_vector[2]);
+    __ctx_model_matrix(ctx, &model);
+    glMultMatrixf(model.m);
 
-    glDrawArrays(vertex_mode, 0, num_vertices);
+    glDrawElements(GL_TRIANGLES, mesh->num_indices, mesh->index_type, mesh->indices);
 
-    glPopAttrib();
+    __pop_attrib();
     glPopMatrix();
+
+    ++__stats_thread()->objects_submitted;
+    __count_draw(__stats_thread(), mesh->num_indices, 1);
 }
 
-status_e render_add_object(render_ctx_t * ctx)
+void render_set_instancing(int enabled)
 {
-    status_e status = __ctx_sanity_check(ctx);
-    if (status != status_success) return status;
+    __instancing_enabled = enabled;
+}
 
-    return array_push(&__objects, ctx);
+void render_set_indirect(int enabled)
+{
+    __indirect_enabled = enabled;
 }
 
-status_e render_remove_object(render_ctx_t * ctx)
+void render_set_culling(int enabled)
 {
-    status_e status = __ctx_sanity_check(ctx);
-    if (status != status_success) return status;
+    __culling_enabled = enabled;
+}
 
-    return array_remove(&__objects, ctx);
+void render_set_occlusion_culling(int enabled)
+{
+    __occlusion_enabled = enabled;
 }
 
-status_e render_add_def(render_def_t * def)
+void render_get_stats(render_stats_t * stats)
 {
-    status_e status = __def_sanity_check(def);
-    if (status != status_success) return status;
+    if (!stats)
+    {
+        LOG_ERROR("stats is NULL!\n");
+        return;
+    }
 
-    return array_push(&__defs, def);
+    __stats_sum(stats);
 }
 
-status_e render_remove_def(render_def_t * def)
+void render_stats_next_frame(void)
 {
-    status_e status = __def_sanity_check(def);
-    if (status != status_success) return status;
+    __stats_sum(&__stats_history[__stats_history_next]);
+    __stats_history_next = (__stats_history_next + 1) % RENDER_STATS_HISTORY;
+    if (__stats_history_len < RENDER_STATS_HISTORY) ++__stats_history_len;
 
-    return array_remove(&__defs, def);
+    for (unsigned int idx = 0; idx < __stats_num_slots && idx < STATS_MAX_THREADS; ++idx)
+    {
+        memset(&__stats_slots[idx].stats, 0, sizeof(render_stats_t));
+    }
 }
 
-static void __render_shutdown(void)
+unsigned int render_get_stats_history(render_stats_t * history, unsigned int max_frames)
 {
-    if (!__initialized)
+    unsigned int count = max_frames < __stats_history_len ? max_frames : __stats_history_len;
+    unsigned int first = (__stats_history_next + RENDER_STATS_HISTORY - count) % RENDER_STATS_HISTORY;
+
+    if (!history && count > 0)
     {
-        LOG_ERROR("renderer already initialized!\n");
-        return;
+        LOG_ERROR("history is NULL!\n");
+        return 0;
     }
-    
-    LOG_DEBUG("shutting down...\n");
-
-    array_destroy_deep(&__objects);
-    array_destroy_deep(&__defs);
 
-    __initialized = 0;
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        history[idx] = __stats_history[(first + idx) % RENDER_STATS_HISTORY];
+    }
 
-    LOG_DEBUG("shutdown complete\n");
+    return count;
 }
 
-static status_e __ctx_sanity_check(const render_ctx_t * ctx)
+status_e render_stream_alloc(GLsizeiptr size, GLsizeiptr alignment, render_stream_span_t * span)
 {
-    if (!ctx)
+    GLintptr offset = 0, region_base = 0;
+
+    if (!span || size <= 0 || alignment <= 0 || (alignment & (alignment - 1)) != 0)
     {
-        LOG_ERROR("ctx is NULL!\n");
+        LOG_ERROR("invalid span request! (span = %p, size = %ld, alignment = %ld)\n", span, (long)size, (long)alignment);
         return status_error;
     }
 
+    // callers fall back to their own buffers, so running without one is not an error
+    if (__stream_mode == __stream_none) return status_error;
+
+    offset = (__stream_offset + alignment - 1) & ~(alignment - 1);
+    __stream_demand += size + alignment - 1;
+    if (offset + size > __stream_region_bytes) return status_error;
+
+    if (__stream_mode == __stream_persistent)
+    {
+        if (__stream_offset == 0) __stream_wait(__stream_region);
+        region_base = __stream_region * __stream_region_bytes;
+    }
+    else if (!__stream_map)
+    {
+        // nothing past __stream_offset has been handed out this frame, so the GPU cannot be reading it
+        __bind_buffer(GL_ARRAY_BUFFER, __stream_buffer);
+        __stream_map = glMapBufferRange(GL_ARRAY_BUFFER, __stream_offset, __stream_region_bytes - __stream_offset,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        __bind_buffer(GL_ARRAY_BUFFER, 0);
+        if (!__stream_map)
+        {
+            LOG_ERROR("failed to map the streaming buffer\n");
+            return status_error;
+        }
+        __stream_map_offset = __stream_offset;
+    }
+
+    span->data = __stream_map + (region_base + offset - __stream_map_offset);
+    span->buffer = __stream_buffer;
+    span->offset = region_base + offset;
+    span->size = size;
+    __stream_offset = offset + size;
+    __stats_thread()->bytes_uploaded += size;
+
     return status_success;
 }
 
-static status_e __def_sanity_check(const render_def_t * def)
+void render_stream_flush(void)
 {
-    if (!def)
+    // a persistent, coherent mapping needs nothing before drawing
+    if (__stream_mode != __stream_orphaning || !__stream_map) return;
+
+    __bind_buffer(GL_ARRAY_BUFFER, __stream_buffer);
+    if (glUnmapBuffer(GL_ARRAY_BUFFER) != GL_TRUE) LOG_ERROR("streaming buffer contents were lost\n");
+    __bind_buffer(GL_ARRAY_BUFFER, 0);
+    __stream_map = NULL;
+}
+
+unsigned int render_query_aabb(const GLfloat min[3], const GLfloat max[3], render_query_cb cb, void * data)
+{
+    struct __query query = { cb, data, 0, { NULL } };
+    bvh_aabb_t box;
+
+    if (!min || !max || !cb)
     {
-        LOG_ERROR("def is NULL!\n");
-        return status_error;
+        LOG_ERROR("min, max or cb is NULL! (min = %p, max = %p, cb = %p)\n", min, max, cb);
+        return 0;
     }
 
-    return status_success;
+    box.min = vec3_make(min[0], min[1], min[2]);
+    box.max = vec3_make(max[0], max[1], max[2]);
+    query.region.box = &box;
+    query.exact_box = 1;
+
+    if (__dirty_len) __bvh_refresh();
+    bvh_query_aabb(&__bvh, &box, __query_filter, &query);
+
+    return query.hits;
+}
+
+unsigned int render_query_frustum(const mat4_t * view_projection, render_query_cb cb, void * data)
+{
+    struct __query query = { cb, data, 0, { NULL } };
+    cull_frustum_t frustum;
+
+    if (!view_projection || !cb)
+    {
+        LOG_ERROR("view_projection or cb is NULL! (view_projection = %p, cb = %p)\n", view_projection, cb);
+        return 0;
+    }
+
+    cull_frustum_extract(&frustum, view_projection);
+    query.region.frustum = &frustum;
+
+    if (__dirty_len) __bvh_refresh();
+    bvh_query_frustum(&__bvh, &frustum, __query_filter, &query);
+
+    return query.hits;
+}
+
+render_handle_t render_query_nearest(const GLfloat point[3], GLfloat max_distance, GLfloat * distance)
+{
+    if (!point)
+    {
+        LOG_ERROR("point is NULL!\n");
+        return RENDER_NULL_HANDLE;
+    }
+
+    if (__dirty_len) __bvh_refresh();
+    return (render_handle_t)(uintptr_t)bvh_nearest(&__bvh, vec3_make(point[0], point[1], point[2]), max_distance,
+            __query_distance, NULL, distance);
+}
+
+int render_raycast(const render_ray_t * ray, render_ray_hit_t * hit)
+{
+    if (!ray || !hit)
+    {
+        LOG_ERROR("ray or hit is NULL! (ray = %p, hit = %p)\n", ray, hit);
+        return 0;
+    }
+
+    if (__dirty_len) __bvh_refresh();
+    __raycast_packet(ray, 1, hit);
+
+    return hit->object != RENDER_NULL_HANDLE;
+}
+
+unsigned int render_raycast_batch(const render_ray_t * rays, unsigned int count, render_ray_hit_t * hits)
+{
+    struct __raycast_batch batch = { rays, hits, count };
+    unsigned int num_hits = 0;
+
+    if (!rays || !hits)
+    {
+        LOG_ERROR("rays or hits is NULL! (rays = %p, hits = %p)\n", rays, hits);
+        return 0;
+    }
+
+    if (__dirty_len) __bvh_refresh();
+    jobs_parallel_for((count + BVH_PACKET - 1) / BVH_PACKET, RAYCAST_GRAIN, __raycast_range, &batch);
+
+    for (unsigned int idx = 0; idx < count; ++idx) num_hits += hits[idx].object != RENDER_NULL_HANDLE;
+
+    return num_hits;
+}
+
+render_handle_t render_create_object(render_object_e type, unsigned long def_id)
+{
+    if (type > render_object_count)
+    {
+        LOG_ERROR("invalid object type %d\n", type);
+        return RENDER_NULL_HANDLE;
+    }
+
+    return __object_create(type, def_id, NULL);
+}
+
+status_e render_destroy_object(render_handle_t object)
+{
+    unsigned int slot = __object_slot(object), last = __object_len - 1, index = object & OBJECT_INDEX_MASK;
+
+    if (slot == ~0U)
+    {
+        LOG_ERROR("object %u does not exist!\n", object);
+        return status_error;
+    }
+
+    if (__object_proxies[slot] != BVH_NULL) bvh_remove(&__bvh, __object_proxies[slot]);
+    __object_unlink_def(slot);
+    if (__object_clusters[slot]) __static_leave(slot);
+    if (__object_owners[slot]) __object_owners[slot]->handle = RENDER_NULL_HANDLE;
+
+    // the last object fills the hole so the streams stay dense
+    if (slot != last)
+    {
+        for (unsigned int idx = 0; idx < sizeof(__object_streams) / sizeof(__object_streams[0]); ++idx)
+        {
+            const __stream_t * stream = &__object_streams[idx];
+            char * data = *stream->stream;
+
+            memcpy(data + slot * stream->size, data + last * stream->size, stream->size);
+        }
+        __handle_slots[__object_handles[slot] & OBJECT_INDEX_MASK] = slot;
+    }
+    --__object_len;
+
+    if (++__handle_generations[index] > OBJECT_GENERATION_MASK) __handle_generations[index] = 1;
+    __handle_slots[index] = __handle_free;
+    __handle_free = index;
+
+    return status_success;
+}
+
+int render_object_valid(render_handle_t object)
+{
+    return __object_slot(object) != ~0U;
+}
+
+void render_object_set_position(render_handle_t object, GLfloat x, GLfloat y, GLfloat z)
+{
+    unsigned int slot = __object_slot(object);
+    render_ctx_t * ctx = NULL;
+
+    if (slot == ~0U)
+    {
+        LOG_ERROR("object %u does not exist!\n", object);
+        return;
+    }
+
+    __object_positions[slot] = vec3_make(x, y, z);
+    __object_mark_dirty(slot);
+
+    if ((ctx = __object_owners[slot]))
+    {
+        ctx->pos[0] = x;
+        ctx->pos[1] = y;
+        ctx->pos[2] = z;
+    }
+}
+
+void render_object_set_scale(render_handle_t object, GLfloat x, GLfloat y, GLfloat z)
+{
+    unsigned int slot = __object_slot(object);
+    render_ctx_t * ctx = NULL;
+
+    if (slot == ~0U)
+    {
+        LOG_ERROR("object %u does not exist!\n", object);
+        return;
+    }
+
+    __object_scales[slot] = vec3_make(x, y, z);
+    __object_mark_dirty(slot);
+
+    if ((ctx = __object_owners[slot]))
+    {
+        ctx->scale[0] = x;
+        ctx->scale[1] = y;
+        ctx->scale[2] = z;
+    }
+}
+
+void render_object_set_rotation(render_handle_t object, GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
+{
+    unsigned int slot = __object_slot(object);
+    render_ctx_t * ctx = NULL;
+
+    if (slot == ~0U)
+    {
+        LOG_ERROR("object %u does not exist!\n", object);
+        return;
+    }
+
+    __object_rotations[slot] = quat_from_axis_angle(vec3_make(x, y, z), angle);
+    __object_mark_dirty(slot);
+
+    if ((ctx = __object_owners[slot]))
+    {
+        ctx->rotation_angle = angle;
+        ctx->rotation_vector[0] = x;
+        ctx->rotation_vector[1] = y;
+        ctx->rotation_vector[2] = z;
+    }
+}
+
+void render_object_set_color(render_handle_t object, GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+    unsigned int slot = __object_slot(object);
+    render_ctx_t * ctx = NULL;
+
+    if (slot == ~0U)
+    {
+        LOG_ERROR("object %u does not exist!\n", object);
+        return;
+    }
+
+    // no transform depends on the color, only the merged geometry of static objects
+    __object_colors[slot] = vec4_make(r, g, b, a);
+    if (__object_flags[slot] & OBJECT_STATIC) __object_mark_dirty(slot);
+
+    if ((ctx = __object_owners[slot]))
+    {
+        ctx->color[0] = r;
+        ctx->color[1] = g;
+        ctx->color[2] = b;
+        ctx->color[3] = a;
+    }
+}
+
+void render_object_set_polygon_mode(render_handle_t object, GLenum polygon_mode)
+{
+    unsigned int slot = __object_slot(object);
+
+    if (slot == ~0U)
+    {
+        LOG_ERROR("object %u does not exist!\n", object);
+        return;
+    }
+
+    __object_polygon_modes[slot] = polygon_mode;
+    if (__object_owners[slot]) __object_owners[slot]->polygon_mode = polygon_mode;
+    if (__object_flags[slot] & OBJECT_STATIC) __object_mark_dirty(slot);
+}
+
+void render_object_set_static(render_handle_t object, int is_static)
+{
+    unsigned int slot = __object_slot(object);
+
+    if (slot == ~0U)
+    {
+        LOG_ERROR("object %u does not exist!\n", object);
+        return;
+    }
+
+    if (is_static) __object_flags[slot] |= OBJECT_STATIC;
+    else __object_flags[slot] &= ~OBJECT_STATIC;
+    if (__object_owners[slot]) __object_owners[slot]->is_static = is_static;
+
+    // joining or leaving a batch happens with the other changes at the next render_objects
+    __object_mark_dirty(slot);
+}
+
+void render_objects_set_positions(const render_handle_t * objects, const vec3_t * positions, unsigned int count)
+{
+    if (!objects || !positions)
+    {
+        LOG_ERROR("NULL buffer! (objects = %p, positions = %p)\n", objects, positions);
+        return;
+    }
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        unsigned int slot = __object_slot(objects[idx]);
+        render_ctx_t * ctx = NULL;
+
+        if (slot == ~0U) continue;
+
+        __object_positions[slot] = positions[idx];
+        __object_mark_dirty(slot);
+
+        if ((ctx = __object_owners[slot]))
+        {
+            ctx->pos[0] = positions[idx].x;
+            ctx->pos[1] = positions[idx].y;
+            ctx->pos[2] = positions[idx].z;
+        }
+    }
+}
+
+void render_objects_set_scales(const render_handle_t * objects, const vec3_t * scales, unsigned int count)
+{
+    if (!objects || !scales)
+    {
+        LOG_ERROR("NULL buffer! (objects = %p, scales = %p)\n", objects, scales);
+        return;
+    }
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        unsigned int slot = __object_slot(objects[idx]);
+        render_ctx_t * ctx = NULL;
+
+        if (slot == ~0U) continue;
+
+        __object_scales[slot] = scales[idx];
+        __object_mark_dirty(slot);
+
+        if ((ctx = __object_owners[slot]))
+        {
+            ctx->scale[0] = scales[idx].x;
+            ctx->scale[1] = scales[idx].y;
+            ctx->scale[2] = scales[idx].z;
+        }
+    }
+}
+
+void render_objects_set_rotations(const render_handle_t * objects, const quat_t * rotations, unsigned int count)
+{
+    if (!objects || !rotations)
+    {
+        LOG_ERROR("NULL buffer! (objects = %p, rotations = %p)\n", objects, rotations);
+        return;
+    }
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        unsigned int slot = __object_slot(objects[idx]);
+        render_ctx_t * ctx = NULL;
+
+        if (slot == ~0U) continue;
+
+        __object_rotations[slot] = rotations[idx];
+        __object_mark_dirty(slot);
+
+        // ctxs hold angle and axis, which only added objects pay for
+        if ((ctx = __object_owners[slot]))
+        {
+            quat_t q = rotations[idx];
+            float s = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z);
+
+            ctx->rotation_angle = s > 0.0f ? 2.0f * atan2f(s, q.w) * 180.0f / (float)M_PI : 0.0f;
+            ctx->rotation_vector[0] = s > 0.0f ? q.x / s : 0.0f;
+            ctx->rotation_vector[1] = s > 0.0f ? q.y / s : 1.0f;
+            ctx->rotation_vector[2] = s > 0.0f ? q.z / s : 0.0f;
+        }
+    }
+}
+
+void render_objects_set_colors(const render_handle_t * objects, const vec4_t * colors, unsigned int count)
+{
+    if (!objects || !colors)
+    {
+        LOG_ERROR("NULL buffer! (objects = %p, colors = %p)\n", objects, colors);
+        return;
+    }
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        unsigned int slot = __object_slot(objects[idx]);
+        render_ctx_t * ctx = NULL;
+
+        if (slot == ~0U) continue;
+
+        __object_colors[slot] = colors[idx];
+        if (__object_flags[slot] & OBJECT_STATIC) __object_mark_dirty(slot);
+
+        if ((ctx = __object_owners[slot]))
+        {
+            ctx->color[0] = colors[idx].x;
+            ctx->color[1] = colors[idx].y;
+            ctx->color[2] = colors[idx].z;
+            ctx->color[3] = colors[idx].w;
+        }
+    }
+}
+
+status_e render_object_get_position(render_handle_t object, GLfloat pos[3])
+{
+    unsigned int slot = __object_slot(object);
+
+    if (slot == ~0U || !pos)
+    {
+        LOG_ERROR("object %u does not exist or pos is NULL! (pos = %p)\n", object, pos);
+        return status_error;
+    }
+
+    pos[0] = __object_positions[slot].x;
+    pos[1] = __object_positions[slot].y;
+    pos[2] = __object_positions[slot].z;
+
+    return status_success;
+}
+
+status_e render_object_get_bounds(render_handle_t object, GLfloat min[3], GLfloat max[3])
+{
+    unsigned int slot = __object_slot(object);
+
+    if (slot == ~0U || !min || !max)
+    {
+        LOG_ERROR("object %u does not exist or min or max is NULL! (min = %p, max = %p)\n", object, min, max);
+        return status_error;
+    }
+
+    min[0] = __object_world_min[slot].x;
+    min[1] = __object_world_min[slot].y;
+    min[2] = __object_world_min[slot].z;
+    max[0] = __object_world_max[slot].x;
+    max[1] = __object_world_max[slot].y;
+    max[2] = __object_world_max[slot].z;
+
+    return status_success;
+}
+
+render_ctx_t * render_object_get_ctx(render_handle_t object)
+{
+    unsigned int slot = __object_slot(object);
+
+    return slot == ~0U ? NULL : __object_owners[slot];
+}
+
+status_e render_add_object(render_ctx_t * ctx)
+{
+    status_e status = __ctx_sanity_check(ctx);
+    if (status != status_success) return status;
+
+    if (__object_slot(ctx->handle) != ~0U && __object_owners[__object_slot(ctx->handle)] == ctx)
+    {
+        LOG_ERROR("ctx %p is already added!\n", ctx);
+        return status_error;
+    }
+
+    if ((ctx->handle = __object_create(ctx->object_type, ctx->def_id, ctx)) == RENDER_NULL_HANDLE)
+    {
+        LOG_ERROR("failed to add ctx %p\n", ctx);
+        return status_error;
+    }
+
+    return status_success;
+}
+
+status_e render_remove_object(render_ctx_t * ctx)
+{
+    unsigned int slot = ~0U;
+    status_e status = __ctx_sanity_check(ctx);
+    if (status != status_success) return status;
+
+    if ((slot = __object_slot(ctx->handle)) == ~0U || __object_owners[slot] != ctx)
+    {
+        LOG_ERROR("ctx %p is not added!\n", ctx);
+        return status_error;
+    }
+
+    // the ctx goes back to its caller
+    __object_owners[slot] = NULL;
+    status = render_destroy_object(ctx->handle);
+    ctx->handle = RENDER_NULL_HANDLE;
+
+    return status;
+}
+
+void render_ctx_set_position(render_ctx_t * ctx, GLfloat x, GLfloat y, GLfloat z)
+{
+    if (!ctx)
+    {
+        LOG_ERROR("ctx is NULL!\n");
+        return;
+    }
+
+    ctx->pos[0] = x;
+    ctx->pos[1] = y;
+    ctx->pos[2] = z;
+    render_ctx_mark_dirty(ctx);
+}
+
+void render_ctx_set_scale(render_ctx_t * ctx, GLfloat x, GLfloat y, GLfloat z)
+{
+    if (!ctx)
+    {
+        LOG_ERROR("ctx is NULL!\n");
+        return;
+    }
+
+    ctx->scale[0] = x;
+    ctx->scale[1] = y;
+    ctx->scale[2] = z;
+    render_ctx_mark_dirty(ctx);
+}
+
+void render_ctx_set_rotation(render_ctx_t * ctx, GLfloat angle, GLfloat x, GLfloat y, GLfloat z)
+{
+    if (!ctx)
+    {
+        LOG_ERROR("ctx is NULL!\n");
+        return;
+    }
+
+    ctx->rotation_angle = angle;
+    ctx->rotation_vector[0] = x;
+    ctx->rotation_vector[1] = y;
+    ctx->rotation_vector[2] = z;
+    render_ctx_mark_dirty(ctx);
+}
+
+void render_ctx_mark_dirty(render_ctx_t * ctx)
+{
+    unsigned int slot = ~0U;
+
+    if (!ctx)
+    {
+        LOG_ERROR("ctx is NULL!\n");
+        return;
+    }
+
+    // objects that are not added are brought up to date by render_add_object or render_object instead
+    if ((slot = __object_slot(ctx->handle)) == ~0U || __object_owners[slot] != ctx) return;
+
+    __object_copy_ctx(slot, ctx);
+    __object_mark_dirty(slot);
+}
+
+status_e render_add_def(render_def_t * def)
+{
+    status_e status = __def_sanity_check(def);
+    if (status != status_success) return status;
+
+    if (hash_get(&__def_table, def->id))
+    {
+        LOG_ERROR("a def with id %lu is already registered!\n", def->id);
+        return status_error;
+    }
+
+    if ((status = hash_set(&__def_table, def->id, def)) != status_success) return status;
+
+    if (!(def->flags & RENDER_DEF_PREBUILT)) __def_compute_bounds(def);
+    if ((status = __def_build_meshes(def)) != status_success)
+    {
+        hash_remove(&__def_table, def->id);
+        __def_free_meshes(def);
+        return status;
+    }
+
+    // slots only need to be mostly unique: a collision costs extra state changes, never a wrong draw
+    def->sort_slot = __def_next_sort_slot;
+    if (++__def_next_sort_slot > QUEUE_DEF_MASK) __def_next_sort_slot = render_object_count;
+
+    if ((status = array_push(&__defs, def)) != status_success)
+    {
+        hash_remove(&__def_table, def->id);
+        __def_free_meshes(def);
+        return status;
+    }
+
+    // objects added before their def existed have only been placed by position so far
+    for (render_handle_t object = (render_handle_t)(uintptr_t)hash_get(&__def_users, def->id); object != RENDER_NULL_HANDLE;)
+    {
+        unsigned int slot = __object_slot(object);
+
+        __object_defs[slot] = def;
+        __object_mark_dirty(slot);
+        object = __object_def_next[slot];
+    }
+
+    return status_success;
+}
+
+status_e render_update_def(render_def_t * def)
+{
+    status_e status = __def_sanity_check(def);
+    if (status != status_success) return status;
+
+    if (hash_get(&__def_table, def->id) != def)
+    {
+        LOG_ERROR("def %p (id %lu) is not registered!\n", def, def->id);
+        return status_error;
+    }
+
+    if (__backend == render_backend_core)
+    {
+        __core_release_def(def);
+        __indirect_release_def(def);
+    }
+    __def_free_meshes(def);
+
+    if (!(def->flags & RENDER_DEF_PREBUILT)) __def_compute_bounds(def);
+    if ((status = __def_build_meshes(def)) != status_success)
+    {
+        // left registered without geometry, like a def whose meshes could not be uploaded
+        __def_free_meshes(def);
+        LOG_ERROR("failed to rebuild def %p (id %lu)\n", def, def->id);
+    }
+
+    // the objects drawing it keep it, but their bounds may have changed
+    for (render_handle_t object = (render_handle_t)(uintptr_t)hash_get(&__def_users, def->id); object != RENDER_NULL_HANDLE;)
+    {
+        unsigned int slot = __object_slot(object);
+
+        __object_mark_dirty(slot);
+        object = __object_def_next[slot];
+    }
+
+    return status;
+}
+
+status_e render_remove_def(render_def_t * def)
+{
+    status_e status = __def_sanity_check(def);
+    if (status != status_success) return status;
+
+    if (hash_get(&__def_table, def->id) != def)
+    {
+        LOG_ERROR("def %p (id %lu) is not registered!\n", def, def->id);
+        return status_error;
+    }
+
+    hash_remove(&__def_table, def->id);
+    if (__backend == render_backend_core)
+    {
+        __core_release_def(def);
+        __indirect_release_def(def);
+    }
+    __def_free_meshes(def);
+
+    // any ctx that cached this def must resolve its id again, and objects drawing it lose their geometry
+    ++__def_generation;
+    for (render_handle_t object = (render_handle_t)(uintptr_t)hash_get(&__def_users, def->id); object != RENDER_NULL_HANDLE;)
+    {
+        unsigned int slot = __object_slot(object);
+
+        __object_defs[slot] = NULL;
+        __object_mark_dirty(slot);
+        object = __object_def_next[slot];
+    }
+
+    return array_remove(&__defs, def);
+}
+
+static void __render_shutdown(void)
+{
+    if (!__initialized)
+    {
+        LOG_ERROR("renderer already initialized!\n");
+        return;
+    }
+    
+    LOG_DEBUG("shutting down...\n");
+
+    __object_free_all();
+    __static_free_all();
+    for (unsigned int idx = 0; idx < __defs.len; ++idx)
+    {
+        __def_free_meshes(array_get(&__defs, idx));
+    }
+    array_destroy_deep(&__defs);
+    for (unsigned int type = 0; type < render_object_count; ++type)
+    {
+        __def_free_meshes(&__builtin_defs[type]);
+    }
+    hash_destroy(&__def_table);
+    hash_destroy(&__def_users);
+    bvh_destroy(&__bvh);
+    if (__occlusion_ready) occlusion_destroy(&__occlusion);
+    __occlusion_ready = 0;
+    free(__occluders);
+    __occluders = NULL;
+    __occluders_capacity = 0;
+
+    free(__queue_keys);
+    free(__queue_tmp_keys);
+    free(__queue_items);
+    free(__queue_tmp_items);
+    __queue_keys = __queue_tmp_keys = NULL;
+    __queue_items = __queue_tmp_items = NULL;
+    __queue_len = __queue_capacity = 0;
+
+    free(__cull_x);
+    free(__cull_y);
+    free(__cull_z);
+    free(__cull_radius);
+    free(__cull_results);
+    free(__visible);
+    __cull_x = __cull_y = __cull_z = __cull_radius = NULL;
+    __cull_results = NULL;
+    __visible = NULL;
+    __cull_capacity = __visible_len = 0;
+
+    free(__indirect_commands);
+    __indirect_commands = NULL;
+    __indirect_commands_capacity = 0;
+
+    for (unsigned int idx = 0; idx < __record_lists_capacity; ++idx) cmdlist_destroy(&__record_lists[idx]);
+    free(__record_lists);
+    __record_lists = NULL;
+    __record_lists_capacity = 0;
+
+    free(__instance_data);
+    free(__instance_spans);
+    free(__instance_ranges);
+    __instance_data = NULL;
+    __instance_spans = NULL;
+    __instance_ranges = NULL;
+    __instance_capacity = __instance_len = __instance_buffer_len = 0;
+
+    __initialized = 0;
+
+    LOG_DEBUG("shutdown complete\n");
+}
+
+static status_e __ctx_sanity_check(const render_ctx_t * ctx)
+{
+    if (!ctx)
+    {
+        LOG_ERROR("ctx is NULL!\n");
+        return status_error;
+    }
+
+    return status_success;
+}
+
+static status_e __def_sanity_check(const render_def_t * def)
+{
+    if (!def)
+    {
+        LOG_ERROR("def is NULL!\n");
+        return status_error;
+    }
+
+    return status_success;
+}
+
+static render_def_t * __resolve_def(render_ctx_t * ctx)
+{
+    render_def_t * def = ctx->def;
+
+    if (ctx->object_type < render_object_count) return &__builtin_defs[ctx->object_type];
+
+    // a cached def is only trusted while no def has been removed since it was resolved
+    if (def && ctx->def_generation == __def_generation && def->id == ctx->def_id) return def;
+
+    if (!(def = hash_get(&__def_table, ctx->def_id)))
+    {
+        LOG_ERROR("no def registered with id %lu\n", ctx->def_id);
+        ctx->def = NULL;
+        return NULL;
+    }
+
+    ctx->def = def;
+    ctx->def_generation = __def_generation;
+
+    return def;
+}
+
+static void __ctx_model_matrix(const render_ctx_t * ctx, mat4_t * m)
+{
+    mat4_compose(m, vec3_make(ctx->pos[0], ctx->pos[1], ctx->pos[2]), vec3_make(ctx->scale[0], ctx->scale[1], ctx->scale[2]),
+            quat_from_axis_angle(vec3_make(ctx->rotation_vector[0], ctx->rotation_vector[1], ctx->rotation_vector[2]),
+                ctx->rotation_angle));
+}
+
+static status_e __object_reserve(unsigned int capacity)
+{
+    unsigned int new_capacity = __object_capacity ? __object_capacity : 64;
+
+    if (capacity <= __object_capacity) return status_success;
+
+    while (new_capacity < capacity) new_capacity *= 2;
+
+    // a failure part way leaves some streams bigger than __object_capacity, which is harmless
+    for (unsigned int idx = 0; idx < sizeof(__object_streams) / sizeof(__object_streams[0]); ++idx)
+    {
+        const __stream_t * stream = &__object_streams[idx];
+        void * data = NULL;
+
+        if (posix_memalign(&data, OBJECT_ALIGN, new_capacity * stream->size) != 0)
+        {
+            LOG_ERROR("failed to allocate memory for %u objects\n", new_capacity);
+            return status_error;
+        }
+
+        if (*stream->stream) memcpy(data, *stream->stream, __object_len * stream->size);
+        free(*stream->stream);
+        *stream->stream = data;
+    }
+
+    __object_capacity = new_capacity;
+
+    return status_success;
+}
+
+static render_handle_t __object_create(render_object_e type, unsigned long def_id, render_ctx_t * owner)
+{
+    unsigned int index = 0, slot = __object_len;
+    render_handle_t object = RENDER_NULL_HANDLE;
+
+    if (__object_reserve(__object_len + 1) != status_success) return RENDER_NULL_HANDLE;
+
+    if (__handle_free == ~0U)
+    {
+        unsigned int capacity = __handle_capacity ? __handle_capacity * 2 : 64;
+        unsigned int * slots = NULL, * generations = NULL;
+
+        if (__handle_capacity > OBJECT_INDEX_MASK)
+        {
+            LOG_ERROR("cannot create more than %u objects\n", OBJECT_INDEX_MASK + 1);
+            return RENDER_NULL_HANDLE;
+        }
+
+        if (!(slots = realloc(__handle_slots, capacity * sizeof(unsigned int))))
+        {
+            LOG_ERROR("failed to allocate memory for %u handles\n", capacity);
+            return RENDER_NULL_HANDLE;
+        }
+        __handle_slots = slots;
+
+        if (!(generations = realloc(__handle_generations, capacity * sizeof(unsigned int))))
+        {
+            LOG_ERROR("failed to allocate memory for %u handles\n", capacity);
+            return RENDER_NULL_HANDLE;
+        }
+        __handle_generations = generations;
+
+        // thread the new entries onto the free list, lowest index first
+        for (unsigned int idx = __handle_capacity; idx < capacity; ++idx)
+        {
+            __handle_slots[idx] = idx + 1 < capacity ? idx + 1 : ~0U;
+            __handle_generations[idx] = 1;
+        }
+        __handle_free = __handle_capacity;
+        __handle_capacity = capacity;
+    }
+
+    index = __handle_free;
+    __handle_free = __handle_slots[index];
+    __handle_slots[index] = slot;
+    object = (__handle_generations[index] << OBJECT_INDEX_BITS) | index;
+
+    __object_center_x[slot] = __object_center_y[slot] = __object_center_z[slot] = 0.0f;
+    __object_radius[slot] = -1.0f;
+    __object_positions[slot] = vec3_make(0.0f, 0.0f, 0.0f);
+    __object_defs[slot] = NULL;
+    __object_lods[slot] = 0;
+    __object_polygon_modes[slot] = GL_FILL;
+    __object_colors[slot] = vec4_make(1.0f, 1.0f, 1.0f, 1.0f);
+    __object_scales[slot] = vec3_make(1.0f, 1.0f, 1.0f);
+    __object_rotations[slot] = quat_identity();
+    __object_types[slot] = type;
+    __object_def_ids[slot] = def_id;
+    __object_flags[slot] = 0;
+    __object_owners[slot] = owner;
+    __object_clusters[slot] = NULL;
+    __object_handles[slot] = object;
+    if (__object_link_def(slot) != status_success)
+    {
+        __handle_slots[index] = __handle_free;
+        __handle_free = index;
+        return RENDER_NULL_HANDLE;
+    }
+    if (owner) __object_copy_ctx(slot, owner);
+
+    __object_resolve_def(slot);
+    __object_update_transform(slot);
+    // the leaf is made by the next __bvh_refresh, once the caller has had a chance to place the object
+    __object_proxies[slot] = BVH_NULL;
+
+    ++__object_len;
+    __object_mark_dirty(slot);
+
+    return object;
+}
+
+static unsigned int __object_slot(render_handle_t object)
+{
+    unsigned int index = object & OBJECT_INDEX_MASK;
+
+    if (object == RENDER_NULL_HANDLE || index >= __handle_capacity) return ~0U;
+    if (__handle_generations[index] != object >> OBJECT_INDEX_BITS) return ~0U;
+
+    // a free entry's next index can never be a slot holding this handle
+    if (__handle_slots[index] >= __object_len || __object_handles[__handle_slots[index]] != object) return ~0U;
+
+    return __handle_slots[index];
+}
+
+static void __object_copy_ctx(unsigned int slot, const render_ctx_t * ctx)
+{
+    __object_positions[slot] = vec3_make(ctx->pos[0], ctx->pos[1], ctx->pos[2]);
+    __object_scales[slot] = vec3_make(ctx->scale[0], ctx->scale[1], ctx->scale[2]);
+    __object_rotations[slot] = quat_from_axis_angle(vec3_make(ctx->rotation_vector[0], ctx->rotation_vector[1],
+                ctx->rotation_vector[2]), ctx->rotation_angle);
+    __object_colors[slot] = vec4_make(ctx->color[0], ctx->color[1], ctx->color[2], ctx->color[3]);
+    __object_polygon_modes[slot] = ctx->polygon_mode;
+    if (ctx->is_static) __object_flags[slot] |= OBJECT_STATIC;
+    else __object_flags[slot] &= ~OBJECT_STATIC;
+
+    if (__object_types[slot] != ctx->object_type || __object_def_ids[slot] != ctx->def_id)
+    {
+        __object_unlink_def(slot);
+        __object_types[slot] = ctx->object_type;
+        __object_def_ids[slot] = ctx->def_id;
+        // an object left off the lists still draws its def, it just misses the def's later changes
+        __object_link_def(slot);
+        __object_resolve_def(slot);
+    }
+}
+
+static void __object_resolve_def(unsigned int slot)
+{
+    render_object_e type = __object_types[slot];
+
+    if (type < render_object_count)
+    {
+        __object_defs[slot] = &__builtin_defs[type];
+    }
+    else if (!(__object_defs[slot] = hash_get(&__def_table, __object_def_ids[slot])))
+    {
+        LOG_ERROR("no def registered with id %lu\n", __object_def_ids[slot]);
+    }
+}
+
+// objects of a registered def id are found through the list when it is added, updated or removed, without
+// walking every object. built-in types are never on one.
+static status_e __object_link_def(unsigned int slot)
+{
+    render_handle_t object = __object_handles[slot], head = RENDER_NULL_HANDLE;
+
+    __object_def_prev[slot] = __object_def_next[slot] = RENDER_NULL_HANDLE;
+    if (__object_types[slot] < render_object_count) return status_success;
+
+    head = (render_handle_t)(uintptr_t)hash_get(&__def_users, __object_def_ids[slot]);
+    if (hash_set(&__def_users, __object_def_ids[slot], (void *)(uintptr_t)object) != status_success)
+    {
+        LOG_ERROR("failed to list object %u under def id %lu\n", object, __object_def_ids[slot]);
+        return status_error;
+    }
+
+    __object_def_next[slot] = head;
+    if (head != RENDER_NULL_HANDLE) __object_def_prev[__object_slot(head)] = object;
+
+    return status_success;
+}
+
+static void __object_unlink_def(unsigned int slot)
+{
+    render_handle_t object = __object_handles[slot], prev = __object_def_prev[slot], next = __object_def_next[slot];
+
+    if (__object_types[slot] < render_object_count) return;
+
+    if (next != RENDER_NULL_HANDLE) __object_def_prev[__object_slot(next)] = prev;
+    if (prev != RENDER_NULL_HANDLE)
+    {
+        __object_def_next[__object_slot(prev)] = next;
+    }
+    else if ((render_handle_t)(uintptr_t)hash_get(&__def_users, __object_def_ids[slot]) == object)
+    {
+        // removing the entry first leaves room for its replacement, so setting cannot fail
+        hash_remove(&__def_users, __object_def_ids[slot]);
+        if (next != RENDER_NULL_HANDLE) hash_set(&__def_users, __object_def_ids[slot], (void *)(uintptr_t)next);
+    }
+
+    __object_def_prev[slot] = __object_def_next[slot] = RENDER_NULL_HANDLE;
+}
+
+static void __object_update_transform(unsigned int slot)
+{
+    const render_def_t * def = __object_defs[slot];
+    vec3_t scale = __object_scales[slot], center;
+
+    mat4_compose(&__object_models[slot], __object_positions[slot], scale, __object_rotations[slot]);
+
+    // objects without geometry still get a place in the index so they can be found by position
+    if (!def)
+    {
+        __object_world_min[slot] = __object_world_max[slot] = __object_positions[slot];
+        __object_center_x[slot] = __object_positions[slot].x;
+        __object_center_y[slot] = __object_positions[slot].y;
+        __object_center_z[slot] = __object_positions[slot].z;
+        __object_radius[slot] = -1.0f;
+        return;
+    }
+
+    cull_transform_aabb(&__object_models[slot], vec3_make(def->bounds_min[0], def->bounds_min[1], def->bounds_min[2]),
+            vec3_make(def->bounds_max[0], def->bounds_max[1], def->bounds_max[2]), &__object_world_min[slot],
+            &__object_world_max[slot]);
+    center = mat4_mul_point(&__object_models[slot], vec3_make(def->bounds_center[0], def->bounds_center[1], def->bounds_center[2]));
+
+    __object_center_x[slot] = center.x;
+    __object_center_y[slot] = center.y;
+    __object_center_z[slot] = center.z;
+    __object_radius[slot] = def->bounds_radius * fmaxf(fabsf(scale.x), fmaxf(fabsf(scale.y), fabsf(scale.z)));
+}
+
+static void __object_mark_dirty(unsigned int slot)
+{
+    if (__object_flags[slot] & OBJECT_DIRTY) return;
+
+    if (__dirty_len == __dirty_capacity)
+    {
+        unsigned int capacity = __dirty_capacity ? __dirty_capacity * 2 : 64;
+        render_handle_t * dirty = realloc(__dirty, capacity * sizeof(render_handle_t));
+
+        if (!dirty)
+        {
+            LOG_ERROR("failed to queue object %u for a transform update\n", __object_handles[slot]);
+            return;
+        }
+
+        __dirty = dirty;
+        __dirty_capacity = capacity;
+    }
+
+    __object_flags[slot] |= OBJECT_DIRTY;
+    __dirty[__dirty_len++] = __object_handles[slot];
+}
+
+static void __object_world_bounds(unsigned int slot, bvh_aabb_t * box)
+{
+    box->min = __object_world_min[slot];
+    box->max = __object_world_max[slot];
+}
+
+static void __object_free_all(void)
+{
+    // ctxs handed to render_add_object are owned by the renderer from then on
+    for (unsigned int slot = 0; slot < __object_len; ++slot)
+    {
+        free(__object_owners[slot]);
+    }
+
+    for (unsigned int idx = 0; idx < sizeof(__object_streams) / sizeof(__object_streams[0]); ++idx)
+    {
+        free(*__object_streams[idx].stream);
+        *__object_streams[idx].stream = NULL;
+    }
+    __object_len = __object_capacity = 0;
+
+    free(__handle_slots);
+    free(__handle_generations);
+    __handle_slots = __handle_generations = NULL;
+    __handle_capacity = 0;
+    __handle_free = ~0U;
+
+    free(__dirty);
+    __dirty = NULL;
+    __dirty_len = __dirty_capacity = 0;
+}
+
+static void __bvh_refresh(void)
+{
+    unsigned int inserted = 0;
+    bvh_aabb_t box;
+
+    // only changed objects are looked at; bvh_update is a containment test unless the object left its fat box
+    for (unsigned int idx = 0; idx < __dirty_len; ++idx)
+    {
+        unsigned int slot = __object_slot(__dirty[idx]);
+        if (slot == ~0U) continue;
+
+        __object_update_transform(slot);
+        __object_flags[slot] &= ~OBJECT_DIRTY;
+        __object_world_bounds(slot, &box);
+        if (__object_proxies[slot] != BVH_NULL)
+        {
+            bvh_update(&__bvh, __object_proxies[slot], &box);
+        }
+        else if ((__object_proxies[slot] = bvh_insert(&__bvh, &box, (void *)(uintptr_t)__dirty[idx])) != BVH_NULL)
+        {
+            ++inserted;
+        }
+        else
+        {
+            LOG_ERROR("failed to add object %u to the spatial index\n", __dirty[idx]);
+        }
+        if ((__object_flags[slot] & OBJECT_STATIC) || __object_clusters[slot]) __static_place(slot);
+    }
+    __dirty_len = 0;
+
+    // a frame that brought in most of the leaves (a level loading) gets a full SAH build straight away
+    if (inserted > __bvh.num_leaves / 2) bvh_rebuild(&__bvh);
+    else bvh_optimize(&__bvh, BVH_REBUILD_RATIO);
+}
+
+static int __bvh_collect(void * data, int inside, void * user)
+{
+    unsigned int slot = __object_slot((render_handle_t)(uintptr_t)data);
+
+    // straddling leaves grow up from the front of __visible, contained ones down from the back
+    if (inside)
+    {
+        __visible[__cull_capacity - ++__cull_contained] = slot;
+    }
+    else
+    {
+        __visible[__cull_straddling++] = slot;
+    }
+
+    return 1;
+}
+
+static int __query_filter(void * data, int inside, void * user)
+{
+    struct __query * query = user;
+    render_handle_t object = (render_handle_t)(uintptr_t)data;
+    bvh_aabb_t box;
+
+    if (!inside)
+    {
+        __object_world_bounds(__object_slot(object), &box);
+
+        if (query->exact_box)
+        {
+            const bvh_aabb_t * region = query->region.box;
+            if (box.min.x > region->max.x || box.max.x < region->min.x || box.min.y > region->max.y
+                    || box.max.y < region->min.y || box.min.z > region->max.z || box.max.z < region->min.z) return 1;
+        }
+        else if (cull_aabb(query->region.frustum, box.min, box.max) == cull_outside)
+        {
+            return 1;
+        }
+    }
+
+    ++query->hits;
+
+    return query->cb(object, query->data);
+}
+
+static float __query_distance(void * data, vec3_t point, void * user)
+{
+    bvh_aabb_t box;
+    vec3_t d;
+
+    __object_world_bounds(__object_slot((render_handle_t)(uintptr_t)data), &box);
+    d = vec3_sub(vec3_max(box.min, vec3_min(point, box.max)), point);
+
+    return vec3_length(d);
+}
+
+static void __raycast_packet(const render_ray_t * rays, unsigned int count, render_ray_hit_t * hits)
+{
+    bvh_ray_t packet[BVH_PACKET];
+    void * objects[BVH_PACKET];
+    float t[BVH_PACKET];
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        vec3_t direction = vec3_make(rays[idx].direction[0], rays[idx].direction[1], rays[idx].direction[2]);
+        float length = vec3_length(direction);
+
+        packet[idx].origin = vec3_make(rays[idx].origin[0], rays[idx].origin[1], rays[idx].origin[2]);
+        packet[idx].direction = length > 0.0f ? vec3_scale(direction, 1.0f / length) : direction;
+        // a ray without a direction goes nowhere
+        packet[idx].max_t = length > 0.0f ? rays[idx].max_distance : -1.0f;
+
+        memset(&hits[idx], 0, sizeof(render_ray_hit_t));
+        hits[idx].object = RENDER_NULL_HANDLE;
+        hits[idx].distance = -1.0f;
+    }
+
+    // __raycast_object fills in the hits as it finds nearer ones
+    bvh_raycast(&__bvh, packet, count, __raycast_object, hits, objects, t);
+}
+
+static void __raycast_range(unsigned int begin, unsigned int end, void * data)
+{
+    const struct __raycast_batch * batch = data;
+
+    for (unsigned int packet = begin; packet < end; ++packet)
+    {
+        unsigned int first = packet * BVH_PACKET, count = batch->count - first;
+
+        __raycast_packet(&batch->rays[first], count < BVH_PACKET ? count : BVH_PACKET, &batch->hits[first]);
+    }
+}
+
+static float __raycast_object(void * data, const bvh_ray_t * ray, unsigned int ray_index, float max_t, void * user)
+{
+    render_handle_t object = (render_handle_t)(uintptr_t)data;
+    render_ray_hit_t * hit = (render_ray_hit_t *)user + ray_index;
+    unsigned int slot = __object_slot(object), triangle = 0, found = ~0U;
+    const render_def_t * def = slot != ~0U ? __object_defs[slot] : NULL;
+    const render_lod_t * mesh = NULL;
+    const float * m = NULL;
+    vec3_t origin, direction, normal = vec3_make(0.0f, 0.0f, 0.0f);
+    float best = max_t;
+    mat4_t inverse;
+
+    if (!def || !__ray_box(ray, __object_world_min[slot], __object_world_max[slot], max_t)) return -1.0f;
+
+    // flattened objects have no inverse, and nothing to hit
+    if (!mat4_inverse(&inverse, &__object_models[slot])) return -1.0f;
+
+    m = inverse.m;
+    origin = mat4_mul_point(&inverse, ray->origin);
+    direction = vec3_make(m[0] * ray->direction.x + m[4] * ray->direction.y + m[8] * ray->direction.z,
+            m[1] * ray->direction.x + m[5] * ray->direction.y + m[9] * ray->direction.z,
+            m[2] * ray->direction.x + m[6] * ray->direction.y + m[10] * ray->direction.z);
+
+    mesh = &def->meshes[0];
+    for (triangle = 0; triangle < (unsigned int)mesh->num_indices / 3; ++triangle)
+    {
+        unsigned int corners[3];
+        vec3_t v[3];
+        float t = 0.0f;
+
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            unsigned int idx = 3 * triangle + corner;
+            corners[corner] = mesh->index_type == GL_UNSIGNED_INT ? ((const GLuint *)mesh->indices)[idx]
+                : ((const GLushort *)mesh->indices)[idx];
+            v[corner] = vec3_make(mesh->vertices[3 * corners[corner]], mesh->vertices[3 * corners[corner] + 1],
+                    mesh->vertices[3 * corners[corner] + 2]);
+        }
+
+        t = __ray_triangle(origin, direction, v[0], v[1], v[2]);
+        if (t < 0.0f || t >= best) continue;
+
+        best = t;
+        found = triangle;
+        normal = vec3_cross(vec3_sub(v[1], v[0]), vec3_sub(v[2], v[0]));
+    }
+
+    if (found == ~0U) return -1.0f;
+
+    // normals go to world space by the inverse transpose
+    normal = vec3_normalize(vec3_make(m[0] * normal.x + m[1] * normal.y + m[2] * normal.z,
+                m[4] * normal.x + m[5] * normal.y + m[6] * normal.z, m[8] * normal.x + m[9] * normal.y + m[10] * normal.z));
+    if (vec3_dot(normal, ray->direction) > 0.0f) normal = vec3_scale(normal, -1.0f);
+
+    hit->object = object;
+    hit->distance = best;
+    hit->triangle = found;
+    hit->point[0] = ray->origin.x + best * ray->direction.x;
+    hit->point[1] = ray->origin.y + best * ray->direction.y;
+    hit->point[2] = ray->origin.z + best * ray->direction.z;
+    hit->normal[0] = normal.x;
+    hit->normal[1] = normal.y;
+    hit->normal[2] = normal.z;
+
+    return best;
+}
+
+// leaves hold fat boxes; the exact one spares the triangle tests of near misses
+static int __ray_box(const bvh_ray_t * ray, vec3_t min, vec3_t max, float max_t)
+{
+    const float * origin = &ray->origin.x, * direction = &ray->direction.x, * lo = &min.x, * hi = &max.x;
+    float near = 0.0f, far = max_t;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float t0 = 0.0f, t1 = 0.0f;
+
+        if (direction[axis] == 0.0f)
+        {
+            if (origin[axis] < lo[axis] || origin[axis] > hi[axis]) return 0;
+            continue;
+        }
+
+        t0 = (lo[axis] - origin[axis]) / direction[axis];
+        t1 = (hi[axis] - origin[axis]) / direction[axis];
+        near = fmaxf(near, fminf(t0, t1));
+        far = fminf(far, fmaxf(t0, t1));
+    }
+
+    return near <= far;
+}
+
+// Moller/Trumbore, both faces: t along direction, or -1 for a miss
+static float __ray_triangle(vec3_t origin, vec3_t direction, vec3_t a, vec3_t b, vec3_t c)
+{
+    vec3_t ab = vec3_sub(b, a), ac = vec3_sub(c, a), p = vec3_cross(direction, ac), s, q;
+    float det = vec3_dot(ab, p), inverse = 0.0f, u = 0.0f, v = 0.0f;
+
+    // parallel to the triangle, or the triangle is degenerate
+    if (fabsf(det) < 1e-12f) return -1.0f;
+
+    inverse = 1.0f / det;
+    s = vec3_sub(origin, a);
+    u = vec3_dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f) return -1.0f;
+
+    q = vec3_cross(s, ab);
+    v = vec3_dot(direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f) return -1.0f;
+
+    return vec3_dot(ac, q) * inverse;
+}
+
+static status_e __instancing_init(void)
+{
+    GLint gl_major = 0, gl_minor = 0;
+    shader_attrib_t attribs[] = {
+        { INSTANCE_ATTRIB_MODEL + 0, "inst_model0" },
+        { INSTANCE_ATTRIB_MODEL + 1, "inst_model1" },
+        { INSTANCE_ATTRIB_MODEL + 2, "inst_model2" },
+        { INSTANCE_ATTRIB_MODEL + 3, "inst_model3" },
+        { INSTANCE_ATTRIB_COLOR, "inst_color" },
+    };
+
+    __instancing_supported = 0;
+
+    glGetIntegerv(GL_MAJOR_VERSION, &gl_major);
+    glGetIntegerv(GL_MINOR_VERSION, &gl_minor);
+    if ((gl_major < 3 || (gl_major == 3 && gl_minor < 3)) && !glfwExtensionSupported("GL_ARB_instanced_arrays"))
+    {
+        LOG_ERROR("instanced arrays are not supported (OpenGL v%d.%d)\n", gl_major, gl_minor);
+        return status_error;
+    }
+
+    if (shader_create_program(__instance_vertex_source, __instance_fragment_source,
+                attribs, sizeof(attribs) / sizeof(attribs[0]), &__instance_program) != status_success)
+    {
+        LOG_ERROR("failed to create instancing program\n");
+        return status_error;
+    }
+
+    __instance_lighting_loc = glGetUniformLocation(__instance_program, "lighting");
+
+    glGenBuffers(1, &__instance_vbo);
+
+    __instancing_supported = 1;
+
+    return status_success;
+}
+
+static status_e __queue_reserve(unsigned int capacity)
+{
+    unsigned long long * keys = NULL, * tmp_keys = NULL;
+    unsigned int * items = NULL, * tmp_items = NULL;
+
+    if (capacity <= __queue_capacity) return status_success;
+
+    keys = malloc(capacity * sizeof(unsigned long long));
+    tmp_keys = malloc(capacity * sizeof(unsigned long long));
+    items = malloc(capacity * sizeof(unsigned int));
+    tmp_items = malloc(capacity * sizeof(unsigned int));
+    if (!keys || !tmp_keys || !items || !tmp_items)
+    {
+        LOG_ERROR("failed to allocate memory for a render queue of %u items\n", capacity);
+        free(keys);
+        free(tmp_keys);
+        free(items);
+        free(tmp_items);
+        return status_error;
+    }
+
+    free(__queue_keys);
+    free(__queue_tmp_keys);
+    free(__queue_items);
+    free(__queue_tmp_items);
+    __queue_keys = keys;
+    __queue_tmp_keys = tmp_keys;
+    __queue_items = items;
+    __queue_tmp_items = tmp_items;
+    __queue_capacity = capacity;
+
+    return status_success;
+}
+
+static void __def_compute_bounds(render_def_t * def)
+{
+    vec3_t min = vec3_make(0.0f, 0.0f, 0.0f), max = min, center;
+    float radius_sq = 0.0f;
+
+    for (GLsizei idx = 0; def->vertices && idx < def->num_vertices; ++idx)
+    {
+        vec3_t v = vec3_make(def->vertices[idx * 3], def->vertices[idx * 3 + 1], def->vertices[idx * 3 + 2]);
+        min = idx == 0 ? v : vec3_min(min, v);
+        max = idx == 0 ? v : vec3_max(max, v);
+    }
+
+    center = vec3_scale(vec3_add(min, max), 0.5f);
+    for (GLsizei idx = 0; def->vertices && idx < def->num_vertices; ++idx)
+    {
+        vec3_t d = vec3_sub(vec3_make(def->vertices[idx * 3], def->vertices[idx * 3 + 1], def->vertices[idx * 3 + 2]), center);
+        if (vec3_dot(d, d) > radius_sq) radius_sq = vec3_dot(d, d);
+    }
+
+    def->bounds_min[0] = min.x;
+    def->bounds_min[1] = min.y;
+    def->bounds_min[2] = min.z;
+    def->bounds_max[0] = max.x;
+    def->bounds_max[1] = max.y;
+    def->bounds_max[2] = max.z;
+    def->bounds_center[0] = center.x;
+    def->bounds_center[1] = center.y;
+    def->bounds_center[2] = center.z;
+    def->bounds_radius = sqrtf(radius_sq);
+}
+
+static status_e __def_build_meshes(render_def_t * def)
+{
+    render_lod_t source = { def->vertices, def->normals, def->num_vertices, def->vertex_mode,
+        def->indices, def->num_indices, def->index_type, 0.0f };
+    GLfloat * simplify_vertices = def->vertices, * simplify_normals = NULL;
+    GLsizei simplify_num_vertices = def->num_vertices;
+    GLenum simplify_mode = def->vertex_mode;
+    unsigned int triangles = 0;
+    status_e status = status_success;
+
+    memset(def->meshes, 0, sizeof(def->meshes));
+    def->acmr_before = def->acmr_after = 0.0f;
+
+    if (def->num_lods > RENDER_MAX_LODS - 1)
+    {
+        LOG_ERROR("def %lu has %u levels of detail, only %d are supported\n", def->id, def->num_lods, RENDER_MAX_LODS - 1);
+        def->num_lods = RENDER_MAX_LODS - 1;
+    }
+
+    // a def without geometry can still be placed, it just never draws
+    if (!def->vertices)
+    {
+        def->num_lods = 0;
+        return status_success;
+    }
+
+    if (def->flags & RENDER_DEF_PREBUILT)
+    {
+        if (!def->indices || def->vertex_mode != GL_TRIANGLES)
+        {
+            LOG_ERROR("def %lu is marked prebuilt but is not indexed GL_TRIANGLES\n", def->id);
+            return status_error;
+        }
+
+        def->meshes[0] = source;
+        for (unsigned int idx = 0; idx < def->num_lods; ++idx)
+        {
+            def->meshes[idx + 1] = def->lods[idx];
+        }
+
+        return status_success;
+    }
+
+    if ((status = __def_compile_level(&source, &def->meshes[0], &def->acmr_before, &def->acmr_after)) != status_success)
+    {
+        LOG_ERROR("def %lu: failed to build its index buffer\n", def->id);
+        return status;
+    }
+
+    LOG_DEBUG("def %lu: %d vertices welded to %d, ACMR %.3f -> %.3f\n", def->id, def->num_vertices,
+            def->meshes[0].num_vertices, def->acmr_before, def->acmr_after);
+
+    // simplify only takes unindexed geometry
+    triangles = def->meshes[0].num_indices / 3;
+    if (def->num_lods && def->indices)
+    {
+        mesh_t mesh;
+
+        if (mesh_build(&mesh, def->vertices, def->normals, def->num_vertices, def->indices, def->num_indices,
+                    def->index_type, def->vertex_mode) != status_success
+                || mesh_unindex(&mesh, &simplify_vertices, &simplify_normals) != status_success)
+        {
+            LOG_ERROR("def %lu: failed to expand its index buffer, dropping its levels of detail\n", def->id);
+            mesh_destroy(&mesh);
+            def->num_lods = 0;
+            return status_success;
+        }
+
+        simplify_num_vertices = mesh.num_indices;
+        simplify_mode = GL_TRIANGLES;
+        mesh_destroy(&mesh);
+    }
+
+    for (unsigned int idx = 0; idx < def->num_lods; ++idx)
+    {
+        render_lod_t * lod = &def->lods[idx], generated;
+
+        if (idx > 0 && lod->distance < def->lods[idx - 1].distance)
+        {
+            LOG_ERROR("def %lu: level %u starts closer than level %u, dropping the levels from %u on\n", def->id, idx + 1, idx, idx + 1);
+            def->num_lods = idx;
+            break;
+        }
+
+        triangles = (unsigned int)(triangles * LOD_REDUCTION);
+        if (lod->vertices)
+        {
+            status = __def_compile_level(lod, &def->meshes[idx + 1], NULL, NULL);
+        }
+        else
+        {
+            memset(&generated, 0, sizeof(generated));
+            generated.vertex_mode = GL_TRIANGLES;
+            generated.distance = lod->distance;
+
+            if (triangles < LOD_MIN_TRIANGLES) triangles = LOD_MIN_TRIANGLES;
+            if ((status = simplify_mesh(simplify_vertices, simplify_num_vertices, simplify_mode, triangles,
+                        &generated.vertices, &generated.normals, &generated.num_vertices)) == status_success)
+            {
+                status = __def_compile_level(&generated, &def->meshes[idx + 1], NULL, NULL);
+            }
+
+            free(generated.vertices);
+            free(generated.normals);
+        }
+
+        if (status != status_success)
+        {
+            LOG_ERROR("def %lu: failed to build level %u, dropping the levels from %u on\n", def->id, idx + 1, idx + 1);
+            def->num_lods = idx;
+            break;
+        }
+    }
+
+    if (simplify_vertices != def->vertices)
+    {
+        free(simplify_vertices);
+        free(simplify_normals);
+    }
+
+    return status_success;
+}
+
+static status_e __def_compile_level(const render_lod_t * source, render_lod_t * out, GLfloat * acmr_before, GLfloat * acmr_after)
+{
+    mesh_t mesh;
+    status_e status = status_success;
+
+    if ((status = mesh_build(&mesh, source->vertices, source->normals, source->num_vertices, source->indices,
+                    source->num_indices, source->index_type, source->vertex_mode)) != status_success) return status;
+
+    // unindexed geometry transforms one vertex per corner whatever the order
+    if (acmr_before)
+    {
+        *acmr_before = source->indices ? mesh_acmr(mesh.indices, mesh.num_indices, mesh.num_vertices, MESH_CACHE_SIZE)
+            : (GLfloat)source->num_vertices / simplify_count_triangles(source->num_vertices, source->vertex_mode);
+    }
+
+    if ((status = mesh_optimize_vertex_cache(&mesh)) != status_success
+            || (status = mesh_optimize_vertex_fetch(&mesh)) != status_success)
+    {
+        mesh_destroy(&mesh);
+        return status;
+    }
+
+    if (acmr_after) *acmr_after = mesh_acmr(mesh.indices, mesh.num_indices, mesh.num_vertices, MESH_CACHE_SIZE);
+
+    memset(out, 0, sizeof(render_lod_t));
+    out->distance = source->distance;
+
+    // 16-bit indices halve the index traffic whenever the vertex count allows it
+    if (mesh.num_vertices <= 0x10000)
+    {
+        GLushort * indices = malloc(mesh.num_indices * sizeof(GLushort));
+
+        if (!indices)
+        {
+            LOG_ERROR("failed to allocate memory for %u indices\n", mesh.num_indices);
+            mesh_destroy(&mesh);
+            return status_error;
+        }
+
+        for (unsigned int idx = 0; idx < mesh.num_indices; ++idx) indices[idx] = (GLushort)mesh.indices[idx];
+        free(mesh.indices);
+        out->indices = indices;
+        out->index_type = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        out->indices = mesh.indices;
+        out->index_type = GL_UNSIGNED_INT;
+    }
+
+    out->vertices = mesh.vertices;
+    out->normals = mesh.normals;
+    out->num_vertices = mesh.num_vertices;
+    out->vertex_mode = GL_TRIANGLES;
+    out->num_indices = mesh.num_indices;
+
+    return status_success;
+}
+
+static void __def_free_meshes(render_def_t * def)
+{
+    // prebuilt meshes point at the caller's arrays
+    for (unsigned int idx = 0; idx < RENDER_MAX_LODS && !(def->flags & RENDER_DEF_PREBUILT); ++idx)
+    {
+        free(def->meshes[idx].vertices);
+        free(def->meshes[idx].normals);
+        free(def->meshes[idx].indices);
+    }
+
+    memset(def->meshes, 0, sizeof(def->meshes));
+}
+
+static const render_lod_t * __def_lod(const render_def_t * def, unsigned int lod)
+{
+    return &def->meshes[lod <= def->num_lods ? lod : 0];
+}
+
+static unsigned int __select_lod(const render_def_t * def, unsigned int current, GLfloat distance)
+{
+    // lods[lod] is where level lod + 1 takes over from level lod
+    unsigned int lod = current > def->num_lods ? def->num_lods : current;
+
+    while (lod < def->num_lods && distance > def->lods[lod].distance * (1.0f + LOD_HYSTERESIS)) ++lod;
+    while (lod > 0 && distance < def->lods[lod - 1].distance * (1.0f - LOD_HYSTERESIS)) --lod;
+
+    return lod;
+}
+
+static status_e __cull_reserve(unsigned int capacity)
+{
+    if (capacity <= __cull_capacity) return status_success;
+
+    free(__cull_x);
+    free(__cull_y);
+    free(__cull_z);
+    free(__cull_radius);
+    free(__cull_results);
+    free(__visible);
+    __cull_x = malloc(capacity * sizeof(float));
+    __cull_y = malloc(capacity * sizeof(float));
+    __cull_z = malloc(capacity * sizeof(float));
+    __cull_radius = malloc(capacity * sizeof(float));
+    __cull_results = malloc(capacity);
+    __visible = malloc(capacity * sizeof(unsigned int));
+    __cull_capacity = capacity;
+
+    if (!__cull_x || !__cull_y || !__cull_z || !__cull_radius || !__cull_results || !__visible)
+    {
+        LOG_ERROR("failed to allocate memory for culling %u objects\n", capacity);
+        __cull_capacity = 0;
+        return status_error;
+    }
+
+    return status_success;
+}
+
+static void __cull_range(unsigned int begin, unsigned int end, void * data)
+{
+    // gathered so the spheres tested together are contiguous; a negative radius culls objects without a def
+    for (unsigned int idx = begin; idx < end; ++idx)
+    {
+        unsigned int slot = __visible[idx];
+
+        __cull_x[idx] = __object_center_x[slot];
+        __cull_y[idx] = __object_center_y[slot];
+        __cull_z[idx] = __object_center_z[slot];
+        __cull_radius[idx] = __object_radius[slot];
+    }
+
+    cull_spheres(&__frustum, __cull_x + begin, __cull_y + begin, __cull_z + begin, __cull_radius + begin,
+            end - begin, __cull_results + begin);
+
+    for (unsigned int idx = begin; idx < end; ++idx)
+    {
+        if (__cull_results[idx] == cull_intersecting)
+        {
+            bvh_aabb_t box;
+
+            __object_world_bounds(__visible[idx], &box);
+            __cull_results[idx] = cull_aabb(&__frustum, box.min, box.max);
+        }
+    }
+}
+
+static void __cull_objects(void)
+{
+    __visible_len = 0;
+
+    if (__cull_reserve(__object_len) != status_success) return;
+
+    if (!__culling_enabled)
+    {
+        for (unsigned int slot = 0; slot < __object_len; ++slot) __visible[slot] = slot;
+        __visible_len = __object_len;
+        return;
+    }
+
+    __cull_straddling = __cull_contained = 0;
+    bvh_query_frustum(&__bvh, &__frustum, __bvh_collect, NULL);
+
+    jobs_parallel_for(__cull_straddling, CULL_GRAIN, __cull_range, NULL);
+
+    for (unsigned int idx = 0; idx < __cull_straddling; ++idx)
+    {
+        if (__cull_results[idx] != cull_outside) __visible[__visible_len++] = __visible[idx];
+    }
+
+    memmove(__visible + __visible_len, __visible + __cull_capacity - __cull_contained,
+            __cull_contained * sizeof(unsigned int));
+    __visible_len += __cull_contained;
+
+    __stats_thread()->objects_culled += __object_len - __visible_len;
+}
+
+static int __occluder_compare(const void * a, const void * b)
+{
+    float size_a = ((const __occluder_t *)a)->size, size_b = ((const __occluder_t *)b)->size;
+
+    return (size_a < size_b) - (size_a > size_b);
+}
+
+static void __occlusion_range(unsigned int begin, unsigned int end, void * data)
+{
+    for (unsigned int idx = begin; idx < end; ++idx)
+    {
+        bvh_aabb_t box;
+
+        __object_world_bounds(__visible[idx], &box);
+        __cull_results[idx] = occlusion_test_aabb(&__occlusion, box.min, box.max);
+    }
+}
+
+static void __occlusion_cull(const mat4_t * view_projection)
+{
+    unsigned int num_occluders = 0, triangles = 0, tested = __visible_len;
+
+    if (!__occlusion_enabled || !__occlusion_ready || __visible_len == 0) return;
+
+    if (__visible_len > __occluders_capacity)
+    {
+        __occluder_t * occluders = realloc(__occluders, __visible_len * sizeof(__occluder_t));
+
+        if (!occluders)
+        {
+            LOG_ERROR("failed to allocate memory for %u occluder candidates\n", __visible_len);
+            return;
+        }
+
+        __occluders = occluders;
+        __occluders_capacity = __visible_len;
+    }
+
+    for (unsigned int idx = 0; idx < __visible_len; ++idx)
+    {
+        unsigned int slot = __visible[idx];
+        const render_def_t * def = __object_defs[slot];
+        float distance = 0.0f, size = 0.0f;
+
+        // anything see-through or drawn as lines or points hides nothing behind it
+        if (!def || def->meshes[0].num_indices == 0 || __object_colors[slot].w < 1.0f
+                || __object_polygon_modes[slot] != GL_FILL) continue;
+
+        distance = vec3_length(vec3_sub(__object_positions[slot], __camera_pos));
+        size = __object_radius[slot] / fmaxf(distance, 1e-3f);
+        if (size < OCCLUSION_MIN_SIZE) continue;
+
+        __occluders[num_occluders].size = size;
+        __occluders[num_occluders].slot = slot;
+        ++num_occluders;
+    }
+
+    if (num_occluders == 0) return;
+
+    qsort(__occluders, num_occluders, sizeof(__occluder_t), __occluder_compare);
+
+    occlusion_begin(&__occlusion, view_projection);
+    for (unsigned int idx = 0; idx < num_occluders && idx < OCCLUSION_MAX_OCCLUDERS; ++idx)
+    {
+        unsigned int slot = __occluders[idx].slot;
+        const render_lod_t * mesh = &__object_defs[slot]->meshes[0];
+        unsigned int count = mesh->num_indices / 3;
+
+        if (triangles + count > OCCLUSION_MAX_TRIANGLES) continue;
+
+        if (occlusion_add_occluder(&__occlusion, &__object_models[slot], mesh->vertices, mesh->num_vertices, mesh->indices,
+                    mesh->num_indices, mesh->index_type, GL_TRIANGLES) != status_success) break;
+        triangles += count;
+    }
+    occlusion_rasterize(&__occlusion);
+
+    // frustum culling is done with the results array, so it is reused for the occlusion verdicts
+    jobs_parallel_for(__visible_len, CULL_GRAIN, __occlusion_range, NULL);
+
+    __visible_len = 0;
+    for (unsigned int idx = 0; idx < tested; ++idx)
+    {
+        if (__cull_results[idx]) __visible[__visible_len++] = __visible[idx];
+    }
+
+    __stats_thread()->objects_occluded += tested - __visible_len;
+    __stats_thread()->occluded_percent = 100.0f * (tested - __visible_len) / tested;
+}
+
+static void __queue_build(const mat4_t * view)
+{
+    const float * v = view->m;
+
+    __queue_len = 0;
+
+    if (__queue_reserve(__visible_len) != status_success) return;
+
+    for (unsigned int idx = 0; idx < __visible_len; ++idx)
+    {
+        unsigned int slot = __visible[idx];
+        const render_def_t * def = __object_defs[slot];
+        vec3_t pos = __object_positions[slot];
+        unsigned long long pass = __pass_opaque, depth_bits = 0;
+        GLfloat depth = 0.0f;
+        union { GLfloat f; unsigned int u; } depth_float;
+
+        if (!def || def->meshes[0].num_indices == 0) continue;
+
+        if (__object_clusters[slot])
+        {
+            __static_mark_visible(__object_clusters[slot]);
+            continue;
+        }
+
+        __object_lods[slot] = def->num_lods ? __select_lod(def, __object_lods[slot], vec3_length(vec3_sub(pos, __camera_pos))) : 0;
+
+        // distance along the view direction; for non-negative floats the bit pattern orders like the value
+        depth = -(v[2] * pos.x + v[6] * pos.y + v[10] * pos.z + v[14]);
+        depth_float.f = depth > 0.0f ? depth : 0.0f;
+        depth_bits = depth_float.u >> 8;
+
+        // opaque objects go front to back to help early depth rejection, transparent ones back to front to blend correctly
+        if (__object_colors[slot].w < 1.0f)
+        {
+            pass = __pass_transparent;
+            depth_bits = ~depth_bits & QUEUE_DEPTH_MASK;
+        }
+
+        __queue_keys[__queue_len] = (pass << QUEUE_PASS_SHIFT)
+            | ((unsigned long long)((__object_polygon_modes[slot] - GL_POINT) & 3) << QUEUE_MODE_SHIFT)
+            | ((def->sort_slot & QUEUE_DEF_MASK) << QUEUE_DEF_SHIFT)
+            | ((__object_lods[slot] & QUEUE_LOD_MASK) << QUEUE_LOD_SHIFT)
+            | (depth_bits << QUEUE_DEPTH_SHIFT);
+        __queue_items[__queue_len] = idx;
+        ++__queue_len;
+    }
+
+    sort_radix_u64(__queue_keys, __queue_items, __queue_tmp_keys, __queue_tmp_items, __queue_len);
+}
+
+static void __queue_set_pass(__pass_e pass)
+{
+    ++__stats_thread()->state_changes;
+
+    if (pass == __pass_transparent)
+    {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+    }
+    else
+    {
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
+    }
+}
+
+static void __queue_submit(void)
+{
+    glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+
+    __record_queue(__record_objects, NULL);
+}
+
+static void __queue_submit_instanced(void)
+{
+    __record_instances_t instances;
+
+    if (__instance_update(GL_ARRAY_BUFFER, 4 * sizeof(GLfloat), 0, &instances.buffer, &instances.base) != status_success) return;
+
+    __use_program(__instance_program);
+    glUniform1i(__instance_lighting_loc, glIsEnabled(GL_LIGHTING));
+
+    for (GLuint attrib = 0; attrib < 5; ++attrib)
+    {
+        glEnableVertexAttribArray(INSTANCE_ATTRIB_MODEL + attrib);
+        glVertexAttribDivisor(INSTANCE_ATTRIB_MODEL + attrib, 1);
+    }
+
+    __record_queue(__record_instanced, &instances);
+
+    for (GLuint attrib = 0; attrib < 5; ++attrib)
+    {
+        glVertexAttribDivisor(INSTANCE_ATTRIB_MODEL + attrib, 0);
+        glDisableVertexAttribArray(INSTANCE_ATTRIB_MODEL + attrib);
+    }
+
+    __use_program(0);
+}
+
+// a run ends where the pass, polygon mode, def or level of detail changes
+static int __queue_same_run(unsigned int a, unsigned int b)
+{
+    return (__queue_keys[a] & QUEUE_STATE_MASK) == (__queue_keys[b] & QUEUE_STATE_MASK)
+        && __object_defs[__visible[__queue_items[a]]] == __object_defs[__visible[__queue_items[b]]];
+}
+
+static void __record_queue(jobs_range_fn fn, void * data)
+{
+    unsigned int num_lists = (__queue_len + RECORD_GRAIN - 1) / RECORD_GRAIN;
+
+    if (num_lists > __record_lists_capacity)
+    {
+        cmdlist_t * lists = realloc(__record_lists, num_lists * sizeof(cmdlist_t));
+        if (!lists)
+        {
+            LOG_ERROR("failed to allocate memory for %u command lists\n", num_lists);
+            return;
+        }
+
+        for (unsigned int idx = __record_lists_capacity; idx < num_lists; ++idx) cmdlist_init(&lists[idx]);
+        __record_lists = lists;
+        __record_lists_capacity = num_lists;
+    }
+
+    for (unsigned int idx = 0; idx < num_lists; ++idx) cmdlist_reset(&__record_lists[idx]);
+
+    // ranges start at multiples of the grain, so each one knows its list without any locking
+    jobs_parallel_for(__queue_len, RECORD_GRAIN, fn, data);
+
+    if (cmdlist_play(__record_lists, num_lists) != status_success) return;
+
+    for (unsigned int idx = 0; idx < num_lists; ++idx) __stats_thread()->draw_calls += __record_lists[idx].draws;
+    __stats_thread()->objects_submitted += __queue_len;
+}
+
+// same state as __queue_set_pass
+static void __record_pass(cmdlist_t * list, __pass_e pass)
+{
+    if (pass == __pass_transparent)
+    {
+        cmdlist_enable(list, GL_BLEND);
+        cmdlist_blend_func(list, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        cmdlist_depth_mask(list, GL_FALSE);
+    }
+    else
+    {
+        cmdlist_disable(list, GL_BLEND);
+        cmdlist_depth_mask(list, GL_TRUE);
+    }
+}
+
+// a command that fails to record marks its list, which is then not played, so results go unchecked here
+static void __record_objects(unsigned int begin, unsigned int end, void * data)
+{
+    cmdlist_t * list = &__record_lists[begin / RECORD_GRAIN];
+    render_stats_t * stats = __stats_thread();
+    unsigned long long last_key = ~0ULL;
+    const GLfloat * last_vertices = NULL;
+    GLenum last_mode = 0;
+
+    for (unsigned int idx = begin; idx < end; ++idx)
+    {
+        unsigned long long key = __queue_keys[idx];
+        unsigned int slot = __visible[__queue_items[idx]];
+        const render_lod_t * level = __def_lod(__object_defs[slot], __object_lods[slot]);
+
+        if ((key >> QUEUE_PASS_SHIFT) != (last_key >> QUEUE_PASS_SHIFT))
+        {
+            __record_pass(list, key >> QUEUE_PASS_SHIFT);
+            ++stats->state_changes;
+        }
+
+        if (__object_polygon_modes[slot] != last_mode)
+        {
+            last_mode = __object_polygon_modes[slot];
+            cmdlist_polygon_mode(list, last_mode);
+            ++stats->polygon_mode_changes;
+            ++stats->state_changes;
+        }
+
+        if (level->vertices != last_vertices)
+        {
+            cmdlist_vertex_arrays(list, level->vertices, level->normals);
+            last_vertices = level->vertices;
+            ++stats->state_changes;
+        }
+
+        last_key = key;
+
+        cmdlist_draw(list, __object_models[slot].m, &__object_colors[slot].x, level->num_indices, level->index_type, level->indices);
+        stats->vertices_submitted += level->num_indices;
+        stats->primitives_submitted += level->num_indices / 3;
+    }
+}
+
+// a run is recorded whole by the list its first item falls in, so lists never split one
+static void __record_instanced(unsigned int begin, unsigned int end, void * data)
+{
+    const __record_instances_t * instances = data;
+    cmdlist_t * list = &__record_lists[begin / RECORD_GRAIN];
+    render_stats_t * stats = __stats_thread();
+    unsigned long long last_key = ~0ULL;
+    const GLfloat * last_vertices = NULL;
+    unsigned int run_start = begin, idx = 0;
+
+    while (run_start > 0 && run_start < end && __queue_same_run(run_start - 1, run_start)) ++run_start;
+
+    for (; run_start < end; run_start = idx)
+    {
+        unsigned long long key = __queue_keys[run_start];
+        unsigned int slot = __visible[__queue_items[run_start]];
+        const render_lod_t * level = __def_lod(__object_defs[slot], __object_lods[slot]);
+
+        for (idx = run_start + 1; idx < __queue_len && __queue_same_run(run_start, idx); ++idx);
+
+        if ((key >> QUEUE_PASS_SHIFT) != (last_key >> QUEUE_PASS_SHIFT))
+        {
+            __record_pass(list, key >> QUEUE_PASS_SHIFT);
+            ++stats->state_changes;
+        }
+
+        if (((key >> QUEUE_MODE_SHIFT) & 3) != ((last_key >> QUEUE_MODE_SHIFT) & 3))
+        {
+            cmdlist_polygon_mode(list, __object_polygon_modes[slot]);
+            ++stats->polygon_mode_changes;
+            ++stats->state_changes;
+        }
+
+        // binds the instance buffer and unbinds it again
+        cmdlist_instance_attribs(list, instances->buffer, instances->base + run_start * INSTANCE_FLOATS * sizeof(GLfloat),
+                INSTANCE_FLOATS * sizeof(GLfloat), INSTANCE_ATTRIB_MODEL, 5);
+        stats->buffer_binds += 2;
+        stats->state_changes += 2;
+
+        if (level->vertices != last_vertices)
+        {
+            // the def geometry itself still comes from client memory
+            cmdlist_vertex_arrays(list, level->vertices, level->normals);
+            last_vertices = level->vertices;
+            ++stats->state_changes;
+        }
+
+        last_key = key;
+
+        cmdlist_draw_instanced(list, level->num_indices, level->index_type, level->indices, idx - run_start);
+        stats->vertices_submitted += (unsigned long)level->num_indices * (idx - run_start);
+        stats->primitives_submitted += (unsigned long)(level->num_indices / 3) * (idx - run_start);
+    }
+}
+
+// instances are laid out in queue order so every run of equal state is one contiguous range, starting
+// at *base in *buffer. slack is store kept past the last instance, for targets bound in fixed-size ranges.
+static status_e __instance_update(GLenum target, GLsizeiptr alignment, GLsizeiptr slack, GLuint * buffer, GLintptr * base)
+{
+    GLsizeiptr bytes = __queue_len * INSTANCE_FLOATS * sizeof(GLfloat);
+    unsigned int num_spans = 0, changed = 0, idx = 0;
+    render_stream_span_t stream;
+
+    if (__queue_len > __instance_capacity)
+    {
+        unsigned int num_ranges = (__queue_len + INSTANCE_GRAIN - 1) / INSTANCE_GRAIN;
+        GLfloat * data = NULL;
+        unsigned int * spans = NULL;
+        __instance_range_t * ranges = NULL;
+
+        if ((data = realloc(__instance_data, bytes))) __instance_data = data;
+        if ((spans = realloc(__instance_spans, __queue_len * 2 * sizeof(unsigned int)))) __instance_spans = spans;
+        if ((ranges = realloc(__instance_ranges, num_ranges * sizeof(__instance_range_t)))) __instance_ranges = ranges;
+        if (!data || !spans || !ranges)
+        {
+            LOG_ERROR("failed to allocate memory for %u instances\n", __queue_len);
+            return status_error;
+        }
+
+        __instance_capacity = __queue_len;
+    }
+
+    // the cached matrices are compared against last frame's, so in a scene that keeps its
+    // draw order only moved or recolored objects are uploaded
+    jobs_parallel_for(__queue_len, INSTANCE_GRAIN, __instance_diff_range, NULL);
+
+    // each range left its spans at its own first instance; packed, they stay in queue order
+    for (unsigned int range = 0; range * INSTANCE_GRAIN < __queue_len; ++range)
+    {
+        memmove(__instance_spans + num_spans * 2, __instance_spans + range * INSTANCE_GRAIN * 2,
+                __instance_ranges[range].num_spans * 2 * sizeof(unsigned int));
+        num_spans += __instance_ranges[range].num_spans;
+        changed += __instance_ranges[range].changed;
+    }
+    __instance_len = __queue_len;
+
+    // mostly changed instances are cheaper to write out whole than to patch into a buffer
+    // the GPU may still be drawing the last frame from
+    if (changed * INSTANCE_STREAM_RATIO > __queue_len
+            && render_stream_alloc(bytes + slack, alignment, &stream) == status_success)
+    {
+        memcpy(stream.data, __instance_data, bytes);
+        render_stream_flush();
+        __instance_buffer_stale = 1;
+        *buffer = stream.buffer;
+        *base = stream.offset;
+        return status_success;
+    }
+
+    *buffer = __instance_vbo;
+    *base = 0;
+    __bind_buffer(target, __instance_vbo);
+
+    // a bigger store is respecified whole. partial updates give up orphaning, which is what lets
+    // unchanged instances stay on the GPU; drivers copy or wait when a span is still being read
+    if (__queue_len > __instance_buffer_len)
+    {
+        __buffer_data(target, bytes + slack, NULL, GL_DYNAMIC_DRAW);
+        __buffer_sub_data(target, 0, bytes, __instance_data);
+        __instance_buffer_len = __queue_len;
+    }
+    else if (__instance_buffer_stale)
+    {
+        __buffer_sub_data(target, 0, bytes, __instance_data);
+    }
+    else
+    {
+        for (idx = 0; idx < num_spans; ++idx)
+        {
+            __instance_upload(target, __instance_spans[idx * 2], __instance_spans[idx * 2 + 1]);
+        }
+    }
+    __instance_buffer_stale = 0;
+
+    return status_success;
+}
+
+static void __instance_diff_range(unsigned int begin, unsigned int end, void * data)
+{
+    __instance_range_t * range = &__instance_ranges[begin / INSTANCE_GRAIN];
+    unsigned int * spans = __instance_spans + begin * 2;    // never more spans than instances
+    unsigned int num_spans = 0, changed = 0;
+
+    for (unsigned int idx = begin; idx < end; ++idx)
+    {
+        unsigned int slot = __visible[__queue_items[idx]];
+        GLfloat * instance = __instance_data + idx * INSTANCE_FLOATS;
+
+        if (idx < __instance_len && memcmp(instance, __object_models[slot].m, 16 * sizeof(GLfloat)) == 0
+                && memcmp(instance + 16, &__object_colors[slot], 4 * sizeof(GLfloat)) == 0) continue;
+
+        memcpy(instance, __object_models[slot].m, 16 * sizeof(GLfloat));
+        memcpy(instance + 16, &__object_colors[slot], 4 * sizeof(GLfloat));
+        ++changed;
+
+        if (num_spans == 0 || idx - spans[num_spans * 2 - 1] >= INSTANCE_UPLOAD_GAP)
+        {
+            spans[num_spans * 2] = idx;
+            ++num_spans;
+        }
+        spans[num_spans * 2 - 1] = idx + 1;
+    }
+
+    range->num_spans = num_spans;
+    range->changed = changed;
+}
+
+static void __instance_upload(GLenum target, unsigned int begin, unsigned int end)
+{
+    if (begin == end) return;
+
+    __buffer_sub_data(target, begin * INSTANCE_FLOATS * sizeof(GLfloat), (end - begin) * INSTANCE_FLOATS * sizeof(GLfloat),
+            __instance_data + begin * INSTANCE_FLOATS);
+}
+
+static status_e __stream_init(void)
+{
+    GLint gl_major = 0, gl_minor = 0;
+
+    glGetIntegerv(GL_MAJOR_VERSION, &gl_major);
+    glGetIntegerv(GL_MINOR_VERSION, &gl_minor);
+
+    __stream_mode = __stream_none;
+    if (gl_major < 3 || (gl_major == 3 && gl_minor < 2))
+    {
+        LOG_ERROR("fences are not supported (OpenGL v%d.%d)\n", gl_major, gl_minor);
+        return status_error;
+    }
+
+    if (gl_major > 4 || (gl_major == 4 && gl_minor >= 4) || glfwExtensionSupported("GL_ARB_buffer_storage"))
+    {
+        __stream_mode = __stream_persistent;
+    }
+    else
+    {
+        LOG_DEBUG("no persistent buffer mapping, orphaning the streaming buffer every frame\n");
+        __stream_mode = __stream_orphaning;
+    }
+
+    return __stream_create(STREAM_REGION_BYTES);
+}
+
+static status_e __stream_create(GLsizeiptr region_bytes)
+{
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    glGenBuffers(1, &__stream_buffer);
+    __bind_buffer(GL_ARRAY_BUFFER, __stream_buffer);
+
+    __stream_region_bytes = region_bytes;
+    __stream_region = 0;
+    __stream_offset = 0;
+    __stream_map_offset = 0;
+    __stream_map = NULL;
+
+    if (__stream_mode == __stream_persistent)
+    {
+        glBufferStorage(GL_ARRAY_BUFFER, STREAM_FRAMES * region_bytes, NULL, flags);
+        __stream_map = glMapBufferRange(GL_ARRAY_BUFFER, 0, STREAM_FRAMES * region_bytes, flags);
+    }
+    else
+    {
+        __buffer_data(GL_ARRAY_BUFFER, region_bytes, NULL, GL_STREAM_DRAW);
+    }
+    __bind_buffer(GL_ARRAY_BUFFER, 0);
+
+    if (__stream_mode == __stream_persistent && !__stream_map)
+    {
+        LOG_ERROR("failed to map %ld bytes of streaming buffer\n", (long)(STREAM_FRAMES * region_bytes));
+        __stream_destroy();
+        return status_error;
+    }
+
+    return status_success;
+}
+
+static void __stream_destroy(void)
+{
+    // deleting the buffer unmaps it, and GL keeps the store alive for commands still reading it
+    for (unsigned int region = 0; region < STREAM_FRAMES; ++region)
+    {
+        if (__stream_fences[region]) glDeleteSync(__stream_fences[region]);
+        __stream_fences[region] = NULL;
+    }
+
+    glDeleteBuffers(1, &__stream_buffer);
+    __stream_buffer = 0;
+    __stream_map = NULL;
+    __stream_mode = __stream_none;
+}
+
+static void __stream_begin_frame(void)
+{
+    __stream_mode_e mode = __stream_mode;
+
+    if (mode == __stream_none) return;
+
+    render_stream_flush();
+
+    if (__stream_demand > __stream_region_bytes)
+    {
+        GLsizeiptr region_bytes = __stream_region_bytes;
+
+        while (region_bytes < __stream_demand) region_bytes *= 2;
+        LOG_DEBUG("growing streaming buffer regions to %ld bytes\n", (long)region_bytes);
+
+        __stream_demand = 0;
+        __stream_destroy();
+        __stream_mode = mode;
+        if (__stream_create(region_bytes) != status_success) __stream_mode = __stream_none;
+        return;
+    }
+    __stream_demand = 0;
+
+    if (mode == __stream_orphaning)
+    {
+        // the driver retires the old store once the GPU is done with it
+        if (__stream_offset > 0)
+        {
+            __bind_buffer(GL_ARRAY_BUFFER, __stream_buffer);
+            __buffer_data(GL_ARRAY_BUFFER, __stream_region_bytes, NULL, GL_STREAM_DRAW);
+            __bind_buffer(GL_ARRAY_BUFFER, 0);
+        }
+        __stream_offset = 0;
+        return;
+    }
+
+    // every command reading the region was issued last frame
+    if (__stream_offset > 0) __stream_fences[__stream_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    __stream_region = (__stream_region + 1) % STREAM_FRAMES;
+    __stream_offset = 0;
+}
+
+// only blocks when the CPU is STREAM_FRAMES frames ahead of the GPU
+static void __stream_wait(unsigned int region)
+{
+    GLsync fence = __stream_fences[region];
+
+    if (!fence) return;
+
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_WAIT_NS) == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(fence);
+    __stream_fences[region] = NULL;
+}
+
+static status_e __core_init(void)
+{
+    shader_attrib_t attribs[] = {
+        { CORE_ATTRIB_POSITION, "position" },
+        { CORE_ATTRIB_NORMAL, "normal" },
+    };
+    GLuint frame_index = GL_INVALID_INDEX, object_index = GL_INVALID_INDEX;
+
+    if (shader_create_program(__core_vertex_source, __core_fragment_source,
+                attribs, sizeof(attribs) / sizeof(attribs[0]), &__core_program) != status_success)
+    {
+        LOG_ERROR("failed to create core profile program\n");
+        return status_error;
+    }
+
+    frame_index = glGetUniformBlockIndex(__core_program, "frame_data");
+    object_index = glGetUniformBlockIndex(__core_program, "object_data");
+    if (frame_index == GL_INVALID_INDEX || object_index == GL_INVALID_INDEX)
+    {
+        LOG_ERROR("core profile program is missing its uniform blocks\n");
+        shader_destroy_program(__core_program);
+        __core_program = 0;
+        return status_error;
+    }
+
+    glUniformBlockBinding(__core_program, frame_index, CORE_FRAME_BINDING);
+    glUniformBlockBinding(__core_program, object_index, CORE_OBJECT_BINDING);
+    __core_base_loc = glGetUniformLocation(__core_program, "object_base");
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &__core_ubo_align);
+
+    glGenBuffers(1, &__core_frame_ubo);
+    __bind_buffer(GL_UNIFORM_BUFFER, __core_frame_ubo);
+    __buffer_data(GL_UNIFORM_BUFFER, sizeof(__core_frame_t), NULL, GL_DYNAMIC_DRAW);
+
+    // the whole block is always bound, even when one object is all that is read from it
+    glGenBuffers(1, &__core_object_ubo);
+    __bind_buffer(GL_UNIFORM_BUFFER, __core_object_ubo);
+    __buffer_data(GL_UNIFORM_BUFFER, CORE_BLOCK_BYTES, NULL, GL_DYNAMIC_DRAW);
+    __bind_buffer(GL_UNIFORM_BUFFER, 0);
+
+    glGenBuffers(1, &__instance_vbo);
+
+    return status_success;
+}
+
+static void __core_upload_def(render_def_t * def)
+{
+    for (unsigned int idx = 0; idx <= def->num_lods && idx < RENDER_MAX_LODS; ++idx)
+    {
+        const render_lod_t * mesh = &def->meshes[idx];
+        GLsizeiptr vertex_bytes = mesh->num_vertices * 3 * sizeof(GLfloat);
+        GLsizeiptr index_bytes = mesh->num_indices * (mesh->index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+
+        if (def->gpu_arrays[idx] || mesh->num_indices == 0) continue;
+
+        __stats_def_gpu_bytes += __core_level_bytes(mesh);
+
+        glGenVertexArrays(1, &def->gpu_arrays[idx]);
+        glGenBuffers(2, def->gpu_buffers[idx]);
+        __bind_vertex_array(def->gpu_arrays[idx]);
+
+        __bind_buffer(GL_ARRAY_BUFFER, def->gpu_buffers[idx][0]);
+        __buffer_data(GL_ARRAY_BUFFER, 2 * vertex_bytes, NULL, GL_STATIC_DRAW);
+        __buffer_sub_data(GL_ARRAY_BUFFER, 0, vertex_bytes, mesh->vertices);
+        __buffer_sub_data(GL_ARRAY_BUFFER, vertex_bytes, vertex_bytes, mesh->normals);
+        glEnableVertexAttribArray(CORE_ATTRIB_POSITION);
+        glVertexAttribPointer(CORE_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)0);
+        glEnableVertexAttribArray(CORE_ATTRIB_NORMAL);
+        glVertexAttribPointer(CORE_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, (const GLvoid *)vertex_bytes);
+
+        // the element buffer binding is part of the vertex array
+        __bind_buffer(GL_ELEMENT_ARRAY_BUFFER, def->gpu_buffers[idx][1]);
+        __buffer_data(GL_ELEMENT_ARRAY_BUFFER, index_bytes, mesh->indices, GL_STATIC_DRAW);
+
+        __bind_vertex_array(0);
+        __bind_buffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+static void __core_release_def(render_def_t * def)
+{
+    for (unsigned int idx = 0; idx < RENDER_MAX_LODS; ++idx)
+    {
+        if (!def->gpu_arrays[idx]) continue;
+
+        glDeleteVertexArrays(1, &def->gpu_arrays[idx]);
+        glDeleteBuffers(2, def->gpu_buffers[idx]);
+        __stats_def_gpu_bytes -= __core_level_bytes(&def->meshes[idx]);
+    }
+
+    memset(def->gpu_arrays, 0, sizeof(def->gpu_arrays));
+    memset(def->gpu_buffers, 0, sizeof(def->gpu_buffers));
+}
+
+// positions and normals, then indices
+static GLsizeiptr __core_level_bytes(const render_lod_t * mesh)
+{
+    return 2 * mesh->num_vertices * 3 * sizeof(GLfloat)
+        + mesh->num_indices * (mesh->index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+}
+
+static void __core_begin(void)
+{
+    __core_frame_t frame;
+    render_stream_span_t span;
+
+    frame.view = __view;
+    frame.projection = __projection;
+    memcpy(frame.global_ambient, __lighting.global_ambient, sizeof(frame.global_ambient));
+    memcpy(frame.light_position, __lighting.light_position, sizeof(frame.light_position));
+    memcpy(frame.light_ambient, __lighting.light_ambient, sizeof(frame.light_ambient));
+    memcpy(frame.light_diffuse, __lighting.light_diffuse, sizeof(frame.light_diffuse));
+    memcpy(frame.light_specular, __lighting.light_specular, sizeof(frame.light_specular));
+    memcpy(frame.material_specular, __lighting.material_specular, sizeof(frame.material_specular));
+    frame.params[0] = __lighting.material_shininess;
+    frame.params[1] = __lighting.enabled ? 1.0f : 0.0f;
+    frame.params[2] = frame.params[3] = 0.0f;
+
+    if (render_stream_alloc(sizeof(frame), __core_ubo_align, &span) == status_success)
+    {
+        memcpy(span.data, &frame, sizeof(frame));
+        render_stream_flush();
+        __bind_buffer_range(GL_UNIFORM_BUFFER, CORE_FRAME_BINDING, span.buffer, span.offset, sizeof(frame));
+    }
+    else
+    {
+        __bind_buffer(GL_UNIFORM_BUFFER, __core_frame_ubo);
+        __buffer_sub_data(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+        __bind_buffer_base(GL_UNIFORM_BUFFER, CORE_FRAME_BINDING, __core_frame_ubo);
+    }
+
+    __use_program(__core_program);
+}
+
+static void __core_end(void)
+{
+    // leave the state render_prerun set up for whoever draws next
+    __bind_vertex_array(0);
+    __bind_buffer(GL_UNIFORM_BUFFER, 0);
+    __use_program(0);
+    __polygon_mode(GL_FILL);
+    __queue_set_pass(__pass_opaque);
+}
+
+static void __core_submit(void)
+{
+    render_stats_t * stats = __stats_thread();
+    unsigned long long last_key = ~0ULL;
+    unsigned int run_start = 0, idx = 0;
+    GLuint buffer = 0;
+    GLintptr base = 0;
+
+    if (__instance_update(GL_UNIFORM_BUFFER, __core_ubo_align, CORE_BLOCK_BYTES, &buffer, &base) != status_success) return;
+
+    for (run_start = 0; run_start < __queue_len; run_start = idx)
+    {
+        unsigned long long key = __queue_keys[run_start];
+        unsigned int slot = __visible[__queue_items[run_start]];
+        render_def_t * def = __object_defs[slot];
+        unsigned int lod = __object_lods[slot] <= def->num_lods ? __object_lods[slot] : 0;
+        const render_lod_t * level = &def->meshes[lod];
+
+        // a run ends where the pass, polygon mode, def or level of detail changes
+        for (idx = run_start + 1; idx < __queue_len; ++idx)
+        {
+            if ((__queue_keys[idx] & QUEUE_STATE_MASK) != (key & QUEUE_STATE_MASK)) break;
+            if (__object_defs[__visible[__queue_items[idx]]] != def) break;
+        }
+
+        if ((key >> QUEUE_PASS_SHIFT) != (last_key >> QUEUE_PASS_SHIFT))
+        {
+            __queue_set_pass(key >> QUEUE_PASS_SHIFT);
+        }
+
+        if (((key >> QUEUE_MODE_SHIFT) & 3) != ((last_key >> QUEUE_MODE_SHIFT) & 3))
+        {
+            __polygon_mode(__object_polygon_modes[slot]);
+        }
+
+        last_key = key;
+
+        __core_upload_def(def);
+        __bind_vertex_array(def->gpu_arrays[lod]);
+
+        // runs longer than a block's worth of objects take several draws
+        for (unsigned int first = run_start, count = 0; first < idx; first += count)
+        {
+            GLintptr offset = base + first * INSTANCE_FLOATS * sizeof(GLfloat);
+            GLintptr aligned = offset - offset % __core_ubo_align;
+
+            count = (CORE_BLOCK_BYTES - (offset - aligned)) / (INSTANCE_FLOATS * sizeof(GLfloat));
+            if (count > idx - first) count = idx - first;
+
+            __bind_buffer_range(GL_UNIFORM_BUFFER, CORE_OBJECT_BINDING, buffer, aligned, CORE_BLOCK_BYTES);
+            glUniform1i(__core_base_loc, (offset - aligned) / (4 * sizeof(GLfloat)));
+            glDrawElementsInstanced(GL_TRIANGLES, level->num_indices, level->index_type, NULL, count);
+
+            __count_draw(stats, level->num_indices, count);
+        }
+
+        stats->objects_submitted += idx - run_start;
+    }
+}
+
+static status_e __indirect_init(void)
+{
+    GLint gl_major = 0, gl_minor = 0;
+    shader_attrib_t attribs[] = {
+        { CORE_ATTRIB_POSITION, "position" },
+        { CORE_ATTRIB_NORMAL, "normal" },
+        { INDIRECT_ATTRIB_MODEL + 0, "inst_model0" },
+        { INDIRECT_ATTRIB_MODEL + 1, "inst_model1" },
+        { INDIRECT_ATTRIB_MODEL + 2, "inst_model2" },
+        { INDIRECT_ATTRIB_MODEL + 3, "inst_model3" },
+        { INDIRECT_ATTRIB_COLOR, "inst_color" },
+    };
+    GLuint frame_index = GL_INVALID_INDEX;
+
+    __indirect_supported = 0;
+
+    glGetIntegerv(GL_MAJOR_VERSION, &gl_major);
+    glGetIntegerv(GL_MINOR_VERSION, &gl_minor);
+    __indirect_multi_draw = gl_major > 4 || (gl_major == 4 && gl_minor >= 3) || glfwExtensionSupported("GL_ARB_multi_draw_indirect");
+    if (!__indirect_multi_draw) LOG_DEBUG("multi-draw-indirect is not supported (OpenGL v%d.%d)\n", gl_major, gl_minor);
+
+    if (shader_create_program(__indirect_vertex_source, __core_fragment_source,
+                attribs, sizeof(attribs) / sizeof(attribs[0]), &__indirect_program) != status_success)
+    {
+        LOG_ERROR("failed to create indirect drawing program\n");
+        return status_error;
+    }
+
+    if ((frame_index = glGetUniformBlockIndex(__indirect_program, "frame_data")) == GL_INVALID_INDEX)
+    {
+        LOG_ERROR("indirect drawing program is missing its uniform block\n");
+        shader_destroy_program(__indirect_program);
+        __indirect_program = 0;
+        return status_error;
+    }
+    glUniformBlockBinding(__indirect_program, frame_index, CORE_FRAME_BINDING);
+
+    glGenVertexArrays(1, &__indirect_array);
+    glGenBuffers(1, &__indirect_vbo);
+    glGenBuffers(1, &__indirect_ibo);
+    glGenBuffers(1, &__indirect_command_buffer);
+
+    __bind_buffer(GL_ARRAY_BUFFER, __indirect_vbo);
+    __buffer_data(GL_ARRAY_BUFFER, INDIRECT_INITIAL_VERTICES * INDIRECT_VERTEX_FLOATS * sizeof(GLfloat), NULL, GL_STATIC_DRAW);
+    __bind_buffer(GL_ARRAY_BUFFER, __indirect_ibo);
+    __buffer_data(GL_ARRAY_BUFFER, INDIRECT_INITIAL_INDICES * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+    __bind_buffer(GL_ARRAY_BUFFER, 0);
+    __indirect_vertex_capacity = INDIRECT_INITIAL_VERTICES;
+    __indirect_index_capacity = INDIRECT_INITIAL_INDICES;
+    __indirect_bind_geometry();
+
+    __indirect_supported = 1;
+
+    return status_success;
+}
+
+static status_e __indirect_reserve(unsigned int vertices, unsigned int indices)
+{
+    unsigned int vertex_capacity = __indirect_vertex_capacity, index_capacity = __indirect_index_capacity;
+
+    if (__indirect_vertex_len + vertices <= vertex_capacity && __indirect_index_len + indices <= index_capacity)
+    {
+        return status_success;
+    }
+
+    if (__indirect_dead_vertices * 2 > __indirect_vertex_len || __indirect_dead_indices * 2 > __indirect_index_len)
+    {
+        LOG_DEBUG("reclaiming indirect drawing buffers from removed defs\n");
+        ++__indirect_generation;
+        __indirect_vertex_len = __indirect_index_len = 0;
+        __indirect_dead_vertices = __indirect_dead_indices = 0;
+        if (vertices <= vertex_capacity && indices <= index_capacity) return status_success;
+    }
+
+    while (__indirect_vertex_len + vertices > vertex_capacity) vertex_capacity *= 2;
+    while (__indirect_index_len + indices > index_capacity) index_capacity *= 2;
+
+    if (vertex_capacity != __indirect_vertex_capacity)
+    {
+        __indirect_vbo = __indirect_grow(GL_ARRAY_BUFFER, __indirect_vbo,
+                __indirect_vertex_len * INDIRECT_VERTEX_FLOATS * sizeof(GLfloat), vertex_capacity * INDIRECT_VERTEX_FLOATS * sizeof(GLfloat));
+        __indirect_vertex_capacity = vertex_capacity;
+    }
+
+    if (index_capacity != __indirect_index_capacity)
+    {
+        __indirect_ibo = __indirect_grow(GL_ELEMENT_ARRAY_BUFFER, __indirect_ibo,
+                __indirect_index_len * sizeof(GLuint), index_capacity * sizeof(GLuint));
+        __indirect_index_capacity = index_capacity;
+    }
+
+    if (!__indirect_vbo || !__indirect_ibo)
+    {
+        LOG_ERROR("failed to grow indirect drawing buffers\n");
+        return status_error;
+    }
+
+    __indirect_bind_geometry();
+
+    return status_success;
+}
+
+// copies what is used of buffer into a bigger one without a round trip through the CPU
+static GLuint __indirect_grow(GLenum target, GLuint buffer, GLsizeiptr used, GLsizeiptr size)
+{
+    GLuint grown = 0;
+
+    glGenBuffers(1, &grown);
+    __bind_buffer(GL_COPY_WRITE_BUFFER, grown);
+    __buffer_data(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+    if (used > 0)
+    {
+        __bind_buffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+        __bind_buffer(GL_COPY_READ_BUFFER, 0);
+    }
+    __bind_buffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+
+    return grown;
+}
+
+static void __indirect_bind_geometry(void)
+{
+    __bind_vertex_array(__indirect_array);
+
+    __bind_buffer(GL_ARRAY_BUFFER, __indirect_vbo);
+    glEnableVertexAttribArray(CORE_ATTRIB_POSITION);
+    glVertexAttribPointer(CORE_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, INDIRECT_VERTEX_FLOATS * sizeof(GLfloat), (const GLvoid *)0);
+    glEnableVertexAttribArray(CORE_ATTRIB_NORMAL);
+    glVertexAttribPointer(CORE_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, INDIRECT_VERTEX_FLOATS * sizeof(GLfloat),
+            (const GLvoid *)(3 * sizeof(GLfloat)));
+
+    for (GLuint attrib = 0; attrib < 5; ++attrib)
+    {
+        glEnableVertexAttribArray(INDIRECT_ATTRIB_MODEL + attrib);
+        glVertexAttribDivisor(INDIRECT_ATTRIB_MODEL + attrib, 1);
+    }
+
+    // the element buffer binding is part of the vertex array
+    __bind_buffer(GL_ELEMENT_ARRAY_BUFFER, __indirect_ibo);
+
+    __bind_vertex_array(0);
+    __bind_buffer(GL_ARRAY_BUFFER, 0);
+}
+
+// instanced attributes start at offset, with base_instance counted from there
+static void __indirect_point_instances(GLuint buffer, GLintptr offset)
+{
+    __bind_buffer(GL_ARRAY_BUFFER, buffer);
+    for (GLuint attrib = 0; attrib < 5; ++attrib)
+    {
+        glVertexAttribPointer(INDIRECT_ATTRIB_MODEL + attrib, 4, GL_FLOAT, GL_FALSE, INSTANCE_FLOATS * sizeof(GLfloat),
+                (const GLvoid *)(offset + attrib * 4 * sizeof(GLfloat)));
+    }
+    __bind_buffer(GL_ARRAY_BUFFER, 0);
+}
+
+static status_e __indirect_upload_def(render_def_t * def)
+{
+    unsigned int vertices = 0, indices = 0;
+    GLfloat * scratch = NULL;
+
+    if (def->mega_generation == __indirect_generation) return status_success;
+
+    for (unsigned int idx = 0; idx <= def->num_lods && idx < RENDER_MAX_LODS; ++idx)
+    {
+        vertices += def->meshes[idx].num_vertices;
+        indices += def->meshes[idx].num_indices;
+    }
+
+    if (__indirect_reserve(vertices, indices) != status_success) return status_error;
+
+    // vertices are interleaved and indices widened, so every level draws with the same layout and index type
+    if (!(scratch = malloc(vertices * INDIRECT_VERTEX_FLOATS * sizeof(GLfloat) + indices * sizeof(GLuint))))
+    {
+        LOG_ERROR("failed to allocate memory to place def %lu for indirect drawing\n", def->id);
+        return status_error;
+    }
+
+    for (unsigned int idx = 0; idx <= def->num_lods && idx < RENDER_MAX_LODS; ++idx)
+    {
+        const render_lod_t * mesh = &def->meshes[idx];
+        GLuint * widened = (GLuint *)(scratch + mesh->num_vertices * INDIRECT_VERTEX_FLOATS);
+
+        for (GLsizei vertex = 0; vertex < mesh->num_vertices; ++vertex)
+        {
+            memcpy(scratch + vertex * INDIRECT_VERTEX_FLOATS, mesh->vertices + vertex * 3, 3 * sizeof(GLfloat));
+            memcpy(scratch + vertex * INDIRECT_VERTEX_FLOATS + 3, mesh->normals + vertex * 3, 3 * sizeof(GLfloat));
+        }
+
+        for (GLsizei corner = 0; corner < mesh->num_indices; ++corner)
+        {
+            widened[corner] = mesh->index_type == GL_UNSIGNED_SHORT ? ((const GLushort *)mesh->indices)[corner]
+                : ((const GLuint *)mesh->indices)[corner];
+        }
+
+        __bind_buffer(GL_ARRAY_BUFFER, __indirect_vbo);
+        __buffer_sub_data(GL_ARRAY_BUFFER, __indirect_vertex_len * INDIRECT_VERTEX_FLOATS * sizeof(GLfloat),
+                mesh->num_vertices * INDIRECT_VERTEX_FLOATS * sizeof(GLfloat), scratch);
+        __bind_buffer(GL_ARRAY_BUFFER, __indirect_ibo);
+        __buffer_sub_data(GL_ARRAY_BUFFER, __indirect_index_len * sizeof(GLuint), mesh->num_indices * sizeof(GLuint), widened);
+
+        def->mega_base_vertex[idx] = __indirect_vertex_len;
+        def->mega_first_index[idx] = __indirect_index_len;
+        __indirect_vertex_len += mesh->num_vertices;
+        __indirect_index_len += mesh->num_indices;
+    }
+    __bind_buffer(GL_ARRAY_BUFFER, 0);
+    free(scratch);
+
+    def->mega_generation = __indirect_generation;
+
+    return status_success;
+}
+
+static void __indirect_release_def(render_def_t * def)
+{
+    if (def->mega_generation == __indirect_generation)
+    {
+        for (unsigned int idx = 0; idx <= def->num_lods && idx < RENDER_MAX_LODS; ++idx)
+        {
+            __indirect_dead_vertices += def->meshes[idx].num_vertices;
+            __indirect_dead_indices += def->meshes[idx].num_indices;
+        }
+    }
+
+    def->mega_generation = 0;
+}
+
+// draws count commands from __indirect_commands + first, their instances being at base in buffer
+static void __indirect_flush(unsigned int first, unsigned int count, GLuint buffer, GLintptr base)
+{
+    render_stats_t * stats = __stats_thread();
+    const __indirect_command_t * commands = __indirect_commands + first;
+    GLsizeiptr bytes = count * sizeof(__indirect_command_t);
+    render_stream_span_t span;
+    GLintptr offset = 0;
+
+    if (count == 0) return;
+
+    if (!__indirect_multi_draw)
+    {
+        for (unsigned int idx = 0; idx < count; ++idx)
+        {
+            __indirect_point_instances(buffer, base + commands[idx].base_instance * INSTANCE_FLOATS * sizeof(GLfloat));
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, commands[idx].count, GL_UNSIGNED_INT,
+                    (const GLvoid *)(commands[idx].first_index * sizeof(GLuint)), commands[idx].instance_count,
+                    commands[idx].base_vertex);
+            __count_draw(stats, commands[idx].count, commands[idx].instance_count);
+        }
+        return;
+    }
+
+    if (render_stream_alloc(bytes, sizeof(GLuint), &span) == status_success)
+    {
+        memcpy(span.data, commands, bytes);
+        render_stream_flush();
+        __bind_buffer(GL_DRAW_INDIRECT_BUFFER, span.buffer);
+        offset = span.offset;
+    }
+    else
+    {
+        __bind_buffer(GL_DRAW_INDIRECT_BUFFER, __indirect_command_buffer);
+        __buffer_data(GL_DRAW_INDIRECT_BUFFER, bytes, commands, GL_STREAM_DRAW);
+    }
+
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid *)offset, count, 0);
+    __bind_buffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // counted as one draw of everything its commands draw
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        stats->vertices_submitted += (unsigned long)commands[idx].count * commands[idx].instance_count;
+        stats->primitives_submitted += (unsigned long)(commands[idx].count / 3) * commands[idx].instance_count;
+    }
+    ++stats->draw_calls;
+    stats->indirect_draws += count;
+}
+
+static void __indirect_submit(void)
+{
+    unsigned long long last_key = ~0ULL;
+    unsigned long generation = 0;
+    unsigned int run_start = 0, idx = 0, num_commands = 0, group_start = 0;
+    const render_def_t * last_def = NULL;
+    GLuint buffer = 0;
+    GLintptr base = 0;
+
+    if (__queue_len > __indirect_commands_capacity)
+    {
+        __indirect_command_t * commands = realloc(__indirect_commands, __queue_len * sizeof(__indirect_command_t));
+        if (!commands)
+        {
+            LOG_ERROR("failed to allocate memory for %u indirect draws\n", __queue_len);
+            return;
+        }
+
+        __indirect_commands = commands;
+        __indirect_commands_capacity = __queue_len;
+    }
+
+    // placing a def can start the buffers over, so every def is placed before any command is written
+    do
+    {
+        generation = __indirect_generation;
+        last_def = NULL;
+        for (idx = 0; idx < __queue_len; ++idx)
+        {
+            render_def_t * def = __object_defs[__visible[__queue_items[idx]]];
+
+            if (def == last_def) continue;
+            if (__indirect_upload_def(def) != status_success) return;
+            last_def = def;
+        }
+    } while (generation != __indirect_generation);
+
+    // the instance buffer keeps the slack __core_submit binds windows of, in case the mode is switched
+    if (__instance_update(GL_ARRAY_BUFFER, 4 * sizeof(GLfloat), CORE_BLOCK_BYTES, &buffer, &base) != status_success) return;
+
+    __use_program(__indirect_program);
+    __bind_vertex_array(__indirect_array);
+    if (__indirect_multi_draw) __indirect_point_instances(buffer, base);
+
+    for (run_start = 0; run_start < __queue_len; run_start = idx)
+    {
+        unsigned long long key = __queue_keys[run_start];
+        unsigned int slot = __visible[__queue_items[run_start]];
+        const render_def_t * def = __object_defs[slot];
+        unsigned int lod = __object_lods[slot] <= def->num_lods ? __object_lods[slot] : 0;
+        __indirect_command_t * command = &__indirect_commands[num_commands++];
+
+        // a run ends where the pass, polygon mode, def or level of detail changes
+        for (idx = run_start + 1; idx < __queue_len; ++idx)
+        {
+            if ((__queue_keys[idx] & QUEUE_STATE_MASK) != (key & QUEUE_STATE_MASK)) break;
+            if (__object_defs[__visible[__queue_items[idx]]] != def) break;
+        }
+
+        // only a change of pass or polygon mode splits the multi-draw
+        if ((key >> QUEUE_MODE_SHIFT) != (last_key >> QUEUE_MODE_SHIFT))
+        {
+            __indirect_flush(group_start, num_commands - 1 - group_start, buffer, base);
+            group_start = num_commands - 1;
+
+            if ((key >> QUEUE_PASS_SHIFT) != (last_key >> QUEUE_PASS_SHIFT))
+            {
+                __queue_set_pass(key >> QUEUE_PASS_SHIFT);
+            }
+
+            if (((key >> QUEUE_MODE_SHIFT) & 3) != ((last_key >> QUEUE_MODE_SHIFT) & 3))
+            {
+                __polygon_mode(__object_polygon_modes[slot]);
+            }
+        }
+
+        last_key = key;
+
+        command->count = def->meshes[lod].num_indices;
+        command->instance_count = idx - run_start;
+        command->first_index = def->mega_first_index[lod];
+        command->base_vertex = def->mega_base_vertex[lod];
+        command->base_instance = run_start;
+
+        __stats_thread()->objects_submitted += idx - run_start;
+    }
+
+    __indirect_flush(group_start, num_commands - group_start, buffer, base);
+}
+
+static status_e __static_init(void)
+{
+    shader_attrib_t attribs[] = {
+        { CORE_ATTRIB_POSITION, "position" },
+        { CORE_ATTRIB_NORMAL, "normal" },
+        { STATIC_ATTRIB_COLOR, "color" },
+    };
+    GLuint frame_index = GL_INVALID_INDEX;
+
+    if (shader_create_program(__static_vertex_source, __core_fragment_source,
+                attribs, sizeof(attribs) / sizeof(attribs[0]), &__static_program) != status_success)
+    {
+        LOG_ERROR("failed to create static batch program\n");
+        return status_error;
+    }
+
+    frame_index = glGetUniformBlockIndex(__static_program, "frame_data");
+    if (frame_index == GL_INVALID_INDEX)
+    {
+        LOG_ERROR("static batch program is missing its uniform block\n");
+        shader_destroy_program(__static_program);
+        __static_program = 0;
+        return status_error;
+    }
+
+    glUniformBlockBinding(__static_program, frame_index, CORE_FRAME_BINDING);
+
+    return status_success;
+}
+
+// moves a static object into the cluster of its cell, or out of batching once it no longer qualifies
+static void __static_place(unsigned int slot)
+{
+    __static_cluster_t * current = __object_clusters[slot], * cluster = NULL;
+    const render_def_t * def = __object_defs[slot];
+
+    if ((__object_flags[slot] & OBJECT_STATIC) && def && def->meshes[0].num_indices > 0 && __object_colors[slot].w >= 1.0f)
+    {
+        cluster = __static_cluster_get(__static_key(slot), __object_polygon_modes[slot]);
+    }
+
+    if (cluster == current)
+    {
+        // same cell, but the geometry or color changed
+        if (cluster) cluster->dirty = 1;
+        return;
+    }
+
+    if (current) __static_leave(slot);
+    if (!cluster) return;
+
+    if (cluster->num_members == cluster->members_capacity)
+    {
+        unsigned int capacity = cluster->members_capacity ? cluster->members_capacity * 2 : 16;
+        render_handle_t * members = realloc(cluster->members, capacity * sizeof(render_handle_t));
+        if (!members)
+        {
+            LOG_ERROR("failed to allocate memory for a static cluster of %u objects\n", capacity);
+            return;
+        }
+
+        cluster->members = members;
+        cluster->members_capacity = capacity;
+    }
+
+    cluster->members[cluster->num_members++] = __object_handles[slot];
+    cluster->dirty = 1;
+    __object_clusters[slot] = cluster;
+}
+
+// grid cell of the object's position, biased so negative cells fit the mask, and its polygon mode
+static unsigned long __static_key(unsigned int slot)
+{
+    vec3_t pos = __object_positions[slot];
+    unsigned long bias = 1UL << (STATIC_CELL_BITS - 1);
+    unsigned long x = ((unsigned long)(long)floorf(pos.x / STATIC_CLUSTER_SIZE) + bias) & STATIC_CELL_MASK;
+    unsigned long y = ((unsigned long)(long)floorf(pos.y / STATIC_CLUSTER_SIZE) + bias) & STATIC_CELL_MASK;
+    unsigned long z = ((unsigned long)(long)floorf(pos.z / STATIC_CLUSTER_SIZE) + bias) & STATIC_CELL_MASK;
+
+    return (x << (2 * STATIC_CELL_BITS)) | (y << STATIC_CELL_BITS) | z
+        | ((unsigned long)((__object_polygon_modes[slot] - GL_POINT) & 3) << (3 * STATIC_CELL_BITS));
+}
+
+static __static_cluster_t * __static_cluster_get(unsigned long key, GLenum polygon_mode)
+{
+    __static_cluster_t * cluster = hash_get(&__static_table, key);
+
+    if (cluster) return cluster;
+
+    if (!(cluster = calloc(1, sizeof(__static_cluster_t))))
+    {
+        LOG_ERROR("failed to allocate memory for a static cluster\n");
+        return NULL;
+    }
+
+    cluster->key = key;
+    cluster->polygon_mode = polygon_mode;
+    if (hash_set(&__static_table, key, cluster) != status_success)
+    {
+        free(cluster);
+        return NULL;
+    }
+
+    if (array_push(&__static_clusters, cluster) != status_success)
+    {
+        hash_remove(&__static_table, key);
+        free(cluster);
+        return NULL;
+    }
+
+    return cluster;
+}
+
+static void __static_leave(unsigned int slot)
+{
+    __static_cluster_t * cluster = __object_clusters[slot];
+
+    for (unsigned int idx = 0; idx < cluster->num_members; ++idx)
+    {
+        if (cluster->members[idx] != __object_handles[slot]) continue;
+
+        cluster->members[idx] = cluster->members[--cluster->num_members];
+        break;
+    }
+
+    cluster->dirty = 1;
+    __object_clusters[slot] = NULL;
+}
+
+// rebuilds the clusters that changed since the last frame and starts a new visible list
+static void __static_refresh(void)
+{
+    for (unsigned int idx = 0; idx < __static_clusters.len; ++idx)
+    {
+        __static_cluster_t * cluster = array_get(&__static_clusters, idx);
+        if (cluster->dirty) __static_rebuild(cluster);
+    }
+
+    ++__static_frame;
+    __static_visible_len = 0;
+
+    if (__static_clusters.len > __static_visible_capacity)
+    {
+        __static_cluster_t ** visible = realloc(__static_visible, __static_clusters.len * sizeof(__static_cluster_t *));
+        if (!visible)
+        {
+            LOG_ERROR("failed to allocate memory for %u static clusters\n", __static_clusters.len);
+            return;
+        }
+
+        __static_visible = visible;
+        __static_visible_capacity = __static_clusters.len;
+    }
+}
+
+static void __static_rebuild(__static_cluster_t * cluster)
+{
+    unsigned int num_vertices = 0, num_indices = 0, vertex = 0, index = 0;
+
+    cluster->dirty = 0;
+
+    for (unsigned int idx = 0; idx < cluster->num_members; ++idx)
+    {
+        const render_lod_t * mesh = &__object_defs[__object_slot(cluster->members[idx])]->meshes[0];
+        num_vertices += mesh->num_vertices;
+        num_indices += mesh->num_indices;
+    }
+
+    if (num_vertices > __static_vertices_capacity)
+    {
+        __static_vertex_t * vertices = realloc(__static_vertices, num_vertices * sizeof(__static_vertex_t));
+        if (!vertices)
+        {
+            LOG_ERROR("failed to allocate memory for %u static vertices\n", num_vertices);
+            return;
+        }
+
+        __static_vertices = vertices;
+        __static_vertices_capacity = num_vertices;
+    }
+
+    if (num_indices > __static_indices_capacity)
+    {
+        GLuint * indices = realloc(__static_indices, num_indices * sizeof(GLuint));
+        if (!indices)
+        {
+            LOG_ERROR("failed to allocate memory for %u static indices\n", num_indices);
+            return;
+        }
+
+        __static_indices = indices;
+        __static_indices_capacity = num_indices;
+    }
+
+    for (unsigned int idx = 0; idx < cluster->num_members; ++idx)
+    {
+        unsigned int slot = __object_slot(cluster->members[idx]);
+        const render_lod_t * mesh = &__object_defs[slot]->meshes[0];
+        const mat4_t * m = &__object_models[slot];
+        vec3_t c0 = vec3_make(m->m[0], m->m[1], m->m[2]);
+        vec3_t c1 = vec3_make(m->m[4], m->m[5], m->m[6]);
+        vec3_t c2 = vec3_make(m->m[8], m->m[9], m->m[10]);
+        // cofactor columns, the inverse transpose up to a scale that normalizing removes
+        vec3_t n0 = vec3_cross(c1, c2), n1 = vec3_cross(c2, c0), n2 = vec3_cross(c0, c1);
+        GLfloat sign = vec3_dot(c0, n0) < 0.0f ? -1.0f : 1.0f;
+        vec4_t color = __object_colors[slot];
+        GLubyte rgba[4] = {
+            (GLubyte)(fminf(fmaxf(color.x, 0.0f), 1.0f) * 255.0f + 0.5f),
+            (GLubyte)(fminf(fmaxf(color.y, 0.0f), 1.0f) * 255.0f + 0.5f),
+            (GLubyte)(fminf(fmaxf(color.z, 0.0f), 1.0f) * 255.0f + 0.5f),
+            255,
+        };
+
+        for (GLsizei v = 0; v < mesh->num_vertices; ++v)
+        {
+            __static_vertex_t * out = &__static_vertices[vertex + v];
+            const GLfloat * p = &mesh->vertices[v * 3], * n = &mesh->normals[v * 3];
+            vec3_t world = mat4_mul_point(m, vec3_make(p[0], p[1], p[2]));
+            vec3_t normal = vec3_normalize(vec3_scale(vec3_add(vec3_add(vec3_scale(n0, n[0]), vec3_scale(n1, n[1])),
+                                vec3_scale(n2, n[2])), sign));
+
+            out->position[0] = world.x;
+            out->position[1] = world.y;
+            out->position[2] = world.z;
+            out->normal[0] = normal.x;
+            out->normal[1] = normal.y;
+            out->normal[2] = normal.z;
+            memcpy(out->color, rgba, sizeof(rgba));
+        }
+
+        for (GLsizei i = 0; i < mesh->num_indices; ++i)
+        {
+            GLuint source = mesh->index_type == GL_UNSIGNED_SHORT ? ((const GLushort *)mesh->indices)[i] : ((const GLuint *)mesh->indices)[i];
+            __static_indices[index + i] = vertex + source;
+        }
+
+        vertex += mesh->num_vertices;
+        index += mesh->num_indices;
+    }
+
+    cluster->num_indices = num_indices;
+    __static_upload(cluster, num_vertices);
+}
+
+static void __static_upload(__static_cluster_t * cluster, unsigned int num_vertices)
+{
+    GLsizeiptr gpu_bytes = num_vertices * sizeof(__static_vertex_t) + cluster->num_indices * sizeof(GLuint);
+
+    __stats_def_gpu_bytes += gpu_bytes - cluster->gpu_bytes;
+    cluster->gpu_bytes = gpu_bytes;
+
+    // an emptied cluster keeps its key, so the cell can fill up again, but not its buffers
+    if (cluster->num_indices == 0)
+    {
+        if (cluster->array) glDeleteVertexArrays(1, &cluster->array);
+        if (cluster->buffers[0]) glDeleteBuffers(2, cluster->buffers);
+        cluster->array = 0;
+        cluster->buffers[0] = cluster->buffers[1] = 0;
+        return;
+    }
+
+    if (!cluster->buffers[0]) glGenBuffers(2, cluster->buffers);
+
+    if (__backend == render_backend_core)
+    {
+        if (!cluster->array)
+        {
+            glGenVertexArrays(1, &cluster->array);
+            __bind_vertex_array(cluster->array);
+            __bind_buffer(GL_ARRAY_BUFFER, cluster->buffers[0]);
+            glEnableVertexAttribArray(CORE_ATTRIB_POSITION);
+            glVertexAttribPointer(CORE_ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(__static_vertex_t),
+                    (const GLvoid *)offsetof(__static_vertex_t, position));
+            glEnableVertexAttribArray(CORE_ATTRIB_NORMAL);
+            glVertexAttribPointer(CORE_ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(__static_vertex_t),
+                    (const GLvoid *)offsetof(__static_vertex_t, normal));
+            glEnableVertexAttribArray(STATIC_ATTRIB_COLOR);
+            glVertexAttribPointer(STATIC_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(__static_vertex_t),
+                    (const GLvoid *)offsetof(__static_vertex_t, color));
+        }
+        else
+        {
+            __bind_vertex_array(cluster->array);
+        }
+    }
+
+    __bind_buffer(GL_ARRAY_BUFFER, cluster->buffers[0]);
+    __buffer_data(GL_ARRAY_BUFFER, num_vertices * sizeof(__static_vertex_t), __static_vertices, GL_STATIC_DRAW);
+    // the element buffer binding is part of the vertex array
+    __bind_buffer(GL_ELEMENT_ARRAY_BUFFER, cluster->buffers[1]);
+    __buffer_data(GL_ELEMENT_ARRAY_BUFFER, cluster->num_indices * sizeof(GLuint), __static_indices, GL_STATIC_DRAW);
+
+    if (__backend == render_backend_core) __bind_vertex_array(0);
+    else __bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    __bind_buffer(GL_ARRAY_BUFFER, 0);
+}
+
+// clusters are drawn whole, once, when any member survived culling
+static void __static_mark_visible(__static_cluster_t * cluster)
+{
+    if (cluster->drawn_frame == __static_frame || cluster->num_indices == 0) return;
+    if (__static_visible_len == __static_visible_capacity) return;
+
+    cluster->drawn_frame = __static_frame;
+    __static_visible[__static_visible_len++] = cluster;
+}
+
+// opaque, so before the render queue; expects the state render_objects sets up for the queue
+static void __static_draw(void)
+{
+    render_stats_t * stats = __stats_thread();
+    GLenum last_mode = 0;
+
+    if (__static_visible_len == 0) return;
+
+    __queue_set_pass(__pass_opaque);
+
+    if (__backend == render_backend_core)
+    {
+        __use_program(__static_program);
+    }
+    else
+    {
+        glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+        glEnableClientState(GL_COLOR_ARRAY);
+    }
+
+    for (unsigned int idx = 0; idx < __static_visible_len; ++idx)
+    {
+        __static_cluster_t * cluster = __static_visible[idx];
+
+        if (cluster->polygon_mode != last_mode)
+        {
+            last_mode = cluster->polygon_mode;
+            __polygon_mode(last_mode);
+        }
+
+        if (__backend == render_backend_core)
+        {
+            __bind_vertex_array(cluster->array);
+        }
+        else
+        {
+            __bind_buffer(GL_ARRAY_BUFFER, cluster->buffers[0]);
+            glVertexPointer(3, GL_FLOAT, sizeof(__static_vertex_t), (const GLvoid *)offsetof(__static_vertex_t, position));
+            glNormalPointer(GL_FLOAT, sizeof(__static_vertex_t), (const GLvoid *)offsetof(__static_vertex_t, normal));
+            glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(__static_vertex_t), (const GLvoid *)offsetof(__static_vertex_t, color));
+            __bind_buffer(GL_ELEMENT_ARRAY_BUFFER, cluster->buffers[1]);
+        }
+
+        glDrawElements(GL_TRIANGLES, cluster->num_indices, GL_UNSIGNED_INT, NULL);
+        __count_draw(stats, cluster->num_indices, 1);
+        stats->objects_submitted += cluster->num_members;
+    }
+
+    if (__backend == render_backend_core)
+    {
+        __bind_vertex_array(0);
+        __use_program(__core_program);
+    }
+    else
+    {
+        // the queue draws from client memory
+        __bind_buffer(GL_ARRAY_BUFFER, 0);
+        __bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glDisableClientState(GL_COLOR_ARRAY);
+    }
+}
+
+static void __static_free_all(void)
+{
+    for (unsigned int idx = 0; idx < __static_clusters.len; ++idx)
+    {
+        __static_cluster_t * cluster = array_get(&__static_clusters, idx);
+
+        if (cluster->array) glDeleteVertexArrays(1, &cluster->array);
+        if (cluster->buffers[0]) glDeleteBuffers(2, cluster->buffers);
+        __stats_def_gpu_bytes -= cluster->gpu_bytes;
+        free(cluster->members);
+        free(cluster);
+    }
+
+    hash_destroy(&__static_table);
+    array_destroy(&__static_clusters);
+    if (__static_program) shader_destroy_program(__static_program);
+    __static_program = 0;
+
+    free(__static_visible);
+    free(__static_vertices);
+    free(__static_indices);
+    __static_visible = NULL;
+    __static_vertices = NULL;
+    __static_indices = NULL;
+    __static_visible_len = __static_visible_capacity = 0;
+    __static_vertices_capacity = __static_indices_capacity = 0;
+}
+
+static render_stats_t * __stats_thread(void)
+{
+    unsigned int slot = 0;
+
+    if (__stats_local) return __stats_local;
+
+    slot = __atomic_fetch_add(&__stats_num_slots, 1, __ATOMIC_RELAXED);
+    if (slot < STATS_MAX_THREADS)
+    {
+        __stats_local = &__stats_slots[slot].stats;
+    }
+    else
+    {
+        if (slot == STATS_MAX_THREADS) LOG_ERROR("more than %d threads are counting render stats, dropping the rest\n", STATS_MAX_THREADS);
+        __stats_local = &__stats_dropped;
+    }
+
+    return __stats_local;
+}
+
+static void __stats_sum(render_stats_t * total)
+{
+    unsigned int num_slots = __atomic_load_n(&__stats_num_slots, __ATOMIC_ACQUIRE);
+
+    memset(total, 0, sizeof(render_stats_t));
+    for (unsigned int idx = 0; idx < num_slots && idx < STATS_MAX_THREADS; ++idx) __stats_add(total, &__stats_slots[idx].stats);
+
+    total->def_gpu_bytes = __stats_def_gpu_bytes;
+    if (__indirect_supported)
+    {
+        total->def_gpu_bytes += __indirect_vertex_capacity * INDIRECT_VERTEX_FLOATS * sizeof(GLfloat)
+            + __indirect_index_capacity * sizeof(GLuint);
+    }
+}
+
+static void __stats_add(render_stats_t * total, const render_stats_t * stats)
+{
+    total->objects_submitted += stats->objects_submitted;
+    total->objects_culled += stats->objects_culled;
+    total->objects_occluded += stats->objects_occluded;
+    // only the thread calling render_objects sets it
+    if (stats->occluded_percent > total->occluded_percent) total->occluded_percent = stats->occluded_percent;
+    total->draw_calls += stats->draw_calls;
+    total->indirect_draws += stats->indirect_draws;
+    total->vertices_submitted += stats->vertices_submitted;
+    total->primitives_submitted += stats->primitives_submitted;
+    total->state_changes += stats->state_changes;
+    total->polygon_mode_changes += stats->polygon_mode_changes;
+    total->attrib_stack_ops += stats->attrib_stack_ops;
+    total->buffer_binds += stats->buffer_binds;
+    total->bytes_uploaded += stats->bytes_uploaded;
+}
+
+// one draw of count indices per instance, as triangles
+static void __count_draw(render_stats_t * stats, GLsizei count, GLsizei instances)
+{
+    ++stats->draw_calls;
+    stats->vertices_submitted += (unsigned long)count * instances;
+    stats->primitives_submitted += (unsigned long)(count / 3) * instances;
+}
+
+static void __bind_buffer(GLenum target, GLuint buffer)
+{
+    render_stats_t * stats = __stats_thread();
+
+    glBindBuffer(target, buffer);
+    ++stats->buffer_binds;
+    ++stats->state_changes;
+}
+
+static void __bind_buffer_base(GLenum target, GLuint index, GLuint buffer)
+{
+    render_stats_t * stats = __stats_thread();
+
+    glBindBufferBase(target, index, buffer);
+    ++stats->buffer_binds;
+    ++stats->state_changes;
+}
+
+static void __bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    render_stats_t * stats = __stats_thread();
+
+    glBindBufferRange(target, index, buffer, offset, size);
+    ++stats->buffer_binds;
+    ++stats->state_changes;
+}
+
+// store allocated without data is not counted as uploaded
+static void __buffer_data(GLenum target, GLsizeiptr size, const GLvoid * data, GLenum usage)
+{
+    glBufferData(target, size, data, usage);
+    if (data) __stats_thread()->bytes_uploaded += size;
+}
+
+static void __buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid * data)
+{
+    glBufferSubData(target, offset, size, data);
+    __stats_thread()->bytes_uploaded += size;
+}
+
+static void __bind_vertex_array(GLuint array)
+{
+    glBindVertexArray(array);
+    ++__stats_thread()->state_changes;
+}
+
+static void __use_program(GLuint program)
+{
+    glUseProgram(program);
+    ++__stats_thread()->state_changes;
+}
+
+static void __polygon_mode(GLenum mode)
+{
+    render_stats_t * stats = __stats_thread();
+
+    glPolygonMode(GL_FRONT_AND_BACK, mode);
+    ++stats->polygon_mode_changes;
+    ++stats->state_changes;
+}
+
+static void __push_attrib(GLbitfield mask)
+{
+    render_stats_t * stats = __stats_thread();
+
+    glPushAttrib(mask);
+    ++stats->attrib_stack_ops;
+    ++stats->state_changes;
+}
+
+static void __pop_attrib(void)
+{
+    render_stats_t * stats = __stats_thread();
+
+    glPopAttrib();
+    ++stats->attrib_stack_ops;
+    ++stats->state_changes;
 }
@@ -0,0 +1,103 @@
+#include "logging.h"
+
+#include "shader.h"
+
+status_e shader_compile(GLenum type, const char * source, GLuint * shader)
+{
+    GLint compiled = GL_FALSE;
+    GLchar info_log[1024];
+
+    if (!source || !shader)
+    {
+        LOG_ERROR("source or shader is NULL! (source = %p, shader = %p)\n", source, shader);
+        return status_error;
+    }
+
+    if (!(*shader = glCreateShader(type)))
+    {
+        LOG_ERROR("failed to create shader of type 0x%x\n", type);
+        return status_error;
+    }
+
+    glShaderSource(*shader, 1, &source, NULL);
+    glCompileShader(*shader);
+    glGetShaderiv(*shader, GL_COMPILE_STATUS, &compiled);
+    if (compiled != GL_TRUE)
+    {
+        glGetShaderInfoLog(*shader, sizeof(info_log), NULL, info_log);
+        LOG_ERROR("failed to compile shader of type 0x%x:\n%s\n", type, info_log);
+        glDeleteShader(*shader);
+        *shader = 0;
+        return status_error;
+    }
+
+    return status_success;
+}
+
+status_e shader_create_program(const char * vertex_source, const char * fragment_source,
+        const shader_attrib_t * attribs, unsigned int num_attribs, GLuint * program)
+{
+    GLuint vertex_shader = 0, fragment_shader = 0;
+    GLint linked = GL_FALSE;
+    GLchar info_log[1024];
+    unsigned int idx = 0;
+
+    if (!program)
+    {
+        LOG_ERROR("program is NULL!\n");
+        return status_error;
+    }
+
+    *program = 0;
+
+    if (shader_compile(GL_VERTEX_SHADER, vertex_source, &vertex_shader) != status_success) return status_error;
+
+    if (shader_compile(GL_FRAGMENT_SHADER, fragment_source, &fragment_shader) != status_success)
+    {
+        glDeleteShader(vertex_shader);
+        return status_error;
+    }
+
+    *program = glCreateProgram();
+    glAttachShader(*program, vertex_shader);
+    glAttachShader(*program, fragment_shader);
+
+    // attribute locations must be bound before linking
+    for (idx = 0; attribs && idx < num_attribs; ++idx)
+    {
+        glBindAttribLocation(*program, attribs[idx].location, attribs[idx].name);
+    }
+
+    glLinkProgram(*program);
+
+    // the program keeps the compiled stages alive for as long as it needs them
+    glDetachShader(*program, vertex_shader);
+    glDetachShader(*program, fragment_shader);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    glGetProgramiv(*program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+        glGetProgramInfoLog(*program, sizeof(info_log), NULL, info_log);
+        LOG_ERROR("failed to link program:\n%s\n", info_log);
+        glDeleteProgram(*program);
+        *program = 0;
+        return status_error;
+    }
+
+    return status_success;
+}
+
+status_e shader_destroy_program(GLuint program)
+{
+    if (!program)
+    {
+        LOG_ERROR("program is 0!\n");
+        return status_error;
+    }
+
+    glDeleteProgram(program);
+
+    return status_success;
+}
@@ -0,0 +1,708 @@
+#include <math.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "simplify.h"
+
+// collapses happen in passes: each pass takes every edge cheaper than a
+// threshold that grows with the pass number, so cheap edges all over the mesh
+// go before expensive ones without keeping a priority queue up to date.
+// adjacency is rebuilt every few passes. positions are normalized to a unit
+// box first so the thresholds mean the same thing for any model size.
+#define MAX_PASSES 100
+#define REBUILD_INTERVAL 5
+#define AGGRESSIVENESS 7.0
+#define FLIP_DOT 0.2
+#define CREASE_COS 0.5f         // edges sharper than 60 degrees keep separate normals
+
+typedef struct
+{
+    double p[3];
+    double q[10];               // symmetric 4x4 quadric, upper triangle row by row
+    unsigned int tstart;        // first entry in refs
+    unsigned int tcount;
+    int border;
+} __vertex_t;
+
+typedef struct
+{
+    unsigned int v[3];
+    double err[4];              // per edge, then the cheapest of the three
+    double n[3];
+    int deleted;
+    int dirty;                  // touched this pass, its errors are stale
+} __triangle_t;
+
+typedef struct
+{
+    unsigned int tid;
+    unsigned int tvertex;
+} __ref_t;
+
+typedef struct
+{
+    __vertex_t * vertices;
+    unsigned int num_vertices;
+    __triangle_t * triangles;
+    unsigned int num_triangles;
+    __ref_t * refs;
+    unsigned int num_refs;
+    unsigned int refs_capacity;
+    unsigned char * deleted0;
+    unsigned char * deleted1;
+    unsigned int deleted_capacity;
+} __mesh_t;
+
+typedef struct
+{
+    GLfloat p[3];
+    unsigned int index;
+} __weld_t;
+
+static int __weld_compare(const void * a, const void * b);
+static status_e __mesh_build(__mesh_t * mesh, const GLfloat * vertices, GLsizei num_vertices, GLenum vertex_mode,
+        double center[3], double * scale);
+static void __mesh_destroy(__mesh_t * mesh);
+static status_e __mesh_update(__mesh_t * mesh, int pass);
+static status_e __mesh_push_ref(__mesh_t * mesh, __ref_t ref);
+static status_e __mesh_reserve_deleted(__mesh_t * mesh, unsigned int count);
+static double __edge_error(const __mesh_t * mesh, unsigned int v0, unsigned int v1, double p[3]);
+static int __flipped(const __mesh_t * mesh, const double p[3], unsigned int i1, const __vertex_t * v0, unsigned char * deleted);
+static status_e __update_triangles(__mesh_t * mesh, unsigned int i0, const __vertex_t * v, const unsigned char * deleted,
+        unsigned int * deleted_triangles);
+static void __quadric_plane(double q[10], const double n[3], double d);
+static double __quadric_det(const double q[10], int a11, int a12, int a13, int a21, int a22, int a23, int a31, int a32, int a33);
+static double __quadric_error(const double q[10], const double p[3]);
+static void __triangle_normal(const __mesh_t * mesh, const __triangle_t * t, double n[3], int normalize);
+
+unsigned int simplify_count_triangles(GLsizei num_vertices, GLenum vertex_mode)
+{
+    switch (vertex_mode)
+    {
+        case GL_TRIANGLES: return num_vertices / 3;
+        case GL_QUADS: return num_vertices / 4 * 2;
+        case GL_TRIANGLE_STRIP:
+        case GL_TRIANGLE_FAN: return num_vertices > 2 ? num_vertices - 2 : 0;
+        default: return 0;
+    }
+}
+
+unsigned int simplify_triangle_corner(GLsizei tri, int corner, GLenum vertex_mode)
+{
+    static const int quad_corners[2][3] = { { 0, 1, 2 }, { 0, 2, 3 } };
+
+    switch (vertex_mode)
+    {
+        case GL_QUADS: return tri / 2 * 4 + quad_corners[tri % 2][corner];
+        // odd strip triangles are wound the other way round
+        case GL_TRIANGLE_STRIP: return tri + (tri % 2 && corner < 2 ? 1 - corner : corner);
+        case GL_TRIANGLE_FAN: return corner == 0 ? 0 : tri + corner;
+        default: return tri * 3 + corner;
+    }
+}
+
+status_e simplify_mesh(const GLfloat * vertices, GLsizei num_vertices, GLenum vertex_mode, unsigned int target_triangles,
+        GLfloat ** out_vertices, GLfloat ** out_normals, GLsizei * out_num_vertices)
+{
+    __mesh_t mesh;
+    double center[3], scale = 1.0;
+    unsigned int deleted_triangles = 0, num_out = 0;
+    GLfloat * out_v = NULL, * out_n = NULL;
+    status_e status = status_success;
+
+    if (!vertices || !out_vertices || !out_normals || !out_num_vertices)
+    {
+        LOG_ERROR("vertices or an output is NULL! (vertices = %p, out_vertices = %p, out_normals = %p, out_num_vertices = %p)\n",
+                vertices, out_vertices, out_normals, out_num_vertices);
+        return status_error;
+    }
+
+    if (simplify_count_triangles(num_vertices, vertex_mode) == 0)
+    {
+        LOG_ERROR("nothing to simplify in %d vertices of mode 0x%x\n", num_vertices, vertex_mode);
+        return status_error;
+    }
+
+    memset(&mesh, 0, sizeof(mesh));
+    if ((status = __mesh_build(&mesh, vertices, num_vertices, vertex_mode, center, &scale)) != status_success)
+    {
+        __mesh_destroy(&mesh);
+        return status;
+    }
+
+    for (int pass = 0; pass < MAX_PASSES && mesh.num_triangles - deleted_triangles > target_triangles; ++pass)
+    {
+        double threshold = 1e-9 * pow(pass + 3.0, AGGRESSIVENESS);
+
+        if (pass % REBUILD_INTERVAL == 0)
+        {
+            // compacting renumbers triangles, so the running count starts over
+            if ((status = __mesh_update(&mesh, pass)) != status_success) break;
+            deleted_triangles = 0;
+        }
+
+        for (unsigned int idx = 0; idx < mesh.num_triangles; ++idx)
+        {
+            mesh.triangles[idx].dirty = 0;
+        }
+
+        for (unsigned int idx = 0; idx < mesh.num_triangles && mesh.num_triangles - deleted_triangles > target_triangles; ++idx)
+        {
+            __triangle_t * t = &mesh.triangles[idx];
+
+            if (t->deleted || t->dirty || t->err[3] > threshold) continue;
+
+            for (int edge = 0; edge < 3; ++edge)
+            {
+                unsigned int i0 = t->v[edge], i1 = t->v[(edge + 1) % 3], tstart = 0, tcount = 0;
+                __vertex_t * v0 = NULL, * v1 = NULL;
+                double p[3];
+
+                if (t->err[edge] > threshold) continue;
+
+                v0 = &mesh.vertices[i0];
+                v1 = &mesh.vertices[i1];
+
+                // a border vertex may only slide along the border
+                if (v0->border != v1->border) continue;
+
+                __edge_error(&mesh, i0, i1, p);
+
+                if ((status = __mesh_reserve_deleted(&mesh, v0->tcount > v1->tcount ? v0->tcount : v1->tcount)) != status_success) break;
+                if (__flipped(&mesh, p, i1, v0, mesh.deleted0)) continue;
+                if (__flipped(&mesh, p, i0, v1, mesh.deleted1)) continue;
+
+                memcpy(v0->p, p, sizeof(p));
+                for (int q = 0; q < 10; ++q)
+                {
+                    v0->q[q] += v1->q[q];
+                }
+
+                // the merged vertex's refs are appended, then moved back into v0's old range when they fit
+                tstart = mesh.num_refs;
+                if ((status = __update_triangles(&mesh, i0, v0, mesh.deleted0, &deleted_triangles)) != status_success) break;
+                if ((status = __update_triangles(&mesh, i0, &mesh.vertices[i1], mesh.deleted1, &deleted_triangles)) != status_success) break;
+                v0 = &mesh.vertices[i0];
+                tcount = mesh.num_refs - tstart;
+
+                if (tcount <= v0->tcount)
+                {
+                    memmove(&mesh.refs[v0->tstart], &mesh.refs[tstart], tcount * sizeof(__ref_t));
+                    mesh.num_refs = tstart;
+                }
+                else
+                {
+                    v0->tstart = tstart;
+                }
+                v0->tcount = tcount;
+                break;
+            }
+
+            if (status != status_success) break;
+        }
+
+        if (status != status_success) break;
+    }
+
+    // compact once more so refs describe the final triangles for the normals
+    if (status == status_success) status = __mesh_update(&mesh, -1);
+
+    if (status == status_success)
+    {
+        out_v = malloc(mesh.num_triangles * 9 * sizeof(GLfloat));
+        out_n = malloc(mesh.num_triangles * 9 * sizeof(GLfloat));
+        if (!out_v || !out_n)
+        {
+            LOG_ERROR("failed to allocate memory for %u simplified triangles\n", mesh.num_triangles);
+            status = status_error;
+        }
+    }
+
+    for (unsigned int idx = 0; status == status_success && idx < mesh.num_triangles; ++idx)
+    {
+        const __triangle_t * t = &mesh.triangles[idx];
+
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            const __vertex_t * v = &mesh.vertices[t->v[corner]];
+            double n[3] = { 0.0, 0.0, 0.0 }, len = 0.0;
+
+            // area-weighted average of the faces around the corner that are not across a crease
+            for (unsigned int k = 0; k < v->tcount; ++k)
+            {
+                const __triangle_t * other = &mesh.triangles[mesh.refs[v->tstart + k].tid];
+                double weighted[3];
+
+                if (t->n[0] * other->n[0] + t->n[1] * other->n[1] + t->n[2] * other->n[2] < CREASE_COS) continue;
+
+                __triangle_normal(&mesh, other, weighted, 0);
+                n[0] += weighted[0];
+                n[1] += weighted[1];
+                n[2] += weighted[2];
+            }
+
+            len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (len <= 0.0)
+            {
+                memcpy(n, t->n, sizeof(n));
+                len = 1.0;
+            }
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                out_v[num_out * 3 + axis] = (GLfloat)(v->p[axis] / scale + center[axis]);
+                out_n[num_out * 3 + axis] = (GLfloat)(n[axis] / len);
+            }
+            ++num_out;
+        }
+    }
+
+    __mesh_destroy(&mesh);
+
+    if (status != status_success)
+    {
+        free(out_v);
+        free(out_n);
+        return status;
+    }
+
+    LOG_DEBUG("simplified %u triangles to %u (target %u)\n", simplify_count_triangles(num_vertices, vertex_mode),
+            num_out / 3, target_triangles);
+
+    *out_vertices = out_v;
+    *out_normals = out_n;
+    *out_num_vertices = num_out;
+
+    return status_success;
+}
+
+static int __weld_compare(const void * a, const void * b)
+{
+    const __weld_t * wa = a, * wb = b;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (wa->p[axis] < wb->p[axis]) return -1;
+        if (wa->p[axis] > wb->p[axis]) return 1;
+    }
+
+    return 0;
+}
+
+static status_e __mesh_build(__mesh_t * mesh, const GLfloat * vertices, GLsizei num_vertices, GLenum vertex_mode,
+        double center[3], double * scale)
+{
+    unsigned int num_triangles = simplify_count_triangles(num_vertices, vertex_mode), * remap = NULL;
+    __weld_t * weld = NULL;
+    GLfloat min[3], max[3];
+    double extent = 0.0;
+
+    weld = malloc(num_vertices * sizeof(__weld_t));
+    remap = malloc(num_vertices * sizeof(unsigned int));
+    mesh->vertices = calloc(num_vertices, sizeof(__vertex_t));
+    mesh->triangles = calloc(num_triangles, sizeof(__triangle_t));
+    if (!weld || !remap || !mesh->vertices || !mesh->triangles)
+    {
+        LOG_ERROR("failed to allocate memory to simplify %d vertices\n", num_vertices);
+        free(weld);
+        free(remap);
+        return status_error;
+    }
+
+    // weld by sorting: the input repeats positions once per face that uses them
+    for (GLsizei idx = 0; idx < num_vertices; ++idx)
+    {
+        memcpy(weld[idx].p, vertices + idx * 3, sizeof(weld[idx].p));
+        weld[idx].index = idx;
+    }
+    qsort(weld, num_vertices, sizeof(__weld_t), __weld_compare);
+
+    memcpy(min, weld[0].p, sizeof(min));
+    memcpy(max, weld[0].p, sizeof(max));
+    for (GLsizei idx = 0; idx < num_vertices; ++idx)
+    {
+        if (idx == 0 || __weld_compare(&weld[idx - 1], &weld[idx]) != 0)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                mesh->vertices[mesh->num_vertices].p[axis] = weld[idx].p[axis];
+                if (weld[idx].p[axis] < min[axis]) min[axis] = weld[idx].p[axis];
+                if (weld[idx].p[axis] > max[axis]) max[axis] = weld[idx].p[axis];
+            }
+            ++mesh->num_vertices;
+        }
+        remap[weld[idx].index] = mesh->num_vertices - 1;
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        center[axis] = 0.5 * (min[axis] + max[axis]);
+        if (max[axis] - min[axis] > extent) extent = max[axis] - min[axis];
+    }
+    *scale = extent > 0.0 ? 1.0 / extent : 1.0;
+
+    for (unsigned int idx = 0; idx < mesh->num_vertices; ++idx)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            mesh->vertices[idx].p[axis] = (mesh->vertices[idx].p[axis] - center[axis]) * *scale;
+        }
+    }
+
+    for (unsigned int idx = 0; idx < num_triangles; ++idx)
+    {
+        __triangle_t * t = &mesh->triangles[mesh->num_triangles];
+
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            t->v[corner] = remap[simplify_triangle_corner(idx, corner, vertex_mode)];
+        }
+
+        // welding can make triangles degenerate
+        if (t->v[0] != t->v[1] && t->v[1] != t->v[2] && t->v[2] != t->v[0]) ++mesh->num_triangles;
+    }
+
+    free(weld);
+    free(remap);
+
+    return status_success;
+}
+
+static void __mesh_destroy(__mesh_t * mesh)
+{
+    free(mesh->vertices);
+    free(mesh->triangles);
+    free(mesh->refs);
+    free(mesh->deleted0);
+    free(mesh->deleted1);
+    memset(mesh, 0, sizeof(__mesh_t));
+}
+
+static status_e __mesh_update(__mesh_t * mesh, int pass)
+{
+    unsigned int dst = 0, tstart = 0;
+    status_e status = status_success;
+
+    for (unsigned int idx = 0; idx < mesh->num_triangles; ++idx)
+    {
+        if (!mesh->triangles[idx].deleted) mesh->triangles[dst++] = mesh->triangles[idx];
+    }
+    mesh->num_triangles = dst;
+
+    for (unsigned int idx = 0; idx < mesh->num_triangles; ++idx)
+    {
+        __triangle_normal(mesh, &mesh->triangles[idx], mesh->triangles[idx].n, 1);
+    }
+
+    // every vertex starts out with the summed planes of the faces around it
+    if (pass == 0)
+    {
+        for (unsigned int idx = 0; idx < mesh->num_triangles; ++idx)
+        {
+            __triangle_t * t = &mesh->triangles[idx];
+            const double * p = mesh->vertices[t->v[0]].p;
+            double d = -(t->n[0] * p[0] + t->n[1] * p[1] + t->n[2] * p[2]);
+
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                __quadric_plane(mesh->vertices[t->v[corner]].q, t->n, d);
+            }
+        }
+    }
+
+    // triangle lists per vertex, laid out back to back in refs
+    for (unsigned int idx = 0; idx < mesh->num_vertices; ++idx)
+    {
+        mesh->vertices[idx].tcount = 0;
+    }
+    for (unsigned int idx = 0; idx < mesh->num_triangles; ++idx)
+    {
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            ++mesh->vertices[mesh->triangles[idx].v[corner]].tcount;
+        }
+    }
+    for (unsigned int idx = 0; idx < mesh->num_vertices; ++idx)
+    {
+        mesh->vertices[idx].tstart = tstart;
+        tstart += mesh->vertices[idx].tcount;
+        mesh->vertices[idx].tcount = 0;
+    }
+
+    mesh->num_refs = 0;
+    for (unsigned int idx = 0; idx < tstart; ++idx)
+    {
+        __ref_t empty = { 0, 0 };
+        if ((status = __mesh_push_ref(mesh, empty)) != status_success) return status;
+    }
+    for (unsigned int idx = 0; idx < mesh->num_triangles; ++idx)
+    {
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            __vertex_t * v = &mesh->vertices[mesh->triangles[idx].v[corner]];
+            mesh->refs[v->tstart + v->tcount].tid = idx;
+            mesh->refs[v->tstart + v->tcount].tvertex = corner;
+            ++v->tcount;
+        }
+    }
+
+    if (pass != 0) return status_success;
+
+    // a vertex is on the border when one of its neighbours is shared by a single triangle around it
+    for (unsigned int idx = 0; idx < mesh->num_vertices; ++idx)
+    {
+        __vertex_t * v = &mesh->vertices[idx];
+
+        for (unsigned int j = 0; j < v->tcount && !v->border; ++j)
+        {
+            const __triangle_t * t = &mesh->triangles[mesh->refs[v->tstart + j].tid];
+
+            for (int corner = 0; corner < 3 && !v->border; ++corner)
+            {
+                unsigned int neighbour = t->v[corner], uses = 0;
+
+                if (neighbour == idx) continue;
+
+                for (unsigned int k = 0; k < v->tcount; ++k)
+                {
+                    const __triangle_t * other = &mesh->triangles[mesh->refs[v->tstart + k].tid];
+                    uses += other->v[0] == neighbour || other->v[1] == neighbour || other->v[2] == neighbour;
+                }
+
+                if (uses == 1)
+                {
+                    v->border = 1;
+                    mesh->vertices[neighbour].border = 1;
+                }
+            }
+        }
+    }
+
+    for (unsigned int idx = 0; idx < mesh->num_triangles; ++idx)
+    {
+        __triangle_t * t = &mesh->triangles[idx];
+        double p[3];
+
+        for (int edge = 0; edge < 3; ++edge)
+        {
+            t->err[edge] = __edge_error(mesh, t->v[edge], t->v[(edge + 1) % 3], p);
+        }
+        t->err[3] = fmin(t->err[0], fmin(t->err[1], t->err[2]));
+    }
+
+    return status_success;
+}
+
+static status_e __mesh_push_ref(__mesh_t * mesh, __ref_t ref)
+{
+    if (mesh->num_refs == mesh->refs_capacity)
+    {
+        unsigned int capacity = mesh->refs_capacity ? mesh->refs_capacity * 2 : 256;
+        __ref_t * refs = realloc(mesh->refs, capacity * sizeof(__ref_t));
+
+        if (!refs)
+        {
+            LOG_ERROR("failed to grow triangle references to %u\n", capacity);
+            return status_error;
+        }
+
+        mesh->refs = refs;
+        mesh->refs_capacity = capacity;
+    }
+
+    mesh->refs[mesh->num_refs++] = ref;
+
+    return status_success;
+}
+
+static status_e __mesh_reserve_deleted(__mesh_t * mesh, unsigned int count)
+{
+    unsigned char * deleted0 = NULL, * deleted1 = NULL;
+
+    if (count <= mesh->deleted_capacity) return status_success;
+
+    deleted0 = realloc(mesh->deleted0, count * 2);
+    if (deleted0) mesh->deleted0 = deleted0;
+    deleted1 = realloc(mesh->deleted1, count * 2);
+    if (deleted1) mesh->deleted1 = deleted1;
+
+    if (!deleted0 || !deleted1)
+    {
+        LOG_ERROR("failed to allocate memory for %u triangle flags\n", count * 2);
+        return status_error;
+    }
+
+    mesh->deleted_capacity = count * 2;
+
+    return status_success;
+}
+
+static double __edge_error(const __mesh_t * mesh, unsigned int v0, unsigned int v1, double p[3])
+{
+    const __vertex_t * a = &mesh->vertices[v0], * b = &mesh->vertices[v1];
+    double q[10], det = 0.0, error = 0.0;
+    double mid[3] = { 0.5 * (a->p[0] + b->p[0]), 0.5 * (a->p[1] + b->p[1]), 0.5 * (a->p[2] + b->p[2]) };
+    double edge_sq = 0.0, offset_sq = 0.0;
+
+    for (int idx = 0; idx < 10; ++idx)
+    {
+        q[idx] = a->q[idx] + b->q[idx];
+    }
+
+    // the optimal position solves the quadric's 3x3 system. a nearly singular system (flat or
+    // cylindrical neighbourhoods) can put it far away from the edge, so it is only trusted near it.
+    det = __quadric_det(q, 0, 1, 2, 1, 4, 5, 2, 5, 7);
+    if (det != 0.0 && !(a->border && b->border))
+    {
+        p[0] = -1.0 / det * __quadric_det(q, 1, 2, 3, 4, 5, 6, 5, 7, 8);
+        p[1] = 1.0 / det * __quadric_det(q, 0, 2, 3, 1, 5, 6, 2, 7, 8);
+        p[2] = -1.0 / det * __quadric_det(q, 0, 1, 3, 1, 4, 6, 2, 5, 8);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            edge_sq += (a->p[axis] - b->p[axis]) * (a->p[axis] - b->p[axis]);
+            offset_sq += (p[axis] - mid[axis]) * (p[axis] - mid[axis]);
+        }
+
+        if (offset_sq <= edge_sq) return __quadric_error(q, p);
+    }
+
+    {
+        double error_a = __quadric_error(q, a->p), error_b = __quadric_error(q, b->p), error_mid = __quadric_error(q, mid);
+
+        error = fmin(error_a, fmin(error_b, error_mid));
+        if (error == error_a) memcpy(p, a->p, sizeof(mid));
+        else if (error == error_b) memcpy(p, b->p, sizeof(mid));
+        else memcpy(p, mid, sizeof(mid));
+    }
+
+    return error;
+}
+
+static int __flipped(const __mesh_t * mesh, const double p[3], unsigned int i1, const __vertex_t * v0, unsigned char * deleted)
+{
+    // moving v0 to p must not turn any of its other triangles over or squash them flat
+    for (unsigned int k = 0; k < v0->tcount; ++k)
+    {
+        const __ref_t * ref = &mesh->refs[v0->tstart + k];
+        const __triangle_t * t = &mesh->triangles[ref->tid];
+        unsigned int id1 = t->v[(ref->tvertex + 1) % 3], id2 = t->v[(ref->tvertex + 2) % 3];
+        double d1[3], d2[3], n[3], len1 = 0.0, len2 = 0.0, len = 0.0;
+
+        if (t->deleted) continue;
+
+        // triangles sharing the collapsed edge disappear with it
+        if (id1 == i1 || id2 == i1)
+        {
+            deleted[k] = 1;
+            continue;
+        }
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            d1[axis] = mesh->vertices[id1].p[axis] - p[axis];
+            d2[axis] = mesh->vertices[id2].p[axis] - p[axis];
+        }
+        len1 = sqrt(d1[0] * d1[0] + d1[1] * d1[1] + d1[2] * d1[2]);
+        len2 = sqrt(d2[0] * d2[0] + d2[1] * d2[1] + d2[2] * d2[2]);
+        if (len1 <= 0.0 || len2 <= 0.0) return 1;
+        if (fabs(d1[0] * d2[0] + d1[1] * d2[1] + d1[2] * d2[2]) / (len1 * len2) > 0.999) return 1;
+
+        n[0] = d1[1] * d2[2] - d1[2] * d2[1];
+        n[1] = d1[2] * d2[0] - d1[0] * d2[2];
+        n[2] = d1[0] * d2[1] - d1[1] * d2[0];
+        len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        deleted[k] = 0;
+        if ((n[0] * t->n[0] + n[1] * t->n[1] + n[2] * t->n[2]) / len < FLIP_DOT) return 1;
+    }
+
+    return 0;
+}
+
+static status_e __update_triangles(__mesh_t * mesh, unsigned int i0, const __vertex_t * v, const unsigned char * deleted,
+        unsigned int * deleted_triangles)
+{
+    // v may point into mesh->vertices, and pushing refs never moves vertices, only refs
+    unsigned int tstart = v->tstart, tcount = v->tcount;
+    status_e status = status_success;
+    double p[3];
+
+    for (unsigned int k = 0; k < tcount; ++k)
+    {
+        __ref_t ref = mesh->refs[tstart + k];
+        __triangle_t * t = &mesh->triangles[ref.tid];
+
+        if (t->deleted) continue;
+
+        if (deleted[k])
+        {
+            t->deleted = 1;
+            ++*deleted_triangles;
+            continue;
+        }
+
+        t->v[ref.tvertex] = i0;
+        t->dirty = 1;
+        for (int edge = 0; edge < 3; ++edge)
+        {
+            t->err[edge] = __edge_error(mesh, t->v[edge], t->v[(edge + 1) % 3], p);
+        }
+        t->err[3] = fmin(t->err[0], fmin(t->err[1], t->err[2]));
+
+        if ((status = __mesh_push_ref(mesh, ref)) != status_success) return status;
+    }
+
+    return status_success;
+}
+
+static void __quadric_plane(double q[10], const double n[3], double d)
+{
+    q[0] += n[0] * n[0];
+    q[1] += n[0] * n[1];
+    q[2] += n[0] * n[2];
+    q[3] += n[0] * d;
+    q[4] += n[1] * n[1];
+    q[5] += n[1] * n[2];
+    q[6] += n[1] * d;
+    q[7] += n[2] * n[2];
+    q[8] += n[2] * d;
+    q[9] += d * d;
+}
+
+static double __quadric_det(const double q[10], int a11, int a12, int a13, int a21, int a22, int a23, int a31, int a32, int a33)
+{
+    return q[a11] * q[a22] * q[a33] + q[a13] * q[a21] * q[a32] + q[a12] * q[a23] * q[a31]
+        - q[a13] * q[a22] * q[a31] - q[a11] * q[a23] * q[a32] - q[a12] * q[a21] * q[a33];
+}
+
+static double __quadric_error(const double q[10], const double p[3])
+{
+    double x = p[0], y = p[1], z = p[2];
+
+    return q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x + q[4] * y * y
+        + 2.0 * q[5] * y * z + 2.0 * q[6] * y + q[7] * z * z + 2.0 * q[8] * z + q[9];
+}
+
+static void __triangle_normal(const __mesh_t * mesh, const __triangle_t * t, double n[3], int normalize)
+{
+    const double * p0 = mesh->vertices[t->v[0]].p, * p1 = mesh->vertices[t->v[1]].p, * p2 = mesh->vertices[t->v[2]].p;
+    double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    double len = 0.0;
+
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+    if (!normalize) return;
+
+    len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len > 0.0)
+    {
+        n[0] /= len;
+        n[1] /= len;
+        n[2] /= len;
+    }
+}
@@ -0,0 +1,70 @@
+#include <string.h>
+
+#include "logging.h"
+
+#include "sort.h"
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+void sort_radix_u64(unsigned long long * keys, unsigned int * values,
+        unsigned long long * tmp_keys, unsigned int * tmp_values, unsigned int count)
+{
+    unsigned int histograms[RADIX_PASSES][RADIX_BUCKETS];
+    unsigned long long * src_keys = keys, * dst_keys = tmp_keys, * swap_keys = NULL;
+    unsigned int * src_values = values, * dst_values = tmp_values, * swap_values = NULL;
+    unsigned int idx = 0, pass = 0;
+
+    if (!keys || !values || !tmp_keys || !tmp_values)
+    {
+        LOG_ERROR("NULL buffer! (keys = %p, values = %p, tmp_keys = %p, tmp_values = %p)\n",
+                keys, values, tmp_keys, tmp_values);
+        return;
+    }
+
+    if (count < 2) return;
+
+    // all digit histograms come from a single read of the keys
+    memset(histograms, 0, sizeof(histograms));
+    for (idx = 0; idx < count; ++idx)
+    {
+        unsigned long long key = keys[idx];
+        for (pass = 0; pass < RADIX_PASSES; ++pass)
+        {
+            ++histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)];
+        }
+    }
+
+    for (pass = 0; pass < RADIX_PASSES; ++pass)
+    {
+        unsigned int * histogram = histograms[pass];
+        unsigned int shift = pass * RADIX_BITS, sum = 0, bucket = 0;
+
+        // a digit every key shares would only copy the data around
+        if (histogram[(src_keys[0] >> shift) & (RADIX_BUCKETS - 1)] == count) continue;
+
+        for (bucket = 0; bucket < RADIX_BUCKETS; ++bucket)
+        {
+            unsigned int bucket_count = histogram[bucket];
+            histogram[bucket] = sum;
+            sum += bucket_count;
+        }
+
+        for (idx = 0; idx < count; ++idx)
+        {
+            unsigned int dst = histogram[(src_keys[idx] >> shift) & (RADIX_BUCKETS - 1)]++;
+            dst_keys[dst] = src_keys[idx];
+            dst_values[dst] = src_values[idx];
+        }
+
+        swap_keys = src_keys; src_keys = dst_keys; dst_keys = swap_keys;
+        swap_values = src_values; src_values = dst_values; dst_values = swap_values;
+    }
+
+    if (src_keys != keys)
+    {
+        memcpy(keys, src_keys, count * sizeof(unsigned long long));
+        memcpy(values, src_values, count * sizeof(unsigned int));
+    }
+}
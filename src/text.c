@@ -0,0 +1,1050 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "hash.h"
+#include "logging.h"
+#include "render.h"
+#include "shader.h"
+
+#include "text.h"
+
+#define TEXT_ATLAS_INITIAL 256
+#define TEXT_ATLAS_MAX 2048
+#define TEXT_PADDING 1              // texels kept clear right of and below each glyph
+#define TEXT_SHELF_ROUND 4          // new shelves are this many rows taller at most than the glyph opening them
+#define TEXT_MAX_RUNS 1024          // cached runs beyond which those not drawn in a frame are dropped
+#define TEXT_ATTRIB_POSITION 0
+#define TEXT_ATTRIB_TEXCOORD 1
+#define TEXT_ATTRIB_COLOR 2
+#define TEXT_NO_SHELF (~0U)
+
+typedef struct
+{
+    GLfloat x;
+    GLfloat y;
+    GLshort u;                      // atlas texels, scaled to [0, 1] when drawn so the atlas may grow in between
+    GLshort v;
+    GLubyte color[4];
+} __vertex_t;
+
+typedef struct __glyph_s
+{
+    unsigned long key;
+    FT_UInt index;                  // in the font, for kerning
+    GLshort x;                      // atlas texels
+    GLshort y;
+    GLshort width;
+    GLshort height;
+    GLshort bearing_x;              // from the pen to the bitmap's left edge
+    GLshort bearing_y;              // from the baseline up to the bitmap's top edge
+    GLfloat advance;
+    unsigned int shelf;             // TEXT_NO_SHELF for glyphs without texels
+    struct __glyph_s * next;        // in the same shelf
+} __glyph_t;
+
+typedef struct
+{
+    unsigned int y;
+    unsigned int height;
+    unsigned int fill;              // texels taken from the left
+    unsigned long epoch;            // last batch one of its glyphs was queued in
+    __glyph_t * glyphs;
+} __shelf_t;
+
+typedef struct
+{
+    GLfloat x0;                     // from the run's top left, y down
+    GLfloat y0;
+    GLfloat x1;
+    GLfloat y1;
+    GLshort u0;
+    GLshort v0;
+    GLshort u1;
+    GLshort v1;
+    unsigned int shelf;
+} __glyph_quad_t;
+
+typedef struct
+{
+    unsigned long generation;       // atlas generation the quads' texels are valid in
+    unsigned long epoch;            // last batch the run was used in
+    text_font_t font;
+    GLfloat width;
+    GLfloat height;
+    unsigned int num_quads;
+    __glyph_quad_t * quads;
+    char * str;
+} __run_t;
+
+typedef struct
+{
+    FT_Face face;
+    GLfloat ascender;
+    GLfloat line_height;
+    int kerning;
+} __font_t;
+
+static int __initialized = 0;
+static int __prerun_done = 0;
+static render_backend_e __backend = render_backend_fixed;
+static FT_Library __library = NULL;
+static __font_t __fonts[TEXT_MAX_FONTS];
+static unsigned int __num_fonts = 0;
+static hash_t __glyphs;
+static hash_t __runs;
+// single-channel coverage, rows of __atlas_width texels. every change bumps the dirty row range,
+// which is uploaded before the next draw
+static GLubyte * __atlas = NULL;
+static unsigned int __atlas_width = 0;
+static unsigned int __atlas_height = 0;
+static unsigned int __atlas_max = TEXT_ATLAS_MAX;
+static int __atlas_resized = 0;
+static unsigned int __atlas_dirty_min = ~0U;
+static unsigned int __atlas_dirty_max = 0;
+// bumped by every eviction, so cached runs know their texels may be gone
+static unsigned long __atlas_generation = 0;
+static __shelf_t * __shelves = NULL;
+static unsigned int __num_shelves = 0;
+static unsigned int __shelves_capacity = 0;
+// bumped by every batch drawn. shelves used in the current epoch have quads queued and are never evicted.
+static unsigned long __epoch = 1;
+static unsigned long __frame_epoch = 1;
+static __vertex_t * __vertices = NULL;     // 4 per queued glyph
+static unsigned int __num_glyphs = 0;
+static unsigned int __glyph_capacity = 0;
+static GLuint __texture = 0;
+static GLuint __index_buffer = 0;
+static GLuint __vertex_buffer = 0;          // when the renderer's streaming buffer is unavailable or full
+static GLuint __vertex_array = 0;
+static GLuint __program = 0;
+static GLint __scale_loc = -1;
+static text_stats_t __stats;
+static text_stats_t __frame_stats;
+
+static const char * __vertex_source =
+    "#version 330 core\n"
+    "uniform vec4 scale;\n"         // 2 / viewport size, 1 / atlas size
+    "in vec2 position;\n"
+    "in vec2 texcoord;\n"
+    "in vec4 color;\n"
+    "out vec2 v_texcoord;\n"
+    "out vec4 v_color;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = vec4(position.x * scale.x - 1.0, 1.0 - position.y * scale.y, 0.0, 1.0);\n"
+    "    v_texcoord = texcoord * scale.zw;\n"
+    "    v_color = color;\n"
+    "}\n";
+
+static const char * __fragment_source =
+    "#version 330 core\n"
+    "uniform sampler2D atlas;\n"
+    "in vec2 v_texcoord;\n"
+    "in vec4 v_color;\n"
+    "out vec4 frag_color;\n"
+    "void main()\n"
+    "{\n"
+    "    frag_color = vec4(v_color.rgb, v_color.a * texture(atlas, v_texcoord).r);\n"
+    "}\n";
+
+static void __text_shutdown(void);
+static unsigned long __utf8_next(const char ** p);
+static unsigned long __run_key(text_font_t font, const char * str);
+static __run_t * __run_get(text_font_t font, const char * str);
+static __run_t * __run_layout(text_font_t font, const char * str);
+static void __runs_purge(void);
+static __glyph_t * __glyph_get(text_font_t font, unsigned long codepoint);
+static status_e __atlas_alloc(unsigned int width, unsigned int height, unsigned int * x, unsigned int * y, unsigned int * shelf);
+static status_e __atlas_grow(void);
+static unsigned int __atlas_evict(unsigned int height);
+static void __atlas_upload(void);
+static void __draw_queued(void);
+static void __draw_fixed(GLuint buffer, GLintptr offset, const GLint viewport[4]);
+static void __draw_core(GLuint buffer, GLintptr offset, const GLint viewport[4]);
+
+status_e text_init(void)
+{
+    if (__initialized)
+    {
+        LOG_ERROR("text already initialized\n");
+        return status_error;
+    }
+
+    atexit(__text_shutdown);
+
+    if (FT_Init_FreeType(&__library) != 0)
+    {
+        LOG_ERROR("failed to initialize FreeType\n");
+        return status_error;
+    }
+
+    if (hash_init(&__glyphs) != status_success || hash_init(&__runs) != status_success)
+    {
+        LOG_ERROR("failed to allocate memory for the glyph and run caches\n");
+        return status_error;
+    }
+
+    if (!(__atlas = calloc(TEXT_ATLAS_INITIAL * TEXT_ATLAS_INITIAL, 1)))
+    {
+        LOG_ERROR("failed to allocate memory for the glyph atlas\n");
+        return status_error;
+    }
+
+    __atlas_width = __atlas_height = TEXT_ATLAS_INITIAL;
+    __atlas_resized = 1;
+    __initialized = 1;
+
+    return status_success;
+}
+
+status_e text_prerun(void)
+{
+    GLint max_texture_size = 0;
+    GLushort * indices = NULL;
+
+    if (!__initialized)
+    {
+        LOG_ERROR("text not initialized\n");
+        return status_error;
+    }
+
+    __backend = render_get_backend();
+
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    while (__atlas_max > (unsigned int)max_texture_size && __atlas_max > TEXT_ATLAS_INITIAL) __atlas_max >>= 1;
+
+    if (__backend == render_backend_core)
+    {
+        shader_attrib_t attribs[] = {
+            { TEXT_ATTRIB_POSITION, "position" },
+            { TEXT_ATTRIB_TEXCOORD, "texcoord" },
+            { TEXT_ATTRIB_COLOR, "color" },
+        };
+
+        if (shader_create_program(__vertex_source, __fragment_source,
+                    attribs, sizeof(attribs) / sizeof(attribs[0]), &__program) != status_success)
+        {
+            LOG_ERROR("failed to create text program\n");
+            return status_error;
+        }
+
+        __scale_loc = glGetUniformLocation(__program, "scale");
+        glUseProgram(__program);
+        glUniform1i(glGetUniformLocation(__program, "atlas"), 0);
+        glUseProgram(0);
+    }
+
+    // every batch is drawn with the same quad indices, its vertex pointers moved to its first glyph
+    if (!(indices = malloc(TEXT_BATCH_GLYPHS * 6 * sizeof(GLushort))))
+    {
+        LOG_ERROR("failed to allocate memory for %d quad indices\n", TEXT_BATCH_GLYPHS);
+        return status_error;
+    }
+
+    for (unsigned int quad = 0; quad < TEXT_BATCH_GLYPHS; ++quad)
+    {
+        GLushort base = quad * 4;
+        GLushort corners[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+
+        memcpy(indices + quad * 6, corners, sizeof(corners));
+    }
+
+    if (__backend == render_backend_core)
+    {
+        // the element buffer binding is part of the vertex array
+        glGenVertexArrays(1, &__vertex_array);
+        glBindVertexArray(__vertex_array);
+        glEnableVertexAttribArray(TEXT_ATTRIB_POSITION);
+        glEnableVertexAttribArray(TEXT_ATTRIB_TEXCOORD);
+        glEnableVertexAttribArray(TEXT_ATTRIB_COLOR);
+    }
+
+    glGenBuffers(1, &__index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, __index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, TEXT_BATCH_GLYPHS * 6 * sizeof(GLushort), indices, GL_STATIC_DRAW);
+    free(indices);
+
+    if (__backend == render_backend_core) glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &__vertex_buffer);
+
+    glGenTextures(1, &__texture);
+    glBindTexture(GL_TEXTURE_2D, __texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    __atlas_resized = 1;
+    __prerun_done = 1;
+
+    return status_success;
+}
+
+status_e text_load_font(const char * path, unsigned int pixel_height, text_font_t * font)
+{
+    __font_t * f = NULL;
+
+    if (!path || !font)
+    {
+        LOG_ERROR("path or font is NULL! (path = %p, font = %p)\n", path, font);
+        return status_error;
+    }
+
+    if (!__initialized || __num_fonts == TEXT_MAX_FONTS)
+    {
+        LOG_ERROR("cannot load %s, text is not initialized or %d fonts are loaded\n", path, TEXT_MAX_FONTS);
+        return status_error;
+    }
+
+    f = &__fonts[__num_fonts];
+    if (FT_New_Face(__library, path, 0, &f->face) != 0)
+    {
+        LOG_ERROR("failed to load font %s\n", path);
+        return status_error;
+    }
+
+    if (FT_Set_Pixel_Sizes(f->face, 0, pixel_height) != 0)
+    {
+        LOG_ERROR("font %s has no %u pixel size\n", path, pixel_height);
+        FT_Done_Face(f->face);
+        f->face = NULL;
+        return status_error;
+    }
+
+    f->ascender = (GLfloat)(f->face->size->metrics.ascender >> 6);
+    f->line_height = (GLfloat)(f->face->size->metrics.height >> 6);
+    f->kerning = FT_HAS_KERNING(f->face) ? 1 : 0;
+    *font = ++__num_fonts;
+
+    LOG_DEBUG("loaded %s at %u pixels as font %u\n", path, pixel_height, *font);
+
+    return status_success;
+}
+
+status_e text_draw(text_font_t font, GLfloat x, GLfloat y, const char * str, const GLfloat color[4])
+{
+    __run_t * run = NULL;
+    __vertex_t * v = NULL;
+    GLubyte rgba[4];
+
+    if (!str || !color)
+    {
+        LOG_ERROR("str or color is NULL! (str = %p, color = %p)\n", str, color);
+        return status_error;
+    }
+
+    if (!(run = __run_get(font, str))) return status_error;
+
+    if (__num_glyphs + run->num_quads > __glyph_capacity)
+    {
+        unsigned int capacity = __glyph_capacity ? __glyph_capacity * 2 : 1024;
+        __vertex_t * vertices = NULL;
+
+        while (capacity < __num_glyphs + run->num_quads) capacity *= 2;
+        if (!(vertices = realloc(__vertices, capacity * 4 * sizeof(__vertex_t))))
+        {
+            LOG_ERROR("failed to allocate memory for %u glyphs\n", capacity);
+            return status_error;
+        }
+
+        __vertices = vertices;
+        __glyph_capacity = capacity;
+    }
+
+    for (int c = 0; c < 4; ++c)
+    {
+        GLfloat channel = color[c] < 0.0f ? 0.0f : (color[c] > 1.0f ? 1.0f : color[c]);
+        rgba[c] = (GLubyte)(channel * 255.0f + 0.5f);
+    }
+
+    v = __vertices + __num_glyphs * 4;
+    for (unsigned int idx = 0; idx < run->num_quads; ++idx, v += 4)
+    {
+        const __glyph_quad_t * q = &run->quads[idx];
+
+        __shelves[q->shelf].epoch = __epoch;
+
+        v[0].x = x + q->x0; v[0].y = y + q->y0; v[0].u = q->u0; v[0].v = q->v0;
+        v[1].x = x + q->x1; v[1].y = y + q->y0; v[1].u = q->u1; v[1].v = q->v0;
+        v[2].x = x + q->x1; v[2].y = y + q->y1; v[2].u = q->u1; v[2].v = q->v1;
+        v[3].x = x + q->x0; v[3].y = y + q->y1; v[3].u = q->u0; v[3].v = q->v1;
+        memcpy(v[0].color, rgba, 4);
+        memcpy(v[1].color, rgba, 4);
+        memcpy(v[2].color, rgba, 4);
+        memcpy(v[3].color, rgba, 4);
+    }
+
+    __num_glyphs += run->num_quads;
+
+    return status_success;
+}
+
+status_e text_measure(text_font_t font, const char * str, GLfloat * width, GLfloat * height)
+{
+    __run_t * run = NULL;
+
+    if (!str || !width || !height)
+    {
+        LOG_ERROR("str, width or height is NULL! (str = %p, width = %p, height = %p)\n", str, width, height);
+        return status_error;
+    }
+
+    if (!(run = __run_get(font, str))) return status_error;
+
+    *width = run->width;
+    *height = run->height;
+
+    return status_success;
+}
+
+void text_flush(void)
+{
+    if (!__prerun_done)
+    {
+        __num_glyphs = 0;
+        return;
+    }
+
+    __draw_queued();
+
+    if (__runs.len > TEXT_MAX_RUNS) __runs_purge();
+
+    __stats = __frame_stats;
+    memset(&__frame_stats, 0, sizeof(__frame_stats));
+    __frame_epoch = __epoch;
+}
+
+void text_get_stats(text_stats_t * stats)
+{
+    if (!stats)
+    {
+        LOG_ERROR("stats is NULL!\n");
+        return;
+    }
+
+    *stats = __stats;
+    stats->atlas_width = __atlas_width;
+    stats->atlas_height = __atlas_height;
+}
+
+static void __text_shutdown(void)
+{
+    if (!__initialized) return;
+
+    for (unsigned int idx = 0; idx < __runs.capacity; ++idx)
+    {
+        if (__runs.entries[idx].used) free(__runs.entries[idx].value);
+    }
+    for (unsigned int idx = 0; idx < __glyphs.capacity; ++idx)
+    {
+        if (__glyphs.entries[idx].used) free(__glyphs.entries[idx].value);
+    }
+    hash_destroy(&__runs);
+    hash_destroy(&__glyphs);
+
+    for (unsigned int idx = 0; idx < __num_fonts; ++idx) FT_Done_Face(__fonts[idx].face);
+    __num_fonts = 0;
+    FT_Done_FreeType(__library);
+    __library = NULL;
+
+    free(__atlas);
+    free(__shelves);
+    free(__vertices);
+    __atlas = NULL;
+    __shelves = NULL;
+    __vertices = NULL;
+    __num_shelves = __shelves_capacity = 0;
+    __num_glyphs = __glyph_capacity = 0;
+
+    __prerun_done = 0;
+    __initialized = 0;
+}
+
+// malformed sequences come out as U+FFFD, one byte at a time
+static unsigned long __utf8_next(const char ** p)
+{
+    const unsigned char * s = (const unsigned char *)*p;
+    unsigned long codepoint = 0;
+    int extra = 0;
+
+    if (s[0] < 0x80)
+    {
+        *p += 1;
+        return s[0];
+    }
+
+    if ((s[0] & 0xe0) == 0xc0) { codepoint = s[0] & 0x1f; extra = 1; }
+    else if ((s[0] & 0xf0) == 0xe0) { codepoint = s[0] & 0x0f; extra = 2; }
+    else if ((s[0] & 0xf8) == 0xf0) { codepoint = s[0] & 0x07; extra = 3; }
+    else
+    {
+        *p += 1;
+        return 0xfffd;
+    }
+
+    for (int idx = 1; idx <= extra; ++idx)
+    {
+        if ((s[idx] & 0xc0) != 0x80)
+        {
+            *p += 1;
+            return 0xfffd;
+        }
+        codepoint = (codepoint << 6) | (s[idx] & 0x3f);
+    }
+
+    *p += extra + 1;
+    return codepoint > 0x10ffff ? 0xfffd : codepoint;
+}
+
+// FNV-1a over the string, seeded with the font
+static unsigned long __run_key(text_font_t font, const char * str)
+{
+    unsigned long long h = 14695981039346656037ULL ^ font;
+
+    for (const unsigned char * s = (const unsigned char *)str; *s; ++s) h = (h ^ *s) * 1099511628211ULL;
+
+    return (unsigned long)(h ^ (h >> 32));
+}
+
+static __run_t * __run_get(text_font_t font, const char * str)
+{
+    unsigned long key = 0;
+    __run_t * run = NULL;
+
+    if (font == 0 || font > __num_fonts)
+    {
+        LOG_ERROR("invalid font %u\n", font);
+        return NULL;
+    }
+
+    key = __run_key(font, str);
+    if ((run = hash_get(&__runs, key)))
+    {
+        if (run->generation == __atlas_generation && run->font == font && strcmp(run->str, str) == 0)
+        {
+            run->epoch = __epoch;
+            return run;
+        }
+
+        // laid out before an eviction, or another string with the same key
+        hash_remove(&__runs, key);
+        free(run);
+    }
+
+    if (!(run = __run_layout(font, str))) return NULL;
+
+    if (hash_set(&__runs, key, run) != status_success)
+    {
+        LOG_ERROR("failed to cache the run of \"%s\"\n", str);
+        free(run);
+        return NULL;
+    }
+
+    return run;
+}
+
+static __run_t * __run_layout(text_font_t font, const char * str)
+{
+    const __font_t * f = &__fonts[font - 1];
+    size_t len = strlen(str);
+    __run_t * run = NULL;
+    int attempt = 0;
+
+    // at most one quad per byte, all in one block with the string after them
+    if (!(run = malloc(sizeof(__run_t) + len * sizeof(__glyph_quad_t) + len + 1)))
+    {
+        LOG_ERROR("failed to allocate memory for the run of \"%s\"\n", str);
+        return NULL;
+    }
+
+    run->quads = (__glyph_quad_t *)(run + 1);
+    run->str = (char *)(run->quads + len);
+    memcpy(run->str, str, len + 1);
+    run->font = font;
+
+    // making room for a glyph may draw the queue early, after which shelves holding this run's earlier
+    // glyphs can be evicted. starting over in the new epoch keeps them, unless the run alone overflows the atlas.
+    for (attempt = 0; attempt < 2; ++attempt)
+    {
+        unsigned long epoch = __epoch;
+        GLfloat pen_x = 0.0f, pen_y = 0.0f;
+        FT_UInt previous = 0;
+        const char * p = str;
+
+        run->num_quads = 0;
+        run->width = 0.0f;
+
+        while (*p && epoch == __epoch)
+        {
+            unsigned long codepoint = __utf8_next(&p);
+            const __glyph_t * glyph = NULL;
+
+            if (codepoint == '\n')
+            {
+                if (pen_x > run->width) run->width = pen_x;
+                pen_x = 0.0f;
+                pen_y += f->line_height;
+                previous = 0;
+                continue;
+            }
+
+            if (!(glyph = __glyph_get(font, codepoint))) continue;
+
+            if (f->kerning && previous && glyph->index)
+            {
+                FT_Vector delta;
+
+                if (FT_Get_Kerning(f->face, previous, glyph->index, FT_KERNING_DEFAULT, &delta) == 0) pen_x += delta.x >> 6;
+            }
+            previous = glyph->index;
+
+            if (glyph->shelf != TEXT_NO_SHELF)
+            {
+                __glyph_quad_t * q = &run->quads[run->num_quads++];
+
+                q->x0 = floorf(pen_x + 0.5f) + glyph->bearing_x;
+                q->y0 = pen_y + f->ascender - glyph->bearing_y;
+                q->x1 = q->x0 + glyph->width;
+                q->y1 = q->y0 + glyph->height;
+                q->u0 = glyph->x;
+                q->v0 = glyph->y;
+                q->u1 = glyph->x + glyph->width;
+                q->v1 = glyph->y + glyph->height;
+                q->shelf = glyph->shelf;
+            }
+
+            pen_x += glyph->advance;
+        }
+
+        if (epoch != __epoch) continue;
+
+        if (pen_x > run->width) run->width = pen_x;
+        run->height = pen_y + f->line_height;
+        run->generation = __atlas_generation;
+        run->epoch = __epoch;
+        ++__frame_stats.runs_laid_out;
+
+        return run;
+    }
+
+    LOG_ERROR("\"%s\" does not fit in the glyph atlas\n", str);
+    free(run);
+
+    return NULL;
+}
+
+// drops the runs not used since the last frame
+static void __runs_purge(void)
+{
+    unsigned long * keys = NULL;
+    unsigned int num_keys = 0;
+
+    if (!(keys = malloc(__runs.len * sizeof(unsigned long)))) return;
+
+    for (unsigned int idx = 0; idx < __runs.capacity; ++idx)
+    {
+        const __run_t * run = __runs.entries[idx].value;
+
+        if (__runs.entries[idx].used && run->epoch < __frame_epoch) keys[num_keys++] = __runs.entries[idx].key;
+    }
+
+    for (unsigned int idx = 0; idx < num_keys; ++idx) free(hash_remove(&__runs, keys[idx]));
+    free(keys);
+}
+
+static __glyph_t * __glyph_get(text_font_t font, unsigned long codepoint)
+{
+    unsigned long key = ((unsigned long)font << 21) | codepoint;
+    FT_Face face = __fonts[font - 1].face;
+    const FT_Bitmap * bitmap = NULL;
+    __glyph_t * glyph = NULL;
+    unsigned int x = 0, y = 0, shelf = TEXT_NO_SHELF;
+
+    if ((glyph = hash_get(&__glyphs, key)))
+    {
+        if (glyph->shelf != TEXT_NO_SHELF) __shelves[glyph->shelf].epoch = __epoch;
+        return glyph;
+    }
+
+    if (FT_Load_Char(face, codepoint, FT_LOAD_RENDER) != 0)
+    {
+        LOG_ERROR("failed to render U+%04lX of font %u\n", codepoint, font);
+        return NULL;
+    }
+
+    bitmap = &face->glyph->bitmap;
+    if (bitmap->pixel_mode != FT_PIXEL_MODE_GRAY && bitmap->pixel_mode != FT_PIXEL_MODE_MONO)
+    {
+        LOG_ERROR("U+%04lX of font %u has an unsupported pixel mode %d\n", codepoint, font, bitmap->pixel_mode);
+        return NULL;
+    }
+
+    if (bitmap->width > 0 && bitmap->rows > 0
+            && __atlas_alloc(bitmap->width + TEXT_PADDING, bitmap->rows + TEXT_PADDING, &x, &y, &shelf) != status_success)
+    {
+        return NULL;
+    }
+
+    if (!(glyph = malloc(sizeof(__glyph_t))))
+    {
+        LOG_ERROR("failed to allocate memory for a glyph\n");
+        return NULL;
+    }
+
+    glyph->key = key;
+    glyph->index = face->glyph->glyph_index;
+    glyph->x = x;
+    glyph->y = y;
+    glyph->width = bitmap->width;
+    glyph->height = bitmap->rows;
+    glyph->bearing_x = face->glyph->bitmap_left;
+    glyph->bearing_y = face->glyph->bitmap_top;
+    glyph->advance = face->glyph->advance.x / 64.0f;
+    glyph->shelf = shelf;
+    glyph->next = NULL;
+
+    if (hash_set(&__glyphs, key, glyph) != status_success)
+    {
+        LOG_ERROR("failed to cache U+%04lX of font %u\n", codepoint, font);
+        free(glyph);
+        return NULL;
+    }
+
+    if (shelf != TEXT_NO_SHELF)
+    {
+        for (unsigned int row = 0; row < bitmap->rows; ++row)
+        {
+            const unsigned char * src = bitmap->buffer + (long)row * bitmap->pitch;
+            GLubyte * dst = __atlas + (size_t)(y + row) * __atlas_width + x;
+
+            if (bitmap->pixel_mode == FT_PIXEL_MODE_GRAY)
+            {
+                memcpy(dst, src, bitmap->width);
+                continue;
+            }
+
+            for (unsigned int col = 0; col < bitmap->width; ++col) dst[col] = (src[col >> 3] & (0x80 >> (col & 7))) ? 0xff : 0;
+        }
+
+        glyph->next = __shelves[shelf].glyphs;
+        __shelves[shelf].glyphs = glyph;
+        if (y < __atlas_dirty_min) __atlas_dirty_min = y;
+        if (y + bitmap->rows > __atlas_dirty_max) __atlas_dirty_max = y + bitmap->rows;
+    }
+
+    ++__frame_stats.glyphs_rasterized;
+
+    return glyph;
+}
+
+static status_e __atlas_alloc(unsigned int width, unsigned int height, unsigned int * x, unsigned int * y, unsigned int * shelf)
+{
+    unsigned int best = TEXT_NO_SHELF, shelf_height = (height + TEXT_SHELF_ROUND - 1) & ~(TEXT_SHELF_ROUND - 1);
+    int flushed = 0;
+
+    if (width > __atlas_max || height > __atlas_max)
+    {
+        LOG_ERROR("%ux%u glyph is larger than the atlas can be\n", width, height);
+        return status_error;
+    }
+
+    while (best == TEXT_NO_SHELF)
+    {
+        unsigned int used = __num_shelves ? __shelves[__num_shelves - 1].y + __shelves[__num_shelves - 1].height : 0;
+
+        // the lowest shelf that fits without wasting more than half the glyph's height
+        for (unsigned int idx = 0; idx < __num_shelves; ++idx)
+        {
+            const __shelf_t * s = &__shelves[idx];
+
+            if (s->height < height || s->height > shelf_height + height / 2 || s->fill + width > __atlas_width) continue;
+            if (best == TEXT_NO_SHELF || s->height < __shelves[best].height) best = idx;
+        }
+        if (best != TEXT_NO_SHELF) break;
+
+        if (used + shelf_height <= __atlas_height && width <= __atlas_width)
+        {
+            if (__num_shelves == __shelves_capacity)
+            {
+                unsigned int capacity = __shelves_capacity ? __shelves_capacity * 2 : 64;
+                __shelf_t * shelves = realloc(__shelves, capacity * sizeof(__shelf_t));
+
+                if (!shelves)
+                {
+                    LOG_ERROR("failed to allocate memory for %u atlas shelves\n", capacity);
+                    return status_error;
+                }
+
+                __shelves = shelves;
+                __shelves_capacity = capacity;
+            }
+
+            best = __num_shelves++;
+            memset(&__shelves[best], 0, sizeof(__shelf_t));
+            __shelves[best].y = used;
+            __shelves[best].height = shelf_height;
+            break;
+        }
+
+        if (__atlas_grow() == status_success) continue;
+
+        if ((best = __atlas_evict(height)) != TEXT_NO_SHELF) break;
+
+        // every shelf tall enough has glyphs queued, so the queue is drawn to free them
+        if (flushed || __num_glyphs == 0)
+        {
+            LOG_ERROR("no room for a %ux%u glyph in the %ux%u atlas\n", width, height, __atlas_width, __atlas_height);
+            return status_error;
+        }
+
+        __draw_queued();
+        flushed = 1;
+    }
+
+    *x = __shelves[best].fill;
+    *y = __shelves[best].y;
+    *shelf = best;
+    __shelves[best].fill += width;
+    __shelves[best].epoch = __epoch;
+
+    return status_success;
+}
+
+// doubles both sides, keeping every glyph where it is
+static status_e __atlas_grow(void)
+{
+    unsigned int width = __atlas_width * 2, height = __atlas_height * 2;
+    GLubyte * atlas = NULL;
+
+    if (width > __atlas_max || height > __atlas_max) return status_error;
+
+    if (!(atlas = calloc((size_t)width * height, 1)))
+    {
+        LOG_ERROR("failed to allocate memory for a %ux%u glyph atlas\n", width, height);
+        return status_error;
+    }
+
+    for (unsigned int row = 0; row < __atlas_height; ++row)
+    {
+        memcpy(atlas + (size_t)row * width, __atlas + (size_t)row * __atlas_width, __atlas_width);
+    }
+
+    free(__atlas);
+    __atlas = atlas;
+    __atlas_width = width;
+    __atlas_height = height;
+    __atlas_resized = 1;
+
+    LOG_DEBUG("glyph atlas grown to %ux%u\n", width, height);
+
+    return status_success;
+}
+
+// empties the least recently used shelf at least height tall that has nothing queued
+static unsigned int __atlas_evict(unsigned int height)
+{
+    unsigned int victim = TEXT_NO_SHELF;
+    __shelf_t * s = NULL;
+
+    for (unsigned int idx = 0; idx < __num_shelves; ++idx)
+    {
+        if (__shelves[idx].height < height || __shelves[idx].epoch == __epoch) continue;
+        if (victim == TEXT_NO_SHELF || __shelves[idx].epoch < __shelves[victim].epoch) victim = idx;
+    }
+
+    if (victim == TEXT_NO_SHELF) return TEXT_NO_SHELF;
+
+    s = &__shelves[victim];
+    while (s->glyphs)
+    {
+        __glyph_t * glyph = s->glyphs;
+
+        s->glyphs = glyph->next;
+        hash_remove(&__glyphs, glyph->key);
+        free(glyph);
+    }
+
+    memset(__atlas + (size_t)s->y * __atlas_width, 0, (size_t)s->height * __atlas_width);
+    if (s->y < __atlas_dirty_min) __atlas_dirty_min = s->y;
+    if (s->y + s->height > __atlas_dirty_max) __atlas_dirty_max = s->y + s->height;
+    s->fill = 0;
+
+    ++__atlas_generation;
+    ++__frame_stats.shelves_evicted;
+
+    return victim;
+}
+
+static void __atlas_upload(void)
+{
+    GLenum format = __backend == render_backend_core ? GL_RED : GL_ALPHA;
+    GLint internal_format = __backend == render_backend_core ? GL_R8 : GL_ALPHA8;
+
+    if (!__atlas_resized && __atlas_dirty_min >= __atlas_dirty_max) return;
+
+    glBindTexture(GL_TEXTURE_2D, __texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // dirty rows span the whole width, so they are contiguous in the atlas
+    if (__atlas_resized)
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, internal_format, __atlas_width, __atlas_height, 0, format, GL_UNSIGNED_BYTE, __atlas);
+    }
+    else
+    {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, __atlas_dirty_min, __atlas_width, __atlas_dirty_max - __atlas_dirty_min,
+                format, GL_UNSIGNED_BYTE, __atlas + (size_t)__atlas_dirty_min * __atlas_width);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    __atlas_resized = 0;
+    __atlas_dirty_min = ~0U;
+    __atlas_dirty_max = 0;
+}
+
+static void __draw_queued(void)
+{
+    GLsizeiptr bytes = (GLsizeiptr)__num_glyphs * 4 * sizeof(__vertex_t);
+    render_stream_span_t span;
+    GLint viewport[4];
+
+    // whatever is queued now is drawn, so every shelf may be evicted again
+    ++__epoch;
+
+    if (__num_glyphs == 0) return;
+
+    __atlas_upload();
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    if (render_stream_alloc(bytes, sizeof(__vertex_t), &span) == status_success)
+    {
+        memcpy(span.data, __vertices, bytes);
+        render_stream_flush();
+    }
+    else
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, __vertex_buffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, __vertices, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        span.buffer = __vertex_buffer;
+        span.offset = 0;
+    }
+
+    if (__backend == render_backend_core) __draw_core(span.buffer, span.offset, viewport);
+    else __draw_fixed(span.buffer, span.offset, viewport);
+
+    __frame_stats.glyphs_drawn += __num_glyphs;
+    __num_glyphs = 0;
+}
+
+static void __draw_fixed(GLuint buffer, GLintptr offset, const GLint viewport[4])
+{
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_POLYGON_BIT | GL_TEXTURE_BIT | GL_TRANSFORM_BIT);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, __texture);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+    // texels to texture coordinates, and pixels from the top left to clip space
+    glMatrixMode(GL_TEXTURE);
+    glPushMatrix();
+    glLoadIdentity();
+    glScalef(1.0f / __atlas_width, 1.0f / __atlas_height, 1.0f);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0.0, viewport[2], viewport[3], 0.0, -1.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, __index_buffer);
+
+    for (unsigned int first = 0; first < __num_glyphs; first += TEXT_BATCH_GLYPHS)
+    {
+        unsigned int count = __num_glyphs - first < TEXT_BATCH_GLYPHS ? __num_glyphs - first : TEXT_BATCH_GLYPHS;
+        GLintptr base = offset + (GLintptr)first * 4 * sizeof(__vertex_t);
+
+        glVertexPointer(2, GL_FLOAT, sizeof(__vertex_t), (const GLvoid *)(base + offsetof(__vertex_t, x)));
+        glTexCoordPointer(2, GL_SHORT, sizeof(__vertex_t), (const GLvoid *)(base + offsetof(__vertex_t, u)));
+        glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(__vertex_t), (const GLvoid *)(base + offsetof(__vertex_t, color)));
+        glDrawElements(GL_TRIANGLES, count * 6, GL_UNSIGNED_SHORT, (const GLvoid *)0);
+        ++__frame_stats.draw_calls;
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glMatrixMode(GL_TEXTURE);
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+
+    glPopClientAttrib();
+    glPopAttrib();
+}
+
+static void __draw_core(GLuint buffer, GLintptr offset, const GLint viewport[4])
+{
+    GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST), cull_face = glIsEnabled(GL_CULL_FACE), blend = glIsEnabled(GL_BLEND);
+
+    // polygons are left filled by the core backend between frames
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    glUseProgram(__program);
+    glUniform4f(__scale_loc, 2.0f / viewport[2], 2.0f / viewport[3], 1.0f / __atlas_width, 1.0f / __atlas_height);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, __texture);
+    glBindVertexArray(__vertex_array);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    for (unsigned int first = 0; first < __num_glyphs; first += TEXT_BATCH_GLYPHS)
+    {
+        unsigned int count = __num_glyphs - first < TEXT_BATCH_GLYPHS ? __num_glyphs - first : TEXT_BATCH_GLYPHS;
+        GLintptr base = offset + (GLintptr)first * 4 * sizeof(__vertex_t);
+
+        glVertexAttribPointer(TEXT_ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(__vertex_t),
+                (const GLvoid *)(base + offsetof(__vertex_t, x)));
+        glVertexAttribPointer(TEXT_ATTRIB_TEXCOORD, 2, GL_SHORT, GL_FALSE, sizeof(__vertex_t),
+                (const GLvoid *)(base + offsetof(__vertex_t, u)));
+        glVertexAttribPointer(TEXT_ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(__vertex_t),
+                (const GLvoid *)(base + offsetof(__vertex_t, color)));
+        glDrawElements(GL_TRIANGLES, count * 6, GL_UNSIGNED_SHORT, (const GLvoid *)0);
+        ++__frame_stats.draw_calls;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+
+    if (depth_test) glEnable(GL_DEPTH_TEST);
+    if (cull_face) glEnable(GL_CULL_FACE);
+    if (!blend) glDisable(GL_BLEND);
+}
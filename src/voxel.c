@@ -0,0 +1,635 @@
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "jobs.h"
+#include "logging.h"
+
+#include "voxel.h"
+
+#define VOXEL_MASK (VOXEL_CHUNK_SIZE - 1)
+#define VOXEL_KEY_BITS 21
+#define VOXEL_KEY_MASK ((1UL << VOXEL_KEY_BITS) - 1)
+
+static const int __side_offsets[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+
+// one chunk being meshed: written by its job only, read back once all jobs are done
+typedef struct
+{
+    voxel_chunk_t * chunk;
+    const voxel_chunk_t * neighbors[6];     // -x, +x, -y, +y, -z, +z, NULL where there is none
+    GLfloat * vertices;
+    GLfloat * normals;
+    unsigned int num_quads;
+    unsigned int capacity;                  // in quads
+    unsigned int num_faces;
+    GLvoid * indices;
+    int failed;
+} __mesh_job_t;
+
+static __mesh_job_t * __jobs = NULL;
+static unsigned int __jobs_capacity = 0;
+
+static status_e __world_sanity_check(const voxel_world_t * world);
+static unsigned long __chunk_key(int cx, int cy, int cz);
+static unsigned int __block_index(int x, int y, int z);
+static voxel_chunk_t * __chunk_create(voxel_world_t * world, int cx, int cy, int cz);
+static void __chunk_mark_dirty(voxel_world_t * world, voxel_chunk_t * chunk);
+static void __chunk_mark_neighbor(voxel_world_t * world, const voxel_chunk_t * chunk, int side);
+static void __chunk_destroy(voxel_chunk_t * chunk);
+static void __mesh_range(unsigned int begin, unsigned int end, void * data);
+static void __mesh_chunk(__mesh_job_t * job);
+static int __emit_quad(__mesh_job_t * job, int d, int side, int plane, int i, int j, int w, int h);
+static void __chunk_publish(voxel_world_t * world, __mesh_job_t * job);
+static double __now(void);
+
+status_e voxel_world_init(voxel_world_t * world, unsigned long def_id_base)
+{
+    if (!world)
+    {
+        LOG_ERROR("world is NULL!\n");
+        return status_error;
+    }
+
+    memset(world, 0, sizeof(voxel_world_t));
+    if (hash_init(&world->chunks) != status_success || array_init(&world->list) != status_success
+            || array_init(&world->dirty) != status_success)
+    {
+        LOG_ERROR("failed to allocate memory for a voxel world\n");
+        return status_error;
+    }
+
+    world->next_def_id = def_id_base;
+    world->color[0] = world->color[1] = world->color[2] = world->color[3] = 1.0f;
+
+    return status_success;
+}
+
+status_e voxel_world_destroy(voxel_world_t * world)
+{
+    status_e status = __world_sanity_check(world);
+    if (status != status_success) return status;
+
+    for (unsigned int idx = 0; idx < world->list.len; ++idx)
+    {
+        __chunk_destroy(array_get(&world->list, idx));
+    }
+
+    hash_destroy(&world->chunks);
+    array_destroy(&world->list);
+    array_destroy(&world->dirty);
+    memset(world, 0, sizeof(voxel_world_t));
+
+    return status_success;
+}
+
+void voxel_world_set_color(voxel_world_t * world, GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+    if (__world_sanity_check(world) != status_success) return;
+
+    world->color[0] = r;
+    world->color[1] = g;
+    world->color[2] = b;
+    world->color[3] = a;
+
+    for (unsigned int idx = 0; idx < world->list.len; ++idx)
+    {
+        voxel_chunk_t * chunk = array_get(&world->list, idx);
+        if (chunk->object != RENDER_NULL_HANDLE) render_object_set_color(chunk->object, r, g, b, a);
+    }
+}
+
+status_e voxel_set_block(voxel_world_t * world, int x, int y, int z, voxel_block_t block)
+{
+    int cx = x >> VOXEL_CHUNK_BITS, cy = y >> VOXEL_CHUNK_BITS, cz = z >> VOXEL_CHUNK_BITS;
+    int lx = x & VOXEL_MASK, ly = y & VOXEL_MASK, lz = z & VOXEL_MASK;
+    const int borders[6] = { lx == 0, lx == VOXEL_MASK, ly == 0, ly == VOXEL_MASK, lz == 0, lz == VOXEL_MASK };
+    voxel_chunk_t * chunk = NULL;
+    voxel_block_t * target = NULL;
+    status_e status = __world_sanity_check(world);
+    if (status != status_success) return status;
+
+    if (!(chunk = hash_get(&world->chunks, __chunk_key(cx, cy, cz))))
+    {
+        // air is what a missing chunk already holds
+        if (block == 0) return status_success;
+        if (!(chunk = __chunk_create(world, cx, cy, cz))) return status_error;
+    }
+
+    target = &chunk->blocks[__block_index(lx, ly, lz)];
+    if ((*target != 0) == (block != 0))
+    {
+        *target = block;
+        return status_success;
+    }
+
+    chunk->num_solid += block ? 1 : -1;
+    *target = block;
+    __chunk_mark_dirty(world, chunk);
+
+    // the neighbor's face against this block appears or disappears
+    for (int side = 0; side < 6; ++side)
+    {
+        if (borders[side]) __chunk_mark_neighbor(world, chunk, side);
+    }
+
+    return status_success;
+}
+
+status_e voxel_set_chunk(voxel_world_t * world, int cx, int cy, int cz, const voxel_block_t * blocks)
+{
+    voxel_chunk_t * chunk = NULL;
+    unsigned int num_solid = 0;
+    status_e status = __world_sanity_check(world);
+    if (status != status_success) return status;
+
+    if (!blocks)
+    {
+        LOG_ERROR("blocks is NULL!\n");
+        return status_error;
+    }
+
+    if (!(chunk = hash_get(&world->chunks, __chunk_key(cx, cy, cz))) && !(chunk = __chunk_create(world, cx, cy, cz)))
+    {
+        return status_error;
+    }
+
+    memcpy(chunk->blocks, blocks, sizeof(chunk->blocks));
+    for (unsigned int idx = 0; idx < VOXEL_CHUNK_BLOCKS; ++idx) num_solid += (blocks[idx] != 0);
+    chunk->num_solid = num_solid;
+
+    __chunk_mark_dirty(world, chunk);
+    for (int side = 0; side < 6; ++side) __chunk_mark_neighbor(world, chunk, side);
+
+    return status_success;
+}
+
+status_e voxel_remove_chunk(voxel_world_t * world, int cx, int cy, int cz)
+{
+    voxel_chunk_t * chunk = NULL;
+    status_e status = __world_sanity_check(world);
+    if (status != status_success) return status;
+
+    if (!(chunk = hash_remove(&world->chunks, __chunk_key(cx, cy, cz)))) return status_success;
+
+    array_remove(&world->list, chunk);
+    if (chunk->dirty) array_remove(&world->dirty, chunk);
+
+    // faces against it show again, now that it is air
+    if (chunk->num_solid > 0)
+    {
+        for (int side = 0; side < 6; ++side) __chunk_mark_neighbor(world, chunk, side);
+    }
+
+    __chunk_destroy(chunk);
+
+    return status_success;
+}
+
+voxel_block_t voxel_get_block(const voxel_world_t * world, int x, int y, int z)
+{
+    const voxel_chunk_t * chunk = voxel_get_chunk(world, x >> VOXEL_CHUNK_BITS, y >> VOXEL_CHUNK_BITS, z >> VOXEL_CHUNK_BITS);
+
+    return chunk ? chunk->blocks[__block_index(x & VOXEL_MASK, y & VOXEL_MASK, z & VOXEL_MASK)] : 0;
+}
+
+voxel_chunk_t * voxel_get_chunk(const voxel_world_t * world, int cx, int cy, int cz)
+{
+    if (__world_sanity_check(world) != status_success) return NULL;
+
+    return hash_get(&world->chunks, __chunk_key(cx, cy, cz));
+}
+
+void voxel_world_set_mesh_budget(voxel_world_t * world, unsigned int max_chunks)
+{
+    if (__world_sanity_check(world) != status_success) return;
+
+    world->mesh_budget = max_chunks;
+}
+
+status_e voxel_world_update(voxel_world_t * world, unsigned int * num_meshed)
+{
+    unsigned int count = 0;
+    double start = 0.0;
+    status_e status = __world_sanity_check(world);
+    if (status != status_success) return status;
+
+    count = world->dirty.len;
+    if (world->mesh_budget && count > world->mesh_budget) count = world->mesh_budget;
+    if (num_meshed) *num_meshed = count;
+    if (count == 0) return status_success;
+
+    if (count > __jobs_capacity)
+    {
+        __mesh_job_t * jobs = realloc(__jobs, count * sizeof(__mesh_job_t));
+        if (!jobs)
+        {
+            LOG_ERROR("failed to allocate memory for %u meshing jobs\n", count);
+            return status_error;
+        }
+
+        __jobs = jobs;
+        __jobs_capacity = count;
+    }
+
+    // neighbors are looked up here, so the jobs only ever read blocks
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        __mesh_job_t * job = &__jobs[idx];
+        voxel_chunk_t * chunk = array_get(&world->dirty, idx);
+
+        memset(job, 0, sizeof(__mesh_job_t));
+        job->chunk = chunk;
+        for (int side = 0; side < 6; ++side)
+        {
+            job->neighbors[side] = hash_get(&world->chunks, __chunk_key(chunk->coords[0] + __side_offsets[side][0],
+                        chunk->coords[1] + __side_offsets[side][1], chunk->coords[2] + __side_offsets[side][2]));
+        }
+    }
+
+    start = __now();
+    status = jobs_parallel_for(count, 1, __mesh_range, NULL);
+    world->stats.mesh_seconds += __now() - start;
+
+    for (unsigned int idx = 0; idx < count; ++idx)
+    {
+        __chunk_publish(world, &__jobs[idx]);
+    }
+
+    // what the budget left waits for the next update, in order
+    memmove(world->dirty.data, world->dirty.data + count, (world->dirty.len - count) * sizeof(void *));
+    world->dirty.len -= count;
+
+    return status;
+}
+
+void voxel_get_stats(const voxel_world_t * world, voxel_stats_t * stats)
+{
+    if (__world_sanity_check(world) != status_success || !stats) return;
+
+    *stats = world->stats;
+}
+
+static status_e __world_sanity_check(const voxel_world_t * world)
+{
+    if (!world)
+    {
+        LOG_ERROR("world is NULL!\n");
+        return status_error;
+    }
+
+    return status_success;
+}
+
+// chunk coordinates biased into VOXEL_KEY_BITS each
+static unsigned long __chunk_key(int cx, int cy, int cz)
+{
+    unsigned long bias = 1UL << (VOXEL_KEY_BITS - 1);
+
+    return ((((unsigned long)(long)cx + bias) & VOXEL_KEY_MASK) << (2 * VOXEL_KEY_BITS))
+        | ((((unsigned long)(long)cy + bias) & VOXEL_KEY_MASK) << VOXEL_KEY_BITS)
+        | (((unsigned long)(long)cz + bias) & VOXEL_KEY_MASK);
+}
+
+static unsigned int __block_index(int x, int y, int z)
+{
+    return x | (y << VOXEL_CHUNK_BITS) | (z << (2 * VOXEL_CHUNK_BITS));
+}
+
+static voxel_chunk_t * __chunk_create(voxel_world_t * world, int cx, int cy, int cz)
+{
+    voxel_chunk_t * chunk = calloc(1, sizeof(voxel_chunk_t));
+    unsigned long key = __chunk_key(cx, cy, cz);
+
+    if (!chunk)
+    {
+        LOG_ERROR("failed to allocate memory for chunk (%d, %d, %d)\n", cx, cy, cz);
+        return NULL;
+    }
+
+    chunk->coords[0] = cx;
+    chunk->coords[1] = cy;
+    chunk->coords[2] = cz;
+    chunk->def.id = world->next_def_id++;
+    chunk->object = RENDER_NULL_HANDLE;
+
+    if (hash_set(&world->chunks, key, chunk) != status_success)
+    {
+        free(chunk);
+        return NULL;
+    }
+
+    if (array_push(&world->list, chunk) != status_success)
+    {
+        hash_remove(&world->chunks, key);
+        free(chunk);
+        return NULL;
+    }
+
+    return chunk;
+}
+
+static void __chunk_mark_dirty(voxel_world_t * world, voxel_chunk_t * chunk)
+{
+    if (chunk->dirty) return;
+
+    // a chunk left out is picked up by the next change to it
+    if (array_push(&world->dirty, chunk) != status_success) return;
+    chunk->dirty = 1;
+}
+
+// only neighbors with something to draw have faces that can change
+static void __chunk_mark_neighbor(voxel_world_t * world, const voxel_chunk_t * chunk, int side)
+{
+    voxel_chunk_t * neighbor = hash_get(&world->chunks, __chunk_key(chunk->coords[0] + __side_offsets[side][0],
+                chunk->coords[1] + __side_offsets[side][1], chunk->coords[2] + __side_offsets[side][2]));
+
+    if (neighbor && neighbor->num_solid > 0) __chunk_mark_dirty(world, neighbor);
+}
+
+static void __chunk_destroy(voxel_chunk_t * chunk)
+{
+    if (chunk->object != RENDER_NULL_HANDLE) render_destroy_object(chunk->object);
+    if (chunk->num_indices > 0) render_remove_def(&chunk->def);
+
+    free(chunk->vertices);
+    free(chunk->normals);
+    free(chunk->indices);
+    free(chunk);
+}
+
+static void __mesh_range(unsigned int begin, unsigned int end, void * data)
+{
+    for (unsigned int idx = begin; idx < end; ++idx)
+    {
+        __mesh_chunk(&__jobs[idx]);
+    }
+}
+
+// for each axis and facing, slice by slice: mark the faces of solid blocks
+// against air, then cover the marks with rectangles, each grown along u as
+// far as it goes and then along v while whole rows match
+static void __mesh_chunk(__mesh_job_t * job)
+{
+    const voxel_chunk_t * chunk = job->chunk;
+    const unsigned int strides[3] = { 1, VOXEL_CHUNK_SIZE, VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE };
+    unsigned char mask[VOXEL_CHUNK_SIZE * VOXEL_CHUNK_SIZE];
+    unsigned int num_vertices = 0;
+
+    if (chunk->num_solid == 0) return;
+
+    for (int d = 0; d < 3; ++d)
+    {
+        int u = (d + 1) % 3, v = (d + 2) % 3;
+
+        for (int side = 0; side < 2; ++side)
+        {
+            for (int s = 0; s < VOXEL_CHUNK_SIZE; ++s)
+            {
+                // the slice the faces look into, in the neighbor chunk past the border (air without one)
+                int facing = s + (side ? 1 : -1);
+                const voxel_chunk_t * next = chunk;
+
+                if (facing < 0 || facing >= VOXEL_CHUNK_SIZE)
+                {
+                    next = job->neighbors[d * 2 + side];
+                    facing &= VOXEL_MASK;
+                }
+
+                for (int j = 0; j < VOXEL_CHUNK_SIZE; ++j)
+                {
+                    unsigned int row = j * strides[v];
+
+                    for (int i = 0; i < VOXEL_CHUNK_SIZE; ++i)
+                    {
+                        unsigned int offset = row + i * strides[u];
+                        int face = chunk->blocks[s * strides[d] + offset] && !(next && next->blocks[facing * strides[d] + offset]);
+
+                        mask[j * VOXEL_CHUNK_SIZE + i] = face;
+                        job->num_faces += face;
+                    }
+                }
+
+                for (int j = 0; j < VOXEL_CHUNK_SIZE; ++j)
+                {
+                    for (int i = 0; i < VOXEL_CHUNK_SIZE;)
+                    {
+                        int w = 1, h = 1;
+
+                        if (!mask[j * VOXEL_CHUNK_SIZE + i])
+                        {
+                            ++i;
+                            continue;
+                        }
+
+                        while (i + w < VOXEL_CHUNK_SIZE && mask[j * VOXEL_CHUNK_SIZE + i + w]) ++w;
+                        for (; j + h < VOXEL_CHUNK_SIZE; ++h)
+                        {
+                            int k = 0;
+                            while (k < w && mask[(j + h) * VOXEL_CHUNK_SIZE + i + k]) ++k;
+                            if (k < w) break;
+                        }
+
+                        if (!__emit_quad(job, d, side, s + side, i, j, w, h))
+                        {
+                            job->failed = 1;
+                            return;
+                        }
+
+                        for (int l = 0; l < h; ++l) memset(&mask[(j + l) * VOXEL_CHUNK_SIZE + i], 0, w);
+                        i += w;
+                    }
+                }
+            }
+        }
+    }
+
+    // two triangles per quad, 16-bit indices while they reach every vertex
+    num_vertices = job->num_quads * 4;
+    if (job->num_quads == 0) return;
+
+    if (num_vertices <= 65536)
+    {
+        GLushort * indices = malloc(job->num_quads * 6 * sizeof(GLushort));
+        if (!indices)
+        {
+            job->failed = 1;
+            return;
+        }
+
+        for (unsigned int q = 0; q < job->num_quads; ++q)
+        {
+            GLushort base = (GLushort)(q * 4);
+            GLushort * out = &indices[q * 6];
+            out[0] = base; out[1] = base + 1; out[2] = base + 2;
+            out[3] = base; out[4] = base + 2; out[5] = base + 3;
+        }
+
+        job->indices = indices;
+    }
+    else
+    {
+        GLuint * indices = malloc(job->num_quads * 6 * sizeof(GLuint));
+        if (!indices)
+        {
+            job->failed = 1;
+            return;
+        }
+
+        for (unsigned int q = 0; q < job->num_quads; ++q)
+        {
+            GLuint base = q * 4;
+            GLuint * out = &indices[q * 6];
+            out[0] = base; out[1] = base + 1; out[2] = base + 2;
+            out[3] = base; out[4] = base + 2; out[5] = base + 3;
+        }
+
+        job->indices = indices;
+    }
+}
+
+// a w by h rectangle in the plane at plane along d, counter-clockwise seen from the side it faces
+static int __emit_quad(__mesh_job_t * job, int d, int side, int plane, int i, int j, int w, int h)
+{
+    int u = (d + 1) % 3, v = (d + 2) % 3;
+    GLfloat corners[4][3];
+    GLfloat * out_vertices = NULL, * out_normals = NULL;
+
+    if (job->num_quads == job->capacity)
+    {
+        unsigned int capacity = job->capacity ? job->capacity * 2 : 256;
+        GLfloat * vertices = realloc(job->vertices, capacity * 12 * sizeof(GLfloat));
+        GLfloat * normals = NULL;
+
+        if (vertices) job->vertices = vertices;
+        if (!vertices || !(normals = realloc(job->normals, capacity * 12 * sizeof(GLfloat)))) return 0;
+
+        job->normals = normals;
+        job->capacity = capacity;
+    }
+
+    for (int c = 0; c < 4; ++c)
+    {
+        corners[c][d] = (GLfloat)plane;
+        corners[c][u] = (GLfloat)i;
+        corners[c][v] = (GLfloat)j;
+    }
+
+    // u x v is +d, so going around u first faces +d
+    corners[side ? 1 : 3][u] += w;
+    corners[2][u] += w;
+    corners[2][v] += h;
+    corners[side ? 3 : 1][v] += h;
+
+    out_vertices = &job->vertices[job->num_quads * 12];
+    out_normals = &job->normals[job->num_quads * 12];
+    memcpy(out_vertices, corners, sizeof(corners));
+    for (int c = 0; c < 4; ++c)
+    {
+        out_normals[c * 3] = out_normals[c * 3 + 1] = out_normals[c * 3 + 2] = 0.0f;
+        out_normals[c * 3 + d] = side ? 1.0f : -1.0f;
+    }
+
+    ++job->num_quads;
+
+    return 1;
+}
+
+// rebuilds the chunk's def from the new mesh in place, so only its own object is touched. the def is
+// registered while the chunk has geometry; the renderer lets go of the old arrays before they are freed.
+static void __chunk_publish(voxel_world_t * world, __mesh_job_t * job)
+{
+    voxel_chunk_t * chunk = job->chunk;
+    render_def_t * def = &chunk->def;
+    GLfloat min[3] = { 0.0f }, max[3] = { 0.0f };
+    int registered = chunk->num_indices > 0;
+    status_e status = status_success;
+
+    chunk->dirty = 0;
+
+    if (job->failed)
+    {
+        LOG_ERROR("failed to allocate memory for the mesh of chunk (%d, %d, %d)\n", chunk->coords[0], chunk->coords[1],
+                chunk->coords[2]);
+        free(job->vertices);
+        free(job->normals);
+        free(job->indices);
+        return;
+    }
+
+    // an emptied chunk keeps its object, which draws nothing until the def is back
+    if (registered && job->num_quads == 0) render_remove_def(def);
+    free(chunk->vertices);
+    free(chunk->normals);
+    free(chunk->indices);
+
+    chunk->vertices = job->vertices;
+    chunk->normals = job->normals;
+    chunk->indices = job->indices;
+    chunk->num_vertices = job->num_quads * 4;
+    chunk->num_indices = job->num_quads * 6;
+    chunk->num_faces = job->num_faces;
+    chunk->num_quads = job->num_quads;
+
+    world->stats.chunks_meshed += 1;
+    world->stats.solid_blocks += chunk->num_solid;
+    world->stats.faces_visible += job->num_faces;
+    world->stats.quads += job->num_quads;
+
+    if (chunk->num_indices == 0) return;
+
+    for (unsigned int idx = 0; idx < chunk->num_vertices; ++idx)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            GLfloat value = chunk->vertices[idx * 3 + axis];
+            if (idx == 0 || value < min[axis]) min[axis] = value;
+            if (idx == 0 || value > max[axis]) max[axis] = value;
+        }
+    }
+
+    def->vertices = chunk->vertices;
+    def->normals = chunk->normals;
+    def->num_vertices = chunk->num_vertices;
+    def->vertex_mode = GL_TRIANGLES;
+    def->indices = chunk->indices;
+    def->num_indices = chunk->num_indices;
+    def->index_type = chunk->num_vertices <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    def->flags = RENDER_DEF_PREBUILT;
+    def->num_lods = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        def->bounds_min[axis] = min[axis];
+        def->bounds_max[axis] = max[axis];
+        def->bounds_center[axis] = (min[axis] + max[axis]) * 0.5f;
+    }
+    def->bounds_radius = 0.5f * sqrtf((max[0] - min[0]) * (max[0] - min[0]) + (max[1] - min[1]) * (max[1] - min[1])
+            + (max[2] - min[2]) * (max[2] - min[2]));
+
+    if (registered) status = render_update_def(def);
+    else status = render_add_def(def);
+
+    if (status != status_success)
+    {
+        LOG_ERROR("failed to add the def of chunk (%d, %d, %d)\n", chunk->coords[0], chunk->coords[1], chunk->coords[2]);
+        if (registered) render_remove_def(def);
+        chunk->num_indices = 0;
+        return;
+    }
+
+    if (chunk->object != RENDER_NULL_HANDLE) return;
+
+    chunk->object = render_create_object(render_object_count, def->id);
+    if (chunk->object == RENDER_NULL_HANDLE) return;
+
+    render_object_set_position(chunk->object, (GLfloat)(chunk->coords[0] * VOXEL_CHUNK_SIZE),
+            (GLfloat)(chunk->coords[1] * VOXEL_CHUNK_SIZE), (GLfloat)(chunk->coords[2] * VOXEL_CHUNK_SIZE));
+    render_object_set_color(chunk->object, world->color[0], world->color[1], world->color[2], world->color[3]);
+}
+
+static double __now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
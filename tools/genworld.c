@@ -0,0 +1,110 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "region.h"
+#include "voxel.h"
+
+// writes a procedural voxel world as region files (see region.h) for the
+// engine to stream around the camera:
+//
+//     genworld [-r radius] output_dir
+//
+// covers the regions from -radius to radius - 1 along x and z, one region
+// high, with hills and caves. each region is generated, written and dropped
+// before the next one so the whole world never has to fit in memory.
+
+#define DEFAULT_RADIUS 2
+#define DEF_ID_BASE 1000
+
+static int __usage(const char * name)
+{
+    fprintf(stderr, "usage: %s [-r radius] output_dir\n", name);
+    return 1;
+}
+
+static int __terrain_height(int x, int z)
+{
+    return (int)(64.0 + 40.0 * sin(x * 0.013) * cos(z * 0.011) + 12.0 * sin((x + z) * 0.05) + 4.0 * cos(x * 0.21));
+}
+
+static int __fill_region(voxel_world_t * world, int rx, int rz)
+{
+    for (int z = rz * REGION_SIZE; z < (rz + 1) * REGION_SIZE; ++z)
+    {
+        for (int x = rx * REGION_SIZE; x < (rx + 1) * REGION_SIZE; ++x)
+        {
+            int height = __terrain_height(x, z);
+
+            for (int y = 0; y < height && y < REGION_SIZE; ++y)
+            {
+                // winding caves below the surface layers
+                if (y < height - 6 && sin(x * 0.07) * sin(y * 0.11) * sin(z * 0.09) > 0.4) continue;
+                if (voxel_set_block(world, x, y, z, 1) != status_success) return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+int main(int argc, char ** argv)
+{
+    char path[REGION_MAX_PATH];
+    int radius = DEFAULT_RADIUS, arg = 1;
+    unsigned long chunks = 0;
+
+    for (; arg < argc && argv[arg][0] == '-'; ++arg)
+    {
+        if (strcmp(argv[arg], "-r") != 0 || arg + 1 >= argc) return __usage(argv[0]);
+        radius = atoi(argv[++arg]);
+        if (radius <= 0) return __usage(argv[0]);
+    }
+
+    if (arg + 1 != argc) return __usage(argv[0]);
+
+    if (mkdir(argv[arg], 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "failed to create %s\n", argv[arg]);
+        return 1;
+    }
+
+    for (int rz = -radius; rz < radius; ++rz)
+    {
+        for (int rx = -radius; rx < radius; ++rx)
+        {
+            voxel_world_t world;
+
+            // the chunks are never meshed, so no render objects are made
+            if (voxel_world_init(&world, DEF_ID_BASE) != status_success)
+            {
+                fprintf(stderr, "failed to initialize a voxel world\n");
+                return 1;
+            }
+
+            if (region_path(path, sizeof(path), argv[arg], rx, 0, rz) != status_success)
+            {
+                fprintf(stderr, "%s is too long a path\n", argv[arg]);
+                voxel_world_destroy(&world);
+                return 1;
+            }
+
+            if (!__fill_region(&world, rx, rz) || region_write(path, &world, rx, 0, rz) != status_success)
+            {
+                fprintf(stderr, "failed to write %s\n", path);
+                voxel_world_destroy(&world);
+                return 1;
+            }
+
+            chunks += world.list.len;
+            voxel_world_destroy(&world);
+        }
+    }
+
+    printf("%s: %d regions, %lu chunks\n", argv[arg], 4 * radius * radius, chunks);
+
+    return 0;
+}
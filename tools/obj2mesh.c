@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mesh.h"
+#include "meshfile.h"
+#include "obj.h"
+#include "simplify.h"
+
+// converts a Wavefront OBJ into a mesh file (see meshfile.h) ready to be
+// mmap'ed by the engine: welded, cache-ordered, with optional coarser levels
+// of detail simplified from the full mesh.
+//
+//     obj2mesh [-l distance]... input.obj output.mesh
+//
+// each -l adds a level drawn from that view distance on, keeping REDUCTION of
+// the previous level's triangles like the renderer does for generated levels.
+
+#define REDUCTION 0.25f
+#define MIN_TRIANGLES 4
+
+static int __usage(const char * name)
+{
+    fprintf(stderr, "usage: %s [-l distance]... input.obj output.mesh\n", name);
+    return 1;
+}
+
+static int __build_level(mesh_t * out, const GLfloat * vertices, const GLfloat * normals, unsigned int num_vertices)
+{
+    return mesh_build(out, vertices, normals, num_vertices, NULL, 0, 0, GL_TRIANGLES) == status_success
+        && mesh_optimize_vertex_cache(out) == status_success
+        && mesh_optimize_vertex_fetch(out) == status_success;
+}
+
+int main(int argc, char ** argv)
+{
+    mesh_t levels[MESHFILE_MAX_LEVELS];
+    GLfloat distances[MESHFILE_MAX_LEVELS] = { 0.0f };
+    GLfloat * flat_vertices = NULL, * flat_normals = NULL;
+    unsigned int num_levels = 1, triangles = 0;
+    const char * input = NULL, * output = NULL;
+    float acmr_before = 0.0f;
+    int arg = 1, result = 0;
+
+    for (; arg < argc && argv[arg][0] == '-'; ++arg)
+    {
+        if (strcmp(argv[arg], "-l") != 0 || arg + 1 >= argc) return __usage(argv[0]);
+
+        if (num_levels == MESHFILE_MAX_LEVELS)
+        {
+            fprintf(stderr, "at most %d levels are supported\n", MESHFILE_MAX_LEVELS);
+            return 1;
+        }
+
+        distances[num_levels] = strtof(argv[++arg], NULL);
+        if (distances[num_levels] <= distances[num_levels - 1])
+        {
+            fprintf(stderr, "level distances must increase\n");
+            return 1;
+        }
+        ++num_levels;
+    }
+
+    if (argc - arg != 2) return __usage(argv[0]);
+    input = argv[arg];
+    output = argv[arg + 1];
+
+    memset(levels, 0, sizeof(levels));
+    if (obj_load(input, &levels[0]) != status_success)
+    {
+        fprintf(stderr, "failed to load %s\n", input);
+        return 1;
+    }
+
+    acmr_before = mesh_acmr(levels[0].indices, levels[0].num_indices, levels[0].num_vertices, MESH_CACHE_SIZE);
+    if (mesh_optimize_vertex_cache(&levels[0]) != status_success || mesh_optimize_vertex_fetch(&levels[0]) != status_success
+            || (num_levels > 1 && mesh_unindex(&levels[0], &flat_vertices, &flat_normals) != status_success))
+    {
+        fprintf(stderr, "failed to optimize %s\n", input);
+        result = 1;
+    }
+
+    printf("level 0: %u vertices, %u triangles, ACMR %.3f -> %.3f\n", levels[0].num_vertices, levels[0].num_indices / 3,
+            acmr_before, mesh_acmr(levels[0].indices, levels[0].num_indices, levels[0].num_vertices, MESH_CACHE_SIZE));
+
+    triangles = levels[0].num_indices / 3;
+    for (unsigned int idx = 1; idx < num_levels && result == 0; ++idx)
+    {
+        GLfloat * vertices = NULL, * normals = NULL;
+        GLsizei num_vertices = 0;
+
+        triangles = (unsigned int)(triangles * REDUCTION);
+        if (triangles < MIN_TRIANGLES) triangles = MIN_TRIANGLES;
+
+        if (simplify_mesh(flat_vertices, levels[0].num_indices, GL_TRIANGLES, triangles, &vertices, &normals, &num_vertices) != status_success
+                || !__build_level(&levels[idx], vertices, normals, num_vertices))
+        {
+            fprintf(stderr, "failed to generate level %u\n", idx);
+            result = 1;
+        }
+        else
+        {
+            printf("level %u: %u vertices, %u triangles from distance %g\n", idx, levels[idx].num_vertices,
+                    levels[idx].num_indices / 3, distances[idx]);
+        }
+
+        free(vertices);
+        free(normals);
+    }
+
+    if (result == 0 && meshfile_write(output, levels, distances, num_levels) != status_success)
+    {
+        fprintf(stderr, "failed to write %s\n", output);
+        result = 1;
+    }
+
+    for (unsigned int idx = 0; idx < num_levels; ++idx) mesh_destroy(&levels[idx]);
+    free(flat_vertices);
+    free(flat_normals);
+
+    return result;
+}